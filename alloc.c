@@ -0,0 +1,46 @@
+/*
+ * alloc.c: Allocator hooks for containers.
+ *
+ * alloc.c is part of libjvs.
+ *
+ * Copyright: (c) 2026 Jacco van Schaik (jacco@jaccovanschaik.net)
+ * Created:   2026-10-18
+ * Version:   $Id$
+ *
+ * This software is distributed under the terms of the MIT license. See
+ * http://www.opensource.org/licenses/mit-license.php for details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+
+/*
+ * Return a zeroed block of <size> bytes, allocated using <alloc>. If <alloc>
+ * is NULL, calloc() is used. Returns NULL if the allocation failed.
+ */
+void *allocNew(const Allocator *alloc, size_t size)
+{
+    void *ptr;
+
+    if (alloc == NULL) return calloc(1, size);
+
+    ptr = alloc->alloc(size, alloc->udata);
+
+    if (ptr != NULL) memset(ptr, 0, size);
+
+    return ptr;
+}
+
+/*
+ * Free <ptr>, which was returned by allocNew() with the same <alloc> and
+ * <size>. If <alloc> is NULL, free() is used.
+ */
+void allocFree(const Allocator *alloc, void *ptr, size_t size)
+{
+    if (alloc == NULL)
+        free(ptr);
+    else
+        alloc->free(ptr, size, alloc->udata);
+}
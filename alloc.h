@@ -0,0 +1,54 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+/*
+ * alloc.h: Allocator hooks for containers.
+ *
+ * An Allocator bundles an allocation function, a matching free function and
+ * some user data to pass to both. Containers that allocate memory for their
+ * own bookkeeping (such as hash table entries and multi-list links) can be
+ * given an Allocator to use instead of calloc() and free(), for example one
+ * provided by an Arena (arena.h) or a Pool (pool.h). The free function is
+ * given the same size that was passed to the allocation function, so that
+ * allocators that hand out blocks of various sizes don't have to remember
+ * them.
+ *
+ * alloc.h is part of libjvs.
+ *
+ * Copyright: (c) 2026 Jacco van Schaik (jacco@jaccovanschaik.net)
+ * Created:   2026-10-18
+ * Version:   $Id$
+ *
+ * This software is distributed under the terms of the MIT license. See
+ * http://www.opensource.org/licenses/mit-license.php for details.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+typedef struct {
+    void *(*alloc)(size_t size, void *udata);
+    void (*free)(void *ptr, size_t size, void *udata);
+    void *udata;
+} Allocator;
+
+/*
+ * Return a zeroed block of <size> bytes, allocated using <alloc>. If <alloc>
+ * is NULL, calloc() is used. Returns NULL if the allocation failed.
+ */
+void *allocNew(const Allocator *alloc, size_t size);
+
+/*
+ * Free <ptr>, which was returned by allocNew() with the same <alloc> and
+ * <size>. If <alloc> is NULL, free() is used.
+ */
+void allocFree(const Allocator *alloc, void *ptr, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
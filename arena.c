@@ -0,0 +1,335 @@
+/*
+ * arena.c: Arena allocator.
+ *
+ * arena.c is part of libjvs.
+ *
+ * Copyright: (c) 2026 Jacco van Schaik (jacco@jaccovanschaik.net)
+ * Created:   2026-10-18
+ * Version:   $Id$
+ *
+ * This software is distributed under the terms of the MIT license. See
+ * http://www.opensource.org/licenses/mit-license.php for details.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "defs.h"
+#include "arena.h"
+
+#define ARENA_CHUNK_SIZE 65536
+
+/* A chunk of memory. Its data follows the header, which is padded to keep
+ * that data aligned. */
+
+struct ArenaChunk {
+    ArenaChunk *prev;           // The chunk that was in use before this one.
+    size_t size;                // The number of bytes of data in this chunk.
+    size_t base;                // Bytes allocated in all earlier chunks.
+};
+
+#define ARENA_HEADER \
+    ((sizeof(ArenaChunk) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1))
+
+#define ARENA_DATA(chunk) ((char *) (chunk) + ARENA_HEADER)
+
+struct Arena {
+    ArenaChunk *chunk;          // The chunk that we're allocating from.
+    ArenaChunk *spare;          // A freed chunk, kept for re-use.
+    size_t chunk_size;          // Normal size of a chunk.
+    size_t used;                // Bytes allocated from the current chunk.
+    Allocator allocator;        // Allocator that uses this arena.
+};
+
+/*
+ * Allocation function for the Allocator of arena <udata>.
+ */
+static void *arena_alloc(size_t size, void *udata)
+{
+    return arenaAlloc(udata, size);
+}
+
+/*
+ * Free function for the Allocator of an arena, which does nothing.
+ */
+static void arena_free(void *ptr, size_t size, void *udata)
+{
+    UNUSED(ptr);
+    UNUSED(size);
+    UNUSED(udata);
+}
+
+/*
+ * Start a new chunk in <arena> with room for at least <size> bytes.
+ */
+static void arena_add_chunk(Arena *arena, size_t size)
+{
+    ArenaChunk *chunk;
+
+    size = MAX(size, arena->chunk_size);
+
+    if (arena->spare != NULL && arena->spare->size >= size) {
+        chunk = arena->spare;
+        arena->spare = NULL;
+    }
+    else {
+        chunk = malloc(ARENA_HEADER + size);
+        chunk->size = size;
+    }
+
+    chunk->prev = arena->chunk;
+    chunk->base = arena->chunk ? arena->chunk->base + arena->used : 0;
+
+    arena->chunk = chunk;
+    arena->used  = 0;
+}
+
+/*
+ * Remove the current chunk from <arena>. The chunk before it becomes the
+ * current one, with all of its data in use.
+ */
+static void arena_drop_chunk(Arena *arena)
+{
+    ArenaChunk *chunk = arena->chunk;
+
+    arena->chunk = chunk->prev;
+    arena->used  = arena->chunk ? chunk->base - arena->chunk->base : 0;
+
+    /* Keep one normal-sized chunk, so that resetting and then allocating again
+     * doesn't have to go back to malloc() every time. */
+
+    if (arena->spare == NULL && chunk->size == arena->chunk_size) {
+        arena->spare = chunk;
+    }
+    else {
+        free(chunk);
+    }
+}
+
+/*
+ * Create an arena that gets memory from malloc() in chunks of <chunk_size>
+ * bytes. Larger allocations get a chunk of their own. If <chunk_size> is 0, a
+ * default size is used.
+ */
+Arena *arenaCreate(size_t chunk_size)
+{
+    Arena *arena = calloc(1, sizeof(Arena));
+
+    arena->chunk_size = chunk_size > 0 ? chunk_size : ARENA_CHUNK_SIZE;
+
+    arena->allocator.alloc = arena_alloc;
+    arena->allocator.free  = arena_free;
+    arena->allocator.udata = arena;
+
+    return arena;
+}
+
+/*
+ * Return a pointer to <size> bytes of uninitialized memory from <arena>,
+ * aligned to <align> bytes, which must be a power of 2.
+ */
+void *arenaAllocAligned(Arena *arena, size_t size, size_t align)
+{
+    uintptr_t addr;
+
+    if (arena->chunk != NULL) {
+        addr = (uintptr_t) ARENA_DATA(arena->chunk) + arena->used;
+        addr = (addr + align - 1) & ~(uintptr_t) (align - 1);
+
+        size_t offset = addr - (uintptr_t) ARENA_DATA(arena->chunk);
+
+        if (offset + size <= arena->chunk->size) {
+            arena->used = offset + size;
+
+            return (void *) addr;
+        }
+    }
+
+    /* Doesn't fit. Chunk data is always aligned to ARENA_ALIGNMENT, so only
+     * larger alignments need extra room in the new chunk. */
+
+    arena_add_chunk(arena, align > ARENA_ALIGNMENT ? size + align : size);
+
+    return arenaAllocAligned(arena, size, align);
+}
+
+/*
+ * Return a pointer to <size> bytes of uninitialized memory from <arena>,
+ * aligned to ARENA_ALIGNMENT bytes.
+ */
+void *arenaAlloc(Arena *arena, size_t size)
+{
+    return arenaAllocAligned(arena, size, ARENA_ALIGNMENT);
+}
+
+/*
+ * Return a copy of the null-terminated string <str>, allocated from <arena>.
+ */
+char *arenaStrdup(Arena *arena, const char *str)
+{
+    size_t size = strlen(str) + 1;
+
+    return memcpy(arenaAllocAligned(arena, size, 1), str, size);
+}
+
+/*
+ * Return the current position in <arena>, to be passed to arenaReset() later.
+ */
+ArenaMark arenaMark(const Arena *arena)
+{
+    ArenaMark mark = { arena->chunk, arena->used };
+
+    return mark;
+}
+
+/*
+ * Free everything that was allocated from <arena> since <mark> was returned by
+ * arenaMark(). Marks that were taken after <mark> become invalid.
+ */
+void arenaReset(Arena *arena, ArenaMark mark)
+{
+    while (arena->chunk != mark.chunk) {
+        arena_drop_chunk(arena);
+    }
+
+    arena->used = mark.used;
+}
+
+/*
+ * Return the number of bytes that have been allocated from <arena>, including
+ * alignment padding and the unused ends of chunks that were full.
+ */
+size_t arenaUsed(const Arena *arena)
+{
+    return arena->chunk ? arena->chunk->base + arena->used : 0;
+}
+
+/*
+ * Return an Allocator that allocates from <arena>, for use with containers
+ * that accept one. Its free function does nothing: memory is only returned
+ * when the arena is reset or cleared.
+ */
+const Allocator *arenaAllocator(Arena *arena)
+{
+    return &arena->allocator;
+}
+
+/*
+ * Free everything that was allocated from <arena>, and all of its chunks.
+ */
+void arenaClear(Arena *arena)
+{
+    ArenaChunk *chunk;
+
+    while ((chunk = arena->chunk) != NULL) {
+        arena->chunk = chunk->prev;
+
+        free(chunk);
+    }
+
+    free(arena->spare);
+
+    arena->spare = NULL;
+    arena->used  = 0;
+}
+
+/*
+ * Clear <arena> and then free it.
+ */
+void arenaDestroy(Arena *arena)
+{
+    arenaClear(arena);
+
+    free(arena);
+}
+
+#ifdef TEST
+#include "utils.h"
+
+static int errors = 0;
+
+int main(void)
+{
+    int i;
+    char *p, *q;
+
+    Arena *arena = arenaCreate(1024);
+
+    make_sure_that(arenaUsed(arena) == 0);
+
+    /* Allocations are aligned and don't overlap. */
+
+    p = arenaAlloc(arena, 3);
+    q = arenaAlloc(arena, 3);
+
+    make_sure_that(((uintptr_t) p % ARENA_ALIGNMENT) == 0);
+    make_sure_that(((uintptr_t) q % ARENA_ALIGNMENT) == 0);
+    make_sure_that(q == p + ARENA_ALIGNMENT);
+    make_sure_that(arenaUsed(arena) == ARENA_ALIGNMENT + 3);
+
+    p = arenaAllocAligned(arena, 8, 256);
+
+    make_sure_that(((uintptr_t) p % 256) == 0);
+
+    p = arenaStrdup(arena, "Hello");
+
+    make_sure_that(strcmp(p, "Hello") == 0);
+
+    /* Resetting to a mark re-uses the same memory. */
+
+    ArenaMark mark = arenaMark(arena);
+
+    size_t used = arenaUsed(arena);
+
+    p = arenaAlloc(arena, 100);
+
+    for (i = 0; i < 100; i++) {
+        q = arenaAlloc(arena, 100);
+        memset(q, i, 100);
+    }
+
+    make_sure_that(arenaUsed(arena) > 100 * 100);
+
+    arenaReset(arena, mark);
+
+    make_sure_that(arenaUsed(arena) == used);
+    make_sure_that(arenaAlloc(arena, 100) == p);
+
+    /* Allocations larger than a chunk get a chunk of their own. */
+
+    mark = arenaMark(arena);
+
+    p = arenaAlloc(arena, 10000);
+    memset(p, 0, 10000);
+
+    q = arenaAlloc(arena, 10);
+
+    make_sure_that(q < p || q >= p + 10000);
+
+    arenaReset(arena, mark);
+
+    /* The Allocator hook works on top of the arena. */
+
+    const Allocator *alloc = arenaAllocator(arena);
+
+    p = allocNew(alloc, 32);
+
+    make_sure_that(p[0] == 0 && p[31] == 0);
+    make_sure_that(arenaUsed(arena) >= used + 32);
+
+    allocFree(alloc, p, 32);
+
+    arenaClear(arena);
+
+    make_sure_that(arenaUsed(arena) == 0);
+
+    p = arenaAlloc(arena, 10);
+
+    make_sure_that(p != NULL);
+
+    arenaDestroy(arena);
+
+    return errors;
+}
+#endif
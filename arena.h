@@ -0,0 +1,113 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+/*
+ * arena.h: Arena allocator.
+ *
+ * An Arena hands out memory by bumping a pointer through large chunks that it
+ * gets from malloc(), which makes allocating a small object about as cheap as
+ * it can be. Objects can't be freed individually. Instead, the position in an
+ * arena can be saved using arenaMark() and later restored using arenaReset(),
+ * which frees everything that was allocated in between in one go, and
+ * arenaClear() frees everything at once. This makes arenas a good fit for
+ * objects that all go away at the same time, like everything that is built
+ * up while handling a single message or request.
+ *
+ * An arena is not thread-safe. Use one arena per thread, or protect it with a
+ * mutex.
+ *
+ * arena.h is part of libjvs.
+ *
+ * Copyright: (c) 2026 Jacco van Schaik (jacco@jaccovanschaik.net)
+ * Created:   2026-10-18
+ * Version:   $Id$
+ *
+ * This software is distributed under the terms of the MIT license. See
+ * http://www.opensource.org/licenses/mit-license.php for details.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include "alloc.h"
+
+/* The alignment of the memory returned by arenaAlloc(). */
+
+#define ARENA_ALIGNMENT 16
+
+typedef struct Arena Arena;
+typedef struct ArenaChunk ArenaChunk;
+
+/* A saved position in an arena. */
+
+typedef struct {
+    ArenaChunk *chunk;
+    size_t used;
+} ArenaMark;
+
+/*
+ * Create an arena that gets memory from malloc() in chunks of <chunk_size>
+ * bytes. Larger allocations get a chunk of their own. If <chunk_size> is 0, a
+ * default size is used.
+ */
+Arena *arenaCreate(size_t chunk_size);
+
+/*
+ * Return a pointer to <size> bytes of uninitialized memory from <arena>,
+ * aligned to ARENA_ALIGNMENT bytes.
+ */
+void *arenaAlloc(Arena *arena, size_t size);
+
+/*
+ * Return a pointer to <size> bytes of uninitialized memory from <arena>,
+ * aligned to <align> bytes, which must be a power of 2.
+ */
+void *arenaAllocAligned(Arena *arena, size_t size, size_t align);
+
+/*
+ * Return a copy of the null-terminated string <str>, allocated from <arena>.
+ */
+char *arenaStrdup(Arena *arena, const char *str);
+
+/*
+ * Return the current position in <arena>, to be passed to arenaReset() later.
+ */
+ArenaMark arenaMark(const Arena *arena);
+
+/*
+ * Free everything that was allocated from <arena> since <mark> was returned by
+ * arenaMark(). Marks that were taken after <mark> become invalid.
+ */
+void arenaReset(Arena *arena, ArenaMark mark);
+
+/*
+ * Return the number of bytes that have been allocated from <arena>, including
+ * alignment padding and the unused ends of chunks that were full.
+ */
+size_t arenaUsed(const Arena *arena);
+
+/*
+ * Return an Allocator that allocates from <arena>, for use with containers
+ * that accept one. Its free function does nothing: memory is only returned
+ * when the arena is reset or cleared.
+ */
+const Allocator *arenaAllocator(Arena *arena);
+
+/*
+ * Free everything that was allocated from <arena>, and all of its chunks.
+ */
+void arenaClear(Arena *arena);
+
+/*
+ * Clear <arena> and then free it.
+ */
+void arenaDestroy(Arena *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -126,6 +126,13 @@ extern "C" {
 #define ROUND_DOWN(val, step) ((step) * floor((double) (val) / (double) (step)))
 #endif
 
+/* Assumed size of a cache line, used to keep data that is written by
+ * different threads apart. */
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
 #ifdef __cplusplus
 }
 #endif
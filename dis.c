@@ -21,12 +21,60 @@
 #include <unistd.h>
 #include <math.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
 #include <sys/select.h>
 
+#include <poll.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <linux/errqueue.h>
+#endif
+
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#define DIS_HAVE_ZEROCOPY
+#endif
+
+/* Maximum number of bytes to send from a file in one go. */
+
+#define DIS_FILE_CHUNK (1 << 20)
+
+/*
+ * A segment of a file that is to be sent, queued using disSendFile(), or a
+ * caller's buffer that is to be sent using MSG_ZEROCOPY, queued using
+ * disWriteZeroCopy(). Data that is written using disWrite() while this
+ * segment is queued goes into <after>, so that it is sent after the segment.
+ */
 typedef struct {
-    Buffer outgoing;
+    ListNode _node;
+    int file_fd;            // Our own duplicate of the file descriptor, or -1.
+    off_t offset;           // Where to continue sending.
+    size_t remaining;       // Number of bytes still to send.
+    bool no_sendfile;       // sendfile() doesn't work for this file.
+    Buffer after;
+    const char *data;       // The caller's buffer, if <file_fd> is -1.
+    size_t size;            // Size of <data>.
+    void (*release)(const void *data, size_t size, void *udata);
+    void *udata;
+    uint32_t first_id;      // Zero-copy id of the first send() for <data>.
+    uint32_t sends;         // Number of send() calls made for <data>.
+    uint32_t pending;       // Number of those not yet completed.
+} DIS_Segment;
+
+typedef struct {
+    Buffer outgoing;        // Data to send before the first segment.
+    List segments;          // Queued segments.
+    List completing;        // Zero-copy segments waiting for completion.
+    size_t zc_threshold;    // Minimum size for zero-copy, 0 if disabled.
+    uint32_t zc_next_id;    // Id the kernel will give the next zero-copy send.
+    int write_error;        // Error that stopped output to this fd, or 0.
     void (*cb)(Dispatcher *dis, int fd, void *udata);
     const void *udata;
+    void (*error_cb)(Dispatcher *dis, int fd, int error, void *udata);
+    const void *error_udata;
 } DIS_File;
 
 typedef struct {
@@ -36,6 +84,137 @@ typedef struct {
     const void *udata;
 } DIS_Timer;
 
+/*
+ * A file that was dropped while the kernel was still sending zero-copy
+ * buffers from it. <fd> is our own duplicate of the original file descriptor,
+ * which keeps the socket and its error queue around until the kernel reports
+ * that it's done with the buffers.
+ */
+typedef struct {
+    ListNode _node;
+    int fd;
+    DIS_File *file;
+} DIS_Orphan;
+
+/* How often to check orphans for completions, in seconds. */
+
+#define DIS_ORPHAN_INTERVAL 0.01
+
+static void dis_read_completions(DIS_File *file, int fd);
+
+/*
+ * Throw away all data queued for <file> that has not been sent yet. Zero-copy
+ * buffers that the kernel is still using move to the list of segments that
+ * are waiting for completion, the others are released.
+ */
+static void dis_discard_output(DIS_File *file)
+{
+    DIS_Segment *seg;
+
+    while ((seg = listRemoveHead(&file->segments)) != NULL) {
+        if (seg->file_fd >= 0) close(seg->file_fd);
+
+        bufClear(&seg->after);
+
+        if (seg->pending > 0) {
+            listAppendTail(&file->completing, seg);
+            continue;
+        }
+
+        if (seg->release) seg->release(seg->data, seg->size, seg->udata);
+
+        free(seg);
+    }
+
+    bufClear(&file->outgoing);
+}
+
+/*
+ * Free <file>, including any data that has not been sent yet.
+ */
+static void dis_free_file(DIS_File *file)
+{
+    DIS_Segment *seg;
+
+    dis_discard_output(file);
+
+    /* The kernel may still be sending from these buffers, but we can't wait
+     * any longer (see dis_drop_file() for the case where we can). */
+
+    while ((seg = listRemoveHead(&file->completing)) != NULL) {
+        seg->release(seg->data, seg->size, seg->udata);
+        free(seg);
+    }
+
+    free(file);
+}
+
+/*
+ * Drop <file>, which was used for <fd>, from <dis>. If the kernel is still
+ * sending zero-copy buffers for it, keep it as an orphan until it's done with
+ * them, otherwise free it right away.
+ */
+static void dis_drop_file(Dispatcher *dis, int fd, DIS_File *file)
+{
+    DIS_Orphan *orphan;
+
+    dis_discard_output(file);
+
+    if (!listIsEmpty(&file->completing)) dis_read_completions(file, fd);
+
+    if (listIsEmpty(&file->completing) || (fd = dup(fd)) == -1) {
+        dis_free_file(file);
+        return;
+    }
+
+    orphan = calloc(1, sizeof(DIS_Orphan));
+
+    orphan->fd = fd;
+    orphan->file = file;
+
+    listAppendTail(&dis->orphans, orphan);
+}
+
+/*
+ * Check the orphans in <dis> for completed zero-copy sends, and free those
+ * that have no more buffers in use by the kernel.
+ */
+static void dis_check_orphans(Dispatcher *dis)
+{
+    DIS_Orphan *orphan, *next;
+
+    for (orphan = listHead(&dis->orphans); orphan; orphan = next) {
+        next = listNext(orphan);
+
+        dis_read_completions(orphan->file, orphan->fd);
+
+        if (listIsEmpty(&orphan->file->completing)) {
+            listRemove(&dis->orphans, orphan);
+
+            close(orphan->fd);
+            dis_free_file(orphan->file);
+            free(orphan);
+        }
+    }
+}
+
+/*
+ * Free all orphans in <dis>, whether the kernel is done with their buffers or
+ * not.
+ */
+static void dis_free_orphans(Dispatcher *dis)
+{
+    DIS_Orphan *orphan;
+
+    dis_check_orphans(dis);
+
+    while ((orphan = listRemoveHead(&dis->orphans)) != NULL) {
+        close(orphan->fd);
+        dis_free_file(orphan->file);
+        free(orphan);
+    }
+}
+
 /*
  * Create a new dispatcher.
  */
@@ -78,7 +257,35 @@ void disOnData(Dispatcher *dis, int fd,
 }
 
 /*
- * Drop the subscription on file descriptor <fd>.
+ * Arrange for <cb> to be called when data that was queued for <fd> (using
+ * disWrite(), disSendFile() and friends) can't be sent, because of an error
+ * or because a file given to disSendFile() turned out to be shorter than
+ * promised. disOnData() must have been called for <fd> previously. <cb> is
+ * called with the given <dis>, <fd> and <udata>, and the errno value that
+ * describes the problem (EIO for a short file). By then, the rest of the data
+ * queued for <fd> has been thrown away, the sending side of <fd> has been
+ * shut down and any further data written to <fd> through <dis> is discarded,
+ * so that the receiver never gets a stream with a piece missing from the
+ * middle. Usually, all that's left to do is to drop and close <fd>.
+ */
+void disOnWriteError(Dispatcher *dis, int fd,
+        void (*cb)(Dispatcher *dis, int fd, int error, void *udata),
+        const void *udata)
+{
+    DIS_File *file = paGet(&dis->files, fd);
+
+    dbgAssert(stderr, file != NULL, "unknown file descriptor: %d\n", fd);
+
+    file->error_cb = cb;
+    file->error_udata = udata;
+}
+
+/*
+ * Drop the subscription on file descriptor <fd>. Data queued for <fd> that
+ * has not been sent yet is thrown away. If the kernel is still sending
+ * zero-copy buffers (see disWriteZeroCopy()) for <fd>, <dis> keeps a
+ * duplicate of <fd> open until it reports that it's done with them, so the
+ * connection isn't completely closed until then, even if <fd> itself is.
  */
 void disDropData(Dispatcher *dis, int fd)
 {
@@ -89,6 +296,8 @@ void disDropData(Dispatcher *dis, int fd)
     dbgAssert(stderr, file != NULL, "unknown file descriptor: %d\n", fd);
 
     paDrop(&dis->files, fd);
+
+    dis_drop_file(dis, fd, file);
 }
 
 /*
@@ -104,7 +313,127 @@ void disWrite(Dispatcher *dis, int fd, const char *data, size_t size)
 
     dbgAssert(stderr, file != NULL, "unknown file descriptor: %d\n", fd);
 
-    bufAdd(&file->outgoing, data, size);
+    DIS_Segment *last = listTail(&file->segments);
+
+    if (file->write_error != 0)
+        return;
+    else if (last == NULL)
+        bufAdd(&file->outgoing, data, size);
+    else
+        bufAdd(&last->after, data, size);
+}
+
+/*
+ * Send <length> bytes from file <file_fd>, starting at <offset>, to <fd>, for
+ * which the disOnData function must have been called previously. Like the data
+ * given to disWrite(), the file data is sent when <fd> becomes writable, in
+ * the order in which it was queued. Where possible, the data is sent using
+ * sendfile(), so that it isn't copied through user space. <file_fd> is
+ * duplicated, so the caller may close it after this call. Returns 0 on
+ * success or -1 if <file_fd> could not be duplicated, or if an earlier write
+ * to <fd> failed (see disOnWriteError()).
+ */
+int disSendFile(Dispatcher *dis, int fd, int file_fd, off_t offset,
+        size_t length)
+{
+    DIS_File *file = paGet(&dis->files, fd);
+
+    dbgAssert(stderr, file != NULL, "unknown file descriptor: %d\n", fd);
+
+    if (file->write_error != 0) {
+        errno = file->write_error;
+        return -1;
+    }
+
+    if (length == 0) return 0;
+
+    DIS_Segment *seg = calloc(1, sizeof(DIS_Segment));
+
+    if ((seg->file_fd = dup(file_fd)) == -1) {
+        free(seg);
+        return -1;
+    }
+
+    seg->offset = offset;
+    seg->remaining = length;
+
+    listAppendTail(&file->segments, seg);
+
+    return 0;
+}
+
+/*
+ * Enable zero-copy sends (using MSG_ZEROCOPY) on socket <fd>, which must have
+ * been given to disOnData() previously, for buffers of at least <threshold>
+ * bytes given to disWriteZeroCopy(). Since zero-copy has its own overhead, it
+ * only pays off for large buffers (the kernel documentation suggests about 10
+ * KB). Returns 0 on success, or -1 if the platform or the socket type doesn't
+ * support it, in which case disWriteZeroCopy() copies the data as disWrite()
+ * does.
+ */
+int disSetZeroCopy(Dispatcher *dis, int fd, size_t threshold)
+{
+    DIS_File *file = paGet(&dis->files, fd);
+
+    dbgAssert(stderr, file != NULL, "unknown file descriptor: %d\n", fd);
+
+#ifdef DIS_HAVE_ZEROCOPY
+    int one = 1;
+
+    if (threshold > 0 &&
+        setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0) {
+        file->zc_threshold = threshold;
+        return 0;
+    }
+#else
+    UNUSED(threshold);
+#endif
+
+    return -1;
+}
+
+/*
+ * Send the <size> bytes in <data> to <fd>, for which the disOnData function
+ * must have been called previously, in order with other data queued for
+ * <fd>. If zero-copy has been enabled for <fd> using disSetZeroCopy() and
+ * <size> is at least the threshold given there, the data is not copied:
+ * instead the kernel sends it straight from <data>, which must therefore not
+ * be changed or freed until <release> is called with <data>, <size> and
+ * <udata>. That happens when the kernel reports that it is done with the
+ * data, even if <fd> has been dropped or closed in the meantime (see
+ * disDropData()). Only if <dis> itself is cleared or destroyed before that
+ * is <release> called while the kernel may still be sending from <data>; its
+ * contents must then stay unchanged until the socket has been closed and its
+ * data sent. Otherwise the data is copied as disWrite() does and <release> is
+ * called immediately.
+ */
+void disWriteZeroCopy(Dispatcher *dis, int fd, const void *data, size_t size,
+        void (*release)(const void *data, size_t size, void *udata),
+        void *udata)
+{
+    DIS_File *file = paGet(&dis->files, fd);
+
+    dbgAssert(stderr, file != NULL, "unknown file descriptor: %d\n", fd);
+
+    if (file->write_error != 0 ||
+        file->zc_threshold == 0 || size < file->zc_threshold) {
+        disWrite(dis, fd, data, size);
+
+        release(data, size, udata);
+
+        return;
+    }
+
+    DIS_Segment *seg = calloc(1, sizeof(DIS_Segment));
+
+    seg->file_fd = -1;
+    seg->data = data;
+    seg->size = size;
+    seg->remaining = size;
+    seg->release = release;
+    seg->udata = udata;
+
+    listAppendTail(&file->segments, seg);
 }
 
 /*
@@ -228,7 +557,9 @@ int disPrepareSelect(Dispatcher *dis, int *nfds, fd_set *rfds, fd_set *wfds,
 
         FD_SET(fd, rfds);
 
-        if (bufLen(&file->outgoing) > 0) FD_SET(fd, wfds);
+        if (bufLen(&file->outgoing) > 0 || !listIsEmpty(&file->segments)) {
+            FD_SET(fd, wfds);
+        }
 
         P {
             fprintf(stderr, " (%s%s)",
@@ -268,6 +599,18 @@ int disPrepareSelect(Dispatcher *dis, int *nfds, fd_set *rfds, fd_set *wfds,
         *tv = &dis->tv;
     }
 
+    /* Orphans don't get select()ed on (they would look readable all the
+     * time once the peer closes the connection) so check them regularly. */
+
+    if (!listIsEmpty(&dis->orphans) &&
+        (*tv == NULL || dis->tv.tv_sec > 0 ||
+         dis->tv.tv_usec > 1000000 * DIS_ORPHAN_INTERVAL)) {
+        dis->tv.tv_sec = 0;
+        dis->tv.tv_usec = 1000000 * DIS_ORPHAN_INTERVAL;
+
+        *tv = &dis->tv;
+    }
+
     return 0;
 }
 
@@ -305,6 +648,248 @@ void disHandleFiles(Dispatcher *dis, int nfds, fd_set *rfds, fd_set *wfds)
     }
 }
 
+/*
+ * Remove segment <seg>, which has been sent completely, from the queue of
+ * <file>. The data that was written after it becomes the new outgoing data.
+ */
+static void dis_finish_segment(DIS_File *file, DIS_Segment *seg)
+{
+    listRemove(&file->segments, seg);
+
+    bufClear(&file->outgoing);
+
+    file->outgoing = seg->after;
+}
+
+/*
+ * Send the next part of zero-copy segment <seg>, the first in the queue of
+ * <file>, to <fd>. Once all of it has been sent, it moves to the list of
+ * segments waiting for completion, or is released if that has already
+ * happened. Returns 0 on success or an errno value if sending failed.
+ */
+static int dis_send_zerocopy(DIS_File *file, int fd, DIS_Segment *seg)
+{
+    ssize_t r = -1;
+
+    const char *data = seg->data + seg->size - seg->remaining;
+
+#ifdef DIS_HAVE_ZEROCOPY
+    r = send(fd, data, seg->remaining, MSG_ZEROCOPY);
+
+    if (r > 0) {
+        /* The kernel numbers every successful zero-copy send. */
+
+        if (seg->sends == 0) seg->first_id = file->zc_next_id;
+
+        file->zc_next_id++;
+
+        seg->sends++;
+        seg->pending++;
+    }
+    else if (r == -1 && errno == ENOBUFS) {
+        /* Out of memory to pin pages, so copy this time. */
+
+        r = send(fd, data, seg->remaining, 0);
+    }
+#else
+    r = write(fd, data, seg->remaining);
+#endif
+
+    if (r > 0) {
+        seg->remaining -= r;
+    }
+    else if (r == -1 && (errno == EAGAIN || errno == EINTR)) {
+        return 0;
+    }
+    else {
+        int error = errno;
+
+        P dbgError(stderr, "could not send zero-copy data to fd %d", fd);
+
+        return error;
+    }
+
+    if (seg->remaining > 0) return 0;
+
+    dis_finish_segment(file, seg);
+
+    if (seg->pending == 0) {
+        seg->release(seg->data, seg->size, seg->udata);
+        free(seg);
+    }
+    else {
+        listAppendTail(&file->completing, seg);
+    }
+
+    return 0;
+}
+
+#ifdef DIS_HAVE_ZEROCOPY
+/*
+ * Mark the zero-copy send with id <id> on <file> as completed, and release
+ * the segment it belongs to if that was the last one.
+ */
+static void dis_complete_id(DIS_File *file, uint32_t id)
+{
+    DIS_Segment *seg;
+
+    /* Look in the completing segments first, then at the one being sent. */
+
+    for (seg = listHead(&file->completing); seg; seg = listNext(seg)) {
+        if (id - seg->first_id < seg->sends) break;
+    }
+
+    if (seg == NULL) {
+        seg = listHead(&file->segments);
+
+        if (seg == NULL || seg->file_fd >= 0 || seg->sends == 0 ||
+            id - seg->first_id >= seg->sends) return;
+
+        seg->pending--;
+
+        return;
+    }
+
+    if (--seg->pending == 0) {
+        listRemove(&file->completing, seg);
+
+        seg->release(seg->data, seg->size, seg->udata);
+
+        free(seg);
+    }
+}
+#endif
+
+/*
+ * Read the zero-copy completion notifications for <fd> from its error queue,
+ * and release the buffers the kernel no longer needs.
+ */
+static void dis_read_completions(DIS_File *file, int fd)
+{
+#ifdef DIS_HAVE_ZEROCOPY
+    char control[128];
+
+    struct msghdr msg = { 0 };
+    struct cmsghdr *cm;
+
+    for (;;) {
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1 ||
+            msg.msg_controllen == 0) break;
+
+        for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            struct sock_extended_err *err;
+            uint32_t id;
+
+            err = (struct sock_extended_err *) CMSG_DATA(cm);
+
+            if (err->ee_errno != 0 ||
+                err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+
+            /* ee_info to ee_data is the (inclusive) range of completed ids.
+             */
+
+            for (id = err->ee_info; id != err->ee_data + 1; id++) {
+                dis_complete_id(file, id);
+            }
+        }
+    }
+#else
+    UNUSED(file);
+    UNUSED(fd);
+#endif
+}
+
+/*
+ * Send the next part of segment <seg>, the first in the queue of <file>, to
+ * <fd>. Once the segment is done, the data that was written after it becomes
+ * the new outgoing data for <file>. Returns 0 on success or an errno value if
+ * sending failed.
+ */
+static int dis_send_segment(DIS_File *file, int fd, DIS_Segment *seg)
+{
+    ssize_t r = -1;
+
+    size_t count = MIN(seg->remaining, DIS_FILE_CHUNK);
+
+    if (seg->file_fd < 0) {
+        return dis_send_zerocopy(file, fd, seg);
+    }
+
+#ifdef __linux__
+    if (!seg->no_sendfile) {
+        r = sendfile(fd, seg->file_fd, &seg->offset, count);
+
+        /* EINVAL or ENOSYS mean that sendfile() can't handle this file (or
+         * this <fd>), so copy it by hand instead. */
+
+        if (r == -1 && (errno == EINVAL || errno == ENOSYS)) {
+            seg->no_sendfile = true;
+        }
+    }
+#else
+    seg->no_sendfile = true;
+#endif
+
+    if (seg->no_sendfile) {
+        char chunk[65536];
+
+        r = pread(seg->file_fd, chunk, MIN(count, sizeof(chunk)), seg->offset);
+
+        if (r > 0 && (r = write(fd, chunk, r)) > 0) {
+            seg->offset += r;
+        }
+    }
+
+    if (r > 0) {
+        seg->remaining -= r;
+    }
+    else if (r == -1 && (errno == EAGAIN || errno == EINTR)) {
+        return 0;
+    }
+    else {
+        /* The file is shorter than promised, or there was an error. Either
+         * way, there's no point in trying again. */
+
+        int error = r == 0 ? EIO : errno;
+
+        P dbgError(stderr, "could not send file segment to fd %d", fd);
+
+        return error;
+    }
+
+    if (seg->remaining == 0) {
+        dis_finish_segment(file, seg);
+
+        close(seg->file_fd);
+        free(seg);
+    }
+
+    return 0;
+}
+
+/*
+ * Sending queued data from <file> to <fd> failed with <error>. Sending more
+ * would leave a gap in the stream, so throw away everything that's still
+ * queued, shut down the sending side of <fd> so that the receiver sees the
+ * stream end here, and tell the user.
+ */
+static void dis_write_failed(Dispatcher *dis, int fd, DIS_File *file,
+        int error)
+{
+    dis_discard_output(file);
+
+    file->write_error = error;
+
+    shutdown(fd, SHUT_WR);
+
+    if (file->error_cb != NULL) {
+        file->error_cb(dis, fd, error, (void *) file->error_udata);
+    }
+}
+
 /*
  * Handle readable file descriptor <fd>.
  */
@@ -314,6 +899,17 @@ void disHandleReadable(Dispatcher *dis, int fd)
 
     dbgAssert(stderr, file != NULL, "unknown file descriptor: %d\n", fd);
 
+    /* Zero-copy completions make the socket look readable, so handle those
+     * first and then check if there really is something to read. */
+
+    if (file->zc_threshold > 0) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+        dis_read_completions(file, fd);
+
+        if (poll(&pfd, 1, 0) < 1) return;
+    }
+
     file->cb(dis, fd, (void *) file->udata);
 }
 
@@ -322,17 +918,28 @@ void disHandleReadable(Dispatcher *dis, int fd)
  */
 void disHandleWritable(Dispatcher *dis, int fd)
 {
-    int r;
+    int r, error = 0;
 
+    DIS_Segment *seg;
     DIS_File *file = paGet(&dis->files, fd);
 
     dbgAssert(stderr, file != NULL, "unknown file descriptor: %d\n", fd);
 
-    r = write(fd, bufGet(&file->outgoing), bufLen(&file->outgoing));
+    if (bufLen(&file->outgoing) > 0) {
+        r = write(fd, bufGet(&file->outgoing), bufLen(&file->outgoing));
 
-    if (r > 0) {
-        bufTrim(&file->outgoing, r, 0);
+        if (r > 0) {
+            bufTrim(&file->outgoing, r, 0);
+        }
+        else if (errno != EAGAIN && errno != EINTR) {
+            error = errno;
+        }
     }
+    else if ((seg = listHead(&file->segments)) != NULL) {
+        error = dis_send_segment(file, fd, seg);
+    }
+
+    if (error != 0) dis_write_failed(dis, fd, file, error);
 }
 
 /*
@@ -349,7 +956,15 @@ void disProcessSelect(Dispatcher *dis, int r, int nfds,
     P dumpfds(stderr, "\trfds:", nfds, rfds);
     P dumpfds(stderr, "\twfds:", nfds, wfds);
 
+    dis_check_orphans(dis);
+
     if (r == 0) {
+        DIS_Timer *timer = listHead(&dis->timers);
+
+        /* The timeout may have been shortened to check on orphans. */
+
+        if (timer == NULL || timer->t > dnow()) return;
+
         P dbgPrint(stderr, "Timeout, calling disHandleTimer.\n");
         disHandleTimer(dis);
     }
@@ -442,7 +1057,8 @@ int disRun(Dispatcher *dis)
 
 /*
  * Close dispatcher <dis>. This removes all file descriptors and timers, which
- * will cause disRun() to return.
+ * will cause disRun() to return (once the kernel is done with any zero-copy
+ * buffers, see disDropData()).
  */
 void disClose(Dispatcher *dis)
 {
@@ -455,9 +1071,7 @@ void disClose(Dispatcher *dis)
         if (file != NULL) {
             paDrop(&dis->files, fd);
 
-            bufRewind(&file->outgoing);
-
-            free(file);
+            dis_drop_file(dis, fd, file);
         }
     }
 
@@ -472,6 +1086,7 @@ void disClose(Dispatcher *dis)
 void disClear(Dispatcher *dis)
 {
     disClose(dis);
+    dis_free_orphans(dis);
 
     memset(dis, 0, sizeof(Dispatcher));
 }
@@ -484,11 +1099,16 @@ void disClear(Dispatcher *dis)
 void disDestroy(Dispatcher *dis)
 {
     disClose(dis);  /* Just to be sure. */
+    dis_free_orphans(dis);
 
     free(dis);
 }
 
 #ifdef TEST
+#include "tcp.h"
+
+#include <fcntl.h>
+#include <sys/socket.h>
 
 static int errors = 0;
 
@@ -520,10 +1140,329 @@ static void handle_timeout(Dispatcher *dis, double t, void *udata)
     }
 }
 
+static Buffer received;
+static size_t expected;
+
+static void handle_receiver(Dispatcher *dis, int fd, void *udata)
+{
+    UNUSED(udata);
+
+    char buffer[65536];
+
+    int count = read(fd, buffer, sizeof(buffer));
+
+    if (count > 0) bufAdd(&received, buffer, count);
+
+    if (count <= 0 || bufLen(&received) >= expected) disClose(dis);
+}
+
+static void handle_sender(Dispatcher *dis, int fd, void *udata)
+{
+    UNUSED(dis);
+    UNUSED(fd);
+    UNUSED(udata);
+}
+
+/*
+ * Send a file segment sandwiched between normal writes, through a socket pair.
+ */
+static void test_send_file(void)
+{
+    int i, sv[2];
+
+    size_t size = 3 << 20, offset = 10, length = size - 20;
+
+    char *data = malloc(size);
+    FILE *fp = tmpfile();
+
+    for (i = 0; i < (int) size; i++) {
+        data[i] = i * 7 + i / 256;
+    }
+
+    make_sure_that(fwrite(data, 1, size, fp) == size);
+    fflush(fp);
+
+    make_sure_that(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+    fcntl(sv[0], F_SETFL, O_NONBLOCK);
+
+    Dispatcher *dis = disCreate();
+
+    disOnData(dis, sv[0], handle_sender, NULL);
+    disOnData(dis, sv[1], handle_receiver, NULL);
+
+    disWrite(dis, sv[0], "head", 4);
+    make_sure_that(disSendFile(dis, sv[0], fileno(fp), offset, length) == 0);
+    disWrite(dis, sv[0], "tail", 4);
+
+    /* The file may be closed right away. */
+
+    fclose(fp);
+
+    expected = 4 + length + 4;
+
+    disRun(dis);
+
+    make_sure_that(bufLen(&received) == expected);
+    make_sure_that(memcmp(bufGet(&received), "head", 4) == 0);
+    make_sure_that(memcmp(bufGet(&received) + 4, data + offset, length) == 0);
+    make_sure_that(memcmp(bufGet(&received) + 4 + length, "tail", 4) == 0);
+
+    close(sv[0]);
+    close(sv[1]);
+
+    bufClear(&received);
+    disDestroy(dis);
+    free(data);
+}
+
+static int write_error;
+
+static void handle_write_error(Dispatcher *dis, int fd, int error, void *udata)
+{
+    FILE *fp = udata;
+
+    write_error = error;
+
+    /* Nothing more can be queued for <fd>. */
+
+    make_sure_that(disSendFile(dis, fd, fileno(fp), 0, 10) == -1);
+
+    disDropData(dis, fd);
+}
+
+/*
+ * Send a file that is truncated after it has been queued. The receiver should
+ * get the part that was there, followed by the end of the stream, but not the
+ * data that was queued after the file.
+ */
+static void test_truncated_file(void)
+{
+    int i, sv[2];
+
+    size_t size = 1 << 20, cut = 100000;
+
+    char *data = malloc(size);
+    FILE *fp = tmpfile();
+
+    for (i = 0; i < (int) size; i++) {
+        data[i] = i * 3 + i / 256;
+    }
+
+    make_sure_that(fwrite(data, 1, size, fp) == size);
+    fflush(fp);
+
+    make_sure_that(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+    fcntl(sv[0], F_SETFL, O_NONBLOCK);
+
+    Dispatcher *dis = disCreate();
+
+    disOnData(dis, sv[0], handle_sender, NULL);
+    disOnWriteError(dis, sv[0], handle_write_error, fp);
+    disOnData(dis, sv[1], handle_receiver, NULL);
+
+    disWrite(dis, sv[0], "head", 4);
+    make_sure_that(disSendFile(dis, sv[0], fileno(fp), 0, size) == 0);
+    disWrite(dis, sv[0], "tail", 4);
+
+    make_sure_that(ftruncate(fileno(fp), cut) == 0);
+
+    expected = 4 + size + 4;
+    write_error = 0;
+
+    disRun(dis);
+
+    make_sure_that(write_error == EIO);
+    make_sure_that(bufLen(&received) == 4 + cut);
+    make_sure_that(memcmp(bufGet(&received), "head", 4) == 0);
+    make_sure_that(memcmp(bufGet(&received) + 4, data, cut) == 0);
+
+    fclose(fp);
+
+    close(sv[0]);
+    close(sv[1]);
+
+    bufClear(&received);
+    disDestroy(dis);
+    free(data);
+}
+
+static int released;
+
+static void handle_collector(Dispatcher *dis, int fd, void *udata)
+{
+    UNUSED(dis);
+    UNUSED(udata);
+
+    char buffer[65536];
+
+    int count = read(fd, buffer, sizeof(buffer));
+
+    if (count > 0) bufAdd(&received, buffer, count);
+}
+
+static void release_buffer(const void *data, size_t size, void *udata)
+{
+    UNUSED(size);
+    UNUSED(udata);
+
+    free((void *) data);
+
+    released++;
+}
+
+static void handle_deadline(Dispatcher *dis, double t, void *udata)
+{
+    UNUSED(dis);
+    UNUSED(t);
+    UNUSED(udata);
+}
+
+/*
+ * Send large and small buffers using disWriteZeroCopy(), interleaved with
+ * normal writes, over a TCP connection. On loopback the kernel copies the data
+ * anyway, but it still reports completions, so the buffers can only be
+ * released after reading the socket's error queue.
+ */
+static void test_zero_copy(void)
+{
+    int i, j, listener, sender, receiver;
+
+    const size_t big = 256 << 10, small = 1000, threshold = 16 << 10;
+    const int buffers = 8;
+
+    Buffer sent = { 0 };
+
+    make_sure_that((listener = tcpListen("127.0.0.1", 0)) >= 0);
+    make_sure_that((sender = tcpConnect("127.0.0.1",
+                    netLocalPort(listener))) >= 0);
+    make_sure_that((receiver = tcpAccept(listener)) >= 0);
+
+    fcntl(sender, F_SETFL, O_NONBLOCK);
+
+    Dispatcher *dis = disCreate();
+
+    disOnData(dis, sender, handle_sender, NULL);
+    disOnData(dis, receiver, handle_collector, NULL);
+
+    /* If the platform doesn't support it, this tests the fallback. */
+
+    disSetZeroCopy(dis, sender, threshold);
+
+    for (i = 0; i < buffers; i++) {
+        size_t size = (i % 3 == 1) ? small : big;
+
+        char *data = malloc(size);
+
+        for (j = 0; j < (int) size; j++) {
+            data[j] = i + j / 3;
+        }
+
+        bufAdd(&sent, data, size);
+
+        disWriteZeroCopy(dis, sender, data, size, release_buffer, NULL);
+
+        char marker[4] = { '<', '0' + i, '>', '\n' };
+
+        bufAdd(&sent, marker, sizeof(marker));
+        disWrite(dis, sender, marker, sizeof(marker));
+    }
+
+    expected = bufLen(&sent);
+
+    double deadline = dnow() + 5;
+
+    disOnTime(dis, deadline, handle_deadline, NULL);
+
+    while ((bufLen(&received) < expected || released < buffers) &&
+           dnow() < deadline) {
+        disHandleEvents(dis);
+    }
+
+    make_sure_that(released == buffers);
+    make_sure_that(bufLen(&received) == expected);
+    make_sure_that(memcmp(bufGet(&received), bufGet(&sent), expected) == 0);
+
+    disDestroy(dis);
+
+    close(listener);
+    close(sender);
+    close(receiver);
+
+    bufClear(&received);
+    bufClear(&sent);
+}
+
+/*
+ * Drop and close a socket while the kernel may still be sending a zero-copy
+ * buffer from it. The buffer must only be released once the kernel is done
+ * with it, which we can only tell by draining the socket's error queue, so
+ * the dispatcher has to keep the socket around until then.
+ */
+static void test_zero_copy_drop(void)
+{
+    int listener, sender, receiver;
+
+    const size_t size = 1 << 20;
+
+    make_sure_that((listener = tcpListen("127.0.0.1", 0)) >= 0);
+    make_sure_that((sender = tcpConnect("127.0.0.1",
+                    netLocalPort(listener))) >= 0);
+    make_sure_that((receiver = tcpAccept(listener)) >= 0);
+
+    fcntl(sender, F_SETFL, O_NONBLOCK);
+
+    Dispatcher *dis = disCreate();
+
+    disOnData(dis, sender, handle_sender, NULL);
+    disOnData(dis, receiver, handle_collector, NULL);
+
+    disSetZeroCopy(dis, sender, 1);
+
+    char *data = calloc(1, size);
+
+    released = 0;
+    expected = size;
+
+    disWriteZeroCopy(dis, sender, data, size, release_buffer, NULL);
+
+    double deadline = dnow() + 5;
+
+    disOnTime(dis, deadline, handle_deadline, NULL);
+
+    while (bufLen(&received) < expected && dnow() < deadline) {
+        disHandleEvents(dis);
+    }
+
+    disDropData(dis, sender);
+    close(sender);
+
+    while (released == 0 && dnow() < deadline) {
+        disHandleEvents(dis);
+    }
+
+    make_sure_that(released == 1);
+    make_sure_that(bufLen(&received) == expected);
+    make_sure_that(listIsEmpty(&dis->orphans));
+
+    disDestroy(dis);
+
+    close(listener);
+    close(receiver);
+
+    bufClear(&received);
+}
+
 int main(void)
 {
     int i;
 
+    test_send_file();
+    test_truncated_file();
+    test_zero_copy();
+    test_zero_copy_drop();
+
     Dispatcher *dis = disCreate();
 
     if (pipe(fd) == -1) {
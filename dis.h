@@ -23,10 +23,12 @@ extern "C" {
 #include <stdarg.h>
 #include <stddef.h>
 #include <sys/time.h>
+#include <sys/types.h>
 
 typedef struct {
     PointerArray files;
     List timers;
+    List orphans;
     struct timeval tv;
 } Dispatcher;
 
@@ -50,7 +52,27 @@ void disOnData(Dispatcher *dis, int fd,
         void (*cb)(Dispatcher *dis, int fd, void *udata), const void *udata);
 
 /*
- * Drop the subscription on file descriptor <fd>.
+ * Arrange for <cb> to be called when data that was queued for <fd> (using
+ * disWrite(), disSendFile() and friends) can't be sent, because of an error
+ * or because a file given to disSendFile() turned out to be shorter than
+ * promised. disOnData() must have been called for <fd> previously. <cb> is
+ * called with the given <dis>, <fd> and <udata>, and the errno value that
+ * describes the problem (EIO for a short file). By then, the rest of the data
+ * queued for <fd> has been thrown away, the sending side of <fd> has been
+ * shut down and any further data written to <fd> through <dis> is discarded,
+ * so that the receiver never gets a stream with a piece missing from the
+ * middle. Usually, all that's left to do is to drop and close <fd>.
+ */
+void disOnWriteError(Dispatcher *dis, int fd,
+        void (*cb)(Dispatcher *dis, int fd, int error, void *udata),
+        const void *udata);
+
+/*
+ * Drop the subscription on file descriptor <fd>. Data queued for <fd> that
+ * has not been sent yet is thrown away. If the kernel is still sending
+ * zero-copy buffers (see disWriteZeroCopy()) for <fd>, <dis> keeps a
+ * duplicate of <fd> open until it reports that it's done with them, so the
+ * connection isn't completely closed until then, even if <fd> itself is.
  */
 void disDropData(Dispatcher *dis, int fd);
 
@@ -63,6 +85,49 @@ void disDropData(Dispatcher *dis, int fd);
  */
 void disWrite(Dispatcher *dis, int fd, const char *data, size_t size);
 
+/*
+ * Send <length> bytes from file <file_fd>, starting at <offset>, to <fd>, for
+ * which the disOnData function must have been called previously. Like the data
+ * given to disWrite(), the file data is sent when <fd> becomes writable, in
+ * the order in which it was queued. Where possible, the data is sent using
+ * sendfile(), so that it isn't copied through user space. <file_fd> is
+ * duplicated, so the caller may close it after this call. Returns 0 on
+ * success or -1 if <file_fd> could not be duplicated, or if an earlier write
+ * to <fd> failed (see disOnWriteError()).
+ */
+int disSendFile(Dispatcher *dis, int fd, int file_fd, off_t offset,
+        size_t length);
+
+/*
+ * Enable zero-copy sends (using MSG_ZEROCOPY) on socket <fd>, which must have
+ * been given to disOnData() previously, for buffers of at least <threshold>
+ * bytes given to disWriteZeroCopy(). Since zero-copy has its own overhead, it
+ * only pays off for large buffers (the kernel documentation suggests about 10
+ * KB). Returns 0 on success, or -1 if the platform or the socket type doesn't
+ * support it, in which case disWriteZeroCopy() copies the data as disWrite()
+ * does.
+ */
+int disSetZeroCopy(Dispatcher *dis, int fd, size_t threshold);
+
+/*
+ * Send the <size> bytes in <data> to <fd>, for which the disOnData function
+ * must have been called previously, in order with other data queued for
+ * <fd>. If zero-copy has been enabled for <fd> using disSetZeroCopy() and
+ * <size> is at least the threshold given there, the data is not copied:
+ * instead the kernel sends it straight from <data>, which must therefore not
+ * be changed or freed until <release> is called with <data>, <size> and
+ * <udata>. That happens when the kernel reports that it is done with the
+ * data, even if <fd> has been dropped or closed in the meantime (see
+ * disDropData()). Only if <dis> itself is cleared or destroyed before that
+ * is <release> called while the kernel may still be sending from <data>; its
+ * contents must then stay unchanged until the socket has been closed and its
+ * data sent. Otherwise the data is copied as disWrite() does and <release> is
+ * called immediately.
+ */
+void disWriteZeroCopy(Dispatcher *dis, int fd, const void *data, size_t size,
+        void (*release)(const void *data, size_t size, void *udata),
+        void *udata);
+
 /*
  * Pack the arguments following <fd> into a string according to the strpack
  * interface in utils.h and send it via <dis> to <fd>.
@@ -160,7 +225,8 @@ int disRun(Dispatcher *dis);
 
 /*
  * Close dispatcher <dis>. This removes all file descriptors and timers, which
- * will cause disRun() to return.
+ * will cause disRun() to return (once the kernel is done with any zero-copy
+ * buffers, see disDropData()).
  */
 void disClose(Dispatcher *dis);
 
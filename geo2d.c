@@ -16,8 +16,14 @@
 #include <math.h>
 #include <stdio.h>
 
+#include "geometry2.h"
 #include "geo2d.h"
 
+/*
+ * Number of circles g2dCircleLineIntersectMany() handles at a time.
+ */
+#define G2D_CHUNK 256
+
 static inline double sqr(double x) { return x * x; }
 
 /*
@@ -194,6 +200,55 @@ int g2dCircleLineIntersect(Circle2D c, Line2D l, double *r1, double *r2)
     }
 }
 
+/*
+ * Intersect line <l> with the <n> circles in <c>, and add a CircleHit2D to
+ * <hit> for each circle that it intersects, with the same positions that
+ * g2dCircleLineIntersect() would return. <hit> must have room for <n> entries.
+ * Returns the number of hits. Several circles are done at once using SIMD
+ * instructions, if available.
+ */
+size_t g2dCircleLineIntersectMany(CircleHit2D *hit, Line2D l,
+        const Circle2D *c, size_t n)
+{
+    double cx[G2D_CHUNK], cy[G2D_CHUNK], radius[G2D_CHUNK];
+    Circle2Hit chunk_hit[G2D_CHUNK];
+    size_t i, j, n_hits = 0;
+
+    /* geometry2.c does the actual work, with the same calculations as
+     * g2dCircleLineIntersect(). */
+
+    Line2 line = {
+        { { l.pv.x, l.pv.y } },
+        { { l.dv.x, l.dv.y } }
+    };
+
+    Vector2Array center = { { cx, cy } };
+
+    for (i = 0; i < n; i += G2D_CHUNK) {
+        size_t count = n - i < G2D_CHUNK ? n - i : G2D_CHUNK;
+
+        for (j = 0; j < count; j++) {
+            cx[j] = c[i + j].c.x;
+            cy[j] = c[i + j].c.y;
+            radius[j] = c[i + j].r;
+        }
+
+        size_t n_chunk =
+            g2CircleLineIntersectArray(chunk_hit, line, center, radius, count);
+
+        for (j = 0; j < n_chunk; j++) {
+            hit[n_hits].index = i + chunk_hit[j].index;
+            hit[n_hits].count = chunk_hit[j].count;
+            hit[n_hits].r1 = chunk_hit[j].r1;
+            hit[n_hits].r2 = chunk_hit[j].r2;
+
+            n_hits++;
+        }
+    }
+
+    return n_hits;
+}
+
 /*
  * Intersect circle <c> with line <l> and write the intersections to p1 and p2.
  * The number of intersections (0, 1 or * 2) is returned. p1 and p2 may be given
@@ -312,6 +367,7 @@ Matrix2x2 g2dMatrixMultiply(Matrix2x2 m1, Matrix2x2 m2)
 
 #ifdef TEST
 
+#include "simd.h"
 #include "utils.h"
 
 int main(void)
@@ -428,6 +484,60 @@ int main(void)
 
     // fprintf(stderr, "p.x = %g, p.y = %g\n", p.x, p.y);
 
+    // One line against many circles, compared with single intersections.
+
+    enum { N_CIRCLES = 1001 };
+
+    Circle2D circle[N_CIRCLES];
+    CircleHit2D hit[N_CIRCLES];
+    int i, level;
+
+    srandom(1);
+
+    for (i = 0; i < N_CIRCLES; i++) {
+        circle[i] = g2dCircleNew(
+                g2dVectorNew(random() % 200 - 100, random() % 200 - 100),
+                random() % 50);
+    }
+
+    // Make sure there are a few touching circles too.
+
+    circle[3] = g2dCircleNew(g2dVectorNew(5, 1), 1);
+    circle[500] = g2dCircleNew(g2dVectorNew(-7, -1), 1);
+
+    l1 = g2dLineNew(g2dVectorNew(0, 0), g2dVectorNew(3, 0));
+
+    for (level = SIMD_NONE; level <= SIMD_AVX2; level++) {
+        size_t n_hits, k = 0;
+        int bad = 0;
+
+        simdSetLevel(level);
+
+        n_hits = g2dCircleLineIntersectMany(hit, l1, circle, N_CIRCLES);
+
+        for (i = 0; i < N_CIRCLES; i++) {
+            r = g2dCircleLineIntersect(circle[i], l1, &r1, &r2);
+
+            if (r == 0) continue;
+
+            if (k >= n_hits || hit[k].index != (size_t) i ||
+                hit[k].count != r || hit[k].r1 != r1 || hit[k].r2 != r2) {
+                bad++;
+            }
+
+            k++;
+        }
+
+        make_sure_that(k == n_hits);
+        make_sure_that(bad == 0);
+        make_sure_that(n_hits > 10 && n_hits < N_CIRCLES);
+    }
+
+    make_sure_that(g2dCircleLineIntersectMany(hit, l1, circle + 3, 1) == 1);
+    make_sure_that(hit[0].index == 0);
+    make_sure_that(hit[0].count == 1);
+    make_sure_that(hit[0].r1 == 5.0 / 3.0);
+
     return errors;
 }
 #endif
@@ -14,6 +14,8 @@
  * http://www.opensource.org/licenses/mit-license.php for details.
  */
 
+#include <stddef.h>
+
 typedef struct {
     double x, y;
 } Vector2D;
@@ -32,6 +34,12 @@ typedef struct {
     Vector2D c[2];
 } Matrix2x2;
 
+typedef struct {
+    size_t index;   // Index of the circle that was hit
+    int count;      // Number of intersections (1 or 2)
+    double r1, r2;  // Positions of the intersections on the line
+} CircleHit2D;
+
 /*
  * Make a vector with <x> and <y> as its coordinates.
  */
@@ -108,6 +116,16 @@ Circle2D g2dCircleNew(Vector2D center, double radius);
  */
 int g2dCircleLineIntersect(Circle2D c, Line2D l, double *r1, double *r2);
 
+/*
+ * Intersect line <l> with the <n> circles in <c>, and add a CircleHit2D to
+ * <hit> for each circle that it intersects, with the same positions that
+ * g2dCircleLineIntersect() would return. <hit> must have room for <n> entries.
+ * Returns the number of hits. Several circles are done at once using SIMD
+ * instructions, if available.
+ */
+size_t g2dCircleLineIntersectMany(CircleHit2D *hit, Line2D l,
+        const Circle2D *c, size_t n);
+
 /*
  * Intersect circle <c> with line <l> and write the intersections to p1 and p2.
  * The number of intersections (0, 1 or * 2) is returned. p1 and p2 may be given
@@ -0,0 +1,899 @@
+/*
+ * geocell.c: Hierarchical cell ids and a spatial index for lat/lon points.
+ *
+ * geocell.c is part of libjvs.
+ *
+ * Copyright: (c) 2026 Jacco van Schaik (jacco@jaccovanschaik.net)
+ * Created:   2026-10-18
+ * Version:   $Id$
+ *
+ * This software is distributed under the terms of the MIT license. See
+ * http://www.opensource.org/licenses/mit-license.php for details.
+ */
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "defs.h"
+#include "geodesy.h"
+
+#include "geocell.h"
+
+/*
+ * Cover query boxes with cells at the deepest level at which they are at most
+ * GC_COVER cells wide and high.
+ */
+#define GC_COVER 8
+
+/*
+ * Maximum number of cells needed to cover a box.
+ */
+#define GC_MAX_RANGES ((GC_COVER + 2) * (GC_COVER + 2))
+
+/*
+ * Number of points that radius queries pass to gdDistanceMany() at a time.
+ */
+#define GC_CHUNK 256
+
+/* Number of cells per axis at GC_MAX_LEVEL. */
+
+#define GC_CELLS ((uint64_t) 1 << GC_MAX_LEVEL)
+
+/*
+ * A range of cell ids at GC_MAX_LEVEL, from <start> up to (but not including)
+ * <end>.
+ */
+typedef struct {
+    uint64_t start, end;
+} GcRange;
+
+/*
+ * A point and its cell id, used to sort the points when creating an index.
+ */
+typedef struct {
+    uint64_t cell;
+    size_t index;
+} GcEntry;
+
+/*
+ * Return the column of the cell at GC_MAX_LEVEL that contains longitude <lon>.
+ */
+static uint64_t gc_column(double lon)
+{
+    double x = floor((lon + 180) * (GC_CELLS / 360.0));
+
+    return x <= 0 ? 0 : x >= GC_CELLS ? GC_CELLS - 1 : (uint64_t) x;
+}
+
+/*
+ * Return the row of the cell at GC_MAX_LEVEL that contains latitude <lat>.
+ */
+static uint64_t gc_row(double lat)
+{
+    double y = floor((lat + 90) * (GC_CELLS / 180.0));
+
+    return y <= 0 ? 0 : y >= GC_CELLS ? GC_CELLS - 1 : (uint64_t) y;
+}
+
+/*
+ * Spread the lower 32 bits of <v> out over the even bits of the result.
+ */
+static uint64_t gc_spread(uint64_t v)
+{
+    v = (v | (v << 16)) & 0x0000FFFF0000FFFFULL;
+    v = (v | (v << 8))  & 0x00FF00FF00FF00FFULL;
+    v = (v | (v << 4))  & 0x0F0F0F0F0F0F0F0FULL;
+    v = (v | (v << 2))  & 0x3333333333333333ULL;
+    v = (v | (v << 1))  & 0x5555555555555555ULL;
+
+    return v;
+}
+
+/*
+ * The reverse of gc_spread(): collect the even bits of <v>.
+ */
+static uint64_t gc_compact(uint64_t v)
+{
+    v &= 0x5555555555555555ULL;
+    v = (v | (v >> 1))  & 0x3333333333333333ULL;
+    v = (v | (v >> 2))  & 0x0F0F0F0F0F0F0F0FULL;
+    v = (v | (v >> 4))  & 0x00FF00FF00FF00FFULL;
+    v = (v | (v >> 8))  & 0x0000FFFF0000FFFFULL;
+    v = (v | (v >> 16)) & 0x00000000FFFFFFFFULL;
+
+    return v;
+}
+
+/*
+ * Return the id of the cell in column <x> and row <y>.
+ */
+static uint64_t gc_cell(uint64_t x, uint64_t y)
+{
+    return (gc_spread(x) << 1) | gc_spread(y);
+}
+
+/*
+ * Compare the GcEntries at <p1> and <p2> for qsort().
+ */
+static int gc_compare(const void *p1, const void *p2)
+{
+    const GcEntry *e1 = p1, *e2 = p2;
+
+    if (e1->cell != e2->cell)
+        return e1->cell < e2->cell ? -1 : 1;
+    else if (e1->index != e2->index)
+        return e1->index < e2->index ? -1 : 1;
+    else
+        return 0;
+}
+
+/*
+ * Compare the GcRanges at <p1> and <p2> for qsort().
+ */
+static int gc_compare_range(const void *p1, const void *p2)
+{
+    const GcRange *r1 = p1, *r2 = p2;
+
+    return r1->start < r2->start ? -1 : r1->start > r2->start ? 1 : 0;
+}
+
+/*
+ * Return the index of the first point in <index> whose cell id is not less
+ * than <cell>.
+ */
+static size_t gc_lower_bound(const GeoIndex *index, uint64_t cell)
+{
+    size_t lo = 0, hi = index->count;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (index->cell[mid] < cell)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/*
+ * Cover the area between <lat_min> and <lat_max> and between <lon_min> and
+ * <lon_max> (which must not be less than <lon_min>) with cells, and put
+ * the ranges of cell ids that they contain in <range>, sorted and with
+ * adjacent ranges merged. Returns the number of ranges.
+ */
+static int gc_cover(GcRange *range, double lat_min, double lon_min,
+        double lat_max, double lon_max)
+{
+    int level, n = 0, i;
+    uint64_t x, y;
+
+    double width  = (lon_max - lon_min) / 360;
+    double height = (lat_max - lat_min) / 180;
+
+    for (level = GC_MAX_LEVEL; level > 0; level--) {
+        double cells = ldexp(1, level);
+
+        if (width * cells <= GC_COVER && height * cells <= GC_COVER) break;
+    }
+
+    int shift = GC_MAX_LEVEL - level;
+
+    uint64_t x0 = gc_column(lon_min) >> shift, x1 = gc_column(lon_max) >> shift;
+    uint64_t y0 = gc_row(lat_min) >> shift,    y1 = gc_row(lat_max) >> shift;
+
+    for (y = y0; y <= y1; y++) {
+        for (x = x0; x <= x1; x++) {
+            uint64_t cell = gc_cell(x, y);
+
+            range[n].start = cell << (2 * shift);
+            range[n].end = (cell + 1) << (2 * shift);
+
+            n++;
+        }
+    }
+
+    qsort(range, n, sizeof(GcRange), gc_compare_range);
+
+    /* Merge ranges that are adjacent. */
+
+    int merged = 0;
+
+    for (i = 1; i < n; i++) {
+        if (range[i].start == range[merged].end) {
+            range[merged].end = range[i].end;
+        }
+        else {
+            range[++merged] = range[i];
+        }
+    }
+
+    return n == 0 ? 0 : merged + 1;
+}
+
+/*
+ * Call <hit> for each point in <index> inside the box with the given
+ * boundaries, which doesn't cross the 180 degree meridian.
+ */
+static void gc_box_part(const GeoIndex *index, size_t query,
+        double lat_min, double lon_min, double lat_max, double lon_max,
+        void (*hit)(size_t query, size_t obj, void *udata), void *udata)
+{
+    GcRange range[GC_MAX_RANGES];
+    size_t i;
+    int r;
+
+    int n = gc_cover(range, lat_min, lon_min, lat_max, lon_max);
+
+    for (r = 0; r < n; r++) {
+        size_t lo = gc_lower_bound(index, range[r].start);
+        size_t hi = gc_lower_bound(index, range[r].end);
+
+        for (i = lo; i < hi; i++) {
+            if (index->lat[i] >= lat_min && index->lat[i] <= lat_max &&
+                index->lon[i] >= lon_min && index->lon[i] <= lon_max) {
+                hit(query, index->index[i], udata);
+            }
+        }
+    }
+}
+
+/*
+ * Call <hit> for each point in <index> inside <box>, passing in <query>, the
+ * index of the point and <udata>.
+ */
+static void gc_box_query(const GeoIndex *index, const GeoBox *box,
+        size_t query,
+        void (*hit)(size_t query, size_t obj, void *udata), void *udata)
+{
+    if (box->lat_min > box->lat_max) return;
+
+    if (box->lon_min <= box->lon_max) {
+        gc_box_part(index, query, box->lat_min, box->lon_min,
+                box->lat_max, box->lon_max, hit, udata);
+    }
+    else {
+        gc_box_part(index, query, box->lat_min, box->lon_min,
+                box->lat_max, 180, hit, udata);
+        gc_box_part(index, query, box->lat_min, -180,
+                box->lat_max, box->lon_max, hit, udata);
+    }
+}
+
+/*
+ * Call <hit> for each point in <index> within <radius> of (<lat>, <lon>) and
+ * inside the box with the given boundaries, which doesn't cross the 180
+ * degree meridian.
+ */
+static void gc_radius_part(const GeoIndex *index, size_t query,
+        double lat, double lon, double radius,
+        double lat_min, double lon_min, double lat_max, double lon_max,
+        void (*hit)(size_t query, size_t obj, void *udata), void *udata)
+{
+    GcRange range[GC_MAX_RANGES];
+    double q_lat[GC_CHUNK], q_lon[GC_CHUNK], dist[GC_CHUNK];
+    size_t i, j;
+    int r;
+
+    for (i = 0; i < GC_CHUNK; i++) {
+        q_lat[i] = lat;
+        q_lon[i] = lon;
+    }
+
+    int n = gc_cover(range, lat_min, lon_min, lat_max, lon_max);
+
+    for (r = 0; r < n; r++) {
+        size_t lo = gc_lower_bound(index, range[r].start);
+        size_t hi = gc_lower_bound(index, range[r].end);
+
+        for (i = lo; i < hi; i += GC_CHUNK) {
+            size_t count = MIN(GC_CHUNK, hi - i);
+
+            gdDistanceMany(dist, q_lat, q_lon,
+                    index->lat + i, index->lon + i, count);
+
+            for (j = 0; j < count; j++) {
+                if (dist[j] <= radius) hit(query, index->index[i + j], udata);
+            }
+        }
+    }
+}
+
+/*
+ * Call <hit> for each point in <index> within <radius> of (<lat>, <lon>),
+ * passing in <query>, the index of the point and <udata>.
+ */
+static void gc_radius_query(const GeoIndex *index,
+        double lat, double lon, double radius, size_t query,
+        void (*hit)(size_t query, size_t obj, void *udata), void *udata)
+{
+    /* Find a box around the circle, with a little margin to allow for
+     * rounding errors. The exact test is done by gc_radius_part(). */
+
+    const double margin = 1e-6;
+
+    double delta = radius / GD_EARTH_RADIUS;
+    double dlat = delta * (180 / M_PI) + margin;
+
+    double lat_min = lat - dlat, lat_max = lat + dlat;
+
+    if (radius < 0) return;
+
+    if (lat_min <= -90 || lat_max >= 90) {
+        /* The circle contains a pole, so it covers all longitudes. */
+
+        gc_radius_part(index, query, lat, lon, radius,
+                MAX(lat_min, -90), -180, MIN(lat_max, 90), 180, hit, udata);
+
+        return;
+    }
+
+    double dlon = asin(sin(delta) / cos(lat * (M_PI / 180))) * (180 / M_PI)
+        + margin;
+
+    double lon_min = lon - dlon, lon_max = lon + dlon;
+
+    if (lon_min < -180) {
+        gc_radius_part(index, query, lat, lon, radius,
+                lat_min, lon_min + 360, lat_max, 180, hit, udata);
+        gc_radius_part(index, query, lat, lon, radius,
+                lat_min, -180, lat_max, lon_max, hit, udata);
+    }
+    else if (lon_max > 180) {
+        gc_radius_part(index, query, lat, lon, radius,
+                lat_min, lon_min, lat_max, 180, hit, udata);
+        gc_radius_part(index, query, lat, lon, radius,
+                lat_min, -180, lat_max, lon_max - 360, hit, udata);
+    }
+    else {
+        gc_radius_part(index, query, lat, lon, radius,
+                lat_min, lon_min, lat_max, lon_max, hit, udata);
+    }
+}
+
+/*
+ * Collects query results into an array, for gcIndexBox() and
+ * gcIndexRadius().
+ */
+typedef struct {
+    size_t *obj;
+    size_t max_obj;
+    size_t count;
+} GcCollector;
+
+/*
+ * Add point <obj> to the GcCollector in <udata>, if there is still room.
+ */
+static void gc_collect(size_t query, size_t obj, void *udata)
+{
+    GcCollector *collector = udata;
+
+    UNUSED(query);
+
+    if (collector->count < collector->max_obj) {
+        collector->obj[collector->count] = obj;
+    }
+
+    collector->count++;
+}
+
+/*
+ * Return the id of the cell at level <level> that contains (<lat>, <lon>).
+ */
+uint64_t gcCell(double lat, double lon, int level)
+{
+    int shift = GC_MAX_LEVEL - level;
+
+    return gc_cell(gc_column(lon) >> shift, gc_row(lat) >> shift);
+}
+
+/*
+ * Set cell[i] to the id of the cell at level <level> that contains (lat[i],
+ * lon[i]), for all 0 <= i < <n>.
+ */
+void gcCellMany(uint64_t *cell, const double *lat, const double *lon,
+        size_t n, int level)
+{
+    int shift = GC_MAX_LEVEL - level;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        cell[i] = gc_cell(gc_column(lon[i]) >> shift, gc_row(lat[i]) >> shift);
+    }
+}
+
+/*
+ * Return the id of the cell at level <level> (which must not be deeper than
+ * the level of <cell>, <cell_level>) that contains cell <cell>.
+ */
+uint64_t gcCellParent(uint64_t cell, int cell_level, int level)
+{
+    return cell >> (2 * (cell_level - level));
+}
+
+/*
+ * Return the area covered by cell <cell> at level <level>.
+ */
+GeoBox gcCellBox(uint64_t cell, int level)
+{
+    double width  = ldexp(360, -level);
+    double height = ldexp(180, -level);
+
+    uint64_t x = gc_compact(cell >> 1);
+    uint64_t y = gc_compact(cell);
+
+    GeoBox box = {
+        .lat_min = -90 + y * height,
+        .lon_min = -180 + x * width,
+        .lat_max = -90 + (y + 1) * height,
+        .lon_max = -180 + (x + 1) * width,
+    };
+
+    return box;
+}
+
+/*
+ * Write the geohash of (<lat>, <lon>), with <precision> characters (at most
+ * 12), to <buf>, which must have room for <precision> + 1 characters. Returns
+ * the number of characters written, not counting the terminating null byte.
+ */
+int gcGeohash(double lat, double lon, int precision, char *buf)
+{
+    static const char *digits = "0123456789bcdefghjkmnpqrstuvwxyz";
+
+    uint64_t cell = gcCell(lat, lon, GC_MAX_LEVEL);
+    int i;
+
+    precision = MIN(precision, 2 * GC_MAX_LEVEL / 5);
+
+    for (i = 0; i < precision; i++) {
+        buf[i] = digits[(cell >> (2 * GC_MAX_LEVEL - 5 * (i + 1))) & 0x1F];
+    }
+
+    buf[i] = '\0';
+
+    return i;
+}
+
+/*
+ * Create an index for the <n> points in <lat> and <lon>. Points are referred
+ * to by their index in these arrays.
+ */
+GeoIndex *gcIndexCreate(const double *lat, const double *lon, size_t n)
+{
+    size_t i;
+
+    GeoIndex *index = calloc(1, sizeof(GeoIndex));
+    GcEntry *entry = malloc(n * sizeof(GcEntry));
+
+    for (i = 0; i < n; i++) {
+        entry[i].cell = gcCell(lat[i], lon[i], GC_MAX_LEVEL);
+        entry[i].index = i;
+    }
+
+    qsort(entry, n, sizeof(GcEntry), gc_compare);
+
+    index->count = n;
+    index->cell  = malloc(n * sizeof(uint64_t));
+    index->index = malloc(n * sizeof(size_t));
+    index->lat   = malloc(n * sizeof(double));
+    index->lon   = malloc(n * sizeof(double));
+
+    for (i = 0; i < n; i++) {
+        index->cell[i]  = entry[i].cell;
+        index->index[i] = entry[i].index;
+        index->lat[i]   = lat[entry[i].index];
+        index->lon[i]   = lon[entry[i].index];
+    }
+
+    free(entry);
+
+    return index;
+}
+
+/*
+ * Put the indexes of the points inside <box> into <obj>, which has room for
+ * <max_obj> entries. Returns the number of points found, which may be more
+ * than <max_obj> (in which case only the first <max_obj> are put in <obj>).
+ */
+size_t gcIndexBox(const GeoIndex *index, GeoBox box,
+        size_t *obj, size_t max_obj)
+{
+    GcCollector collector = { obj, max_obj, 0 };
+
+    gc_box_query(index, &box, 0, gc_collect, &collector);
+
+    return collector.count;
+}
+
+/*
+ * Put the indexes of the points within <radius> of (<lat>, <lon>) into <obj>,
+ * which has room for <max_obj> entries. Distances are calculated using
+ * gdDistanceMany() (see geodesy.h). Returns the number of points found, which
+ * may be more than <max_obj> (in which case only the first <max_obj> are put
+ * in <obj>).
+ */
+size_t gcIndexRadius(const GeoIndex *index, double lat, double lon,
+        double radius, size_t *obj, size_t max_obj)
+{
+    GcCollector collector = { obj, max_obj, 0 };
+
+    gc_radius_query(index, lat, lon, radius, 0, gc_collect, &collector);
+
+    return collector.count;
+}
+
+/*
+ * Call <hit> for each combination of a box in <box> (there are <n>) and a
+ * point inside it, passing in the index of the box, the index of the point
+ * and <udata>.
+ */
+void gcIndexBoxMany(const GeoIndex *index, const GeoBox *box, size_t n,
+        void (*hit)(size_t query, size_t obj, void *udata), void *udata)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        gc_box_query(index, &box[i], i, hit, udata);
+    }
+}
+
+/*
+ * Call <hit> for each combination of a query point (lat[i], lon[i]) (there
+ * are <n>) and a point within radius[i] of it, passing in the index of the
+ * query point, the index of the point found and <udata>.
+ */
+void gcIndexRadiusMany(const GeoIndex *index,
+        const double *lat, const double *lon, const double *radius, size_t n,
+        void (*hit)(size_t query, size_t obj, void *udata), void *udata)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        gc_radius_query(index, lat[i], lon[i], radius[i], i, hit, udata);
+    }
+}
+
+/*
+ * Destroy index <index>.
+ */
+void gcIndexDestroy(GeoIndex *index)
+{
+    free(index->cell);
+    free(index->index);
+    free(index->lat);
+    free(index->lon);
+
+    free(index);
+}
+
+#ifdef TEST
+#include "utils.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define N_POINTS    20000
+#define N_QUERIES   200
+
+static int errors = 0;
+
+static double lat[N_POINTS], lon[N_POINTS];
+
+/*
+ * Return a random number between <min> and <max>.
+ */
+static double random_between(double min, double max)
+{
+    return min + (max - min) * random() / RAND_MAX;
+}
+
+/*
+ * Compare the size_ts at <p1> and <p2> for qsort().
+ */
+static int compare_size(const void *p1, const void *p2)
+{
+    const size_t *s1 = p1, *s2 = p2;
+
+    return *s1 < *s2 ? -1 : *s1 > *s2 ? 1 : 0;
+}
+
+/*
+ * Return true if point <i> is inside <box>.
+ */
+static int in_box(size_t i, const GeoBox *box)
+{
+    if (lat[i] < box->lat_min || lat[i] > box->lat_max) return 0;
+
+    if (box->lon_min <= box->lon_max)
+        return lon[i] >= box->lon_min && lon[i] <= box->lon_max;
+    else
+        return lon[i] >= box->lon_min || lon[i] <= box->lon_max;
+}
+
+/*
+ * Sort the <n> points found in <found> and compare them to the <n_exp>
+ * expected ones in <exp>.
+ */
+static void check_found(size_t *found, size_t n, const size_t *exp,
+        size_t n_exp)
+{
+    qsort(found, n, sizeof(size_t), compare_size);
+
+    make_sure_that(n == n_exp);
+    make_sure_that(n != n_exp || memcmp(found, exp, n * sizeof(size_t)) == 0);
+}
+
+/*
+ * Counts the hits reported by the batch queries.
+ */
+typedef struct {
+    size_t *count;      // Number of hits per query.
+    size_t total;       // Total number of hits.
+} HitCount;
+
+static void count_hit(size_t query, size_t obj, void *udata)
+{
+    HitCount *hits = udata;
+
+    UNUSED(obj);
+
+    hits->count[query]++;
+    hits->total++;
+}
+
+int main(void)
+{
+    static size_t found[N_POINTS], exp[N_POINTS];
+    static double dist[N_POINTS], q_lat[N_POINTS], q_lon[N_POINTS];
+
+    size_t i, q, n, n_exp;
+    char hash[16];
+
+    srandom(1);
+
+    /* Cell ids. */
+
+    make_sure_that(gcCell(0, 0, 0) == 0);
+    make_sure_that(gcCell(-45, -90, 1) == 0);
+    make_sure_that(gcCell(-45, 90, 1) == 2);
+    make_sure_that(gcCell(45, -90, 1) == 1);
+    make_sure_that(gcCell(45, 90, 1) == 3);
+    make_sure_that(gcCell(90, 180, 2) == 15);
+
+    make_sure_that(gcGeohash(57.64911, 10.40744, 11, hash) == 11);
+    make_sure_that(strcmp(hash, "u4pruydqqvj") == 0);
+
+    make_sure_that(gcGeohash(-25.382708, -49.265506, 8, hash) == 8);
+    make_sure_that(strcmp(hash, "6gkzwgjz") == 0);
+
+    for (i = 0; i < N_POINTS; i++) {
+        if (i % 4 == 0) {
+            /* Some clusters... */
+            lat[i] = 52 + random_between(-0.5, 0.5);
+            lon[i] = 4 + random_between(-0.5, 0.5);
+        }
+        else if (i % 4 == 1) {
+            /* ... some around the 180 degree meridian and the poles ... */
+            lat[i] = random_between(80, 90) * (i % 8 == 1 ? 1 : -1);
+            lon[i] = random_between(170, 190);
+            if (lon[i] > 180) lon[i] -= 360;
+        }
+        else {
+            /* ... and the rest spread evenly. */
+            lat[i] = asin(random_between(-1, 1)) * (180 / M_PI);
+            lon[i] = random_between(-180, 180);
+        }
+    }
+
+    gcCellMany((uint64_t *) found, lat, lon, N_POINTS, 17);
+
+    for (i = 0; i < N_POINTS; i++) {
+        uint64_t cell = gcCell(lat[i], lon[i], 17);
+        GeoBox box = gcCellBox(cell, 17);
+
+        make_sure_that(((uint64_t *) found)[i] == cell);
+        make_sure_that(
+                gcCellParent(gcCell(lat[i], lon[i], 25), 25, 17) == cell);
+
+        make_sure_that(lat[i] >= box.lat_min && lat[i] <= box.lat_max);
+        make_sure_that(lon[i] >= box.lon_min && lon[i] <= box.lon_max);
+    }
+
+    GeoIndex *index = gcIndexCreate(lat, lon, N_POINTS);
+
+    make_sure_that(index->count == N_POINTS);
+
+    for (i = 1; i < N_POINTS; i++) {
+        make_sure_that(index->cell[i - 1] <= index->cell[i]);
+    }
+
+    /* Box queries, compared against brute force. */
+
+    GeoBox box[N_QUERIES];
+
+    for (q = 0; q < N_QUERIES; q++) {
+        double size = pow(10, random_between(-3, 2));
+
+        box[q].lat_min = random_between(-90, 90 - size);
+        box[q].lat_max = box[q].lat_min + size;
+        box[q].lon_min = random_between(-180, 180);
+        box[q].lon_max = box[q].lon_min + size;
+
+        if (q % 3 == 0) {
+            box[q].lat_min = 52 - size / 2; box[q].lat_max = 52 + size / 2;
+            box[q].lon_min = 4 - size / 2;  box[q].lon_max = 4 + size / 2;
+        }
+
+        if (box[q].lon_max > 180) box[q].lon_max -= 360;
+
+        for (i = 0, n_exp = 0; i < N_POINTS; i++) {
+            if (in_box(i, &box[q])) exp[n_exp++] = i;
+        }
+
+        n = gcIndexBox(index, box[q], found, N_POINTS);
+
+        check_found(found, n, exp, n_exp);
+
+        make_sure_that(gcIndexBox(index, box[q], found, 0) == n_exp);
+    }
+
+    size_t count[N_QUERIES] = { 0 };
+    HitCount hits = { count, 0 };
+    size_t total = 0;
+
+    gcIndexBoxMany(index, box, N_QUERIES, count_hit, &hits);
+
+    for (q = 0; q < N_QUERIES; q++) {
+        n = gcIndexBox(index, box[q], found, 0);
+        make_sure_that(count[q] == n);
+        total += n;
+    }
+
+    make_sure_that(hits.total == total);
+
+    /* Radius queries, compared against brute force. */
+
+    double r_lat[N_QUERIES], r_lon[N_QUERIES], radius[N_QUERIES];
+
+    for (q = 0; q < N_QUERIES; q++) {
+        radius[q] = pow(10, random_between(2, 7));
+
+        if (q % 4 == 0) {
+            r_lat[q] = 52;
+            r_lon[q] = 4;
+        }
+        else if (q % 4 == 1) {
+            r_lat[q] = random_between(80, 90) * (q % 8 == 1 ? 1 : -1);
+            r_lon[q] = random_between(-180, 180);
+        }
+        else {
+            r_lat[q] = random_between(-90, 90);
+            r_lon[q] = q % 4 == 2 ? random_between(-180, 180) : 179.9;
+        }
+
+        for (i = 0; i < N_POINTS; i++) {
+            q_lat[i] = r_lat[q];
+            q_lon[i] = r_lon[q];
+        }
+
+        gdDistanceMany(dist, q_lat, q_lon, lat, lon, N_POINTS);
+
+        for (i = 0, n_exp = 0; i < N_POINTS; i++) {
+            if (dist[i] <= radius[q]) exp[n_exp++] = i;
+        }
+
+        n = gcIndexRadius(index, r_lat[q], r_lon[q], radius[q],
+                found, N_POINTS);
+
+        check_found(found, n, exp, n_exp);
+    }
+
+    memset(count, 0, sizeof(count));
+    hits.total = total = 0;
+
+    gcIndexRadiusMany(index, r_lat, r_lon, radius, N_QUERIES,
+            count_hit, &hits);
+
+    for (q = 0; q < N_QUERIES; q++) {
+        n = gcIndexRadius(index, r_lat[q], r_lon[q], radius[q], found, 0);
+        make_sure_that(count[q] == n);
+        total += n;
+    }
+
+    make_sure_that(hits.total == total);
+
+    gcIndexDestroy(index);
+
+    return errors;
+}
+#endif
+
+#ifdef BENCH
+#include "utils.h"
+
+#include <stdio.h>
+
+#define N_POINTS    1000000
+#define N_QUERIES   1000
+
+static void count_hit(size_t query, size_t obj, void *udata)
+{
+    size_t *count = udata;
+
+    UNUSED(query);
+    UNUSED(obj);
+
+    (*count)++;
+}
+
+int main(void)
+{
+    double *lat = malloc(N_POINTS * sizeof(double));
+    double *lon = malloc(N_POINTS * sizeof(double));
+    double *dist = malloc(N_POINTS * sizeof(double));
+    double *q_lat = malloc(N_POINTS * sizeof(double));
+    double *q_lon = malloc(N_POINTS * sizeof(double));
+
+    double r_lat[N_QUERIES], r_lon[N_QUERIES], radius[N_QUERIES];
+    size_t i, q, found = 0;
+    double start;
+
+    /* Points spread over western Europe, 10 km queries. */
+
+    for (i = 0; i < N_POINTS; i++) {
+        lat[i] = 40 + 20.0 * random() / RAND_MAX;
+        lon[i] = -10 + 30.0 * random() / RAND_MAX;
+    }
+
+    for (q = 0; q < N_QUERIES; q++) {
+        r_lat[q] = 40 + 20.0 * random() / RAND_MAX;
+        r_lon[q] = -10 + 30.0 * random() / RAND_MAX;
+        radius[q] = 10000;
+    }
+
+    start = dnow();
+
+    for (q = 0; q < N_QUERIES / 100; q++) {
+        for (i = 0; i < N_POINTS; i++) {
+            q_lat[i] = r_lat[q];
+            q_lon[i] = r_lon[q];
+        }
+
+        gdDistanceMany(dist, q_lat, q_lon, lat, lon, N_POINTS);
+
+        for (i = 0; i < N_POINTS; i++) {
+            if (dist[i] <= radius[q]) found++;
+        }
+    }
+
+    printf("%-20s %10.1f queries/s (found %zu)\n", "Full scan",
+            N_QUERIES / 100 / (dnow() - start), found);
+
+    start = dnow();
+
+    GeoIndex *index = gcIndexCreate(lat, lon, N_POINTS);
+
+    printf("%-20s %10.3f s\n", "gcIndexCreate", dnow() - start);
+
+    found = 0;
+    start = dnow();
+
+    gcIndexRadiusMany(index, r_lat, r_lon, radius, N_QUERIES,
+            count_hit, &found);
+
+    printf("%-20s %10.1f queries/s (found %zu)\n", "gcIndexRadiusMany",
+            N_QUERIES / (dnow() - start), found);
+
+    gcIndexDestroy(index);
+
+    free(lat);
+    free(lon);
+    free(dist);
+    free(q_lat);
+    free(q_lon);
+
+    return 0;
+}
+#endif
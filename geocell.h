@@ -0,0 +1,142 @@
+#ifndef GEOCELL_H
+#define GEOCELL_H
+
+/*
+ * geocell.h: Hierarchical cell ids and a spatial index for lat/lon points.
+ *
+ * The earth is divided into a hierarchy of cells: at level <l> (0 to
+ * GC_MAX_LEVEL) the longitude range -180 .. 180 and the latitude range -90 ..
+ * 90 are both divided into 2^<l> equal parts. The id of a cell interleaves the
+ * bits of its longitude and latitude numbers (a Morton or "quad-key" code),
+ * longitude first, so that the cells inside a cell at level <l> form a
+ * contiguous range of ids at every level below it. This is the same scheme
+ * that geohashes use, and gcGeohash() converts cell ids to geohash strings.
+ *
+ * A GeoIndex stores a set of points sorted by their cell ids at GC_MAX_LEVEL.
+ * Box and radius queries cover the region of interest with a few cells,
+ * look up the range of points in each of them using binary search, and then
+ * check each of those points against the exact region.
+ *
+ * Latitudes and longitudes are in degrees, distances in meters. Longitudes
+ * are expected to be between -180 and 180.
+ *
+ * geocell.h is part of libjvs.
+ *
+ * Copyright: (c) 2026 Jacco van Schaik (jacco@jaccovanschaik.net)
+ * Created:   2026-10-18
+ * Version:   $Id$
+ *
+ * This software is distributed under the terms of the MIT license. See
+ * http://www.opensource.org/licenses/mit-license.php for details.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Deepest level of the cell hierarchy. Cells at this level are about 4 cm
+ * wide at the equator. */
+
+#define GC_MAX_LEVEL 30
+
+/*
+ * An area bounded by two latitudes and two longitudes. If <lon_min> is greater
+ * than <lon_max>, the box crosses the 180 degree meridian.
+ */
+typedef struct {
+    double lat_min, lon_min;
+    double lat_max, lon_max;
+} GeoBox;
+
+typedef struct {
+    size_t count;       // Number of points
+    uint64_t *cell;     // Cell ids at GC_MAX_LEVEL, in ascending order.
+    size_t *index;      // Original index of each point.
+    double *lat;        // Latitude of each point.
+    double *lon;        // Longitude of each point.
+} GeoIndex;
+
+/*
+ * Return the id of the cell at level <level> that contains (<lat>, <lon>).
+ */
+uint64_t gcCell(double lat, double lon, int level);
+
+/*
+ * Set cell[i] to the id of the cell at level <level> that contains (lat[i],
+ * lon[i]), for all 0 <= i < <n>.
+ */
+void gcCellMany(uint64_t *cell, const double *lat, const double *lon,
+        size_t n, int level);
+
+/*
+ * Return the id of the cell at level <level> (which must not be deeper than
+ * the level of <cell>, <cell_level>) that contains cell <cell>.
+ */
+uint64_t gcCellParent(uint64_t cell, int cell_level, int level);
+
+/*
+ * Return the area covered by cell <cell> at level <level>.
+ */
+GeoBox gcCellBox(uint64_t cell, int level);
+
+/*
+ * Write the geohash of (<lat>, <lon>), with <precision> characters (at most
+ * 12), to <buf>, which must have room for <precision> + 1 characters. Returns
+ * the number of characters written, not counting the terminating null byte.
+ */
+int gcGeohash(double lat, double lon, int precision, char *buf);
+
+/*
+ * Create an index for the <n> points in <lat> and <lon>. Points are referred
+ * to by their index in these arrays.
+ */
+GeoIndex *gcIndexCreate(const double *lat, const double *lon, size_t n);
+
+/*
+ * Put the indexes of the points inside <box> into <obj>, which has room for
+ * <max_obj> entries. Returns the number of points found, which may be more
+ * than <max_obj> (in which case only the first <max_obj> are put in <obj>).
+ */
+size_t gcIndexBox(const GeoIndex *index, GeoBox box,
+        size_t *obj, size_t max_obj);
+
+/*
+ * Put the indexes of the points within <radius> of (<lat>, <lon>) into <obj>,
+ * which has room for <max_obj> entries. Distances are calculated using
+ * gdDistanceMany() (see geodesy.h). Returns the number of points found, which
+ * may be more than <max_obj> (in which case only the first <max_obj> are put
+ * in <obj>).
+ */
+size_t gcIndexRadius(const GeoIndex *index, double lat, double lon,
+        double radius, size_t *obj, size_t max_obj);
+
+/*
+ * Call <hit> for each combination of a box in <box> (there are <n>) and a
+ * point inside it, passing in the index of the box, the index of the point
+ * and <udata>.
+ */
+void gcIndexBoxMany(const GeoIndex *index, const GeoBox *box, size_t n,
+        void (*hit)(size_t query, size_t obj, void *udata), void *udata);
+
+/*
+ * Call <hit> for each combination of a query point (lat[i], lon[i]) (there
+ * are <n>) and a point within radius[i] of it, passing in the index of the
+ * query point, the index of the point found and <udata>.
+ */
+void gcIndexRadiusMany(const GeoIndex *index,
+        const double *lat, const double *lon, const double *radius, size_t n,
+        void (*hit)(size_t query, size_t obj, void *udata), void *udata);
+
+/*
+ * Destroy index <index>.
+ */
+void gcIndexDestroy(GeoIndex *index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1124 @@
+/*
+ * geodesy.c: Distances, bearings and coordinate conversions on the earth.
+ *
+ * Latitudes, longitudes and bearings are in degrees, distances and altitudes
+ * in meters. Distances, bearings and destinations are calculated on a sphere
+ * with radius GD_EARTH_RADIUS, conversions to earth-centered, earth-fixed
+ * (ECEF) and local east-north-up (ENU) coordinates use the WGS84 ellipsoid.
+ *
+ * geodesy.c is part of libjvs.
+ *
+ * Copyright: (c) 2026 Jacco van Schaik (jacco@jaccovanschaik.net)
+ * Created:   2026-10-18
+ * Version:   $Id$
+ *
+ * This software is distributed under the terms of the MIT license. See
+ * http://www.opensource.org/licenses/mit-license.php for details.
+ */
+
+#include <math.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "simd.h"
+
+#include "geodesy.h"
+
+/* Conversions between degrees and radians. */
+
+#define GD_RAD  (M_PI / 180)
+#define GD_DEG  (180 / M_PI)
+
+/* Squared eccentricity of the WGS84 ellipsoid. */
+
+#define GD_WGS84_E2     (GD_WGS84_F * (2 - GD_WGS84_F))
+
+/*
+ * The batch functions below use polynomial approximations of sin, cos and
+ * atan2. The AVX2 versions perform exactly the same operations, in the same
+ * order, as the scalar versions, and don't use fused multiply-add, so that
+ * results don't depend on the instruction set that is used.
+ *
+ * Sine and cosine first reduce their argument to the range -pi/4 .. pi/4 by
+ * subtracting a multiple of pi/2, which is split into three parts to keep the
+ * subtraction exact (Cody & Waite). The polynomials (and the ones for atan)
+ * are those from the Cephes math library.
+ */
+
+#define GD_PIO2_1   1.57079625129699707031e+00
+#define GD_PIO2_2   7.54978941586159635335e-08
+#define GD_PIO2_3   5.39030285815811905290e-15
+
+#define GD_SIN_0    1.58962301576546568060e-10
+#define GD_SIN_1   -2.50507477628578072866e-08
+#define GD_SIN_2    2.75573136213857245213e-06
+#define GD_SIN_3   -1.98412698295895385996e-04
+#define GD_SIN_4    8.33333333332211858878e-03
+#define GD_SIN_5   -1.66666666666666307295e-01
+
+#define GD_COS_0   -1.13585365213876817300e-11
+#define GD_COS_1    2.08757008419747316778e-09
+#define GD_COS_2   -2.75573141792967388112e-07
+#define GD_COS_3    2.48015872888517045348e-05
+#define GD_COS_4   -1.38888888888730564116e-03
+#define GD_COS_5    4.16666666666665929218e-02
+
+#define GD_ATAN_P0 -8.750608600031904122785e-01
+#define GD_ATAN_P1 -1.615753718733365076637e+01
+#define GD_ATAN_P2 -7.500855792314704667340e+01
+#define GD_ATAN_P3 -1.228866684490136173410e+02
+#define GD_ATAN_P4 -6.485021904942025371773e+01
+
+#define GD_ATAN_Q0  2.485846490142306297962e+01
+#define GD_ATAN_Q1  1.650270098316988542046e+02
+#define GD_ATAN_Q2  4.328810604912902668951e+02
+#define GD_ATAN_Q3  4.853903996359136964868e+02
+#define GD_ATAN_Q4  1.945506571482613964425e+02
+
+#define GD_ATAN_MOREBITS 6.123233995736765886130e-17
+
+/*
+ * Put approximations of the sine and cosine of <x> in <s> and <c>.
+ */
+static void gd_sincos(double x, double *s, double *c)
+{
+    double q = floor(x * M_2_PI + 0.5);
+    double r = ((x - q * GD_PIO2_1) - q * GD_PIO2_2) - q * GD_PIO2_3;
+    double z = r * r;
+
+    double ps = r + r * z * (((((GD_SIN_0 * z + GD_SIN_1) * z + GD_SIN_2)
+                    * z + GD_SIN_3) * z + GD_SIN_4) * z + GD_SIN_5);
+    double pc = 1 - 0.5 * z + z * z * (((((GD_COS_0 * z + GD_COS_1)
+                    * z + GD_COS_2) * z + GD_COS_3) * z + GD_COS_4)
+                    * z + GD_COS_5);
+
+    double k = q - 4 * floor(q * 0.25);
+
+    if (k == 0)      { *s =  ps; *c =  pc; }
+    else if (k == 1) { *s =  pc; *c = -ps; }
+    else if (k == 2) { *s = -ps; *c = -pc; }
+    else             { *s = -pc; *c =  ps; }
+}
+
+/*
+ * Return an approximation of atan2(<y>, <x>).
+ */
+static double gd_atan2(double y, double x)
+{
+    double ax = fabs(x), ay = fabs(y);
+    double mx = ay > ax ? ay : ax;
+    double mn = ay > ax ? ax : ay;
+    double t = mx == 0 ? 0 : mn / mx;
+
+    /* atan(t), with 0 <= t <= 1. */
+
+    int big = t > 0.66;
+    double u = big ? (t - 1) / (t + 1) : t;
+    double z = u * u;
+
+    double p = (((GD_ATAN_P0 * z + GD_ATAN_P1) * z + GD_ATAN_P2)
+            * z + GD_ATAN_P3) * z + GD_ATAN_P4;
+    double q = ((((z + GD_ATAN_Q0) * z + GD_ATAN_Q1) * z + GD_ATAN_Q2)
+            * z + GD_ATAN_Q3) * z + GD_ATAN_Q4;
+
+    double a = u * (z * p / q) + u;
+
+    if (big) a = M_PI_4 + (a + 0.5 * GD_ATAN_MOREBITS);
+
+    if (ay > ax) a = M_PI_2 - a;
+    if (x < 0)   a = M_PI - a;
+    if (y < 0)   a = -a;
+
+    return a;
+}
+
+/*
+ * Return the great-circle distance between (<lat1>, <lon1>) and (<lat2>,
+ * <lon2>), using the approximations above.
+ */
+static double gd_distance(double lat1, double lon1, double lat2, double lon2)
+{
+    double s1, c1, s2, c2, sdp, cdp, sdl, cdl;
+
+    gd_sincos(lat1 * GD_RAD, &s1, &c1);
+    gd_sincos(lat2 * GD_RAD, &s2, &c2);
+    gd_sincos((lat2 - lat1) * (0.5 * GD_RAD), &sdp, &cdp);
+    gd_sincos((lon2 - lon1) * (0.5 * GD_RAD), &sdl, &cdl);
+
+    double h = sdp * sdp + (c1 * c2) * (sdl * sdl);
+    double w = 1 - h;
+
+    if (!(w > 0)) w = 0;
+
+    return (2 * GD_EARTH_RADIUS) * gd_atan2(sqrt(h), sqrt(w));
+}
+
+/*
+ * Return the initial bearing from (<lat1>, <lon1>) to (<lat2>, <lon2>), using
+ * the approximations above.
+ */
+static double gd_bearing(double lat1, double lon1, double lat2, double lon2)
+{
+    double s1, c1, s2, c2, sdl, cdl;
+
+    gd_sincos(lat1 * GD_RAD, &s1, &c1);
+    gd_sincos(lat2 * GD_RAD, &s2, &c2);
+    gd_sincos((lon2 - lon1) * GD_RAD, &sdl, &cdl);
+
+    double b = gd_atan2(sdl * c2, c1 * s2 - (s1 * c2) * cdl) * GD_DEG;
+
+    return b < 0 ? b + 360 : b;
+}
+
+/*
+ * Find the point at <distance> from (<lat>, <lon>) with initial bearing
+ * <bearing> using the approximations above, and put it in <lat2> and <lon2>.
+ */
+static void gd_destination(double lat, double lon,
+        double bearing, double distance, double *lat2, double *lon2)
+{
+    double s1, c1, sb, cb, sd, cd;
+
+    gd_sincos(lat * GD_RAD, &s1, &c1);
+    gd_sincos(bearing * GD_RAD, &sb, &cb);
+    gd_sincos(distance / GD_EARTH_RADIUS, &sd, &cd);
+
+    double s2 = s1 * cd + (c1 * sd) * cb;
+    double w = (1 - s2) * (1 + s2);
+
+    if (!(w > 0)) w = 0;
+
+    double dl = gd_atan2((sb * sd) * c1, cd - s1 * s2);
+    double l2 = lon + dl * GD_DEG;
+
+    *lat2 = gd_atan2(s2, sqrt(w)) * GD_DEG;
+    *lon2 = l2 - 360 * floor((l2 + 180) * (1.0 / 360));
+}
+
+/*
+ * Convert (<lat>, <lon>, <alt>) to ECEF coordinates <x>, <y> and <z>, using
+ * the approximations above.
+ */
+static void gd_to_ecef(double lat, double lon, double alt,
+        double *x, double *y, double *z)
+{
+    double sp, cp, sl, cl;
+
+    gd_sincos(lat * GD_RAD, &sp, &cp);
+    gd_sincos(lon * GD_RAD, &sl, &cl);
+
+    double N = GD_WGS84_A / sqrt(1 - (GD_WGS84_E2 * sp) * sp);
+    double r = (N + alt) * cp;
+
+    *x = r * cl;
+    *y = r * sl;
+    *z = (N * (1 - GD_WGS84_E2) + alt) * sp;
+}
+
+/*
+ * Everything needed to convert ECEF coordinates to ENU coordinates relative to
+ * a reference point.
+ */
+typedef struct {
+    double x0, y0, z0;      // ECEF coordinates of the reference point.
+    double ex, ey;          // Rotation matrix from ECEF to ENU.
+    double nx, ny, nz;
+    double ux, uy, uz;
+} GdFrame;
+
+/*
+ * Set up <frame> for conversions to ENU coordinates relative to the point at
+ * (<lat0>, <lon0>, <alt0>).
+ */
+static void gd_frame(GdFrame *frame, double lat0, double lon0, double alt0)
+{
+    double sp = sin(lat0 * GD_RAD), cp = cos(lat0 * GD_RAD);
+    double sl = sin(lon0 * GD_RAD), cl = cos(lon0 * GD_RAD);
+
+    gdToECEF(lat0, lon0, alt0, &frame->x0, &frame->y0, &frame->z0);
+
+    frame->ex = -sl;      frame->ey = cl;
+    frame->nx = -sp * cl; frame->ny = -sp * sl; frame->nz = cp;
+    frame->ux =  cp * cl; frame->uy =  cp * sl; frame->uz = sp;
+}
+
+/*
+ * Convert ECEF coordinates (<x>, <y>, <z>) to ENU coordinates <e>, <n> and <u>
+ * in <frame>.
+ */
+static void gd_ecef_to_enu(const GdFrame *frame, double x, double y, double z,
+        double *e, double *n, double *u)
+{
+    double dx = x - frame->x0, dy = y - frame->y0, dz = z - frame->z0;
+
+    *e = frame->ex * dx + frame->ey * dy;
+    *n = (frame->nx * dx + frame->ny * dy) + frame->nz * dz;
+    *u = (frame->ux * dx + frame->uy * dy) + frame->uz * dz;
+}
+
+#if defined(__x86_64__)
+
+/*
+ * AVX2 version of gd_sincos(), for four values at a time.
+ */
+__attribute__((target("avx2")))
+static inline void gd_sincos_avx2(__m256d x, __m256d *s, __m256d *c)
+{
+    __m256d one  = _mm256_set1_pd(1);
+    __m256d sign = _mm256_set1_pd(-0.0);
+
+    __m256d q = _mm256_floor_pd(_mm256_add_pd(
+                _mm256_mul_pd(x, _mm256_set1_pd(M_2_PI)),
+                _mm256_set1_pd(0.5)));
+    __m256d r = _mm256_sub_pd(_mm256_sub_pd(_mm256_sub_pd(x,
+                    _mm256_mul_pd(q, _mm256_set1_pd(GD_PIO2_1))),
+                _mm256_mul_pd(q, _mm256_set1_pd(GD_PIO2_2))),
+            _mm256_mul_pd(q, _mm256_set1_pd(GD_PIO2_3)));
+    __m256d z = _mm256_mul_pd(r, r);
+
+    __m256d p = _mm256_set1_pd(GD_SIN_0);
+
+    p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(GD_SIN_1));
+    p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(GD_SIN_2));
+    p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(GD_SIN_3));
+    p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(GD_SIN_4));
+    p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(GD_SIN_5));
+
+    __m256d ps = _mm256_add_pd(r, _mm256_mul_pd(_mm256_mul_pd(r, z), p));
+
+    p = _mm256_set1_pd(GD_COS_0);
+
+    p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(GD_COS_1));
+    p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(GD_COS_2));
+    p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(GD_COS_3));
+    p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(GD_COS_4));
+    p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(GD_COS_5));
+
+    __m256d pc = _mm256_add_pd(
+            _mm256_sub_pd(one, _mm256_mul_pd(_mm256_set1_pd(0.5), z)),
+            _mm256_mul_pd(_mm256_mul_pd(z, z), p));
+
+    /* Pick the right one of ps, pc, -ps and -pc depending on the quadrant. */
+
+    __m256d k = _mm256_sub_pd(q, _mm256_mul_pd(_mm256_set1_pd(4),
+                _mm256_floor_pd(_mm256_mul_pd(q, _mm256_set1_pd(0.25)))));
+
+    __m256d k1 = _mm256_cmp_pd(k, one, _CMP_EQ_OQ);
+    __m256d k2 = _mm256_cmp_pd(k, _mm256_set1_pd(2), _CMP_EQ_OQ);
+    __m256d k3 = _mm256_cmp_pd(k, _mm256_set1_pd(3), _CMP_EQ_OQ);
+
+    __m256d swap = _mm256_or_pd(k1, k3);
+
+    *s = _mm256_xor_pd(_mm256_blendv_pd(ps, pc, swap),
+            _mm256_and_pd(sign, _mm256_or_pd(k2, k3)));
+    *c = _mm256_xor_pd(_mm256_blendv_pd(pc, ps, swap),
+            _mm256_and_pd(sign, _mm256_or_pd(k1, k2)));
+}
+
+/*
+ * AVX2 version of gd_atan2(), for four values at a time.
+ */
+__attribute__((target("avx2")))
+static inline __m256d gd_atan2_avx2(__m256d y, __m256d x)
+{
+    __m256d zero = _mm256_setzero_pd();
+    __m256d one  = _mm256_set1_pd(1);
+    __m256d sign = _mm256_set1_pd(-0.0);
+
+    __m256d ax = _mm256_andnot_pd(sign, x);
+    __m256d ay = _mm256_andnot_pd(sign, y);
+
+    __m256d y_big = _mm256_cmp_pd(ay, ax, _CMP_GT_OQ);
+
+    __m256d mx = _mm256_blendv_pd(ax, ay, y_big);
+    __m256d mn = _mm256_blendv_pd(ay, ax, y_big);
+    __m256d t = _mm256_blendv_pd(_mm256_div_pd(mn, mx), zero,
+            _mm256_cmp_pd(mx, zero, _CMP_EQ_OQ));
+
+    __m256d big = _mm256_cmp_pd(t, _mm256_set1_pd(0.66), _CMP_GT_OQ);
+    __m256d u = _mm256_blendv_pd(t, _mm256_div_pd(_mm256_sub_pd(t, one),
+                _mm256_add_pd(t, one)), big);
+    __m256d z = _mm256_mul_pd(u, u);
+
+    __m256d p = _mm256_set1_pd(GD_ATAN_P0);
+
+    p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(GD_ATAN_P1));
+    p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(GD_ATAN_P2));
+    p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(GD_ATAN_P3));
+    p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(GD_ATAN_P4));
+
+    __m256d q = _mm256_add_pd(z, _mm256_set1_pd(GD_ATAN_Q0));
+
+    q = _mm256_add_pd(_mm256_mul_pd(q, z), _mm256_set1_pd(GD_ATAN_Q1));
+    q = _mm256_add_pd(_mm256_mul_pd(q, z), _mm256_set1_pd(GD_ATAN_Q2));
+    q = _mm256_add_pd(_mm256_mul_pd(q, z), _mm256_set1_pd(GD_ATAN_Q3));
+    q = _mm256_add_pd(_mm256_mul_pd(q, z), _mm256_set1_pd(GD_ATAN_Q4));
+
+    __m256d a = _mm256_add_pd(_mm256_mul_pd(u,
+                _mm256_div_pd(_mm256_mul_pd(z, p), q)), u);
+
+    a = _mm256_blendv_pd(a, _mm256_add_pd(_mm256_set1_pd(M_PI_4),
+                _mm256_add_pd(a, _mm256_set1_pd(0.5 * GD_ATAN_MOREBITS))),
+            big);
+
+    a = _mm256_blendv_pd(a, _mm256_sub_pd(_mm256_set1_pd(M_PI_2), a), y_big);
+    a = _mm256_blendv_pd(a, _mm256_sub_pd(_mm256_set1_pd(M_PI), a),
+            _mm256_cmp_pd(x, zero, _CMP_LT_OQ));
+    a = _mm256_blendv_pd(a, _mm256_xor_pd(a, sign),
+            _mm256_cmp_pd(y, zero, _CMP_LT_OQ));
+
+    return a;
+}
+
+/*
+ * AVX2 version of gdDistanceMany(). Returns the number of distances done.
+ */
+__attribute__((target("avx2")))
+static size_t gd_distance_avx2(double *dist,
+        const double *lat1, const double *lon1,
+        const double *lat2, const double *lon2, size_t n)
+{
+    __m256d rad = _mm256_set1_pd(GD_RAD);
+    __m256d half_rad = _mm256_set1_pd(0.5 * GD_RAD);
+    __m256d one = _mm256_set1_pd(1);
+    __m256d diameter = _mm256_set1_pd(2 * GD_EARTH_RADIUS);
+
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m256d p1 = _mm256_loadu_pd(lat1 + i);
+        __m256d p2 = _mm256_loadu_pd(lat2 + i);
+        __m256d l1 = _mm256_loadu_pd(lon1 + i);
+        __m256d l2 = _mm256_loadu_pd(lon2 + i);
+
+        __m256d s1, c1, s2, c2, sdp, cdp, sdl, cdl;
+
+        gd_sincos_avx2(_mm256_mul_pd(p1, rad), &s1, &c1);
+        gd_sincos_avx2(_mm256_mul_pd(p2, rad), &s2, &c2);
+        gd_sincos_avx2(_mm256_mul_pd(_mm256_sub_pd(p2, p1), half_rad),
+                &sdp, &cdp);
+        gd_sincos_avx2(_mm256_mul_pd(_mm256_sub_pd(l2, l1), half_rad),
+                &sdl, &cdl);
+
+        __m256d h = _mm256_add_pd(_mm256_mul_pd(sdp, sdp),
+                _mm256_mul_pd(_mm256_mul_pd(c1, c2), _mm256_mul_pd(sdl, sdl)));
+        __m256d w = _mm256_sub_pd(one, h);
+
+        w = _mm256_and_pd(w, _mm256_cmp_pd(w, _mm256_setzero_pd(),
+                    _CMP_GT_OQ));
+
+        _mm256_storeu_pd(dist + i, _mm256_mul_pd(diameter,
+                    gd_atan2_avx2(_mm256_sqrt_pd(h), _mm256_sqrt_pd(w))));
+    }
+
+    return i;
+}
+
+/*
+ * AVX2 version of gdBearingMany(). Returns the number of bearings done.
+ */
+__attribute__((target("avx2")))
+static size_t gd_bearing_avx2(double *bearing,
+        const double *lat1, const double *lon1,
+        const double *lat2, const double *lon2, size_t n)
+{
+    __m256d rad = _mm256_set1_pd(GD_RAD);
+    __m256d deg = _mm256_set1_pd(GD_DEG);
+    __m256d full = _mm256_set1_pd(360);
+    __m256d zero = _mm256_setzero_pd();
+
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m256d s1, c1, s2, c2, sdl, cdl;
+
+        gd_sincos_avx2(_mm256_mul_pd(_mm256_loadu_pd(lat1 + i), rad),
+                &s1, &c1);
+        gd_sincos_avx2(_mm256_mul_pd(_mm256_loadu_pd(lat2 + i), rad),
+                &s2, &c2);
+        gd_sincos_avx2(_mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(lon2 + i),
+                        _mm256_loadu_pd(lon1 + i)), rad), &sdl, &cdl);
+
+        __m256d y = _mm256_mul_pd(sdl, c2);
+        __m256d x = _mm256_sub_pd(_mm256_mul_pd(c1, s2),
+                _mm256_mul_pd(_mm256_mul_pd(s1, c2), cdl));
+        __m256d b = _mm256_mul_pd(gd_atan2_avx2(y, x), deg);
+
+        b = _mm256_blendv_pd(b, _mm256_add_pd(b, full),
+                _mm256_cmp_pd(b, zero, _CMP_LT_OQ));
+
+        _mm256_storeu_pd(bearing + i, b);
+    }
+
+    return i;
+}
+
+/*
+ * AVX2 version of gdDestinationMany(). Returns the number of points done.
+ */
+__attribute__((target("avx2")))
+static size_t gd_destination_avx2(double *lat2, double *lon2,
+        const double *lat, const double *lon,
+        const double *bearing, const double *distance, size_t n)
+{
+    __m256d rad = _mm256_set1_pd(GD_RAD);
+    __m256d deg = _mm256_set1_pd(GD_DEG);
+    __m256d one = _mm256_set1_pd(1);
+    __m256d radius = _mm256_set1_pd(GD_EARTH_RADIUS);
+
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m256d s1, c1, sb, cb, sd, cd;
+
+        gd_sincos_avx2(_mm256_mul_pd(_mm256_loadu_pd(lat + i), rad),
+                &s1, &c1);
+        gd_sincos_avx2(_mm256_mul_pd(_mm256_loadu_pd(bearing + i), rad),
+                &sb, &cb);
+        gd_sincos_avx2(_mm256_div_pd(_mm256_loadu_pd(distance + i), radius),
+                &sd, &cd);
+
+        __m256d s2 = _mm256_add_pd(_mm256_mul_pd(s1, cd),
+                _mm256_mul_pd(_mm256_mul_pd(c1, sd), cb));
+        __m256d w = _mm256_mul_pd(_mm256_sub_pd(one, s2),
+                _mm256_add_pd(one, s2));
+
+        w = _mm256_and_pd(w, _mm256_cmp_pd(w, _mm256_setzero_pd(),
+                    _CMP_GT_OQ));
+
+        __m256d dl = gd_atan2_avx2(
+                _mm256_mul_pd(_mm256_mul_pd(sb, sd), c1),
+                _mm256_sub_pd(cd, _mm256_mul_pd(s1, s2)));
+        __m256d l2 = _mm256_add_pd(_mm256_loadu_pd(lon + i),
+                _mm256_mul_pd(dl, deg));
+
+        _mm256_storeu_pd(lat2 + i,
+                _mm256_mul_pd(gd_atan2_avx2(s2, _mm256_sqrt_pd(w)), deg));
+        _mm256_storeu_pd(lon2 + i, _mm256_sub_pd(l2,
+                    _mm256_mul_pd(_mm256_set1_pd(360), _mm256_floor_pd(
+                            _mm256_mul_pd(_mm256_add_pd(l2,
+                                    _mm256_set1_pd(180)),
+                                _mm256_set1_pd(1.0 / 360))))));
+    }
+
+    return i;
+}
+
+/*
+ * AVX2 version of gd_to_ecef(), for the four points at <lat>, <lon> and
+ * <alt>.
+ */
+__attribute__((target("avx2")))
+static inline void gd_to_ecef_avx2(const double *lat, const double *lon,
+        const double *alt, __m256d *x, __m256d *y, __m256d *z)
+{
+    __m256d sp, cp, sl, cl;
+
+    gd_sincos_avx2(_mm256_mul_pd(_mm256_loadu_pd(lat),
+                _mm256_set1_pd(GD_RAD)), &sp, &cp);
+    gd_sincos_avx2(_mm256_mul_pd(_mm256_loadu_pd(lon),
+                _mm256_set1_pd(GD_RAD)), &sl, &cl);
+
+    __m256d h = _mm256_loadu_pd(alt);
+    __m256d N = _mm256_div_pd(_mm256_set1_pd(GD_WGS84_A),
+            _mm256_sqrt_pd(_mm256_sub_pd(_mm256_set1_pd(1), _mm256_mul_pd(
+                        _mm256_mul_pd(_mm256_set1_pd(GD_WGS84_E2), sp), sp))));
+    __m256d r = _mm256_mul_pd(_mm256_add_pd(N, h), cp);
+
+    *x = _mm256_mul_pd(r, cl);
+    *y = _mm256_mul_pd(r, sl);
+    *z = _mm256_mul_pd(_mm256_add_pd(_mm256_mul_pd(N,
+                    _mm256_set1_pd(1 - GD_WGS84_E2)), h), sp);
+}
+
+/*
+ * AVX2 version of gdToECEFMany(). Returns the number of points done.
+ */
+__attribute__((target("avx2")))
+static size_t gd_to_ecef_many_avx2(double *x, double *y, double *z,
+        const double *lat, const double *lon, const double *alt, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m256d vx, vy, vz;
+
+        gd_to_ecef_avx2(lat + i, lon + i, alt + i, &vx, &vy, &vz);
+
+        _mm256_storeu_pd(x + i, vx);
+        _mm256_storeu_pd(y + i, vy);
+        _mm256_storeu_pd(z + i, vz);
+    }
+
+    return i;
+}
+
+/*
+ * AVX2 version of gdToENUMany(). Returns the number of points done.
+ */
+__attribute__((target("avx2")))
+static size_t gd_to_enu_many_avx2(double *e, double *n, double *u,
+        const GdFrame *frame,
+        const double *lat, const double *lon, const double *alt,
+        size_t count)
+{
+    size_t i;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        __m256d x, y, z;
+
+        gd_to_ecef_avx2(lat + i, lon + i, alt + i, &x, &y, &z);
+
+        __m256d dx = _mm256_sub_pd(x, _mm256_set1_pd(frame->x0));
+        __m256d dy = _mm256_sub_pd(y, _mm256_set1_pd(frame->y0));
+        __m256d dz = _mm256_sub_pd(z, _mm256_set1_pd(frame->z0));
+
+        _mm256_storeu_pd(e + i, _mm256_add_pd(
+                    _mm256_mul_pd(_mm256_set1_pd(frame->ex), dx),
+                    _mm256_mul_pd(_mm256_set1_pd(frame->ey), dy)));
+        _mm256_storeu_pd(n + i, _mm256_add_pd(_mm256_add_pd(
+                        _mm256_mul_pd(_mm256_set1_pd(frame->nx), dx),
+                        _mm256_mul_pd(_mm256_set1_pd(frame->ny), dy)),
+                    _mm256_mul_pd(_mm256_set1_pd(frame->nz), dz)));
+        _mm256_storeu_pd(u + i, _mm256_add_pd(_mm256_add_pd(
+                        _mm256_mul_pd(_mm256_set1_pd(frame->ux), dx),
+                        _mm256_mul_pd(_mm256_set1_pd(frame->uy), dy)),
+                    _mm256_mul_pd(_mm256_set1_pd(frame->uz), dz)));
+    }
+
+    return i;
+}
+
+#endif
+
+/*
+ * Return the great-circle distance between (<lat1>, <lon1>) and (<lat2>,
+ * <lon2>), using the haversine formula.
+ */
+double gdDistance(double lat1, double lon1, double lat2, double lon2)
+{
+    double sdp = sin((lat2 - lat1) * (0.5 * GD_RAD));
+    double sdl = sin((lon2 - lon1) * (0.5 * GD_RAD));
+
+    double h = sdp * sdp + cos(lat1 * GD_RAD) * cos(lat2 * GD_RAD) * sdl * sdl;
+    double w = 1 - h;
+
+    if (!(w > 0)) w = 0;
+
+    return 2 * GD_EARTH_RADIUS * atan2(sqrt(h), sqrt(w));
+}
+
+/*
+ * Return the initial bearing (between 0 and 360 degrees) on the great circle
+ * from (<lat1>, <lon1>) to (<lat2>, <lon2>).
+ */
+double gdBearing(double lat1, double lon1, double lat2, double lon2)
+{
+    double p1 = lat1 * GD_RAD, p2 = lat2 * GD_RAD;
+    double dl = (lon2 - lon1) * GD_RAD;
+
+    double b = atan2(sin(dl) * cos(p2),
+            cos(p1) * sin(p2) - sin(p1) * cos(p2) * cos(dl)) * GD_DEG;
+
+    return b < 0 ? b + 360 : b;
+}
+
+/*
+ * Find the point at <distance> from (<lat>, <lon>) along the great circle
+ * with initial bearing <bearing>, and put its latitude and longitude (between
+ * -180 and 180 degrees) in <lat2> and <lon2>.
+ */
+void gdDestination(double lat, double lon, double bearing, double distance,
+        double *lat2, double *lon2)
+{
+    double p1 = lat * GD_RAD, b = bearing * GD_RAD;
+    double d = distance / GD_EARTH_RADIUS;
+
+    double s2 = sin(p1) * cos(d) + cos(p1) * sin(d) * cos(b);
+
+    if (s2 > 1) s2 = 1;
+    else if (s2 < -1) s2 = -1;
+
+    double l2 = lon + atan2(sin(b) * sin(d) * cos(p1),
+            cos(d) - sin(p1) * s2) * GD_DEG;
+
+    *lat2 = asin(s2) * GD_DEG;
+    *lon2 = fmod(fmod(l2 + 180, 360) + 360, 360) - 180;
+}
+
+/*
+ * Convert latitude <lat>, longitude <lon> and altitude <alt> to ECEF
+ * coordinates, and put them in <x>, <y> and <z>.
+ */
+void gdToECEF(double lat, double lon, double alt,
+        double *x, double *y, double *z)
+{
+    double sp = sin(lat * GD_RAD), cp = cos(lat * GD_RAD);
+    double sl = sin(lon * GD_RAD), cl = cos(lon * GD_RAD);
+
+    double N = GD_WGS84_A / sqrt(1 - GD_WGS84_E2 * sp * sp);
+
+    *x = (N + alt) * cp * cl;
+    *y = (N + alt) * cp * sl;
+    *z = (N * (1 - GD_WGS84_E2) + alt) * sp;
+}
+
+/*
+ * Convert latitude <lat>, longitude <lon> and altitude <alt> to ENU
+ * coordinates relative to the point at (<lat0>, <lon0>, <alt0>), and put them
+ * in <e>, <n> and <u>.
+ */
+void gdToENU(double lat0, double lon0, double alt0,
+        double lat, double lon, double alt,
+        double *e, double *n, double *u)
+{
+    GdFrame frame;
+    double x, y, z;
+
+    gd_frame(&frame, lat0, lon0, alt0);
+
+    gdToECEF(lat, lon, alt, &x, &y, &z);
+
+    gd_ecef_to_enu(&frame, x, y, z, e, n, u);
+}
+
+/*
+ * Set dist[i] to the great-circle distance between (lat1[i], lon1[i]) and
+ * (lat2[i], lon2[i]), for all 0 <= i < <n>.
+ */
+void gdDistanceMany(double *dist,
+        const double *lat1, const double *lon1,
+        const double *lat2, const double *lon2, size_t n)
+{
+    size_t i = 0;
+
+#if defined(__x86_64__)
+    if (simdLevel() == SIMD_AVX2) {
+        i = gd_distance_avx2(dist, lat1, lon1, lat2, lon2, n);
+    }
+#endif
+
+    for (; i < n; i++) {
+        dist[i] = gd_distance(lat1[i], lon1[i], lat2[i], lon2[i]);
+    }
+}
+
+/*
+ * Set bearing[i] to the initial bearing on the great circle from (lat1[i],
+ * lon1[i]) to (lat2[i], lon2[i]), for all 0 <= i < <n>.
+ */
+void gdBearingMany(double *bearing,
+        const double *lat1, const double *lon1,
+        const double *lat2, const double *lon2, size_t n)
+{
+    size_t i = 0;
+
+#if defined(__x86_64__)
+    if (simdLevel() == SIMD_AVX2) {
+        i = gd_bearing_avx2(bearing, lat1, lon1, lat2, lon2, n);
+    }
+#endif
+
+    for (; i < n; i++) {
+        bearing[i] = gd_bearing(lat1[i], lon1[i], lat2[i], lon2[i]);
+    }
+}
+
+/*
+ * Set (lat2[i], lon2[i]) to the point at distance[i] from (lat[i], lon[i])
+ * along the great circle with initial bearing bearing[i], for all 0 <= i <
+ * <n>.
+ */
+void gdDestinationMany(double *lat2, double *lon2,
+        const double *lat, const double *lon,
+        const double *bearing, const double *distance, size_t n)
+{
+    size_t i = 0;
+
+#if defined(__x86_64__)
+    if (simdLevel() == SIMD_AVX2) {
+        i = gd_destination_avx2(lat2, lon2, lat, lon, bearing, distance, n);
+    }
+#endif
+
+    for (; i < n; i++) {
+        gd_destination(lat[i], lon[i], bearing[i], distance[i],
+                &lat2[i], &lon2[i]);
+    }
+}
+
+/*
+ * Convert the <n> points in <lat>, <lon> and <alt> to ECEF coordinates and
+ * put them in <x>, <y> and <z>.
+ */
+void gdToECEFMany(double *x, double *y, double *z,
+        const double *lat, const double *lon, const double *alt, size_t n)
+{
+    size_t i = 0;
+
+#if defined(__x86_64__)
+    if (simdLevel() == SIMD_AVX2) {
+        i = gd_to_ecef_many_avx2(x, y, z, lat, lon, alt, n);
+    }
+#endif
+
+    for (; i < n; i++) {
+        gd_to_ecef(lat[i], lon[i], alt[i], &x[i], &y[i], &z[i]);
+    }
+}
+
+/*
+ * Convert the <count> points in <lat>, <lon> and <alt> to ENU coordinates
+ * relative to the point at (<lat0>, <lon0>, <alt0>) and put them in <e>, <n>
+ * and <u>.
+ */
+void gdToENUMany(double *e, double *n, double *u,
+        double lat0, double lon0, double alt0,
+        const double *lat, const double *lon, const double *alt,
+        size_t count)
+{
+    GdFrame frame;
+    size_t i = 0;
+
+    gd_frame(&frame, lat0, lon0, alt0);
+
+#if defined(__x86_64__)
+    if (simdLevel() == SIMD_AVX2) {
+        i = gd_to_enu_many_avx2(e, n, u, &frame, lat, lon, alt, count);
+    }
+#endif
+
+    for (; i < count; i++) {
+        double x, y, z;
+
+        gd_to_ecef(lat[i], lon[i], alt[i], &x, &y, &z);
+        gd_ecef_to_enu(&frame, x, y, z, &e[i], &n[i], &u[i]);
+    }
+}
+
+#ifdef TEST
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+
+static int errors = 0;
+
+#define N 10000
+
+/*
+ * Return a random number between <min> and <max>.
+ */
+static double random_between(double min, double max)
+{
+    return min + (max - min) * random() / RAND_MAX;
+}
+
+/*
+ * Return the difference between angles <a> and <b> (in degrees), taking
+ * wrap-around into account.
+ */
+static double angle_diff(double a, double b)
+{
+    double d = fmod(fabs(a - b), 360);
+
+    return d > 180 ? 360 - d : d;
+}
+
+/*
+ * Return the error in <approx>, an approximation of <exact>, in units in the
+ * last place.
+ */
+static double ulps(double approx, double exact)
+{
+    double ulp = nextafter(fabs(exact), INFINITY) - fabs(exact);
+
+    return fabs(approx - exact) / ulp;
+}
+
+/*
+ * Save the <n> results in <out> in <ref> if <level> is SIMD_NONE, otherwise
+ * make sure that they're the same as the ones saved earlier.
+ */
+static void check_level(int level, double *ref, const double *out, size_t n)
+{
+    if (level == SIMD_NONE)
+        memcpy(ref, out, n * sizeof(double));
+    else
+        make_sure_that(memcmp(ref, out, n * sizeof(double)) == 0);
+}
+
+int main(void)
+{
+    double x, y, z, e, n, u, lat, lon;
+    int i, level;
+
+    srandom(1);
+
+    /* Scalar reference versions. */
+
+    make_sure_that(close_to(gdDistance(0, 0, 0, 90),
+                GD_EARTH_RADIUS * M_PI / 2));
+    make_sure_that(close_to(gdDistance(90, 0, -90, 0),
+                GD_EARTH_RADIUS * M_PI));
+    make_sure_that(gdDistance(52, 4, 52, 4) == 0);
+
+    make_sure_that(close_to(gdBearing(0, 0, 0, 90), 90));
+    make_sure_that(close_to(gdBearing(0, 0, 10, 0), 0));
+    make_sure_that(close_to(gdBearing(0, 0, 0, -90), 270));
+    make_sure_that(close_to(gdBearing(0, 0, -10, 0), 180));
+
+    gdDestination(0, 179, 90, GD_EARTH_RADIUS * 2 * GD_RAD, &lat, &lon);
+
+    make_sure_that(fabs(lat) < 1e-12);
+    make_sure_that(close_to(lon, -179));
+
+    gdToECEF(0, 0, 0, &x, &y, &z);
+
+    make_sure_that(close_to(x, GD_WGS84_A));
+    make_sure_that(fabs(y) < 1e-6 && fabs(z) < 1e-6);
+
+    gdToECEF(90, 0, 0, &x, &y, &z);
+
+    make_sure_that(fabs(x) < 1e-6 && fabs(y) < 1e-6);
+    make_sure_that(fabs(z - GD_WGS84_A * (1 - GD_WGS84_F)) < 1e-6);
+
+    gdToENU(52, 4, 10, 52, 4, 110, &e, &n, &u);
+
+    make_sure_that(fabs(e) < 1e-6 && fabs(n) < 1e-6);
+    make_sure_that(fabs(u - 100) < 1e-6);
+
+    gdToENU(52, 4, 0, 52.001, 4, 0, &e, &n, &u);
+
+    make_sure_that(fabs(e) < 1e-6);
+    make_sure_that(n > 111 && n < 112);
+
+    /* The approximations of sin, cos and atan2. */
+
+    double max_sincos = 0, max_atan2 = 0;
+
+    for (i = 0; i < 100000; i++) {
+        double a = random_between(-1e6, 1e6) / (i % 2 ? 1 : 1e5);
+        double s, c;
+
+        gd_sincos(a, &s, &c);
+
+        max_sincos = fmax(max_sincos, ulps(s, sin(a)));
+        max_sincos = fmax(max_sincos, ulps(c, cos(a)));
+
+        double ya = random_between(-1, 1) * (i % 3 ? 1 : 1e-3);
+        double xa = random_between(-1, 1);
+
+        max_atan2 = fmax(max_atan2, ulps(gd_atan2(ya, xa), atan2(ya, xa)));
+    }
+
+    make_sure_that(max_sincos <= 2);
+    make_sure_that(max_atan2 <= 2);
+
+    make_sure_that(gd_atan2(0, 0) == 0);
+    make_sure_that(gd_atan2(0, -1) == M_PI);
+    make_sure_that(gd_atan2(1, 0) == M_PI_2);
+    make_sure_that(gd_atan2(-1, 0) == -M_PI_2);
+
+    /* Batch versions. N is not a multiple of 4, to exercise the tails. */
+
+    const size_t count = N - 3;
+
+    double *in  = calloc(7 * N, sizeof(double));
+    double *out = calloc(3 * N, sizeof(double));
+    double *ref = calloc(10 * N, sizeof(double));
+
+    double *lat1 = in,         *lon1 = in + N;
+    double *lat2 = in + 2 * N, *lon2 = in + 3 * N;
+    double *alt  = in + 4 * N, *brg  = in + 5 * N, *dist = in + 6 * N;
+
+    for (i = 0; i < N; i++) {
+        lat1[i] = random_between(-90, 90);
+        lon1[i] = random_between(-180, 180);
+        lat2[i] = i % 4 ? random_between(-90, 90) : lat1[i] + 1e-6;
+        lon2[i] = i % 4 ? random_between(-180, 180) : lon1[i] - 1e-6;
+        alt[i]  = random_between(-100, 10000);
+        brg[i]  = random_between(0, 360);
+        dist[i] = random_between(0, 2e7);
+    }
+
+    /* The pole and the date line are a bit special. */
+
+    lat1[1] = 90;  lat2[2] = -90;
+    lon1[3] = 180; lon2[3] = -180;
+
+    for (level = SIMD_NONE; level <= SIMD_AVX2; level++) {
+        simdSetLevel(level);
+
+        /* Check each function against its reference version, and check that
+         * all instruction sets give exactly the same results. */
+
+        gdDistanceMany(out, lat1, lon1, lat2, lon2, count);
+
+        for (i = 0; i < (int) count; i++) {
+            make_sure_that(fabs(out[i] -
+                        gdDistance(lat1[i], lon1[i], lat2[i], lon2[i])) < 1e-5);
+        }
+
+        check_level(level, ref, out, count);
+
+        gdBearingMany(out, lat1, lon1, lat2, lon2, count);
+
+        for (i = 0; i < (int) count; i++) {
+            double d = gdDistance(lat1[i], lon1[i], lat2[i], lon2[i]);
+
+            make_sure_that(out[i] >= 0 && out[i] <= 360);
+            make_sure_that(angle_diff(out[i],
+                        gdBearing(lat1[i], lon1[i], lat2[i], lon2[i]))
+                    * GD_RAD * d < 1e-6);
+        }
+
+        check_level(level, ref + N, out, count);
+
+        gdDestinationMany(out, out + N, lat1, lon1, brg, dist, count);
+
+        for (i = 0; i < (int) count; i++) {
+            gdDestination(lat1[i], lon1[i], brg[i], dist[i], &lat, &lon);
+
+            make_sure_that(fabs(out[i] - lat) < 1e-9);
+            make_sure_that(out[N + i] >= -180 && out[N + i] < 180);
+            make_sure_that(angle_diff(out[N + i], lon)
+                    * cos(lat * GD_RAD) < 1e-9);
+        }
+
+        check_level(level, ref + 2 * N, out, N + count);
+
+        gdToECEFMany(out, out + N, out + 2 * N, lat1, lon1, alt, count);
+
+        for (i = 0; i < (int) count; i++) {
+            gdToECEF(lat1[i], lon1[i], alt[i], &x, &y, &z);
+
+            make_sure_that(fabs(out[i] - x) < 1e-6);
+            make_sure_that(fabs(out[N + i] - y) < 1e-6);
+            make_sure_that(fabs(out[2 * N + i] - z) < 1e-6);
+        }
+
+        check_level(level, ref + 4 * N, out, 3 * N);
+
+        gdToENUMany(out, out + N, out + 2 * N, 52, 4, 10,
+                lat2, lon2, alt, count);
+
+        for (i = 0; i < (int) count; i++) {
+            gdToENU(52, 4, 10, lat2[i], lon2[i], alt[i], &e, &n, &u);
+
+            make_sure_that(fabs(out[i] - e) < 1e-6);
+            make_sure_that(fabs(out[N + i] - n) < 1e-6);
+            make_sure_that(fabs(out[2 * N + i] - u) < 1e-6);
+        }
+
+        check_level(level, ref + 7 * N, out, 3 * N);
+    }
+
+    free(in);
+    free(out);
+    free(ref);
+
+    return errors;
+}
+#endif
+
+#ifdef BENCH
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define N       1000000
+#define ROUNDS  10
+
+/*
+ * Report the time it took (since <start>) to calculate N * ROUNDS distances
+ * with method <what>. <out> is used to make sure the results are used.
+ */
+static void report(const char *what, double start, const double *out)
+{
+    double elapsed = dnow() - start;
+
+    printf("%-28s %8.1f Mpairs/s (check %g)\n",
+            what, N * ROUNDS / elapsed / 1e6, out[N / 2]);
+}
+
+int main(void)
+{
+    double *in  = calloc(4 * N, sizeof(double));
+    double *out = calloc(N, sizeof(double));
+
+    double *lat1 = in,         *lon1 = in + N;
+    double *lat2 = in + 2 * N, *lon2 = in + 3 * N;
+
+    int round, level, i;
+    char what[32];
+    double start;
+
+    for (i = 0; i < N; i++) {
+        lat1[i] = -90  + 180.0 * random() / RAND_MAX;
+        lon1[i] = -180 + 360.0 * random() / RAND_MAX;
+        lat2[i] = -90  + 180.0 * random() / RAND_MAX;
+        lon2[i] = -180 + 360.0 * random() / RAND_MAX;
+    }
+
+    start = dnow();
+
+    for (round = 0; round < ROUNDS; round++) {
+        for (i = 0; i < N; i++) {
+            out[i] = gdDistance(lat1[i], lon1[i], lat2[i], lon2[i]);
+        }
+    }
+
+    report("gdDistance", start, out);
+
+    for (level = SIMD_NONE; level <= SIMD_AVX2; level++) {
+        if (simdSetLevel(level) != (SimdLevel) level) continue;
+
+        snprintf(what, sizeof(what), "gdDistanceMany (%s)",
+                simdLevelName(level));
+
+        start = dnow();
+
+        for (round = 0; round < ROUNDS; round++) {
+            gdDistanceMany(out, lat1, lon1, lat2, lon2, N);
+        }
+
+        report(what, start, out);
+    }
+
+    start = dnow();
+
+    for (round = 0; round < ROUNDS; round++) {
+        for (i = 0; i < N; i++) {
+            out[i] = gdBearing(lat1[i], lon1[i], lat2[i], lon2[i]);
+        }
+    }
+
+    report("gdBearing", start, out);
+
+    for (level = SIMD_NONE; level <= SIMD_AVX2; level++) {
+        if (simdSetLevel(level) != (SimdLevel) level) continue;
+
+        snprintf(what, sizeof(what), "gdBearingMany (%s)",
+                simdLevelName(level));
+
+        start = dnow();
+
+        for (round = 0; round < ROUNDS; round++) {
+            gdBearingMany(out, lat1, lon1, lat2, lon2, N);
+        }
+
+        report(what, start, out);
+    }
+
+    free(in);
+    free(out);
+
+    return 0;
+}
+#endif
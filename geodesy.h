@@ -0,0 +1,140 @@
+#ifndef GEODESY_H
+#define GEODESY_H
+
+/*
+ * geodesy.h: Distances, bearings and coordinate conversions on the earth.
+ *
+ * Latitudes, longitudes and bearings are in degrees, distances and altitudes
+ * in meters. Distances, bearings and destinations are calculated on a sphere
+ * with radius GD_EARTH_RADIUS, conversions to earth-centered, earth-fixed
+ * (ECEF) and local east-north-up (ENU) coordinates use the WGS84 ellipsoid.
+ *
+ * Every calculation comes in two versions: one for a single point (or pair of
+ * points) that uses the sin(), cos() and atan2() functions from the C library,
+ * and a batch version for arrays of points that uses polynomial
+ * approximations of those functions, four points at a time if AVX2 is
+ * available (see simd.h). The approximations of sine and cosine are accurate
+ * to within 2 units in the last place (ulp) for arguments up to 1e6 radians,
+ * and the approximation of atan2 to within 2 ulp. Batch results are the same
+ * whichever instruction set is used, and differ from the single-point
+ * versions by at most:
+ *
+ * - 1e-5 meters for distances and 1e-6 meters for ECEF or ENU coordinates;
+ * - 1e-6 meters divided by the distance between the points, in radians, for
+ *   bearings (so 1e-9 degrees for points that are 100 km apart, but more for
+ *   points that are very close together, where the bearing itself becomes
+ *   ill-conditioned);
+ * - 1e-9 degrees for the latitudes of destinations, and 1e-9 degrees divided
+ *   by the cosine of the latitude for their longitudes.
+ *
+ * Inputs are expected to be in the usual ranges (-90 to 90 for latitudes,
+ * and -180 to 180 or 0 to 360 for longitudes and bearings).
+ *
+ * geodesy.h is part of libjvs.
+ *
+ * Copyright: (c) 2026 Jacco van Schaik (jacco@jaccovanschaik.net)
+ * Created:   2026-10-18
+ * Version:   $Id$
+ *
+ * This software is distributed under the terms of the MIT license. See
+ * http://www.opensource.org/licenses/mit-license.php for details.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/* Mean radius of the earth, in meters. */
+
+#define GD_EARTH_RADIUS 6371008.8
+
+/* Semi-major axis and flattening of the WGS84 ellipsoid. */
+
+#define GD_WGS84_A      6378137.0
+#define GD_WGS84_F      (1 / 298.257223563)
+
+/*
+ * Return the great-circle distance between (<lat1>, <lon1>) and (<lat2>,
+ * <lon2>), using the haversine formula.
+ */
+double gdDistance(double lat1, double lon1, double lat2, double lon2);
+
+/*
+ * Return the initial bearing (between 0 and 360 degrees) on the great circle
+ * from (<lat1>, <lon1>) to (<lat2>, <lon2>).
+ */
+double gdBearing(double lat1, double lon1, double lat2, double lon2);
+
+/*
+ * Find the point at <distance> from (<lat>, <lon>) along the great circle
+ * with initial bearing <bearing>, and put its latitude and longitude (between
+ * -180 and 180 degrees) in <lat2> and <lon2>.
+ */
+void gdDestination(double lat, double lon, double bearing, double distance,
+        double *lat2, double *lon2);
+
+/*
+ * Convert latitude <lat>, longitude <lon> and altitude <alt> to ECEF
+ * coordinates, and put them in <x>, <y> and <z>.
+ */
+void gdToECEF(double lat, double lon, double alt,
+        double *x, double *y, double *z);
+
+/*
+ * Convert latitude <lat>, longitude <lon> and altitude <alt> to ENU
+ * coordinates relative to the point at (<lat0>, <lon0>, <alt0>), and put them
+ * in <e>, <n> and <u>.
+ */
+void gdToENU(double lat0, double lon0, double alt0,
+        double lat, double lon, double alt,
+        double *e, double *n, double *u);
+
+/*
+ * Set dist[i] to the great-circle distance between (lat1[i], lon1[i]) and
+ * (lat2[i], lon2[i]), for all 0 <= i < <n>.
+ */
+void gdDistanceMany(double *dist,
+        const double *lat1, const double *lon1,
+        const double *lat2, const double *lon2, size_t n);
+
+/*
+ * Set bearing[i] to the initial bearing on the great circle from (lat1[i],
+ * lon1[i]) to (lat2[i], lon2[i]), for all 0 <= i < <n>.
+ */
+void gdBearingMany(double *bearing,
+        const double *lat1, const double *lon1,
+        const double *lat2, const double *lon2, size_t n);
+
+/*
+ * Set (lat2[i], lon2[i]) to the point at distance[i] from (lat[i], lon[i])
+ * along the great circle with initial bearing bearing[i], for all 0 <= i <
+ * <n>.
+ */
+void gdDestinationMany(double *lat2, double *lon2,
+        const double *lat, const double *lon,
+        const double *bearing, const double *distance, size_t n);
+
+/*
+ * Convert the <n> points in <lat>, <lon> and <alt> to ECEF coordinates and
+ * put them in <x>, <y> and <z>.
+ */
+void gdToECEFMany(double *x, double *y, double *z,
+        const double *lat, const double *lon, const double *alt, size_t n);
+
+/*
+ * Convert the <count> points in <lat>, <lon> and <alt> to ENU coordinates
+ * relative to the point at (<lat0>, <lon0>, <alt0>) and put them in <e>, <n>
+ * and <u>.
+ */
+void gdToENUMany(double *e, double *n, double *u,
+        double lat0, double lon0, double alt0,
+        const double *lat, const double *lon, const double *alt,
+        size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
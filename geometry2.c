@@ -9,11 +9,27 @@
  * http://www.opensource.org/licenses/mit-license.php for details.
  */
 
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "defs.h"
+#include "simd.h"
 #include "vector2.h"
 #include "matrix2.h"
 
 #include "geometry2.h"
 
+/*
+ * Number of points or circles that the batch functions convert to a
+ * "structure of arrays" at a time.
+ */
+#define G2_CHUNK 256
+
 /*                _   _       _
  * If line <l> is l = s + n * d, this returns the <n> where line <l>
  * intersects line <m>. The result might be +/- infinity (if the lines are
@@ -62,3 +78,1040 @@ Vector2 g2PointLineProjection(Vector2 p, Line2 l)
 
     return v2Sum(l.pv, v2Scaled(l.dv, mult));
 }
+
+/*                _   _       _
+ * If line <l> is l = s + n * d, this sets <r1> and <r2> to the values of <n>
+ * where <l> intersects circle <c> and returns the number of intersections (0,
+ * 1 or 2). <r1> and <r2> may be NULL.
+ */
+int g2CircleLineIntersect(Circle2 c, Line2 l, double *r1, double *r2)
+{
+    double px = l.pv.r[0] - c.c.r[0];
+    double py = l.pv.r[1] - c.c.r[1];
+    double dx = l.dv.r[0];
+    double dy = l.dv.r[1];
+
+    double A = dx * dx + dy * dy;
+    double B = 2 * (px * dx + py * dy);
+    double C = (px * px + py * py) - c.r * c.r;
+
+    double discr = B * B - 4 * A * C;
+
+    if (discr < 0) return 0;
+
+    double root = sqrt(discr);
+
+    if (r1) *r1 = (-B - root) / (2 * A);
+    if (r2) *r2 = (-B + root) / (2 * A);
+
+    return discr == 0 ? 1 : 2;
+}
+
+#if defined(__x86_64__)
+
+/*
+ * Intersect line <l> with the circles whose centers are in <cx> and <cy> and
+ * whose radii are in <radius>, four at a time, for as long as possible. Hits
+ * are added to <hit>, numbered from <first>, and their number is added to
+ * <n_hits>. Returns the number of circles done.
+ */
+__attribute__((target("avx2")))
+static size_t g2_circle_line_avx2(Circle2Hit *hit, size_t *n_hits, Line2 l,
+        const double *cx, const double *cy, const double *radius,
+        size_t n, size_t first)
+{
+    double dx = l.dv.r[0], dy = l.dv.r[1];
+    double A = dx * dx + dy * dy;
+
+    __m256d pvx = _mm256_set1_pd(l.pv.r[0]);
+    __m256d pvy = _mm256_set1_pd(l.pv.r[1]);
+    __m256d vdx = _mm256_set1_pd(dx);
+    __m256d vdy = _mm256_set1_pd(dy);
+    __m256d two = _mm256_set1_pd(2);
+    __m256d four_a = _mm256_set1_pd(4 * A);
+    __m256d two_a = _mm256_set1_pd(2 * A);
+    __m256d zero = _mm256_setzero_pd();
+
+    double r1[4], r2[4];
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m256d px = _mm256_sub_pd(pvx, _mm256_loadu_pd(cx + i));
+        __m256d py = _mm256_sub_pd(pvy, _mm256_loadu_pd(cy + i));
+        __m256d r  = _mm256_loadu_pd(radius + i);
+
+        __m256d B = _mm256_mul_pd(two, _mm256_add_pd(
+                    _mm256_mul_pd(px, vdx), _mm256_mul_pd(py, vdy)));
+        __m256d C = _mm256_sub_pd(_mm256_add_pd(
+                    _mm256_mul_pd(px, px), _mm256_mul_pd(py, py)),
+                _mm256_mul_pd(r, r));
+
+        __m256d discr = _mm256_sub_pd(_mm256_mul_pd(B, B),
+                                      _mm256_mul_pd(four_a, C));
+
+        /* Work out the roots for all four, and only then look at which ones
+         * are real. */
+
+        int mask   = _mm256_movemask_pd(_mm256_cmp_pd(discr, zero, _CMP_GE_OQ));
+        int single = _mm256_movemask_pd(_mm256_cmp_pd(discr, zero, _CMP_EQ_OQ));
+
+        if (mask == 0) continue;
+
+        __m256d root = _mm256_sqrt_pd(_mm256_max_pd(discr, zero));
+        __m256d neg_b = _mm256_sub_pd(zero, B);
+
+        _mm256_storeu_pd(r1, _mm256_div_pd(_mm256_sub_pd(neg_b, root), two_a));
+        _mm256_storeu_pd(r2, _mm256_div_pd(_mm256_add_pd(neg_b, root), two_a));
+
+        while (mask != 0) {
+            int k = __builtin_ctz(mask);
+            Circle2Hit *h = &hit[(*n_hits)++];
+
+            mask &= mask - 1;
+
+            h->index = first + i + k;
+            h->count = (single & (1 << k)) ? 1 : 2;
+            h->r1 = r1[k];
+            h->r2 = r2[k];
+        }
+    }
+
+    return i;
+}
+
+#endif
+
+/*
+ * Intersect line <l> with the circles whose centers are in <cx> and <cy> and
+ * whose radii are in <radius>, using the best available instruction set. Hits
+ * are added to <hit>, numbered from <first>, and their number is added to
+ * <n_hits>.
+ */
+static void g2_circle_line(Circle2Hit *hit, size_t *n_hits, Line2 l,
+        const double *cx, const double *cy, const double *radius,
+        size_t n, size_t first)
+{
+    size_t i = 0;
+
+#if defined(__x86_64__)
+    if (simdLevel() == SIMD_AVX2) {
+        i = g2_circle_line_avx2(hit, n_hits, l, cx, cy, radius, n, first);
+    }
+#endif
+
+    for (; i < n; i++) {
+        Circle2 c = { v2Make(cx[i], cy[i]), radius[i] };
+        Circle2Hit *h = &hit[*n_hits];
+
+        if ((h->count = g2CircleLineIntersect(c, l, &h->r1, &h->r2)) > 0) {
+            h->index = first + i;
+            (*n_hits)++;
+        }
+    }
+}
+
+/*
+ * Intersect line <l> with the <n> circles in <c>, and add a Circle2Hit to <hit>
+ * for each circle that it intersects. <hit> must have room for <n> entries.
+ * Returns the number of hits. The results are the same as those of
+ * g2CircleLineIntersect(), but several circles are done at once using SIMD
+ * instructions.
+ */
+size_t g2CircleLineIntersectMany(Circle2Hit *hit, Line2 l,
+        const Circle2 *c, size_t n)
+{
+    double cx[G2_CHUNK], cy[G2_CHUNK], radius[G2_CHUNK];
+    size_t i, j, n_hits = 0;
+
+    for (i = 0; i < n; i += G2_CHUNK) {
+        size_t count = MIN(n - i, G2_CHUNK);
+
+        for (j = 0; j < count; j++) {
+            cx[j] = c[i + j].c.r[0];
+            cy[j] = c[i + j].c.r[1];
+            radius[j] = c[i + j].r;
+        }
+
+        g2_circle_line(hit, &n_hits, l, cx, cy, radius, count, i);
+    }
+
+    return n_hits;
+}
+
+/*
+ * Like g2CircleLineIntersectMany(), but for <n> circles whose centers are in
+ * "structure of arrays" <center> and whose radii are in <radius>.
+ */
+size_t g2CircleLineIntersectArray(Circle2Hit *hit, Line2 l,
+        Vector2Array center, const double *radius, size_t n)
+{
+    size_t n_hits = 0;
+
+    g2_circle_line(hit, &n_hits, l, center.r[0], center.r[1], radius, n, 0);
+
+    return n_hits;
+}
+
+/*
+ * Line segments in "structure of arrays" form, for
+ * g2SegmentSegmentIntersectMany().
+ */
+typedef struct {
+    double *px, *py, *dx, *dy;
+} G2Segments;
+
+/*
+ * Add hit <i>, <j>, <r1>, <r2> to <hit> if there is still room (according to
+ * <max_hits>), and count it in <n_hits>.
+ */
+static inline void g2_add_line_hit(Line2Hit *hit, size_t max_hits,
+        size_t *n_hits, size_t i, size_t j, double r1, double r2)
+{
+    if (*n_hits < max_hits) {
+        hit[*n_hits].i = i;
+        hit[*n_hits].j = j;
+        hit[*n_hits].r1 = r1;
+        hit[*n_hits].r2 = r2;
+    }
+
+    (*n_hits)++;
+}
+
+#if defined(__x86_64__)
+
+/*
+ * Intersect segment <l>, which is number <i>, with the <n> segments in <b>,
+ * four at a time for as long as possible, and add hits to <hit>. Returns the
+ * number of segments in <b> done.
+ */
+__attribute__((target("avx2")))
+static size_t g2_segment_segment_avx2(Line2Hit *hit, size_t max_hits,
+        size_t *n_hits, Line2 l, size_t i, const G2Segments *b, size_t n)
+{
+    __m256d lpx = _mm256_set1_pd(l.pv.r[0]);
+    __m256d lpy = _mm256_set1_pd(l.pv.r[1]);
+    __m256d ldx = _mm256_set1_pd(l.dv.r[0]);
+    __m256d ldy = _mm256_set1_pd(l.dv.r[1]);
+    __m256d zero = _mm256_setzero_pd();
+    __m256d one = _mm256_set1_pd(1);
+
+    double r1[4], r2[4];
+    size_t j;
+
+    for (j = 0; j + 4 <= n; j += 4) {
+        __m256d mpx = _mm256_loadu_pd(b->px + j);
+        __m256d mpy = _mm256_loadu_pd(b->py + j);
+        __m256d mdx = _mm256_loadu_pd(b->dx + j);
+        __m256d mdy = _mm256_loadu_pd(b->dy + j);
+
+        /* The same calculations as g2LineLineIntersect(l, m) and
+         * g2LineLineIntersect(m, l). */
+
+        __m256d num1 = _mm256_sub_pd(
+                _mm256_mul_pd(mdy, _mm256_sub_pd(lpx, mpx)),
+                _mm256_mul_pd(mdx, _mm256_sub_pd(lpy, mpy)));
+        __m256d den1 = _mm256_sub_pd(
+                _mm256_mul_pd(mdx, ldy), _mm256_mul_pd(ldx, mdy));
+
+        __m256d num2 = _mm256_sub_pd(
+                _mm256_mul_pd(ldy, _mm256_sub_pd(mpx, lpx)),
+                _mm256_mul_pd(ldx, _mm256_sub_pd(mpy, lpy)));
+        __m256d den2 = _mm256_sub_pd(
+                _mm256_mul_pd(ldx, mdy), _mm256_mul_pd(mdx, ldy));
+
+        __m256d t = _mm256_div_pd(num1, den1);
+        __m256d u = _mm256_div_pd(num2, den2);
+
+        /* Infinities and NaNs (for parallel segments) fail these tests. */
+
+        __m256d on_both = _mm256_and_pd(
+                _mm256_and_pd(_mm256_cmp_pd(t, zero, _CMP_GE_OQ),
+                              _mm256_cmp_pd(t, one, _CMP_LE_OQ)),
+                _mm256_and_pd(_mm256_cmp_pd(u, zero, _CMP_GE_OQ),
+                              _mm256_cmp_pd(u, one, _CMP_LE_OQ)));
+
+        int mask = _mm256_movemask_pd(on_both);
+
+        if (mask == 0) continue;
+
+        _mm256_storeu_pd(r1, t);
+        _mm256_storeu_pd(r2, u);
+
+        while (mask != 0) {
+            int k = __builtin_ctz(mask);
+
+            mask &= mask - 1;
+
+            g2_add_line_hit(hit, max_hits, n_hits, i, j + k, r1[k], r2[k]);
+        }
+    }
+
+    return j;
+}
+
+#endif
+
+/*
+ * Intersect each of the <n_a> line segments in <a> with each of the <n_b>
+ * segments in <b>, where a segment runs from pv to pv + dv, and add a Line2Hit
+ * to <hit> for each pair that intersects, up to <max_hits>. Returns the total
+ * number of intersecting pairs, which may be more than <max_hits>. The
+ * positions in the hits are the same as those returned by
+ * g2LineLineIntersect() for both segments, and parallel segments never
+ * intersect.
+ */
+size_t g2SegmentSegmentIntersectMany(Line2Hit *hit, size_t max_hits,
+        const Line2 *a, size_t n_a, const Line2 *b, size_t n_b)
+{
+    size_t i, j, n_hits = 0;
+    G2Segments soa;
+
+    bool use_avx2 = (simdLevel() == SIMD_AVX2);
+
+    /* Convert <b> to a "structure of arrays" once, since it is run through
+     * for every segment in <a>. */
+
+    double *buf = malloc(4 * MAX(n_b, 1) * sizeof(double));
+
+    soa.px = buf;
+    soa.py = buf + n_b;
+    soa.dx = buf + 2 * n_b;
+    soa.dy = buf + 3 * n_b;
+
+    for (j = 0; j < n_b; j++) {
+        soa.px[j] = b[j].pv.r[0];
+        soa.py[j] = b[j].pv.r[1];
+        soa.dx[j] = b[j].dv.r[0];
+        soa.dy[j] = b[j].dv.r[1];
+    }
+
+    for (i = 0; i < n_a; i++) {
+        j = 0;
+
+#if defined(__x86_64__)
+        if (use_avx2) {
+            j = g2_segment_segment_avx2(hit, max_hits, &n_hits,
+                    a[i], i, &soa, n_b);
+        }
+#else
+        UNUSED(use_avx2);
+#endif
+
+        for (; j < n_b; j++) {
+            double t = g2LineLineIntersect(a[i], b[j]);
+            double u = g2LineLineIntersect(b[j], a[i]);
+
+            if (t >= 0 && t <= 1 && u >= 0 && u <= 1) {
+                g2_add_line_hit(hit, max_hits, &n_hits, i, j, t, u);
+            }
+        }
+    }
+
+    free(buf);
+
+    return n_hits;
+}
+
+/*
+ * Create a polygon with the <count> corner points in <p>. Free it using
+ * free() when done.
+ */
+Polygon2 *g2PolygonCreate(const Vector2 *p, int count)
+{
+    Polygon2 *poly = malloc(sizeof(Polygon2) + count * sizeof(Vector2));
+
+    poly->count = count;
+
+    memcpy(poly->p, p, count * sizeof(Vector2));
+
+    return poly;
+}
+
+/*
+ * Return the area of polygon <poly>. The area is positive if the corner points
+ * are in counter-clockwise order and negative if they are clockwise. The
+ * polygon must not intersect itself.
+ */
+double g2PolygonArea(const Polygon2 *poly)
+{
+    int i, j;
+    double sum = 0;
+
+    for (i = 0, j = poly->count - 1; i < poly->count; j = i++) {
+        sum += poly->p[j].r[0] * poly->p[i].r[1]
+             - poly->p[i].r[0] * poly->p[j].r[1];
+    }
+
+    return sum / 2;
+}
+
+/*
+ * Return the centroid ("center of mass") of polygon <poly>, which must not
+ * intersect itself. The coefficients of the result are NAN if the polygon has
+ * no area.
+ */
+Vector2 g2PolygonCentroid(const Polygon2 *poly)
+{
+    int i, j;
+    double cx = 0, cy = 0, area = 0;
+
+    if (poly->count == 0) return v2Make(NAN, NAN);
+
+    /* Work relative to the first corner point, to keep rounding errors down
+     * for polygons that are far away from the origin. */
+
+    Vector2 o = poly->p[0];
+
+    for (i = 0, j = poly->count - 1; i < poly->count; j = i++) {
+        double xi = poly->p[i].r[0] - o.r[0], yi = poly->p[i].r[1] - o.r[1];
+        double xj = poly->p[j].r[0] - o.r[0], yj = poly->p[j].r[1] - o.r[1];
+
+        double cross = xj * yi - xi * yj;
+
+        area += cross;
+        cx += (xi + xj) * cross;
+        cy += (yi + yj) * cross;
+    }
+
+    if (area == 0) return v2Make(NAN, NAN);
+
+    return v2Make(o.r[0] + cx / (3 * area), o.r[1] + cy / (3 * area));
+}
+
+/*
+ * Put the lower-left corner of the bounding box of polygon <poly> in <min> and
+ * the upper-right corner in <max>.
+ */
+void g2PolygonBox(const Polygon2 *poly, Vector2 *min, Vector2 *max)
+{
+    int i;
+
+    *min = v2Make(INFINITY, INFINITY);
+    *max = v2Make(-INFINITY, -INFINITY);
+
+    for (i = 0; i < poly->count; i++) {
+        min->r[0] = MIN(min->r[0], poly->p[i].r[0]);
+        min->r[1] = MIN(min->r[1], poly->p[i].r[1]);
+        max->r[0] = MAX(max->r[0], poly->p[i].r[0]);
+        max->r[1] = MAX(max->r[1], poly->p[i].r[1]);
+    }
+}
+
+/*
+ * Compare the points at <p1> and <p2> for qsort(), by x and then by y.
+ */
+static int g2_compare_points(const void *p1, const void *p2)
+{
+    const Vector2 *v1 = p1, *v2 = p2;
+
+    if (v1->r[0] != v2->r[0])
+        return v1->r[0] < v2->r[0] ? -1 : 1;
+    else if (v1->r[1] != v2->r[1])
+        return v1->r[1] < v2->r[1] ? -1 : 1;
+    else
+        return 0;
+}
+
+/*
+ * Return a positive number if <o>, <a> and <b> make a counter-clockwise turn,
+ * a negative number if they make a clockwise turn and 0 if they are on one
+ * line.
+ */
+static double g2_turn(Vector2 o, Vector2 a, Vector2 b)
+{
+    return (a.r[0] - o.r[0]) * (b.r[1] - o.r[1])
+         - (a.r[1] - o.r[1]) * (b.r[0] - o.r[0]);
+}
+
+/*
+ * Return the convex hull of the <count> points in <p>, as a newly allocated
+ * polygon with its corner points in counter-clockwise order, starting at the
+ * lowest, left-most point. Points on the edges of the hull are not included.
+ * Free the polygon using free() when done.
+ */
+Polygon2 *g2ConvexHull(const Vector2 *p, int count)
+{
+    int i, n = 0, lower;
+
+    /* Andrew's monotone chain: sort the points, then build the lower and the
+     * upper half of the hull, dropping points that don't make a left turn. */
+
+    Vector2 *sorted = malloc(count * sizeof(Vector2));
+
+    memcpy(sorted, p, count * sizeof(Vector2));
+
+    qsort(sorted, count, sizeof(Vector2), g2_compare_points);
+
+    Polygon2 *hull = malloc(sizeof(Polygon2) + (2 * count) * sizeof(Vector2));
+
+    for (i = 0; i < count; i++) {
+        while (n >= 2 &&
+               g2_turn(hull->p[n - 2], hull->p[n - 1], sorted[i]) <= 0)
+            n--;
+
+        hull->p[n++] = sorted[i];
+    }
+
+    lower = n + 1;
+
+    for (i = count - 2; i >= 0; i--) {
+        while (n >= lower &&
+               g2_turn(hull->p[n - 2], hull->p[n - 1], sorted[i]) <= 0)
+            n--;
+
+        hull->p[n++] = sorted[i];
+    }
+
+    /* The last point is the same as the first one. */
+
+    if (n > 1) n--;
+
+    /* All points may have been the same. */
+
+    if (n == 2 && g2_compare_points(&hull->p[0], &hull->p[1]) == 0) n = 1;
+
+    hull->count = n;
+
+    free(sorted);
+
+    return realloc(hull, sizeof(Polygon2) + MAX(n, 1) * sizeof(Vector2));
+}
+
+/*
+ * Return true if point <p> is inside polygon <poly>, using the even-odd rule.
+ * Points exactly on the edge of the polygon may be reported as inside or
+ * outside.
+ */
+bool g2PolygonContains(const Polygon2 *poly, Vector2 p)
+{
+    int i, j;
+    bool inside = false;
+
+    double x = p.r[0], y = p.r[1];
+
+    /* Count the edges that a ray from <p> in the positive x direction
+     * crosses. */
+
+    for (i = 0, j = poly->count - 1; i < poly->count; j = i++) {
+        const Vector2 *a = &poly->p[j], *b = &poly->p[i];
+
+        if ((a->r[1] > y) != (b->r[1] > y) &&
+            x < (b->r[0] - a->r[0]) * (y - a->r[1]) / (b->r[1] - a->r[1])
+              + a->r[0]) {
+            inside = !inside;
+        }
+    }
+
+    return inside;
+}
+
+/*
+ * Prepare polygon <poly> for testing many points against it using
+ * g2PolygonEdgesContain() and friends. Free the result using free() when
+ * done.
+ */
+Polygon2Edges *g2PolygonEdgesCreate(const Polygon2 *poly)
+{
+    int i, j;
+
+    Polygon2Edges *edges = malloc(sizeof(Polygon2Edges) +
+            poly->count * sizeof(Polygon2Edge));
+
+    edges->count = poly->count;
+
+    g2PolygonBox(poly, &edges->min, &edges->max);
+
+    for (i = 0, j = poly->count - 1; i < poly->count; j = i++) {
+        const Vector2 *a = &poly->p[j], *b = &poly->p[i];
+        Polygon2Edge *e = &edges->edge[i];
+
+        e->x0 = a->r[0];
+        e->y0 = a->r[1];
+        e->y1 = b->r[1];
+
+        e->slope = a->r[1] == b->r[1] ?
+            0 : (b->r[0] - a->r[0]) / (b->r[1] - a->r[1]);
+    }
+
+    return edges;
+}
+
+/*
+ * Return true if the point at (<x>, <y>) is inside the polygon whose edges are
+ * in <edges>. The test is done exactly the same way by the SIMD versions
+ * below.
+ */
+static bool g2_edges_contain(const Polygon2Edges *edges, double x, double y)
+{
+    int i;
+    bool inside = false;
+
+    if (x < edges->min.r[0] || x > edges->max.r[0] ||
+        y < edges->min.r[1] || y > edges->max.r[1]) {
+        return false;
+    }
+
+    for (i = 0; i < edges->count; i++) {
+        const Polygon2Edge *e = &edges->edge[i];
+
+        double dx = (y - e->y0) * e->slope;
+
+        if (((e->y0 > y) != (e->y1 > y)) & (x < e->x0 + dx)) inside = !inside;
+    }
+
+    return inside;
+}
+
+/*
+ * Return true if point <p> is inside the polygon whose edges are in <edges>,
+ * using the even-odd rule.
+ */
+bool g2PolygonEdgesContain(const Polygon2Edges *edges, Vector2 p)
+{
+    return g2_edges_contain(edges, p.r[0], p.r[1]);
+}
+
+#if defined(__x86_64__)
+
+/*
+ * Test the points in <x> and <y> against the polygon whose edges are in
+ * <edges>, two at a time, for as long as possible. Returns the number of
+ * points done.
+ */
+static size_t g2_edges_contain_sse2(bool *inside, const Polygon2Edges *edges,
+        const double *x, const double *y, size_t n)
+{
+    __m128d min_x = _mm_set1_pd(edges->min.r[0]);
+    __m128d min_y = _mm_set1_pd(edges->min.r[1]);
+    __m128d max_x = _mm_set1_pd(edges->max.r[0]);
+    __m128d max_y = _mm_set1_pd(edges->max.r[1]);
+
+    size_t i;
+    int j;
+
+    for (i = 0; i + 2 <= n; i += 2) {
+        __m128d px = _mm_loadu_pd(x + i);
+        __m128d py = _mm_loadu_pd(y + i);
+
+        __m128d in_box = _mm_and_pd(
+                _mm_and_pd(_mm_cmpge_pd(px, min_x), _mm_cmple_pd(px, max_x)),
+                _mm_and_pd(_mm_cmpge_pd(py, min_y), _mm_cmple_pd(py, max_y)));
+
+        __m128d parity = _mm_setzero_pd();
+
+        if (_mm_movemask_pd(in_box) != 0) {
+            for (j = 0; j < edges->count; j++) {
+                const Polygon2Edge *e = &edges->edge[j];
+
+                __m128d y0 = _mm_set1_pd(e->y0);
+                __m128d y1 = _mm_set1_pd(e->y1);
+
+                __m128d straddle = _mm_xor_pd(_mm_cmpgt_pd(y0, py),
+                                              _mm_cmpgt_pd(y1, py));
+
+                __m128d cross_x = _mm_add_pd(_mm_set1_pd(e->x0),
+                        _mm_mul_pd(_mm_sub_pd(py, y0), _mm_set1_pd(e->slope)));
+
+                parity = _mm_xor_pd(parity,
+                        _mm_and_pd(straddle, _mm_cmplt_pd(px, cross_x)));
+            }
+        }
+
+        int mask = _mm_movemask_pd(_mm_and_pd(parity, in_box));
+
+        inside[i]     = (mask & 1) != 0;
+        inside[i + 1] = (mask & 2) != 0;
+    }
+
+    return i;
+}
+
+/*
+ * Test the points in <x> and <y> against the polygon whose edges are in
+ * <edges>, four at a time, for as long as possible. Returns the number of
+ * points done.
+ */
+__attribute__((target("avx2")))
+static size_t g2_edges_contain_avx2(bool *inside, const Polygon2Edges *edges,
+        const double *x, const double *y, size_t n)
+{
+    __m256d min_x = _mm256_set1_pd(edges->min.r[0]);
+    __m256d min_y = _mm256_set1_pd(edges->min.r[1]);
+    __m256d max_x = _mm256_set1_pd(edges->max.r[0]);
+    __m256d max_y = _mm256_set1_pd(edges->max.r[1]);
+
+    size_t i;
+    int j;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m256d px = _mm256_loadu_pd(x + i);
+        __m256d py = _mm256_loadu_pd(y + i);
+
+        __m256d in_box = _mm256_and_pd(
+                _mm256_and_pd(_mm256_cmp_pd(px, min_x, _CMP_GE_OQ),
+                              _mm256_cmp_pd(px, max_x, _CMP_LE_OQ)),
+                _mm256_and_pd(_mm256_cmp_pd(py, min_y, _CMP_GE_OQ),
+                              _mm256_cmp_pd(py, max_y, _CMP_LE_OQ)));
+
+        __m256d parity = _mm256_setzero_pd();
+
+        if (_mm256_movemask_pd(in_box) != 0) {
+            for (j = 0; j < edges->count; j++) {
+                const Polygon2Edge *e = &edges->edge[j];
+
+                __m256d y0 = _mm256_broadcast_sd(&e->y0);
+                __m256d y1 = _mm256_broadcast_sd(&e->y1);
+
+                __m256d straddle = _mm256_xor_pd(
+                        _mm256_cmp_pd(y0, py, _CMP_GT_OQ),
+                        _mm256_cmp_pd(y1, py, _CMP_GT_OQ));
+
+                __m256d cross_x = _mm256_add_pd(_mm256_broadcast_sd(&e->x0),
+                        _mm256_mul_pd(_mm256_sub_pd(py, y0),
+                                      _mm256_broadcast_sd(&e->slope)));
+
+                parity = _mm256_xor_pd(parity, _mm256_and_pd(straddle,
+                        _mm256_cmp_pd(px, cross_x, _CMP_LT_OQ)));
+            }
+        }
+
+        int mask = _mm256_movemask_pd(_mm256_and_pd(parity, in_box));
+
+        inside[i]     = (mask & 1) != 0;
+        inside[i + 1] = (mask & 2) != 0;
+        inside[i + 2] = (mask & 4) != 0;
+        inside[i + 3] = (mask & 8) != 0;
+    }
+
+    return i;
+}
+
+#endif
+
+/*
+ * Test the <n> points in <x> and <y> against the polygon whose edges are in
+ * <edges>, using the best available instruction set.
+ */
+static void g2_edges_contain_many(bool *inside, const Polygon2Edges *edges,
+        const double *x, const double *y, size_t n)
+{
+    size_t i = 0;
+
+    switch(simdLevel()) {
+#if defined(__x86_64__)
+    case SIMD_AVX2:
+        i = g2_edges_contain_avx2(inside, edges, x, y, n);
+        break;
+    case SIMD_SSE2:
+        i = g2_edges_contain_sse2(inside, edges, x, y, n);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    for (; i < n; i++) inside[i] = g2_edges_contain(edges, x[i], y[i]);
+}
+
+/*
+ * Set inside[i] to true if point p[i] is inside the polygon whose edges are in
+ * <edges>, and to false if it isn't, for all 0 <= i < <n>. Gives the same
+ * results as g2PolygonEdgesContain(), but uses SIMD instructions to test
+ * several points at once.
+ */
+void g2PolygonEdgesContainMany(bool *inside, const Polygon2Edges *edges,
+        const Vector2 *p, size_t n)
+{
+    double x[G2_CHUNK], y[G2_CHUNK];
+    size_t i, j;
+
+    for (i = 0; i < n; i += G2_CHUNK) {
+        size_t count = MIN(n - i, G2_CHUNK);
+
+        for (j = 0; j < count; j++) {
+            x[j] = p[i + j].r[0];
+            y[j] = p[i + j].r[1];
+        }
+
+        g2_edges_contain_many(inside + i, edges, x, y, count);
+    }
+}
+
+/*
+ * Set inside[i] to true if point <i> in <p> is inside the polygon whose edges
+ * are in <edges>, and to false if it isn't, for all 0 <= i < <n>. Like
+ * g2PolygonEdgesContainMany(), but for a "structure of arrays".
+ */
+void g2PolygonEdgesContainArray(bool *inside, const Polygon2Edges *edges,
+        Vector2Array p, size_t n)
+{
+    g2_edges_contain_many(inside, edges, p.r[0], p.r[1], n);
+}
+
+#ifdef TEST
+#include "utils.h"
+
+static int errors = 0;
+
+int main(void)
+{
+    int i, level;
+
+    srandom(1);
+
+    /* An L-shaped polygon, counter-clockwise. */
+
+    Vector2 l_shape[] = {
+        { { 0, 0 } }, { { 4, 0 } }, { { 4, 1 } },
+        { { 1, 1 } }, { { 1, 3 } }, { { 0, 3 } }
+    };
+
+    Polygon2 *poly = g2PolygonCreate(l_shape, 6);
+
+    make_sure_that(g2PolygonArea(poly) == 6);
+
+    Vector2 c = g2PolygonCentroid(poly);
+
+    make_sure_that(close_to(c.r[0], 1.5));
+    make_sure_that(close_to(c.r[1], 1));
+
+    Vector2 min, max;
+
+    g2PolygonBox(poly, &min, &max);
+
+    make_sure_that(min.r[0] == 0 && min.r[1] == 0);
+    make_sure_that(max.r[0] == 4 && max.r[1] == 3);
+
+    make_sure_that(g2PolygonContains(poly, v2Make(0.5, 2.5)));
+    make_sure_that(g2PolygonContains(poly, v2Make(3.5, 0.5)));
+    make_sure_that(!g2PolygonContains(poly, v2Make(2, 2)));
+    make_sure_that(!g2PolygonContains(poly, v2Make(-1, 0.5)));
+
+    /* The convex hull of the L is the L without its inner corner. */
+
+    Polygon2 *hull = g2ConvexHull(l_shape, 6);
+
+    make_sure_that(hull->count == 5);
+    make_sure_that(hull->p[0].r[0] == 0 && hull->p[0].r[1] == 0);
+    make_sure_that(hull->p[1].r[0] == 4 && hull->p[1].r[1] == 0);
+    make_sure_that(g2PolygonArea(hull) == 9);
+
+    free(hull);
+
+    /* Clockwise polygons have a negative area. */
+
+    Vector2 cw[] = { { { 0, 0 } }, { { 0, 2 } }, { { 2, 2 } }, { { 2, 0 } } };
+
+    Polygon2 *square = g2PolygonCreate(cw, 4);
+
+    make_sure_that(g2PolygonArea(square) == -4);
+
+    c = g2PolygonCentroid(square);
+
+    make_sure_that(close_to(c.r[0], 1) && close_to(c.r[1], 1));
+
+    free(square);
+
+    /* Hulls of degenerate point sets. */
+
+    Vector2 same[] = { { { 1, 1 } }, { { 1, 1 } }, { { 1, 1 } } };
+
+    hull = g2ConvexHull(same, 3);
+    make_sure_that(hull->count == 1);
+    free(hull);
+
+    Vector2 line[] = { { { 0, 0 } }, { { 2, 2 } }, { { 1, 1 } } };
+
+    hull = g2ConvexHull(line, 3);
+    make_sure_that(hull->count == 2);
+    free(hull);
+
+    /* The hull of random points contains all of them. */
+
+    Vector2 cloud[500];
+
+    for (i = 0; i < 500; i++) {
+        cloud[i] = v2Make(random() % 1000 - 500, random() % 1000 - 500);
+    }
+
+    hull = g2ConvexHull(cloud, 500);
+
+    make_sure_that(g2PolygonArea(hull) > 0);
+
+    int outside = 0;
+
+    for (i = 0; i < 500; i++) {
+        Vector2 p = v2Scaled(cloud[i], 0.99);
+
+        if (!g2PolygonContains(hull, p)) outside++;
+    }
+
+    make_sure_that(outside == 0);
+
+    free(hull);
+
+    /* Batch tests give the same results as single ones, at all instruction
+     * set levels. */
+
+    Polygon2Edges *edges = g2PolygonEdgesCreate(poly);
+
+    make_sure_that(edges->count == 6);
+    make_sure_that(g2PolygonEdgesContain(edges, v2Make(0.5, 2.5)));
+    make_sure_that(!g2PolygonEdgesContain(edges, v2Make(2, 2)));
+
+    enum { N = 1003 };
+
+    Vector2 points[N];
+    double x[N], y[N];
+    bool inside[N];
+
+    for (i = 0; i < N; i++) {
+        x[i] = 5.0 * random() / RAND_MAX - 0.5;
+        y[i] = 4.0 * random() / RAND_MAX - 0.5;
+
+        points[i] = v2Make(x[i], y[i]);
+    }
+
+    for (level = SIMD_NONE; level <= SIMD_AVX2; level++) {
+        int bad = 0;
+
+        simdSetLevel(level);
+
+        g2PolygonEdgesContainMany(inside, edges, points, N);
+
+        for (i = 0; i < N; i++) {
+            if (inside[i] != g2PolygonEdgesContain(edges, points[i])) bad++;
+            if (inside[i] != g2PolygonContains(poly, points[i])) bad++;
+        }
+
+        g2PolygonEdgesContainArray(inside, edges,
+                (Vector2Array) { { x, y } }, N);
+
+        for (i = 0; i < N; i++) {
+            if (inside[i] != g2PolygonEdgesContain(edges, points[i])) bad++;
+        }
+
+        make_sure_that(bad == 0);
+    }
+
+    free(edges);
+    free(poly);
+
+    /* Circles and line segments. */
+
+    double r1, r2;
+
+    Circle2 unit = { v2Make(0, 0), 1 };
+    Line2 horizontal = { v2Make(-2, 0), v2Make(1, 0) };
+
+    make_sure_that(g2CircleLineIntersect(unit, horizontal, &r1, &r2) == 2);
+    make_sure_that(r1 == 1 && r2 == 3);
+
+    horizontal.pv.r[1] = 1;
+
+    make_sure_that(g2CircleLineIntersect(unit, horizontal, &r1, &r2) == 1);
+    make_sure_that(r1 == 2 && r2 == 2);
+
+    horizontal.pv.r[1] = 2;
+
+    make_sure_that(g2CircleLineIntersect(unit, horizontal, NULL, NULL) == 0);
+
+    enum { N_CIRCLES = 1001, N_SEGMENTS = 203 };
+
+    Circle2 circle[N_CIRCLES];
+    double cx[N_CIRCLES], cy[N_CIRCLES], radius[N_CIRCLES];
+    Circle2Hit circle_hit[N_CIRCLES];
+
+    for (i = 0; i < N_CIRCLES; i++) {
+        circle[i].c = v2Make(random() % 200 - 100, random() % 200 - 100);
+        circle[i].r = random() % 50;
+
+        cx[i] = circle[i].c.r[0];
+        cy[i] = circle[i].c.r[1];
+        radius[i] = circle[i].r;
+    }
+
+    Line2 diagonal = { v2Make(-3, 1), v2Make(0.7, 0.3) };
+
+    Line2 a[N_SEGMENTS], b[N_SEGMENTS];
+    Line2Hit *line_hit = malloc(N_SEGMENTS * N_SEGMENTS * sizeof(Line2Hit));
+
+    for (i = 0; i < N_SEGMENTS; i++) {
+        a[i].pv = v2Make(random() % 100, random() % 100);
+        a[i].dv = v2Make(random() % 40 - 20, random() % 40 - 20);
+        b[i].pv = v2Make(random() % 100, random() % 100);
+        b[i].dv = v2Make(random() % 40 - 20, random() % 40 - 20);
+    }
+
+    b[7] = a[5];    /* Coincident... */
+    b[8] = a[5];    /* ... and parallel. */
+    b[8].pv.r[1] += 1;
+
+    for (level = SIMD_NONE; level <= SIMD_AVX2; level++) {
+        size_t n_hits, k = 0, n;
+        int bad = 0, j;
+
+        simdSetLevel(level);
+
+        n_hits = g2CircleLineIntersectMany(circle_hit, diagonal,
+                circle, N_CIRCLES);
+
+        for (i = 0; i < N_CIRCLES; i++) {
+            int r = g2CircleLineIntersect(circle[i], diagonal, &r1, &r2);
+
+            if (r == 0) continue;
+
+            if (k >= n_hits || circle_hit[k].index != (size_t) i ||
+                circle_hit[k].count != r ||
+                circle_hit[k].r1 != r1 || circle_hit[k].r2 != r2) {
+                bad++;
+            }
+
+            k++;
+        }
+
+        make_sure_that(k == n_hits);
+
+        n = g2CircleLineIntersectArray(circle_hit, diagonal,
+                (Vector2Array) { { cx, cy } }, radius, N_CIRCLES);
+
+        make_sure_that(n == n_hits);
+
+        n_hits = g2SegmentSegmentIntersectMany(line_hit,
+                N_SEGMENTS * N_SEGMENTS, a, N_SEGMENTS, b, N_SEGMENTS);
+
+        k = 0;
+
+        for (i = 0; i < N_SEGMENTS; i++) {
+            for (j = 0; j < N_SEGMENTS; j++) {
+                double t = g2LineLineIntersect(a[i], b[j]);
+                double u = g2LineLineIntersect(b[j], a[i]);
+
+                if (!(t >= 0 && t <= 1 && u >= 0 && u <= 1)) continue;
+
+                if (k >= n_hits ||
+                    line_hit[k].i != (size_t) i ||
+                    line_hit[k].j != (size_t) j ||
+                    line_hit[k].r1 != t || line_hit[k].r2 != u) {
+                    bad++;
+                }
+
+                k++;
+            }
+        }
+
+        make_sure_that(k == n_hits);
+        make_sure_that(n_hits > 0);
+        make_sure_that(bad == 0);
+
+        /* Too little room. */
+
+        make_sure_that(g2SegmentSegmentIntersectMany(line_hit, 1,
+                    a, N_SEGMENTS, b, N_SEGMENTS) == n_hits);
+    }
+
+    free(line_hit);
+
+    return errors;
+}
+#endif
@@ -12,6 +12,8 @@
  * http://www.opensource.org/licenses/mit-license.php for details.
  */
 
+#include <stdbool.h>
+
 #include "vector2.h"
 
 typedef struct {
@@ -29,6 +31,47 @@ typedef struct {
     Vector2 p[];
 } Polygon2;
 
+/*
+ * One edge of a polygon, prepared for crossing tests: the edge runs from
+ * (x0, y0) to a point at height y1, and <slope> is the change in x per unit
+ * of y along it (0 for horizontal edges, which are never crossed).
+ */
+typedef struct {
+    double x0, y0, y1, slope;
+} Polygon2Edge;
+
+/*
+ * An intersection of a line with circle number <index> in an array, found by
+ * g2CircleLineIntersectMany(). <count> is the number of intersection points (1
+ * or 2) and <r1> and <r2> are their positions on the line, as returned by
+ * g2CircleLineIntersect().
+ */
+typedef struct {
+    size_t index;
+    int count;
+    double r1, r2;
+} Circle2Hit;
+
+/*
+ * An intersection of line segment number <i> in one array with segment
+ * number <j> in another, found by g2SegmentSegmentIntersectMany(). <r1> and
+ * <r2> are the positions of the intersection point on both segments.
+ */
+typedef struct {
+    size_t i, j;
+    double r1, r2;
+} Line2Hit;
+
+/*
+ * The edges of a polygon and its bounding box, precomputed by
+ * g2PolygonEdgesCreate() to quickly test many points against it.
+ */
+typedef struct {
+    Vector2 min, max;   // Bounding box
+    int count;          // Number of edges
+    Polygon2Edge edge[];
+} Polygon2Edges;
+
 /*                _   _       _
  * If line <l> is l = s + n * d, this returns the <n> where line <l>
  * intersects line <m>. The result might be +/- infinity (if the lines are
@@ -54,4 +97,111 @@ double g2PointLineProject(Vector2 p, Line2 l);
  */
 Vector2 g2PointLineProjection(Vector2 p, Line2 l);
 
+/*                _   _       _
+ * If line <l> is l = s + n * d, this sets <r1> and <r2> to the values of <n>
+ * where <l> intersects circle <c> and returns the number of intersections (0,
+ * 1 or 2). <r1> and <r2> may be NULL.
+ */
+int g2CircleLineIntersect(Circle2 c, Line2 l, double *r1, double *r2);
+
+/*
+ * Intersect line <l> with the <n> circles in <c>, and add a Circle2Hit to <hit>
+ * for each circle that it intersects. <hit> must have room for <n> entries.
+ * Returns the number of hits. The results are the same as those of
+ * g2CircleLineIntersect(), but several circles are done at once using SIMD
+ * instructions.
+ */
+size_t g2CircleLineIntersectMany(Circle2Hit *hit, Line2 l,
+        const Circle2 *c, size_t n);
+
+/*
+ * Like g2CircleLineIntersectMany(), but for <n> circles whose centers are in
+ * "structure of arrays" <center> and whose radii are in <radius>.
+ */
+size_t g2CircleLineIntersectArray(Circle2Hit *hit, Line2 l,
+        Vector2Array center, const double *radius, size_t n);
+
+/*
+ * Intersect each of the <n_a> line segments in <a> with each of the <n_b>
+ * segments in <b>, where a segment runs from pv to pv + dv, and add a Line2Hit
+ * to <hit> for each pair that intersects, up to <max_hits>. Returns the total
+ * number of intersecting pairs, which may be more than <max_hits>. The
+ * positions in the hits are the same as those returned by
+ * g2LineLineIntersect() for both segments, and parallel segments never
+ * intersect.
+ */
+size_t g2SegmentSegmentIntersectMany(Line2Hit *hit, size_t max_hits,
+        const Line2 *a, size_t n_a, const Line2 *b, size_t n_b);
+
+/*
+ * Create a polygon with the <count> corner points in <p>. Free it using
+ * free() when done.
+ */
+Polygon2 *g2PolygonCreate(const Vector2 *p, int count);
+
+/*
+ * Return the area of polygon <poly>. The area is positive if the corner points
+ * are in counter-clockwise order and negative if they are clockwise. The
+ * polygon must not intersect itself.
+ */
+double g2PolygonArea(const Polygon2 *poly);
+
+/*
+ * Return the centroid ("center of mass") of polygon <poly>, which must not
+ * intersect itself. The coefficients of the result are NAN if the polygon has
+ * no area.
+ */
+Vector2 g2PolygonCentroid(const Polygon2 *poly);
+
+/*
+ * Put the lower-left corner of the bounding box of polygon <poly> in <min> and
+ * the upper-right corner in <max>.
+ */
+void g2PolygonBox(const Polygon2 *poly, Vector2 *min, Vector2 *max);
+
+/*
+ * Return the convex hull of the <count> points in <p>, as a newly allocated
+ * polygon with its corner points in counter-clockwise order, starting at the
+ * lowest, left-most point. Points on the edges of the hull are not included.
+ * Free the polygon using free() when done.
+ */
+Polygon2 *g2ConvexHull(const Vector2 *p, int count);
+
+/*
+ * Return true if point <p> is inside polygon <poly>, using the even-odd rule.
+ * Points exactly on the edge of the polygon may be reported as inside or
+ * outside.
+ */
+bool g2PolygonContains(const Polygon2 *poly, Vector2 p);
+
+/*
+ * Prepare polygon <poly> for testing many points against it using
+ * g2PolygonEdgesContain() and friends. Free the result using free() when
+ * done.
+ */
+Polygon2Edges *g2PolygonEdgesCreate(const Polygon2 *poly);
+
+/*
+ * Return true if point <p> is inside the polygon whose edges are in <edges>,
+ * using the even-odd rule.
+ */
+bool g2PolygonEdgesContain(const Polygon2Edges *edges, Vector2 p);
+
+/*
+ * Set inside[i] to true if point p[i] is inside the polygon whose edges are in
+ * <edges>, and to false if it isn't, for all 0 <= i < <n>. Gives the same
+ * results as g2PolygonEdgesContain(), but uses SIMD instructions to test
+ * several points at once.
+ */
+void g2PolygonEdgesContainMany(bool *inside, const Polygon2Edges *edges,
+        const Vector2 *p, size_t n);
+
+/*
+ * Set inside[i] to true if point <i> in <p> is inside the polygon whose edges
+ * are in <edges>, and to false if it isn't, for all 0 <= i < <n>. Like
+ * g2PolygonEdgesContainMany(), but for a "structure of arrays".
+ */
+void g2PolygonEdgesContainArray(bool *inside, const Polygon2Edges *edges,
+        Vector2Array p, size_t n);
+
 #endif
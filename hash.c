@@ -29,7 +29,7 @@ typedef struct HashEntry HashEntry;
 struct HashEntry {
     ListNode _node;     /* Make it listable. */
     const void *data;   /* Pointer to some data. */
-    void *key;          /* Points to the associated key. */
+    void *key;          /* Points to the associated key, which follows. */
     int key_len;        /* Length of the key. */
 };
 
@@ -97,6 +97,25 @@ HashTable *hashCreateTable(void)
     return calloc(1, sizeof(HashTable));
 }
 
+/*
+ * Use <alloc> to allocate and free the entries in <tbl>, instead of calloc()
+ * and free(). <tbl> must be empty when this is called.
+ */
+void hashSetAllocator(HashTable *tbl, const Allocator *alloc)
+{
+    tbl->alloc = alloc;
+}
+
+/*
+ * Return the number of bytes that is allocated for an entry with a key of
+ * <key_len> bytes. Each entry, including its copy of the key, takes a single
+ * allocation.
+ */
+size_t hashEntrySize(int key_len)
+{
+    return sizeof(HashEntry) + key_len;
+}
+
 /*
  * Clear table <tbl> i.e. remove all its entries. The user data that the
  * entries point to is *not* removed.
@@ -108,8 +127,7 @@ void hashClear(HashTable *tbl)
 
     for (i = 0; i < HASH_BUCKETS; i++) {
         while ((entry = listRemoveHead(&tbl->bucket[i])) != NULL) {
-            free(entry->key);
-            free(entry);
+            allocFree(tbl->alloc, entry, hashEntrySize(entry->key_len));
         }
     }
 }
@@ -148,10 +166,10 @@ void hashAdd(HashTable *tbl, const void *data, const void *key, int key_len)
         abort();
     }
 
-    entry = calloc(1, sizeof(HashEntry));
+    entry = allocNew(tbl->alloc, hashEntrySize(key_len));
 
     entry->data    = data;
-    entry->key     = malloc(key_len);
+    entry->key     = entry + 1;
     entry->key_len = key_len;
 
     memcpy(entry->key, key, key_len);
@@ -242,8 +260,7 @@ void hashDrop(HashTable *tbl, const void *key, int key_len)
 
     listRemove(&tbl->bucket[hash_key], entry);
 
-    free(entry->key);
-    free(entry);
+    allocFree(tbl->alloc, entry, hashEntrySize(key_len));
 }
 
 /*
@@ -311,6 +328,8 @@ void hashFreeStats(PointerArray *stats)
 #ifdef TEST
 #include <stdio.h>
 
+#include "pool.h"
+
 static int errors = 0;
 
 int main(void)
@@ -419,6 +438,35 @@ int main(void)
 
     hashDestroy(table);
 
+    /* Entries can come from a pool. Those with keys that are too long for it
+     * are allocated using malloc(). */
+
+    Pool *pool = poolCreate(hashEntrySize(sizeof(int)), false);
+
+    table = hashCreateTable();
+
+    hashSetAllocator(table, poolAllocator(pool));
+
+    for (i = 0; i < count; i++) {
+        hashAdd(table, data + i, HASH_VALUE(data[i].i));
+        hashAdd(table, data + i, HASH_STRING(data[i].s));
+    }
+
+    for (i = 0; i < count; i++) {
+        make_sure_that(hashGet(table, HASH_VALUE(data[i].i)) == &data[i]);
+        make_sure_that(hashGet(table, HASH_STRING(data[i].s)) == &data[i]);
+    }
+
+    hashDrop(table, HASH_VALUE(data[2].i));
+    hashDrop(table, HASH_STRING("three"));
+
+    make_sure_that(!hashContains(table, HASH_VALUE(data[2].i)));
+    make_sure_that(!hashContains(table, HASH_STRING("three")));
+
+    hashDestroy(table);
+
+    poolDestroy(pool);
+
     return errors;
 }
 #endif
@@ -15,6 +15,7 @@
 
 #include "list.h"
 #include "pa.h"
+#include "alloc.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -27,10 +28,12 @@ extern "C" {
 #define HASH_BUCKETS (1 << (HASH_BITS))
 
 /* A hash table. Contains <HASH_BUCKETS> buckets, each of which consists of a
- * list of HashEntry structs. */
+ * list of HashEntry structs. Entries are allocated using <alloc>, or calloc()
+ * if it is NULL. */
 
 typedef struct {
     List bucket[HASH_BUCKETS];
+    const Allocator *alloc;
 } HashTable;
 
 /* Use these macros to provide the <key> and <key_len> parameters in the
@@ -51,6 +54,19 @@ void hashInitTable(HashTable *table);
  */
 HashTable *hashCreateTable(void);
 
+/*
+ * Use <alloc> to allocate and free the entries in <tbl>, instead of calloc()
+ * and free(). <tbl> must be empty when this is called.
+ */
+void hashSetAllocator(HashTable *tbl, const Allocator *alloc);
+
+/*
+ * Return the number of bytes that is allocated for an entry with a key of
+ * <key_len> bytes. Each entry, including its copy of the key, takes a single
+ * allocation.
+ */
+size_t hashEntrySize(int key_len);
+
 /*
  * Clear table <tbl> i.e. remove all its entries. The user data that the
  * entries point to is *not* removed.
@@ -15,7 +15,6 @@
 #include "latlon_fields.h"
 #include "debug.h"
 
-#include <regex.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -36,6 +35,14 @@ static Limit *limits[LLF_COUNT] = {
     [LON_SEC] = &((Limit) { .min =    0, .err =  60 } ),
 };
 
+/*
+ * Formats are recognized by a hand-written matcher (see Format below). The
+ * regular expressions it replaced are kept for testing and benchmarking: the
+ * matcher must accept exactly the same strings, with the same fields.
+ */
+#if defined(TEST) || defined(BENCH)
+#include <regex.h>
+
 typedef struct {
     char   *re_str;
     int     match[LLF_COUNT];
@@ -91,10 +98,90 @@ Regex regexes[] = {
 
 static const int regex_count = sizeof(regexes) / sizeof(regexes[0]);
 
-static bool debug = true;
 static bool initialized = false;
 
 #define NMATCH (LLF_COUNT + 1)
+#endif
+
+/*
+ * The kinds of tokens that make up a format.
+ */
+typedef enum {
+    TOK_END,        // End of the format.
+    TOK_SIGN,       // An optional sign: [+-]?
+    TOK_INT,        // Between <min> and <max> digits: [0-9]{min,max}
+    TOK_FRAC,       // [0-9]{min}\.?[0-9]*, or [0-9]+\.?[0-9]* if <min> is 0
+    TOK_HEMI,       // An optional hemisphere: one of the characters in <lit>
+    TOK_SEP,        // A separator: [, \t]+
+    TOK_LIT         // The literal string <lit>.
+} TokenType;
+
+typedef struct {
+    TokenType type;
+    int field;          // The field this token fills in, if any.
+    int min, max;
+    const char *lit;
+} Token;
+
+#define SIGN(f)         { TOK_SIGN, f, 0, 0, NULL }
+#define INT(f, n, m)    { TOK_INT,  f, n, m, NULL }
+#define FRAC(f, n)      { TOK_FRAC, f, n, 0, NULL }
+#define HEMI(f, h)      { TOK_HEMI, f, 0, 0, h }
+#define SEP             { TOK_SEP, -1, 0, 0, NULL }
+#define LIT(s)          { TOK_LIT, -1, 0, 0, s }
+#define END             { TOK_END, -1, 0, 0, NULL }
+
+/*
+ * The accepted formats, in the order in which they are tried. Each is
+ * equivalent to the regular expression with the same index in <regexes>.
+ */
+static const Token formats[][19] = {
+    {   // DDMMSS.ss, DDDMMSS.ss
+        SIGN(LAT_SIGN), INT(LAT_DEG, 2, 2), INT(LAT_MIN, 2, 2),
+        FRAC(LAT_SEC, 2), HEMI(LAT_HEMI, "NS"),
+        SEP,
+        SIGN(LON_SIGN), INT(LON_DEG, 3, 3), INT(LON_MIN, 2, 2),
+        FRAC(LON_SEC, 2), HEMI(LON_HEMI, "EW"),
+        END
+    },
+    {   // DDMM.mm, DDDMM.mm
+        SIGN(LAT_SIGN), INT(LAT_DEG, 2, 2), FRAC(LAT_MIN, 2),
+        HEMI(LAT_HEMI, "NS"),
+        SEP,
+        SIGN(LON_SIGN), INT(LON_DEG, 3, 3), FRAC(LON_MIN, 2),
+        HEMI(LON_HEMI, "EW"),
+        END
+    },
+    {   // DD.dd, DDD.dd
+        SIGN(LAT_SIGN), FRAC(LAT_DEG, 0), HEMI(LAT_HEMI, "NS"),
+        SEP,
+        SIGN(LON_SIGN), FRAC(LON_DEG, 0), HEMI(LON_HEMI, "EW"),
+        END
+    },
+    {   // DD°MM'SS.ss", DDD°MM'SS.ss"
+        SIGN(LAT_SIGN), INT(LAT_DEG, 1, 2), LIT("°"),
+        INT(LAT_MIN, 2, 2), LIT("'"), FRAC(LAT_SEC, 2), LIT("\""),
+        HEMI(LAT_HEMI, "NS"),
+        SEP,
+        SIGN(LON_SIGN), INT(LON_DEG, 1, 3), LIT("°"),
+        INT(LON_MIN, 2, 2), LIT("'"), FRAC(LON_SEC, 2), LIT("\""),
+        HEMI(LON_HEMI, "EW"),
+        END
+    },
+};
+
+static const int format_count = sizeof(formats) / sizeof(formats[0]);
+
+/*
+ * Where a field was found in the input: <len> characters starting at
+ * <start>, or nowhere if <start> is NULL.
+ */
+typedef struct {
+    const char *start;
+    int len;
+} Span;
+
+static bool debug = true;
 
 static void va_report_error(FILE *fp, const char *fmt, va_list ap)
 {
@@ -112,22 +199,14 @@ static void report_error(FILE *fp, const char *fmt, ...)
     va_end(ap);
 }
 
-static int parse_float(const char *file, int line,
-        int re, char *const parts[], int field, double *val)
+/*
+ * Check that <ret>, the value found for <field>, is within its limits. If so,
+ * store it in <val> and return 0, otherwise report an error and return 1.
+ */
+static int check_value(const char *file, int line,
+        int field, double ret, double *val)
 {
-    double ret;
-
-    if (parts[field] == NULL) return 0;
-
-    if (sscanf(parts[field], "%lf", &ret) != 1) {
-        report_error(stderr,
-                "%s:%d: internal error: regex %d found \"%s\" as %s "
-                "but I couldn't parse it.\n", file, line,
-                re, parts[field], latlon_string(field));
-
-        return 1;
-    }
-    else if (limits[field] == NULL) {
+    if (limits[field] == NULL) {
         *val = ret;
 
         return 0;
@@ -157,36 +236,235 @@ static int parse_float(const char *file, int line,
     }
 }
 
-static int parse_input(const char *file, int line,
-        const char *text, double *lat, double *lon)
+/*
+ * Combine the values found in a coordinate string into <lat> and <lon>, taking
+ * the signs and hemispheres into account.
+ */
+static void combine(const double deg[2], const double min[2],
+        const double sec[2], const char sign[2], const char hemi[2],
+        double *lat, double *lon)
 {
-    regmatch_t pmatch[NMATCH];
-    int re;
+    double lat_val = deg[0] + min[0] / 60 + sec[0] / 3600;
+    double lon_val = deg[1] + min[1] / 60 + sec[1] / 3600;
 
-    for (re = 0; re < regex_count; re++) {
-        if (regexec(&regexes[re].re, text, NMATCH, pmatch, 0) == 0) {
+    if (sign[0] == '-') lat_val = -lat_val;
+    if (sign[1] == '-') lon_val = -lon_val;
+
+    if (toupper(hemi[0]) == 'S') lat_val = -lat_val;
+    if (toupper(hemi[1]) == 'W') lon_val = -lon_val;
+
+    *lat = lat_val;
+    *lon = lon_val;
+}
+
+/*
+ * Try to match format <fmt> on <text>, starting exactly at its first
+ * character. If it matches, fill <span> with the positions of the fields and
+ * return true, otherwise return false. The result is the same as the leftmost
+ * longest match of the equivalent regular expression would be: every token
+ * can be matched greedily, because the token that follows it never starts
+ * with a character it could have taken itself.
+ */
+static bool match_format(const Token *fmt, const char *text, Span span[])
+{
+    const char *p = text;
+    int i, n;
+
+    for (i = 0; i < LLF_COUNT; i++) span[i].start = NULL;
+
+    for (; fmt->type != TOK_END; fmt++) {
+        const char *start = p;
+
+        switch(fmt->type) {
+        case TOK_SIGN:
+            if (*p == '+' || *p == '-') p++;
+            break;
+        case TOK_INT:
+            for (n = 0; n < fmt->max && isdigit((unsigned char) *p); n++) p++;
+            if (n < fmt->min) return false;
+            break;
+        case TOK_FRAC:
+            if (fmt->min > 0) {
+                for (n = 0; n < fmt->min; n++, p++) {
+                    if (!isdigit((unsigned char) *p)) return false;
+                }
+
+                if (*p == '.') p++;
+            }
+            else {
+                if (!isdigit((unsigned char) *p)) return false;
+
+                while (isdigit((unsigned char) *p)) p++;
+
+                if (*p == '.') p++;
+            }
+
+            while (isdigit((unsigned char) *p)) p++;
+            break;
+        case TOK_HEMI:
+            if (*p != '\0' && strchr(fmt->lit, *p) != NULL) p++;
+            break;
+        case TOK_SEP:
+            if (*p != ',' && *p != ' ' && *p != '\t') return false;
+            while (*p == ',' || *p == ' ' || *p == '\t') p++;
+            break;
+        case TOK_LIT:
+            n = strlen(fmt->lit);
+            if (strncmp(p, fmt->lit, n) != 0) return false;
+            p += n;
             break;
+        case TOK_END:
+            break;
+        }
+
+        if (fmt->field >= 0) {
+            span[fmt->field].start = start;
+            span[fmt->field].len = p - start;
         }
     }
 
-    if (re == regex_count) {
+    return true;
+}
+
+/*
+ * Return the value of the number in <span>, which consists of digits and at
+ * most one decimal point, exactly like sscanf() would.
+ */
+static double span_value(const Span *span)
+{
+    char buf[32];
+    int i;
+
+    if (span->len <= 15 && memchr(span->start, '.', span->len) == NULL) {
+        /* Up to 15 digits fit in a double without rounding. */
+
+        long long val = 0;
+
+        for (i = 0; i < span->len; i++) val = 10 * val + span->start[i] - '0';
+
+        return val;
+    }
+    else if (span->len < (int) sizeof(buf)) {
+        memcpy(buf, span->start, span->len);
+        buf[span->len] = '\0';
+
+        return strtod(buf, NULL);
+    }
+    else {
+        char *str = strndup(span->start, span->len);
+        double val = strtod(str, NULL);
+
+        free(str);
+
+        return val;
+    }
+}
+
+/*
+ * Get the value of <field> from <span> and check it. Fields that weren't
+ * found are left at 0.
+ */
+static int get_value(const char *file, int line,
+        const Span span[], int field, double *val)
+{
+    if (span[field].start == NULL) return 0;
+
+    return check_value(file, line, field, span_value(&span[field]), val);
+}
+
+/*
+ * Return the first character of <field> in <span>, or a null byte if it
+ * wasn't found or is empty.
+ */
+static char get_char(const Span span[], int field)
+{
+    return span[field].start != NULL && span[field].len > 0 ?
+        span[field].start[0] : '\0';
+}
+
+/*
+ * Find the first format that matches anywhere in <text> and fill <span> with
+ * the fields it found. Like regexec(), each format is tried at each position in
+ * <text> in turn before moving on to the next one. Returns true if a match was
+ * found, false otherwise.
+ */
+static bool find_format(const char *text, Span span[])
+{
+    const char *start;
+    int fmt;
+
+    for (fmt = 0; fmt < format_count; fmt++) {
+        for (start = text; *start != '\0'; start++) {
+            if (match_format(formats[fmt], start, span)) return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Parse <text>, giving exactly the same results and error messages as matching
+ * it against the regular expressions in <regexes> would.
+ */
+static int parse_input(const char *file, int line,
+        const char *text, double *lat, double *lon)
+{
+    Span span[LLF_COUNT];
+
+    if (!find_format(text, span)) {
         report_error(stderr,
                 "%s:%d: string did not match any regular expressions.\n",
                 file, line);
         return 1;
     }
 
-    char *parts[LLF_COUNT] = { 0 };
+    double deg[2] = { 0 }, min[2] = { 0 }, sec[2] = { 0 };
 
-    for (int i = 0; i < LLF_COUNT; i++) {
-        int match = regexes[re].match[i];
+    if (get_value(file, line, span, LAT_DEG, &deg[0]) != 0 ||
+        get_value(file, line, span, LAT_MIN, &min[0]) != 0 ||
+        get_value(file, line, span, LAT_SEC, &sec[0]) != 0 ||
+        get_value(file, line, span, LON_DEG, &deg[1]) != 0 ||
+        get_value(file, line, span, LON_MIN, &min[1]) != 0 ||
+        get_value(file, line, span, LON_SEC, &sec[1]) != 0)
+    {
+        return 1;
+    }
 
-        if (match > 0) {
-            parts[i] = strndup(text + pmatch[match].rm_so,
-                              pmatch[match].rm_eo - pmatch[match].rm_so);
-        }
+    char sign[2] = { get_char(span, LAT_SIGN), get_char(span, LON_SIGN) };
+    char hemi[2] = { get_char(span, LAT_HEMI), get_char(span, LON_HEMI) };
+
+    combine(deg, min, sec, sign, hemi, lat, lon);
+
+    return 0;
+}
+
+#if defined(TEST) || defined(BENCH)
+static int parse_float(const char *file, int line,
+        int re, char *const parts[], int field, double *val)
+{
+    double ret;
+
+    if (parts[field] == NULL) return 0;
+
+    if (sscanf(parts[field], "%lf", &ret) != 1) {
+        report_error(stderr,
+                "%s:%d: internal error: regex %d found \"%s\" as %s "
+                "but I couldn't parse it.\n", file, line,
+                re, parts[field], latlon_string(field));
+
+        return 1;
     }
 
+    return check_value(file, line, field, ret, val);
+}
+
+/*
+ * Convert the fields found by regular expression <re>, which are in <parts>,
+ * into <lat> and <lon>.
+ */
+static int regex_parse_parts(const char *file, int line,
+        int re, char *const parts[], double *lat, double *lon)
+{
     double lat_deg = 0, lat_min = 0, lat_sec = 0;
     double lon_deg = 0, lon_min = 0, lon_sec = 0;
 
@@ -258,11 +536,49 @@ static int parse_input(const char *file, int line,
 }
 
 /*
- * Parse <str>, which contains a latitude and a longitude, and return those
- * through <lat> and <lon>. Returns 0 on success or 1 on failure.
+ * Parse <text> by matching it against the regular expressions in <regexes>.
  */
-int _latlon_parse(const char *file, int line,
-        const char *str, double *lat, double *lon)
+static int regex_parse_input(const char *file, int line,
+        const char *text, double *lat, double *lon)
+{
+    regmatch_t pmatch[NMATCH];
+    int re;
+
+    for (re = 0; re < regex_count; re++) {
+        if (regexec(&regexes[re].re, text, NMATCH, pmatch, 0) == 0) {
+            break;
+        }
+    }
+
+    if (re == regex_count) {
+        report_error(stderr,
+                "%s:%d: string did not match any regular expressions.\n",
+                file, line);
+        return 1;
+    }
+
+    char *parts[LLF_COUNT] = { 0 };
+
+    for (int i = 0; i < LLF_COUNT; i++) {
+        int match = regexes[re].match[i];
+
+        if (match > 0) {
+            parts[i] = strndup(text + pmatch[match].rm_so,
+                              pmatch[match].rm_eo - pmatch[match].rm_so);
+        }
+    }
+
+    int r = regex_parse_parts(file, line, re, parts, lat, lon);
+
+    for (int i = 0; i < LLF_COUNT; i++) free(parts[i]);
+
+    return r;
+}
+
+/*
+ * Compile the regular expressions used by regex_parse_input().
+ */
+static int regex_init(const char *file, int line)
 {
     if (!initialized) {
         for (int i = 0; i < regex_count; i++) {
@@ -276,6 +592,17 @@ int _latlon_parse(const char *file, int line,
         initialized = true;
     }
 
+    return 0;
+}
+#endif
+
+/*
+ * Parse <str>, which contains a latitude and a longitude, and return those
+ * through <lat> and <lon>. Returns 0 on success or 1 on failure.
+ */
+int _latlon_parse(const char *file, int line,
+        const char *str, double *lat, double *lon)
+{
     return parse_input(file, line, str, lat, lon);
 }
 
@@ -299,6 +626,124 @@ static bool equal(int digits, double a, double b)
 
 static int errors = 0;
 
+/*
+ * Pieces that random test strings are made of. Most of them are things the
+ * formats look for, so that many strings almost (or just) match.
+ */
+static const char *pieces[] = {
+    "0", "1", "2", "3", "5", "6", "7", "9", "00", "59", "60", "90", "180",
+    "181", ".", ".5", "+", "-", "N", "S", "E", "W", "n", "s", ",", " ", "\t",
+    ", ", "°", "'", "\"", "x", "\xC2",
+};
+
+/*
+ * Fill <buf> (of size <size>) with a random string of up to <n> pieces.
+ */
+static void random_string(char *buf, size_t size, int n)
+{
+    const int piece_count = sizeof(pieces) / sizeof(pieces[0]);
+
+    buf[0] = '\0';
+
+    for (n = random() % (n + 1); n > 0; n--) {
+        const char *piece = pieces[random() % piece_count];
+
+        if (strlen(buf) + strlen(piece) >= size) break;
+
+        strcat(buf, piece);
+    }
+}
+
+/*
+ * Append <n> random digits to <buf>, which must have room for them.
+ */
+static void add_digits(char *buf, int n)
+{
+    buf += strlen(buf);
+
+    while (n-- > 0) *buf++ = '0' + random() % 10;
+
+    *buf = '\0';
+}
+
+/*
+ * Fill <buf> with a string in format <fmt>, using more or fewer digits than
+ * the format expects every now and then, and surrounded by random junk.
+ */
+static void format_string(char *buf, int fmt)
+{
+    static const int width[][2] = { { 6, 7 }, { 4, 5 }, { 2, 3 }, { 2, 3 } };
+
+    random_string(buf, 16, 3);
+
+    for (int i = 0; i < 2; i++) {
+        int w = width[fmt][i] + (random() % 8 == 0 ? random() % 3 - 1 : 0);
+
+        if (i == 1) strcat(buf, random() % 2 ? ", " : ",\t");
+        if (random() % 4 == 0) strcat(buf, random() % 2 ? "-" : "+");
+
+        if (fmt == 3) {
+            add_digits(buf, w - random() % 2);
+            strcat(buf, "°");
+            add_digits(buf, 2);
+            strcat(buf, "'");
+            add_digits(buf, 2);
+        }
+        else {
+            add_digits(buf, w);
+        }
+
+        if (random() % 2) {
+            strcat(buf, ".");
+            add_digits(buf, random() % 8);
+        }
+
+        if (fmt == 3) strcat(buf, "\"");
+
+        if (random() % 2) strcat(buf, i == 0 ? (random() % 2 ? "N" : "S")
+                                             : (random() % 2 ? "E" : "W"));
+    }
+
+    random_string(buf + strlen(buf), 16, 3);
+}
+
+/*
+ * Parse <str> with the regular expressions and with the new parser, and check
+ * that both give exactly the same results and error messages.
+ */
+static void compare(const char *str)
+{
+    double re_lat = 0, re_lon = 0, lat = 0, lon = 0;
+    char *re_msg, *msg;
+    size_t re_size, size;
+    int re_r, r;
+
+    FILE *saved_stderr = stderr;
+
+    stderr = open_memstream(&re_msg, &re_size);
+    re_r = regex_parse_input("file", 1, str, &re_lat, &re_lon);
+    fclose(stderr);
+
+    stderr = open_memstream(&msg, &size);
+    r = parse_input("file", 1, str, &lat, &lon);
+    fclose(stderr);
+
+    stderr = saved_stderr;
+
+    if (r != re_r || strcmp(msg, re_msg) != 0 ||
+        memcmp(&lat, &re_lat, sizeof(lat)) != 0 ||
+        memcmp(&lon, &re_lon, sizeof(lon)) != 0) {
+        dbgPrint(stderr, "Parsers differ on \"%s\":\n"
+                "\tregex:  %d, %.17g, %.17g, \"%s\"\n"
+                "\tparser: %d, %.17g, %.17g, \"%s\"\n", str,
+                re_r, re_lat, re_lon, re_msg, r, lat, lon, msg);
+        errors++;
+    }
+
+    free(re_msg);
+    free(msg);
+}
+
 int main(void)
 {
     double lat, lon;
@@ -358,7 +803,88 @@ int main(void)
         }
     }
 
+    /* The parser must behave exactly like the regular expressions did. */
+
+    make_sure_that(regex_init(__FILE__, __LINE__) == 0);
+
+    for (int i = 0; i < case_count; i++) {
+        compare(cases[i].str);
+    }
+
+    const char *edge_cases[] = {
+        "", ",", "1,2", "1.,2.", "+1, -2", "91, 0", "-90.5, 0", "0, 180.01",
+        "1N 2E", "1n 2e", "5260.00, 00400.00", "520160, 0040000",
+        "xx52.5N, 4.5E yy", "52°1'00\", 4°01'00\"", "52°01'60\", 4°01'00\"",
+        "520123.45S 0040123.45Wextra", "1234567890123456789, 1",
+        "12345678901234567890123456789012345678901234567890.5, 1",
+    };
+
+    for (size_t i = 0; i < sizeof(edge_cases) / sizeof(edge_cases[0]); i++) {
+        compare(edge_cases[i]);
+    }
+
+    srandom(1);
+
+    for (int i = 0; i < 20000; i++) {
+        char buf[128];
+
+        if (i % 2 == 0)
+            random_string(buf, sizeof(buf), 24);
+        else
+            format_string(buf, random() % format_count);
+
+        compare(buf);
+    }
+
     return errors;
 }
 
 #endif
+
+#ifdef BENCH
+#include "utils.h"
+
+#define N       1000000
+
+int main(void)
+{
+    const char *input[] = {
+        "520123.45N, 0040123.45E",
+        "5201.2345N, 00401.2345E",
+        "52.012345N, 004.012345E",
+        "52°01'23.45\"N, 004°01'23.45\"E",
+        "somewhere near 52.012345, -4.012345 or so",
+    };
+
+    const int input_count = sizeof(input) / sizeof(input[0]);
+
+    double lat = 0, lon = 0, sum;
+    double start;
+    int i;
+
+    if (regex_init(__FILE__, __LINE__) != 0) return 1;
+
+    start = dnow();
+
+    for (i = 0, sum = 0; i < N; i++) {
+        regex_parse_input(__FILE__, __LINE__,
+                input[i % input_count], &lat, &lon);
+        sum += lat + lon;
+    }
+
+    printf("%-8s %8.3f Mparses/s (check %g)\n",
+            "regex", N / (dnow() - start) / 1e6, sum);
+
+    start = dnow();
+
+    for (i = 0, sum = 0; i < N; i++) {
+        parse_input(__FILE__, __LINE__, input[i % input_count], &lat, &lon);
+        sum += lat + lon;
+    }
+
+    printf("%-8s %8.3f Mparses/s (check %g)\n",
+            "parser", N / (dnow() - start) / 1e6, sum);
+
+    return 0;
+}
+#endif
@@ -13,10 +13,15 @@
 
 #include "matrix2.h"
 #include "vector2.h"
+#include "simd.h"
 
 #include <string.h>
 #include <assert.h>
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 /*
  * Return a matrix with all coefficients set to 0.
  */
@@ -232,11 +237,446 @@ void m2Apply(Matrix2 m, Vector2 *v)
     *v = m2Applied(m, *v);
 }
 
+/*
+ * Return <a> advanced by <offset> vectors.
+ */
+static Vector2Array m2_offset(Vector2Array a, size_t offset)
+{
+    Vector2Array r;
+    int c;
+
+    for (c = 0; c < 2; c++) r.r[c] = a.r[c] + offset;
+
+    return r;
+}
+
+/*
+ * Apply <m> to the <n> vectors in <in>, add <t> (unless it is NULL) and write
+ * the results to <out>, one vector at a time.
+ */
+static void m2_apply_many_scalar(Matrix2 m, const Vector2 *t,
+        Vector2 *out, const Vector2 *in, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        out[i] = m2Applied(m, in[i]);
+
+        if (t != NULL) out[i] = v2Sum(out[i], *t);
+    }
+}
+
+#if defined(__x86_64__)
+
+/*
+ * Apply <m> to the <n> vectors in <in>, add <t> (unless it is NULL) and write
+ * the results to <out>, using SSE2. Gives exactly the same results as
+ * m2Applied().
+ */
+static void m2_apply_many_sse2(Matrix2 m, const Vector2 *t,
+        Vector2 *out, const Vector2 *in, size_t n)
+{
+    __m128d c0 = _mm_loadu_pd(m.c[0].r);
+    __m128d c1 = _mm_loadu_pd(m.c[1].r);
+    __m128d tv = t == NULL ? _mm_setzero_pd() : _mm_loadu_pd(t->r);
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        __m128d r = _mm_add_pd(_mm_mul_pd(_mm_set1_pd(in[i].r[0]), c0),
+                               _mm_mul_pd(_mm_set1_pd(in[i].r[1]), c1));
+
+        if (t != NULL) r = _mm_add_pd(r, tv);
+
+        _mm_storeu_pd(out[i].r, r);
+    }
+}
+
+/*
+ * Apply <m> to the <n> vectors in <in>, add <t> (unless it is NULL) and write
+ * the results to <out>, using AVX2 and FMA, two vectors at a time. Returns the
+ * number of vectors done.
+ */
+__attribute__((target("avx2,fma")))
+static size_t m2_apply_many_avx2(Matrix2 m, const Vector2 *t,
+        Vector2 *out, const Vector2 *in, size_t n)
+{
+    __m256d c0 = _mm256_set_pd(m.c[0].r[1], m.c[0].r[0],
+                               m.c[0].r[1], m.c[0].r[0]);
+    __m256d c1 = _mm256_set_pd(m.c[1].r[1], m.c[1].r[0],
+                               m.c[1].r[1], m.c[1].r[0]);
+    __m256d tv = _mm256_setzero_pd();
+    size_t i;
+
+    if (t != NULL) tv = _mm256_set_pd(t->r[1], t->r[0], t->r[1], t->r[0]);
+
+    for (i = 0; i + 2 <= n; i += 2) {
+        __m256d v = _mm256_loadu_pd(in[i].r);
+
+        __m256d x = _mm256_permute_pd(v, 0x0);    /* x0 x0 x1 x1 */
+        __m256d y = _mm256_permute_pd(v, 0xF);    /* y0 y0 y1 y1 */
+
+        /* Without a translation, start with a plain multiplication so that
+         * we don't add +0.0 to a -0.0 result. */
+
+        __m256d r = t == NULL ?
+            _mm256_mul_pd(c0, x) : _mm256_fmadd_pd(c0, x, tv);
+
+        _mm256_storeu_pd(out[i].r, _mm256_fmadd_pd(c1, y, r));
+    }
+
+    return i;
+}
+
+#endif
+
+/*
+ * Apply <m> to the <n> vectors in <in>, add <t> (unless it is NULL) and write
+ * the results to <out>, one vector at a time.
+ */
+static void m2_apply_array_scalar(Matrix2 m, const Vector2 *t,
+        Vector2Array out, Vector2Array in, size_t n)
+{
+    size_t i;
+    int row;
+
+    for (i = 0; i < n; i++) {
+        Vector2 v = v2Make(in.r[0][i], in.r[1][i]);
+
+        v = m2Applied(m, v);
+
+        if (t != NULL) v = v2Sum(v, *t);
+
+        for (row = 0; row < 2; row++) out.r[row][i] = v.r[row];
+    }
+}
+
+#if defined(__x86_64__)
+
+/*
+ * Apply <m> to the <n> vectors in <in>, add <t> (unless it is NULL) and write
+ * the results to <out>, using SSE2. Gives exactly the same results as
+ * m2Applied(). Returns the number of vectors done.
+ */
+static size_t m2_apply_array_sse2(Matrix2 m, const Vector2 *t,
+        Vector2Array out, Vector2Array in, size_t n)
+{
+    size_t i;
+    int row;
+
+    for (i = 0; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(in.r[0] + i);
+        __m128d y = _mm_loadu_pd(in.r[1] + i);
+
+        __m128d r[2];
+
+        for (row = 0; row < 2; row++) {
+            r[row] = _mm_add_pd(_mm_mul_pd(x, _mm_set1_pd(m.c[0].r[row])),
+                                _mm_mul_pd(y, _mm_set1_pd(m.c[1].r[row])));
+        }
+
+        for (row = 0; row < 2; row++) {
+            if (t != NULL) r[row] = _mm_add_pd(r[row], _mm_set1_pd(t->r[row]));
+
+            _mm_storeu_pd(out.r[row] + i, r[row]);
+        }
+    }
+
+    return i;
+}
+
+/*
+ * Apply <m> to the <n> vectors in <in>, add <t> (unless it is NULL) and write
+ * the results to <out>, using AVX2 and FMA. Returns the number of vectors
+ * done.
+ */
+__attribute__((target("avx2,fma")))
+static size_t m2_apply_array_avx2(Matrix2 m, const Vector2 *t,
+        Vector2Array out, Vector2Array in, size_t n)
+{
+    __m256d c[2][2], tv[2];
+    size_t i;
+    int row, col;
+
+    for (row = 0; row < 2; row++) {
+        for (col = 0; col < 2; col++) {
+            c[col][row] = _mm256_set1_pd(m.c[col].r[row]);
+        }
+
+        tv[row] = _mm256_set1_pd(t == NULL ? 0 : t->r[row]);
+    }
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(in.r[0] + i);
+        __m256d y = _mm256_loadu_pd(in.r[1] + i);
+
+        __m256d r[2];
+
+        for (row = 0; row < 2; row++) {
+            r[row] = t == NULL ? _mm256_mul_pd(c[0][row], x) :
+                                 _mm256_fmadd_pd(c[0][row], x, tv[row]);
+
+            r[row] = _mm256_fmadd_pd(c[1][row], y, r[row]);
+        }
+
+        for (row = 0; row < 2; row++) {
+            _mm256_storeu_pd(out.r[row] + i, r[row]);
+        }
+    }
+
+    return i;
+}
+
+#endif
+
+/*
+ * Apply <m> to the <n> vectors in <in>, add <t> (unless it is NULL) and write
+ * the results to <out>.
+ */
+static void m2_apply_many(Matrix2 m, const Vector2 *t,
+        Vector2 *out, const Vector2 *in, size_t n)
+{
+    size_t done = 0;
+
+    switch(simdLevel()) {
+#if defined(__x86_64__)
+    case SIMD_AVX2:
+        done = m2_apply_many_avx2(m, t, out, in, n);
+        break;
+    case SIMD_SSE2:
+        m2_apply_many_sse2(m, t, out, in, n);
+        done = n;
+        break;
+#endif
+    default:
+        break;
+    }
+
+    m2_apply_many_scalar(m, t, out + done, in + done, n - done);
+}
+
+/*
+ * Apply <m> to the <n> vectors in <in>, add <t> (unless it is NULL) and write
+ * the results to <out>.
+ */
+static void m2_apply_array(Matrix2 m, const Vector2 *t,
+        Vector2Array out, Vector2Array in, size_t n)
+{
+    size_t done = 0;
+
+    switch(simdLevel()) {
+#if defined(__x86_64__)
+    case SIMD_AVX2:
+        done = m2_apply_array_avx2(m, t, out, in, n);
+        break;
+    case SIMD_SSE2:
+        done = m2_apply_array_sse2(m, t, out, in, n);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    m2_apply_array_scalar(m, t, m2_offset(out, done),
+            m2_offset(in, done), n - done);
+}
+
+/*
+ * Apply matrix <m> to the <n> vectors in <in> and write the results to <out>.
+ */
+void m2ApplyMany(Matrix2 m, Vector2 *out, const Vector2 *in, size_t n)
+{
+    m2_apply_many(m, NULL, out, in, n);
+}
+
+/*
+ * Apply matrix <m> to the <n> vectors in <in>, add translation <t> and write
+ * the results to <out>.
+ */
+void m2ApplyAffineMany(Matrix2 m, Vector2 t,
+        Vector2 *out, const Vector2 *in, size_t n)
+{
+    m2_apply_many(m, &t, out, in, n);
+}
+
+/*
+ * Apply matrix <m> to the <n> vectors in <in> and write the results to <out>.
+ */
+void m2ApplyArray(Matrix2 m, Vector2Array out, Vector2Array in, size_t n)
+{
+    m2_apply_array(m, NULL, out, in, n);
+}
+
+/*
+ * Apply matrix <m> to the <n> vectors in <in>, add translation <t> and write
+ * the results to <out>.
+ */
+void m2ApplyAffineArray(Matrix2 m, Vector2 t,
+        Vector2Array out, Vector2Array in, size_t n)
+{
+    m2_apply_array(m, &t, out, in, n);
+}
+
 #ifdef TEST
 #include "utils.h"
+#include "defs.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
 
 static int errors = 0;
 
+#define N 1003
+
+/*
+ * Return a random value between -500 and 500.
+ */
+static double random_value(void)
+{
+    return (random() - RAND_MAX / 2) / (RAND_MAX / 1000.0);
+}
+
+/*
+ * Check that <actual> is the result of applying <m> to <v> and adding <t>.
+ * If <exact> is TRUE, it must be exactly the same as what m2Applied() gives,
+ * otherwise it may differ by a few bits.
+ */
+static int check_result(Matrix2 m, Vector2 t,
+        Vector2 v, Vector2 actual, int exact)
+{
+    Vector2 expected = v2Sum(m2Applied(m, v), t);
+    int row, col;
+
+    for (row = 0; row < 2; row++) {
+        double magnitude = fabs(t.r[row]);
+
+        for (col = 0; col < 2; col++) {
+            magnitude += fabs(m.c[col].r[row] * v.r[col]);
+        }
+
+        double error = fabs(actual.r[row] - expected.r[row]);
+
+        if (exact && error != 0) return FALSE;
+        if (error > 4 * DBL_EPSILON * magnitude) return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Check that the batch functions without a translation keep negative zeros,
+ * as m2Applied() does, for each available instruction set.
+ */
+static void check_negative_zero(void)
+{
+    static Vector2 in[8], out[8];
+    static double coords[2 * 2][8];
+
+    Vector2Array soa_in, soa_out;
+    int c, level;
+    size_t i;
+
+    Matrix2 m = m2Identity();
+
+    for (c = 0; c < 2; c++) {
+        soa_in.r[c] = coords[c];
+        soa_out.r[c] = coords[2 + c];
+    }
+
+    for (i = 0; i < 8; i++) {
+        for (c = 0; c < 2; c++) in[i].r[c] = soa_in.r[c][i] = -0.0;
+    }
+
+    for (level = SIMD_NONE; level <= SIMD_AVX2; level++) {
+        if (simdSetLevel(level) != (SimdLevel) level) continue;
+
+        m2ApplyMany(m, out, in, 8);
+        m2ApplyArray(m, soa_out, soa_in, 8);
+
+        for (i = 0; i < 8; i++) {
+            for (c = 0; c < 2; c++) {
+                make_sure_that(signbit(out[i].r[c]));
+                make_sure_that(signbit(soa_out.r[c][i]));
+            }
+        }
+    }
+}
+
+/*
+ * Check the batch functions for each available instruction set.
+ */
+static void check_batch(void)
+{
+    static Vector2 in[N], out[N];
+    static double coords[2 * 2][N];
+
+    Vector2Array soa_in, soa_out;
+    int c, level;
+    size_t i;
+
+    srandom(1);
+
+    Matrix2 m = m2Make(random_value(), random_value(),
+                       random_value(), random_value());
+
+    Vector2 t = v2Make(random_value(), random_value());
+
+    for (c = 0; c < 2; c++) {
+        soa_in.r[c] = coords[c];
+        soa_out.r[c] = coords[2 + c];
+    }
+
+    for (i = 0; i < N; i++) {
+        v2Set(&in[i], random_value(), random_value());
+
+        for (c = 0; c < 2; c++) soa_in.r[c][i] = in[i].r[c];
+    }
+
+    for (level = SIMD_NONE; level <= SIMD_AVX2; level++) {
+        if (simdSetLevel(level) != (SimdLevel) level) continue;
+
+        int exact = (level != SIMD_AVX2);
+
+        m2ApplyMany(m, out, in, N);
+
+        for (i = 0; i < N; i++) {
+            make_sure_that(check_result(m, v2New(), in[i], out[i], exact));
+        }
+
+        m2ApplyAffineMany(m, t, out, in, N);
+
+        for (i = 0; i < N; i++) {
+            make_sure_that(check_result(m, t, in[i], out[i], exact));
+        }
+
+        m2ApplyArray(m, soa_out, soa_in, N);
+
+        for (i = 0; i < N; i++) {
+            for (c = 0; c < 2; c++) out[i].r[c] = soa_out.r[c][i];
+
+            make_sure_that(check_result(m, v2New(), in[i], out[i], exact));
+        }
+
+        m2ApplyAffineArray(m, t, soa_out, soa_in, N);
+
+        for (i = 0; i < N; i++) {
+            for (c = 0; c < 2; c++) out[i].r[c] = soa_out.r[c][i];
+
+            make_sure_that(check_result(m, t, in[i], out[i], exact));
+        }
+
+        /* In place. */
+
+        memcpy(out, in, sizeof(out));
+
+        m2ApplyAffineMany(m, t, out, out, N);
+
+        for (i = 0; i < N; i++) {
+            make_sure_that(check_result(m, t, in[i], out[i], exact));
+        }
+    }
+}
+
 int main(void)
 {
     Matrix2 m1 = m2New();
@@ -387,6 +827,9 @@ int main(void)
 
     make_sure_that(r != 0);
 
+    check_batch();
+    check_negative_zero();
+
     return errors;
 }
 
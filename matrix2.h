@@ -120,6 +120,45 @@ Vector2 m2Applied(Matrix2 m, Vector2 v);
  */
 void m2Apply(Matrix2 m, Vector2 *v);
 
+/*
+ * Batch functions.
+ *
+ * The functions below apply a matrix to <n> vectors at a time, stored either
+ * as plain arrays of Vector2 or as Vector2Arrays (see vector2.h). The "Affine"
+ * versions also add a translation to the results. Output arrays may be the
+ * same as input arrays (to transform vectors in place), but may not overlap
+ * them in any other way. On processors that support AVX2 these functions use
+ * fused multiply-add instructions, which round only once instead of after
+ * every multiplication and addition. Results may then differ from those of
+ * m2Applied() in the last bit or so, i.e. by no more than a few times
+ * DBL_EPSILON relative to the magnitude of the terms involved. Otherwise the
+ * results are identical to those of m2Applied().
+ */
+
+/*
+ * Apply matrix <m> to the <n> vectors in <in> and write the results to <out>.
+ */
+void m2ApplyMany(Matrix2 m, Vector2 *out, const Vector2 *in, size_t n);
+
+/*
+ * Apply matrix <m> to the <n> vectors in <in>, add translation <t> and write
+ * the results to <out>.
+ */
+void m2ApplyAffineMany(Matrix2 m, Vector2 t,
+        Vector2 *out, const Vector2 *in, size_t n);
+
+/*
+ * Apply matrix <m> to the <n> vectors in <in> and write the results to <out>.
+ */
+void m2ApplyArray(Matrix2 m, Vector2Array out, Vector2Array in, size_t n);
+
+/*
+ * Apply matrix <m> to the <n> vectors in <in>, add translation <t> and write
+ * the results to <out>.
+ */
+void m2ApplyAffineArray(Matrix2 m, Vector2 t,
+        Vector2Array out, Vector2Array in, size_t n);
+
 #ifdef __cplusplus
 }
 #endif
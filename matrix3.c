@@ -14,6 +14,11 @@
 #include <string.h>
 #include <assert.h>
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "simd.h"
 #include "matrix2.h"
 #include "matrix3.h"
 
@@ -276,3 +281,560 @@ void m3Apply(Matrix3 m, Vector3 *v)
 {
     *v = m3Applied(m, *v);
 }
+
+/*
+ * Return <a> advanced by <offset> vectors.
+ */
+static Vector3Array m3_offset(Vector3Array a, size_t offset)
+{
+    Vector3Array r;
+    int c;
+
+    for (c = 0; c < 3; c++) r.r[c] = a.r[c] + offset;
+
+    return r;
+}
+
+/*
+ * Apply <m> to the <n> vectors in <in>, add <t> (unless it is NULL) and write
+ * the results to <out>, one vector at a time.
+ */
+static void m3_apply_many_scalar(Matrix3 m, const Vector3 *t,
+        Vector3 *out, const Vector3 *in, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        out[i] = m3Applied(m, in[i]);
+
+        if (t != NULL) out[i] = v3Sum(out[i], *t);
+    }
+}
+
+#if defined(__x86_64__)
+
+/*
+ * Apply <m> to the <n> vectors in <in>, add <t> (unless it is NULL) and write
+ * the results to <out>, using SSE2. Gives exactly the same results as
+ * m3Applied().
+ */
+static void m3_apply_many_sse2(Matrix3 m, const Vector3 *t,
+        Vector3 *out, const Vector3 *in, size_t n)
+{
+    __m128d c0 = _mm_loadu_pd(m.c[0].r);
+    __m128d c1 = _mm_loadu_pd(m.c[1].r);
+    __m128d c2 = _mm_loadu_pd(m.c[2].r);
+    __m128d t01 = t == NULL ? _mm_setzero_pd() : _mm_loadu_pd(t->r);
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        double x = in[i].r[0], y = in[i].r[1], z = in[i].r[2];
+
+        __m128d r01 = _mm_add_pd(
+                _mm_add_pd(_mm_mul_pd(_mm_set1_pd(x), c0),
+                           _mm_mul_pd(_mm_set1_pd(y), c1)),
+                _mm_mul_pd(_mm_set1_pd(z), c2));
+
+        double r2 = x * m.c[0].r[2] + y * m.c[1].r[2] + z * m.c[2].r[2];
+
+        if (t != NULL) {
+            r01 = _mm_add_pd(r01, t01);
+            r2 += t->r[2];
+        }
+
+        _mm_storeu_pd(out[i].r, r01);
+        out[i].r[2] = r2;
+    }
+}
+
+/*
+ * Apply <m> to the <n> vectors in <in>, add <t> (unless it is NULL) and write
+ * the results to <out>, using AVX2 and FMA.
+ */
+__attribute__((target("avx2,fma")))
+static void m3_apply_many_avx2(Matrix3 m, const Vector3 *t,
+        Vector3 *out, const Vector3 *in, size_t n)
+{
+    __m256i mask = _mm256_set_epi64x(0, -1, -1, -1);
+
+    __m256d c0 = _mm256_maskload_pd(m.c[0].r, mask);
+    __m256d c1 = _mm256_maskload_pd(m.c[1].r, mask);
+    __m256d c2 = _mm256_maskload_pd(m.c[2].r, mask);
+    __m256d tv = _mm256_setzero_pd();
+    size_t i;
+
+    if (t != NULL) tv = _mm256_maskload_pd(t->r, mask);
+
+    for (i = 0; i < n; i++) {
+        __m256d x = _mm256_broadcast_sd(&in[i].r[0]);
+        __m256d y = _mm256_broadcast_sd(&in[i].r[1]);
+        __m256d z = _mm256_broadcast_sd(&in[i].r[2]);
+
+        /* Without a translation, start with a plain multiplication so that
+         * we don't add +0.0 to a -0.0 result. */
+
+        __m256d r = t == NULL ?
+            _mm256_mul_pd(c0, x) : _mm256_fmadd_pd(c0, x, tv);
+
+        r = _mm256_fmadd_pd(c2, z, _mm256_fmadd_pd(c1, y, r));
+
+        _mm256_maskstore_pd(out[i].r, mask, r);
+    }
+}
+
+#endif
+
+/*
+ * Apply <m> to the <n> vectors in <in>, add <t> (unless it is NULL) and write
+ * the results to <out>, one vector at a time.
+ */
+static void m3_apply_array_scalar(Matrix3 m, const Vector3 *t,
+        Vector3Array out, Vector3Array in, size_t n)
+{
+    size_t i;
+    int row;
+
+    for (i = 0; i < n; i++) {
+        Vector3 v = v3Make(in.r[0][i], in.r[1][i], in.r[2][i]);
+
+        v = m3Applied(m, v);
+
+        if (t != NULL) v = v3Sum(v, *t);
+
+        for (row = 0; row < 3; row++) out.r[row][i] = v.r[row];
+    }
+}
+
+#if defined(__x86_64__)
+
+/*
+ * Apply <m> to the <n> vectors in <in>, add <t> (unless it is NULL) and write
+ * the results to <out>, using SSE2. Gives exactly the same results as
+ * m3Applied(). Returns the number of vectors done.
+ */
+static size_t m3_apply_array_sse2(Matrix3 m, const Vector3 *t,
+        Vector3Array out, Vector3Array in, size_t n)
+{
+    size_t i;
+    int row;
+
+    for (i = 0; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(in.r[0] + i);
+        __m128d y = _mm_loadu_pd(in.r[1] + i);
+        __m128d z = _mm_loadu_pd(in.r[2] + i);
+
+        __m128d r[3];
+
+        for (row = 0; row < 3; row++) {
+            r[row] = _mm_add_pd(
+                    _mm_add_pd(_mm_mul_pd(x, _mm_set1_pd(m.c[0].r[row])),
+                               _mm_mul_pd(y, _mm_set1_pd(m.c[1].r[row]))),
+                    _mm_mul_pd(z, _mm_set1_pd(m.c[2].r[row])));
+        }
+
+        for (row = 0; row < 3; row++) {
+            if (t != NULL) r[row] = _mm_add_pd(r[row], _mm_set1_pd(t->r[row]));
+
+            _mm_storeu_pd(out.r[row] + i, r[row]);
+        }
+    }
+
+    return i;
+}
+
+/*
+ * Apply <m> to the <n> vectors in <in>, add <t> (unless it is NULL) and write
+ * the results to <out>, using AVX2 and FMA. Returns the number of vectors
+ * done.
+ */
+__attribute__((target("avx2,fma")))
+static size_t m3_apply_array_avx2(Matrix3 m, const Vector3 *t,
+        Vector3Array out, Vector3Array in, size_t n)
+{
+    __m256d c[3][3], tv[3];
+    size_t i;
+    int row, col;
+
+    for (row = 0; row < 3; row++) {
+        for (col = 0; col < 3; col++) {
+            c[col][row] = _mm256_set1_pd(m.c[col].r[row]);
+        }
+
+        tv[row] = _mm256_set1_pd(t == NULL ? 0 : t->r[row]);
+    }
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(in.r[0] + i);
+        __m256d y = _mm256_loadu_pd(in.r[1] + i);
+        __m256d z = _mm256_loadu_pd(in.r[2] + i);
+
+        __m256d r[3];
+
+        for (row = 0; row < 3; row++) {
+            r[row] = t == NULL ? _mm256_mul_pd(c[0][row], x) :
+                                 _mm256_fmadd_pd(c[0][row], x, tv[row]);
+
+            r[row] = _mm256_fmadd_pd(c[2][row], z,
+                     _mm256_fmadd_pd(c[1][row], y, r[row]));
+        }
+
+        for (row = 0; row < 3; row++) {
+            _mm256_storeu_pd(out.r[row] + i, r[row]);
+        }
+    }
+
+    return i;
+}
+
+#endif
+
+/*
+ * Apply <m> to the <n> vectors in <in>, add <t> (unless it is NULL) and write
+ * the results to <out>.
+ */
+static void m3_apply_many(Matrix3 m, const Vector3 *t,
+        Vector3 *out, const Vector3 *in, size_t n)
+{
+    switch(simdLevel()) {
+#if defined(__x86_64__)
+    case SIMD_AVX2:
+        m3_apply_many_avx2(m, t, out, in, n);
+        break;
+    case SIMD_SSE2:
+        m3_apply_many_sse2(m, t, out, in, n);
+        break;
+#endif
+    default:
+        m3_apply_many_scalar(m, t, out, in, n);
+        break;
+    }
+}
+
+/*
+ * Apply <m> to the <n> vectors in <in>, add <t> (unless it is NULL) and write
+ * the results to <out>.
+ */
+static void m3_apply_array(Matrix3 m, const Vector3 *t,
+        Vector3Array out, Vector3Array in, size_t n)
+{
+    size_t done = 0;
+
+    switch(simdLevel()) {
+#if defined(__x86_64__)
+    case SIMD_AVX2:
+        done = m3_apply_array_avx2(m, t, out, in, n);
+        break;
+    case SIMD_SSE2:
+        done = m3_apply_array_sse2(m, t, out, in, n);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    m3_apply_array_scalar(m, t, m3_offset(out, done),
+            m3_offset(in, done), n - done);
+}
+
+/*
+ * Apply matrix <m> to the <n> vectors in <in> and write the results to <out>.
+ */
+void m3ApplyMany(Matrix3 m, Vector3 *out, const Vector3 *in, size_t n)
+{
+    m3_apply_many(m, NULL, out, in, n);
+}
+
+/*
+ * Apply matrix <m> to the <n> vectors in <in>, add translation <t> and write
+ * the results to <out>.
+ */
+void m3ApplyAffineMany(Matrix3 m, Vector3 t,
+        Vector3 *out, const Vector3 *in, size_t n)
+{
+    m3_apply_many(m, &t, out, in, n);
+}
+
+/*
+ * Apply matrix <m> to the <n> vectors in <in> and write the results to <out>.
+ */
+void m3ApplyArray(Matrix3 m, Vector3Array out, Vector3Array in, size_t n)
+{
+    m3_apply_array(m, NULL, out, in, n);
+}
+
+/*
+ * Apply matrix <m> to the <n> vectors in <in>, add translation <t> and write
+ * the results to <out>.
+ */
+void m3ApplyAffineArray(Matrix3 m, Vector3 t,
+        Vector3Array out, Vector3Array in, size_t n)
+{
+    m3_apply_array(m, &t, out, in, n);
+}
+
+#ifdef TEST
+#include "utils.h"
+#include "defs.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+
+static int errors = 0;
+
+#define N 1003
+
+/*
+ * Return a random value between -500 and 500.
+ */
+static double random_value(void)
+{
+    return (random() - RAND_MAX / 2) / (RAND_MAX / 1000.0);
+}
+
+/*
+ * Check that <actual> is the result of applying <m> to <v> and adding <t>.
+ * If <exact> is TRUE, it must be exactly the same as what m3Applied() gives,
+ * otherwise it may differ by a few bits.
+ */
+static int check_result(Matrix3 m, Vector3 t,
+        Vector3 v, Vector3 actual, int exact)
+{
+    Vector3 expected = v3Sum(m3Applied(m, v), t);
+    int row, col;
+
+    for (row = 0; row < 3; row++) {
+        double magnitude = fabs(t.r[row]);
+
+        for (col = 0; col < 3; col++) {
+            magnitude += fabs(m.c[col].r[row] * v.r[col]);
+        }
+
+        double error = fabs(actual.r[row] - expected.r[row]);
+
+        if (exact && error != 0) return FALSE;
+        if (error > 4 * DBL_EPSILON * magnitude) return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Check that the batch functions without a translation keep negative zeros,
+ * as m3Applied() does, for each available instruction set.
+ */
+static void check_negative_zero(void)
+{
+    static Vector3 in[8], out[8];
+    static double coords[2 * 3][8];
+
+    Vector3Array soa_in, soa_out;
+    int c, level;
+    size_t i;
+
+    Matrix3 m = m3Identity();
+
+    for (c = 0; c < 3; c++) {
+        soa_in.r[c] = coords[c];
+        soa_out.r[c] = coords[3 + c];
+    }
+
+    for (i = 0; i < 8; i++) {
+        for (c = 0; c < 3; c++) in[i].r[c] = soa_in.r[c][i] = -0.0;
+    }
+
+    for (level = SIMD_NONE; level <= SIMD_AVX2; level++) {
+        if (simdSetLevel(level) != (SimdLevel) level) continue;
+
+        m3ApplyMany(m, out, in, 8);
+        m3ApplyArray(m, soa_out, soa_in, 8);
+
+        for (i = 0; i < 8; i++) {
+            for (c = 0; c < 3; c++) {
+                make_sure_that(signbit(out[i].r[c]));
+                make_sure_that(signbit(soa_out.r[c][i]));
+            }
+        }
+    }
+}
+
+/*
+ * Check the batch functions for each available instruction set.
+ */
+static void check_batch(void)
+{
+    static Vector3 in[N], out[N];
+    static double coords[2 * 3][N];
+
+    Vector3Array soa_in, soa_out;
+    int c, level;
+    size_t i;
+
+    srandom(1);
+
+    Matrix3 m = m3Make(random_value(), random_value(), random_value(),
+                       random_value(), random_value(), random_value(),
+                       random_value(), random_value(), random_value());
+
+    Vector3 t = v3Make(random_value(), random_value(), random_value());
+
+    for (c = 0; c < 3; c++) {
+        soa_in.r[c] = coords[c];
+        soa_out.r[c] = coords[3 + c];
+    }
+
+    for (i = 0; i < N; i++) {
+        v3Set(&in[i], random_value(), random_value(), random_value());
+
+        for (c = 0; c < 3; c++) soa_in.r[c][i] = in[i].r[c];
+    }
+
+    for (level = SIMD_NONE; level <= SIMD_AVX2; level++) {
+        if (simdSetLevel(level) != (SimdLevel) level) continue;
+
+        int exact = (level != SIMD_AVX2);
+
+        m3ApplyMany(m, out, in, N);
+
+        for (i = 0; i < N; i++) {
+            make_sure_that(check_result(m, v3New(), in[i], out[i], exact));
+        }
+
+        m3ApplyAffineMany(m, t, out, in, N);
+
+        for (i = 0; i < N; i++) {
+            make_sure_that(check_result(m, t, in[i], out[i], exact));
+        }
+
+        m3ApplyArray(m, soa_out, soa_in, N);
+
+        for (i = 0; i < N; i++) {
+            for (c = 0; c < 3; c++) out[i].r[c] = soa_out.r[c][i];
+
+            make_sure_that(check_result(m, v3New(), in[i], out[i], exact));
+        }
+
+        m3ApplyAffineArray(m, t, soa_out, soa_in, N);
+
+        for (i = 0; i < N; i++) {
+            for (c = 0; c < 3; c++) out[i].r[c] = soa_out.r[c][i];
+
+            make_sure_that(check_result(m, t, in[i], out[i], exact));
+        }
+
+        /* In place. */
+
+        memcpy(out, in, sizeof(out));
+
+        m3ApplyAffineMany(m, t, out, out, N);
+
+        for (i = 0; i < N; i++) {
+            make_sure_that(check_result(m, t, in[i], out[i], exact));
+        }
+    }
+}
+
+int main(void)
+{
+    check_batch();
+    check_negative_zero();
+
+    return errors;
+}
+#endif
+
+#ifdef BENCH
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define N       1000000
+#define ROUNDS  20
+
+/*
+ * Report the time it took (since <start>) to transform N * ROUNDS vectors
+ * with method <what>. <out> is used to make sure the results are used.
+ */
+static void report(const char *what, double start, const double *out)
+{
+    double elapsed = dnow() - start;
+
+    printf("%-28s %8.1f Mvec/s (check %g)\n",
+            what, N * ROUNDS / elapsed / 1e6, out[N / 2]);
+}
+
+int main(void)
+{
+    Vector3 *in  = calloc(N, sizeof(Vector3));
+    Vector3 *out = calloc(N, sizeof(Vector3));
+
+    double *coords = calloc(6 * N, sizeof(double));
+
+    Vector3Array soa_in  = { { coords,         coords + N, coords + 2 * N } };
+    Vector3Array soa_out = { { coords + 3 * N, coords + 4 * N,
+                               coords + 5 * N } };
+
+    Matrix3 m = m3Make(cos(0.3), -sin(0.3), 0,
+                       sin(0.3),  cos(0.3), 0,
+                       0,         0,        1);
+
+    Vector3 t = v3Make(1, 2, 3);
+
+    int round, level, i, c;
+    char what[32];
+
+    for (i = 0; i < N; i++) {
+        v3Set(&in[i], i, N - i, i % 1000);
+
+        for (c = 0; c < 3; c++) soa_in.r[c][i] = in[i].r[c];
+    }
+
+    double start = dnow();
+
+    for (round = 0; round < ROUNDS; round++) {
+        for (i = 0; i < N; i++) out[i] = m3Applied(m, in[i]);
+    }
+
+    report("loop over m3Applied", start, out->r);
+
+    for (level = SIMD_NONE; level <= SIMD_AVX2; level++) {
+        if (simdSetLevel(level) != (SimdLevel) level) continue;
+
+        start = dnow();
+
+        for (round = 0; round < ROUNDS; round++) {
+            m3ApplyMany(m, out, in, N);
+        }
+
+        snprintf(what, sizeof(what), "m3ApplyMany (%s)", simdLevelName(level));
+        report(what, start, out->r);
+
+        start = dnow();
+
+        for (round = 0; round < ROUNDS; round++) {
+            m3ApplyAffineMany(m, t, out, in, N);
+        }
+
+        snprintf(what, sizeof(what), "m3ApplyAffineMany (%s)",
+                simdLevelName(level));
+        report(what, start, out->r);
+
+        start = dnow();
+
+        for (round = 0; round < ROUNDS; round++) {
+            m3ApplyArray(m, soa_out, soa_in, N);
+        }
+
+        snprintf(what, sizeof(what), "m3ApplyArray (%s)", simdLevelName(level));
+        report(what, start, soa_out.r[0]);
+    }
+
+    free(in);
+    free(out);
+    free(coords);
+
+    return 0;
+}
+#endif
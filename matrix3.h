@@ -117,6 +117,45 @@ Vector3 m3Applied(Matrix3 m, Vector3 v);
  */
 void m3Apply(Matrix3 m, Vector3 *v);
 
+/*
+ * Batch functions.
+ *
+ * The functions below apply a matrix to <n> vectors at a time, stored either
+ * as plain arrays of Vector3 or as Vector3Arrays (see vector3.h). The "Affine"
+ * versions also add a translation to the results. Output arrays may be the
+ * same as input arrays (to transform vectors in place), but may not overlap
+ * them in any other way. On processors that support AVX2 these functions use
+ * fused multiply-add instructions, which round only once instead of after
+ * every multiplication and addition. Results may then differ from those of
+ * m3Applied() in the last bit or so, i.e. by no more than a few times
+ * DBL_EPSILON relative to the magnitude of the terms involved. Otherwise the
+ * results are identical to those of m3Applied().
+ */
+
+/*
+ * Apply matrix <m> to the <n> vectors in <in> and write the results to <out>.
+ */
+void m3ApplyMany(Matrix3 m, Vector3 *out, const Vector3 *in, size_t n);
+
+/*
+ * Apply matrix <m> to the <n> vectors in <in>, add translation <t> and write
+ * the results to <out>.
+ */
+void m3ApplyAffineMany(Matrix3 m, Vector3 t,
+        Vector3 *out, const Vector3 *in, size_t n);
+
+/*
+ * Apply matrix <m> to the <n> vectors in <in> and write the results to <out>.
+ */
+void m3ApplyArray(Matrix3 m, Vector3Array out, Vector3Array in, size_t n);
+
+/*
+ * Apply matrix <m> to the <n> vectors in <in>, add translation <t> and write
+ * the results to <out>.
+ */
+void m3ApplyAffineArray(Matrix3 m, Vector3 t,
+        Vector3Array out, Vector3Array in, size_t n);
+
 #ifdef __cplusplus
 }
 #endif
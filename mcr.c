@@ -0,0 +1,569 @@
+/*
+ * mcr.c: Batched receiver for multicast feeds.
+ *
+ * mcr.c is part of libjvs.
+ *
+ * Copyright: (c) 2026 Jacco van Schaik (jacco@jaccovanschaik.net)
+ * Created:   2026-10-18
+ * Version:   $Id$
+ *
+ * This software is distributed under the terms of the MIT license. See
+ * http://www.opensource.org/licenses/mit-license.php for details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "defs.h"
+#include "debug.h"
+#include "hash.h"
+#include "pa.h"
+#include "udp.h"
+
+#include "mcr.h"
+
+/*
+ * Maximum number of batches read from a socket before giving other files and
+ * timers in the dispatcher a chance.
+ */
+#define MCR_MAX_BATCHES 16
+
+/*
+ * Room for the control messages of a single packet (only the timestamp).
+ */
+#define MCR_CONTROL_SIZE 64
+
+typedef struct {
+    char *group;
+    char *interface;
+} MCR_Group;
+
+typedef struct {
+    uint64_t next;              // Next expected sequence number.
+} MCR_Stream;
+
+struct MCR {
+    Dispatcher *dis;
+    int batch_size;
+    size_t packet_size;
+
+    char *data;                 // <batch_size> buffers of <packet_size> bytes.
+    char *control;              // <batch_size> control message buffers.
+    struct iovec *iov;
+    struct mmsghdr *msg;
+    struct sockaddr_in *from;
+    MCRPacket *packet;
+
+    PointerArray groups;        // MCR_Group structs, indexed by socket.
+    HashTable streams;          // MCR_Stream structs, by stream id.
+
+    MCRStats stats;
+
+    void (*on_packets_cb)(MCR *mcr,
+            const MCRPacket *packet, int count, void *udata);
+    void *on_packets_udata;
+
+    int (*parser)(const char *data, size_t size,
+            uint32_t *stream, uint64_t *seq, void *udata);
+    void *parser_udata;
+};
+
+/*
+ * Read up to <count> packets from <fd> into <msg>, without blocking. Returns
+ * the number of packets read, or -1 if none could be read.
+ */
+static int mcr_receive(int fd, struct mmsghdr *msg, int count)
+{
+#ifdef __linux__
+    return recvmmsg(fd, msg, count, MSG_DONTWAIT, NULL);
+#else
+    int i;
+
+    for (i = 0; i < count; i++) {
+        ssize_t r = recvmsg(fd, &msg[i].msg_hdr, MSG_DONTWAIT);
+
+        if (r < 0) break;
+
+        msg[i].msg_len = r;
+    }
+
+    return i > 0 ? i : -1;
+#endif
+}
+
+/*
+ * Get the kernel receive time of a packet from the control messages in <hdr>
+ * and store it in <ts>. Returns 0 on success, or -1 if it wasn't there.
+ */
+static int mcr_get_time(struct msghdr *hdr, struct timespec *ts)
+{
+#ifdef SCM_TIMESTAMPNS
+    struct cmsghdr *cm;
+
+    for (cm = CMSG_FIRSTHDR(hdr); cm; cm = CMSG_NXTHDR(hdr, cm)) {
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPNS) {
+            memcpy(ts, CMSG_DATA(cm), sizeof(*ts));
+            return 0;
+        }
+    }
+#else
+    UNUSED(hdr);
+    UNUSED(ts);
+#endif
+
+    return -1;
+}
+
+/*
+ * Use the parser installed in <mcr> to find the stream and sequence number of
+ * <packet>, and check them against the sequence number that was expected.
+ */
+static void mcr_check_sequence(MCR *mcr, MCRPacket *packet)
+{
+    MCR_Stream *stream;
+
+    if (mcr->parser == NULL ||
+        mcr->parser(packet->data, packet->size,
+            &packet->stream, &packet->seq, mcr->parser_udata) != 0) {
+        return;
+    }
+
+    packet->sequenced = true;
+
+    stream = hashGet(&mcr->streams, HASH_VALUE(packet->stream));
+
+    if (stream == NULL) {
+        stream = calloc(1, sizeof(MCR_Stream));
+
+        hashAdd(&mcr->streams, stream, HASH_VALUE(packet->stream));
+    }
+    else if (packet->seq < stream->next) {
+        packet->late = true;
+
+        mcr->stats.late++;
+
+        return;
+    }
+    else if (packet->seq > stream->next) {
+        packet->gap = packet->seq - stream->next;
+
+        mcr->stats.gaps++;
+        mcr->stats.lost += packet->gap;
+    }
+
+    stream->next = packet->seq + 1;
+}
+
+/*
+ * Fill in packet <i> in <mcr>, which was received on <fd> and has just been
+ * read into slot <i> of the batch. <now> is used if the kernel didn't supply
+ * a timestamp.
+ */
+static void mcr_fill_packet(MCR *mcr, int fd, int i,
+        const struct timespec *now)
+{
+    struct msghdr *hdr = &mcr->msg[i].msg_hdr;
+
+    MCRPacket *packet = mcr->packet + i;
+
+    memset(packet, 0, sizeof(MCRPacket));
+
+    packet->data = mcr->data + i * mcr->packet_size;
+    packet->size = MIN(mcr->msg[i].msg_len, mcr->packet_size);
+    packet->fd = fd;
+
+    packet->from = mcr->from[i];
+
+    if (hdr->msg_flags & MSG_TRUNC) {
+        packet->truncated = true;
+
+        mcr->stats.truncated++;
+    }
+
+    if (mcr_get_time(hdr, &packet->time) != 0) packet->time = *now;
+
+    mcr_check_sequence(mcr, packet);
+}
+
+/*
+ * Called by the dispatcher when socket <fd> of <mcr> (in <udata>) is
+ * readable. Reads the waiting packets in batches and passes them on.
+ */
+static void mcr_handle_socket(Dispatcher *dis, int fd, void *udata)
+{
+    int i, b, count;
+
+    MCR *mcr = udata;
+
+    UNUSED(dis);
+
+    for (b = 0; b < MCR_MAX_BATCHES; b++) {
+        struct timespec now;
+
+        for (i = 0; i < mcr->batch_size; i++) {
+            struct msghdr *hdr = &mcr->msg[i].msg_hdr;
+
+            hdr->msg_namelen = sizeof(struct sockaddr_in);
+            hdr->msg_controllen = MCR_CONTROL_SIZE;
+            hdr->msg_flags = 0;
+        }
+
+        if ((count = mcr_receive(fd, mcr->msg, mcr->batch_size)) <= 0) break;
+
+        clock_gettime(CLOCK_REALTIME, &now);
+
+        for (i = 0; i < count; i++) {
+            mcr_fill_packet(mcr, fd, i, &now);
+        }
+
+        mcr->stats.packets += count;
+        mcr->stats.batches++;
+
+        if (mcr->on_packets_cb) {
+            mcr->on_packets_cb(mcr, mcr->packet, count,
+                    mcr->on_packets_udata);
+        }
+
+        /* Stop if the socket is empty, or if the callback left the group. */
+
+        if (count < mcr->batch_size || paGet(&mcr->groups, fd) == NULL) break;
+    }
+}
+
+/*
+ * Create a Multicast Receiver that uses Dispatcher <dis>, and reads up to
+ * <batch_size> packets of up to <packet_size> bytes at a time.
+ */
+MCR *mcrCreate(Dispatcher *dis, int batch_size, size_t packet_size)
+{
+    int i;
+
+    MCR *mcr = calloc(1, sizeof(MCR));
+
+    mcr->dis = dis;
+    mcr->batch_size = MAX(batch_size, 1);
+    mcr->packet_size = MAX(packet_size, 1);
+
+    mcr->data = calloc(mcr->batch_size, mcr->packet_size);
+    mcr->control = calloc(mcr->batch_size, MCR_CONTROL_SIZE);
+    mcr->iov = calloc(mcr->batch_size, sizeof(struct iovec));
+    mcr->msg = calloc(mcr->batch_size, sizeof(struct mmsghdr));
+    mcr->from = calloc(mcr->batch_size, sizeof(struct sockaddr_in));
+    mcr->packet = calloc(mcr->batch_size, sizeof(MCRPacket));
+
+    for (i = 0; i < mcr->batch_size; i++) {
+        struct msghdr *hdr = &mcr->msg[i].msg_hdr;
+
+        mcr->iov[i].iov_base = mcr->data + i * mcr->packet_size;
+        mcr->iov[i].iov_len = mcr->packet_size;
+
+        hdr->msg_name = mcr->from + i;
+        hdr->msg_iov = mcr->iov + i;
+        hdr->msg_iovlen = 1;
+        hdr->msg_control = mcr->control + i * MCR_CONTROL_SIZE;
+    }
+
+    return mcr;
+}
+
+/*
+ * Arrange for <cb> to be called with each batch of packets received by <mcr>.
+ * <cb> is called with <mcr>, a pointer to the first of <count> packets, and
+ * <udata>.
+ */
+void mcrOnPackets(MCR *mcr,
+        void (*cb)(MCR *mcr, const MCRPacket *packet, int count, void *udata),
+        void *udata)
+{
+    mcr->on_packets_cb = cb;
+    mcr->on_packets_udata = udata;
+}
+
+/*
+ * Install <parser> to find the stream id and sequence number of packets
+ * received by <mcr>. <parser> is called with the <data> and <size> of each
+ * packet and the <udata> given here, and should return 0 after filling in
+ * <stream> and <seq>, or -1 if the packet doesn't contain them (in which case
+ * no gap detection is done for it). Sequence numbers are expected to increase
+ * by 1 for every packet on a stream.
+ */
+void mcrSetParser(MCR *mcr,
+        int (*parser)(const char *data, size_t size,
+                      uint32_t *stream, uint64_t *seq, void *udata),
+        void *udata)
+{
+    mcr->parser = parser;
+    mcr->parser_udata = udata;
+}
+
+/*
+ * Join multicast group <group> (a dotted-quad ip address) on port <port> and
+ * receive its packets through <mcr>. If <interface> is not NULL, the group is
+ * joined on the network interface with that (dotted-quad) address. Returns the
+ * file descriptor of the new socket, or -1 if an error occurred.
+ */
+int mcrJoin(MCR *mcr, const char *group, uint16_t port, const char *interface)
+{
+    int fd;
+
+    struct in_addr addr;
+
+    if (inet_pton(AF_INET, group, &addr) != 1 ||
+        !IN_MULTICAST(ntohl(addr.s_addr))) {
+        return -1;
+    }
+
+    if ((fd = udpSocket()) < 0) return -1;
+
+    /* Binding to the group address (rather than INADDR_ANY) makes sure this
+     * socket only gets the packets for this group, even if other groups are
+     * joined on the same port. */
+
+    if (udpBind(fd, group, port) != 0 ||
+        udpMulticastJoinOn(fd, group, interface) != 0) {
+        close(fd);
+        return -1;
+    }
+
+#ifdef SO_TIMESTAMPNS
+    int one = 1;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) != 0) {
+        P dbgError(stderr, "setsockopt(TIMESTAMPNS) failed");
+    }
+#endif
+
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+
+    MCR_Group *grp = calloc(1, sizeof(MCR_Group));
+
+    grp->group = strdup(group);
+    grp->interface = interface ? strdup(interface) : NULL;
+
+    paSet(&mcr->groups, fd, grp);
+
+    disOnData(mcr->dis, fd, mcr_handle_socket, mcr);
+
+    return fd;
+}
+
+/*
+ * Leave the multicast group that was joined using mcrJoin(), which returned
+ * <fd>, and close its socket. Returns 0 on success or -1 if <fd> is unknown.
+ */
+int mcrLeave(MCR *mcr, int fd)
+{
+    MCR_Group *grp = paGet(&mcr->groups, fd);
+
+    if (grp == NULL) return -1;
+
+    disDropData(mcr->dis, fd);
+
+    udpMulticastLeaveOn(fd, grp->group, grp->interface);
+
+    close(fd);
+
+    paDrop(&mcr->groups, fd);
+
+    free(grp->group);
+    free(grp->interface);
+    free(grp);
+
+    return 0;
+}
+
+/*
+ * Free stream <data>. Called through hashTraverse().
+ */
+static void mcr_free_stream(HashTable *tbl, void *data, void *udata)
+{
+    UNUSED(tbl);
+    UNUSED(udata);
+
+    free(data);
+}
+
+/*
+ * Forget the expected sequence numbers of all streams, so that the next
+ * packet on each stream is accepted without reporting a gap. Useful after
+ * recovering from a gap in some other way, or when a feed is restarted.
+ */
+void mcrResetStreams(MCR *mcr)
+{
+    hashTraverse(&mcr->streams, mcr_free_stream, NULL);
+    hashClear(&mcr->streams);
+}
+
+/*
+ * Return the statistics collected by <mcr>.
+ */
+const MCRStats *mcrStats(const MCR *mcr)
+{
+    return &mcr->stats;
+}
+
+/*
+ * Leave all groups joined by <mcr> and delete it. Must not be called from the
+ * packet callback.
+ */
+void mcrDestroy(MCR *mcr)
+{
+    int fd;
+
+    for (fd = 0; fd < paCount(&mcr->groups); fd++) {
+        if (paGet(&mcr->groups, fd) != NULL) mcrLeave(mcr, fd);
+    }
+
+    paClear(&mcr->groups);
+
+    mcrResetStreams(mcr);
+
+    free(mcr->data);
+    free(mcr->control);
+    free(mcr->iov);
+    free(mcr->msg);
+    free(mcr->from);
+    free(mcr->packet);
+
+    free(mcr);
+}
+
+#ifdef TEST
+#include "utils.h"
+
+static int errors = 0;
+
+#define GROUP_A "239.255.42.1"
+#define GROUP_B "239.255.42.2"
+
+static int batches = 0, received = 0, gaps = 0, late = 0;
+
+/*
+ * Packets start with a 4-byte stream id and an 8-byte sequence number, both
+ * in host byte order.
+ */
+static int parse_header(const char *data, size_t size,
+        uint32_t *stream, uint64_t *seq, void *udata)
+{
+    UNUSED(udata);
+
+    if (size < 12) return -1;
+
+    memcpy(stream, data, 4);
+    memcpy(seq, data + 4, 8);
+
+    return 0;
+}
+
+static void handle_packets(MCR *mcr, const MCRPacket *packet, int count,
+        void *udata)
+{
+    int i;
+
+    UNUSED(mcr);
+    UNUSED(udata);
+
+    batches++;
+
+    for (i = 0; i < count; i++) {
+        received++;
+
+        if (packet[i].gap > 0) gaps++;
+        if (packet[i].late) late++;
+
+        make_sure_that(packet[i].time.tv_sec > 0);
+        make_sure_that(packet[i].from.sin_family == AF_INET);
+    }
+}
+
+static void send_packet(int sd, const char *group, uint16_t port,
+        uint32_t stream, uint64_t seq)
+{
+    char data[12];
+
+    memcpy(data, &stream, 4);
+    memcpy(data + 4, &seq, 8);
+
+    make_sure_that(udpSend(sd, group, port, data, sizeof(data)) == 12);
+}
+
+static void timeout(Dispatcher *dis, double t, void *udata)
+{
+    UNUSED(dis);
+    UNUSED(t);
+    UNUSED(udata);
+}
+
+int main(void)
+{
+    int i, fd_a, fd_b, sd;
+
+    Dispatcher *dis = disCreate();
+    MCR *mcr = mcrCreate(dis, 4, 1500);
+
+    mcrOnPackets(mcr, handle_packets, NULL);
+    mcrSetParser(mcr, parse_header, NULL);
+
+    make_sure_that(mcrJoin(mcr, "127.0.0.1", 0, NULL) == -1);
+
+    make_sure_that((fd_a = mcrJoin(mcr, GROUP_A, 0, "127.0.0.1")) >= 0);
+
+    uint16_t port = netLocalPort(fd_a);
+
+    make_sure_that((fd_b = mcrJoin(mcr, GROUP_B, port, "127.0.0.1")) >= 0);
+
+    sd = udpSocket();
+
+    make_sure_that(udpMulticastInterface(sd, "127.0.0.1") == 0);
+
+    /* Stream 1 on group A with seq 5 missing, stream 2 on group B, and seq 3
+     * of stream 1 once more on group B. */
+
+    for (i = 0; i < 10; i++) {
+        if (i != 5) send_packet(sd, GROUP_A, port, 1, i);
+    }
+
+    for (i = 0; i < 10; i++) {
+        send_packet(sd, GROUP_B, port, 2, i);
+    }
+
+    send_packet(sd, GROUP_B, port, 1, 3);
+
+    double deadline = dnow() + 5;
+
+    disOnTime(dis, deadline, timeout, NULL);
+
+    while (received < 20 && dnow() < deadline) {
+        disHandleEvents(dis);
+    }
+
+    make_sure_that(received == 20);
+    make_sure_that(batches >= 5);
+    make_sure_that(gaps == 1);
+    make_sure_that(late == 1);
+
+    const MCRStats *stats = mcrStats(mcr);
+
+    make_sure_that(stats->packets == 20);
+    make_sure_that(stats->batches == (uint64_t) batches);
+    make_sure_that(stats->gaps == 1);
+    make_sure_that(stats->lost == 1);
+    make_sure_that(stats->late == 1);
+    make_sure_that(stats->truncated == 0);
+
+    make_sure_that(mcrLeave(mcr, fd_a) == 0);
+    make_sure_that(mcrLeave(mcr, fd_a) == -1);
+
+    close(sd);
+
+    mcrDestroy(mcr);
+    disDestroy(dis);
+
+    return errors;
+}
+#endif
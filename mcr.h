@@ -0,0 +1,140 @@
+#ifndef MCR_H
+#define MCR_H
+
+/*
+ * mcr.h: Batched receiver for multicast feeds.
+ *
+ * A Multicast Receiver joins any number of IPv4 multicast groups, each using
+ * its own socket, and registers those sockets with a Dispatcher. When a socket
+ * becomes readable, all waiting packets are read from it in batches (using
+ * recvmmsg() where available) into a set of packet buffers that is allocated
+ * once, when the receiver is created. Each batch is handed to a callback in
+ * one go, together with the time at which the kernel received each packet.
+ *
+ * If a header parser is installed, it is asked for the stream id and sequence
+ * number of each packet. These are used to detect gaps (missing packets) and
+ * late packets (duplicates or packets that arrive out of order) per stream.
+ * Streams are identified only by the id the parser returns, so if the same
+ * stream is sent over two groups (an "A" and a "B" feed), the copies that
+ * arrive second are reported as late, and gaps are only reported if a packet
+ * is missing from both feeds.
+ *
+ * mcr.h is part of libjvs.
+ *
+ * Copyright: (c) 2026 Jacco van Schaik (jacco@jaccovanschaik.net)
+ * Created:   2026-10-18
+ * Version:   $Id$
+ *
+ * This software is distributed under the terms of the MIT license. See
+ * http://www.opensource.org/licenses/mit-license.php for details.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include <netinet/in.h>
+
+#include "dis.h"
+
+typedef struct MCR MCR;
+
+/*
+ * A received packet. <data> points into the receiver's own buffers, and is
+ * only valid until the callback it was passed to returns.
+ */
+typedef struct {
+    const char *data;
+    size_t size;
+    bool truncated;             // Packet was larger than the buffer size.
+    struct timespec time;       // When the kernel received the packet.
+    struct sockaddr_in from;    // Who sent it.
+    int fd;                     // Socket it came in on, as from mcrJoin().
+    bool sequenced;             // The parser found the fields below.
+    uint32_t stream;            // Stream id.
+    uint64_t seq;               // Sequence number.
+    uint64_t gap;               // Number of packets missing before this one.
+    bool late;                  // Sequence number lower than expected.
+} MCRPacket;
+
+/*
+ * Statistics collected by a receiver.
+ */
+typedef struct {
+    uint64_t packets;           // Packets received.
+    uint64_t batches;           // Calls of the packet callback.
+    uint64_t truncated;         // Packets that didn't fit in a buffer.
+    uint64_t gaps;              // Number of gaps detected.
+    uint64_t lost;              // Total number of packets in those gaps.
+    uint64_t late;              // Duplicate or out-of-order packets.
+} MCRStats;
+
+/*
+ * Create a Multicast Receiver that uses Dispatcher <dis>, and reads up to
+ * <batch_size> packets of up to <packet_size> bytes at a time.
+ */
+MCR *mcrCreate(Dispatcher *dis, int batch_size, size_t packet_size);
+
+/*
+ * Arrange for <cb> to be called with each batch of packets received by <mcr>.
+ * <cb> is called with <mcr>, a pointer to the first of <count> packets, and
+ * <udata>.
+ */
+void mcrOnPackets(MCR *mcr,
+        void (*cb)(MCR *mcr, const MCRPacket *packet, int count, void *udata),
+        void *udata);
+
+/*
+ * Install <parser> to find the stream id and sequence number of packets
+ * received by <mcr>. <parser> is called with the <data> and <size> of each
+ * packet and the <udata> given here, and should return 0 after filling in
+ * <stream> and <seq>, or -1 if the packet doesn't contain them (in which case
+ * no gap detection is done for it). Sequence numbers are expected to increase
+ * by 1 for every packet on a stream.
+ */
+void mcrSetParser(MCR *mcr,
+        int (*parser)(const char *data, size_t size,
+                      uint32_t *stream, uint64_t *seq, void *udata),
+        void *udata);
+
+/*
+ * Join multicast group <group> (a dotted-quad ip address) on port <port> and
+ * receive its packets through <mcr>. If <interface> is not NULL, the group is
+ * joined on the network interface with that (dotted-quad) address. Returns the
+ * file descriptor of the new socket, or -1 if an error occurred.
+ */
+int mcrJoin(MCR *mcr, const char *group, uint16_t port, const char *interface);
+
+/*
+ * Leave the multicast group that was joined using mcrJoin(), which returned
+ * <fd>, and close its socket. Returns 0 on success or -1 if <fd> is unknown.
+ */
+int mcrLeave(MCR *mcr, int fd);
+
+/*
+ * Forget the expected sequence numbers of all streams, so that the next
+ * packet on each stream is accepted without reporting a gap. Useful after
+ * recovering from a gap in some other way, or when a feed is restarted.
+ */
+void mcrResetStreams(MCR *mcr);
+
+/*
+ * Return the statistics collected by <mcr>.
+ */
+const MCRStats *mcrStats(const MCR *mcr);
+
+/*
+ * Leave all groups joined by <mcr> and delete it. Must not be called from the
+ * packet callback.
+ */
+void mcrDestroy(MCR *mcr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,5 +1,5 @@
 /*
- * mdf.c: Minimal Data Format parser.
+ * mdf.c: Minimal Data Format parser and writer.
  *
  * A data file consists of a sequence of name/value pairs. Names are unquoted
  * strings, starting with a letter or underscore and followed by any number of
@@ -30,14 +30,22 @@
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <limits.h>
+#include <locale.h>
+#include <float.h>
+#include <errno.h>
+#include <math.h>
 #include <assert.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #include "buffer.h"
+#include "defs.h"
 
 #include "mdf.h"
 
@@ -75,8 +83,14 @@ struct MDF_Stream {
         FILE *fp;
         const char *str;
     } u;
+    const char *end;    /* If not NULL, where a string stream ends. */
 };
 
+/* Don't bother splitting up a stream for mdfParseParallel() if the pieces
+ * would be smaller than this. */
+
+#define MDF_MIN_SECTION_SIZE 65536
+
 /*
  * Push back character <c> onto the input stream.
  */
@@ -108,9 +122,9 @@ static int mdf_get_char(MDF_Stream *stream)
     int c;
 
     if (stream->type == MDF_ST_STRING) {
-        c = *stream->u.str;
-
-        if (c == '\0')
+        if (stream->end != NULL && stream->u.str >= stream->end)
+            c = EOF;
+        else if ((c = *stream->u.str) == '\0' && stream->end == NULL)
             c = EOF;
         else
             stream->u.str++;
@@ -152,35 +166,257 @@ static void mdf_unexpected(MDF_Stream *stream, int c)
     }
 }
 
+/* Powers of ten that can be represented exactly by a double. */
+
+static const double mdf_pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* The largest integer up to which every integer is representable exactly by
+ * a double. */
+
+#define MDF_MAX_EXACT_INT (1ULL << 53)
+
+static pthread_once_t mdf_locale_once = PTHREAD_ONCE_INIT;
+static locale_t mdf_locale = (locale_t) 0;
+
 /*
- * Interpret <value> as a number and update <obj> with what we think it is.
+ * Create the "C" locale used to interpret floats that the fast path in
+ * mdf_parse_double() can't handle.
  */
-static int mdf_interpret_number(const char *value, MDF_Object *obj)
+static void mdf_init_locale(void)
 {
-    long i;
-    double f;
+    mdf_locale = newlocale(LC_NUMERIC_MASK, "C", (locale_t) 0);
+}
 
-    char *end;
+/*
+ * Return the value of <c> as a digit in base <base>, or -1 if it isn't one.
+ */
+static int mdf_digit(int c, int base)
+{
+    int d;
+
+    if (c >= '0' && c <= '9')
+        d = c - '0';
+    else if (c >= 'a' && c <= 'f')
+        d = c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F')
+        d = c - 'A' + 10;
+    else
+        return -1;
 
-    i = strtol(value, &end, 0);
+    return d < base ? d : -1;
+}
 
-    if (end == value + strlen(value)) {
+/*
+ * Interpret the <len> characters at <value> as a long integer, following the
+ * same rules as strtol() with base 0 (so hexadecimal if it starts with 0x,
+ * octal if it starts with 0, decimal otherwise) and store the result in
+ * <result>. As with strtol(), values that are out of range are clamped to
+ * LONG_MIN or LONG_MAX. Returns 0 if all <len> characters were used,
+ * otherwise -1.
+ */
+static int mdf_parse_long(const char *value, size_t len, long *result)
+{
+    const char *p = value, *end = value + len;
+
+    int d, base = 10, negative = FALSE, overflow = FALSE;
+
+    if (p < end && (*p == '+' || *p == '-')) {
+        negative = (*p++ == '-');
+    }
+
+    if (p == end) return -1;
+
+    if (*p == '0') {
+        if (end - p > 2 && (p[1] == 'x' || p[1] == 'X') &&
+            mdf_digit(p[2], 16) >= 0)
+        {
+            base = 16;
+            p += 2;
+        }
+        else {
+            base = 8;
+        }
+    }
+
+    unsigned long acc = 0;
+    unsigned long limit = negative ? (unsigned long) LONG_MAX + 1 : LONG_MAX;
+
+    for (; p < end; p++) {
+        if ((d = mdf_digit(*p, base)) < 0) return -1;
+
+        if (acc > (limit - d) / base)
+            overflow = TRUE;
+        else
+            acc = acc * base + d;
+    }
+
+    if (overflow)
+        *result = negative ? LONG_MIN : LONG_MAX;
+    else
+        *result = negative ? (long) (0UL - acc) : (long) acc;
+
+    return 0;
+}
+
+/*
+ * Interpret the <len> characters at <value> as a decimal floating point
+ * number and store the result in <result>. This only handles the cases where
+ * the result can be calculated exactly with a single multiplication or
+ * division by an exactly representable power of ten (which are all numbers
+ * with at most 15 or so significant digits and a reasonable exponent), so
+ * the result is always correctly rounded. If this is not the case, or if
+ * <value> contains anything unexpected, -1 is returned and the caller should
+ * fall back on strtod(). Otherwise 0 is returned.
+ */
+static int mdf_parse_double(const char *value, size_t len, double *result)
+{
+#if FLT_EVAL_METHOD == 0
+    const char *p = value, *end = value + len;
+
+    int negative = FALSE, any_digits = FALSE, sig_digits = 0;
+    int exponent = 0;
+
+    uint64_t mantissa = 0;
+
+    if (p < end && (*p == '+' || *p == '-')) {
+        negative = (*p++ == '-');
+    }
+
+    for (; p < end && isdigit((unsigned char) *p); p++) {
+        any_digits = TRUE;
+
+        if (mantissa == 0 && *p == '0') continue;
+
+        if (++sig_digits > 19) return -1;
+
+        mantissa = 10 * mantissa + (*p - '0');
+    }
+
+    if (p < end && *p == '.') {
+        for (p++; p < end && isdigit((unsigned char) *p); p++) {
+            any_digits = TRUE;
+            exponent--;
+
+            if (mantissa == 0 && *p == '0') continue;
+
+            if (++sig_digits > 19) return -1;
+
+            mantissa = 10 * mantissa + (*p - '0');
+        }
+    }
+
+    if (!any_digits) return -1;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        int exp_negative = FALSE, exp_value = 0;
+
+        p++;
+
+        if (p < end && (*p == '+' || *p == '-')) {
+            exp_negative = (*p++ == '-');
+        }
+
+        if (p == end || !isdigit((unsigned char) *p)) return -1;
+
+        for (; p < end && isdigit((unsigned char) *p); p++) {
+            if (exp_value < 10000) exp_value = 10 * exp_value + (*p - '0');
+        }
+
+        exponent += exp_negative ? -exp_value : exp_value;
+    }
+
+    if (p != end) return -1;
+
+    if (mantissa == 0) {
+        *result = negative ? -0.0 : 0.0;
+        return 0;
+    }
+
+    if (mantissa > MDF_MAX_EXACT_INT) return -1;
+
+    /* If the exponent is too large, see if we can move part of it into the
+     * mantissa without it becoming inexact. */
+
+    for (; exponent > 22; exponent--) {
+        if (mantissa > MDF_MAX_EXACT_INT / 10) return -1;
+
+        mantissa *= 10;
+    }
+
+    if (exponent < -22) return -1;
+
+    double f = (double) mantissa;
+
+    if (exponent >= 0)
+        f *= mdf_pow10[exponent];
+    else
+        f /= mdf_pow10[-exponent];
+
+    *result = negative ? -f : f;
+
+    return 0;
+#else
+    /* Excess precision in intermediate results would break the exactness
+     * guarantee above, so always use strtod(). */
+
+    UNUSED(value);
+    UNUSED(len);
+    UNUSED(result);
+
+    return -1;
+#endif
+}
+
+/*
+ * Interpret the <len> characters at <value> as a number and update <obj>
+ * with what we think it is. Integers are interpreted like strtol() with base
+ * 0 would do, floats like strtod() in the "C" locale. Returns 0 on success
+ * or -1 if <value> is not a number we recognize.
+ */
+static int mdf_interpret_number(const char *value, size_t len, MDF_Object *obj)
+{
+    long i;
+    double f;
+
+    if (mdf_parse_long(value, len, &i) == 0) {
         obj->type = MDF_INT;
         obj->u.i = i;
 
         return 0;
     }
 
-    f = strtod(value, &end);
-
-    if (end == value + strlen(value)) {
+    if (mdf_parse_double(value, len, &f) == 0) {
         obj->type = MDF_FLOAT;
         obj->u.f = f;
 
         return 0;
     }
 
-    return -1;
+    /* Fall back on strtod for everything the fast path doesn't handle (long
+     * mantissas, extreme exponents, hexadecimal floats...) */
+
+    char *copy = strndup(value, len), *end;
+
+    pthread_once(&mdf_locale_once, mdf_init_locale);
+
+    if (mdf_locale != (locale_t) 0)
+        f = strtod_l(copy, &end, mdf_locale);
+    else
+        f = strtod(copy, &end);
+
+    int r = (end == copy + len && len > 0) ? 0 : -1;
+
+    free(copy);
+
+    if (r == 0) {
+        obj->type = MDF_FLOAT;
+        obj->u.f = f;
+    }
+
+    return r;
 }
 
 /*
@@ -250,6 +486,9 @@ static MDF_Object *mdf_parse(MDF_Stream *stream, int nesting_level)
     Buffer name = { 0 };                /* Name of current object. */
     Buffer value = { 0 };               /* Value of current object. */
 
+    const char *number = NULL;          /* Start and length of a number, */
+    size_t number_len = 0;              /* if read from a string stream. */
+
     while (1) {
         if (state == MDF_STATE_ERROR || state == MDF_STATE_END) break;
 
@@ -267,7 +506,17 @@ static MDF_Object *mdf_parse(MDF_Stream *stream, int nesting_level)
                 state = MDF_STATE_NAME;
             }
             else if (c == '+' || c == '-' || c == '.' || isdigit(c)) {
-                bufSetC(&value, c);
+                /* If we're reading from a string, the number will simply be
+                 * interpreted where it is. Otherwise collect it in <value>. */
+
+                if (stream->type == MDF_ST_STRING) {
+                    number = stream->u.str - 1;
+                    number_len = 1;
+                }
+                else {
+                    bufSetC(&value, c);
+                }
+
                 state = MDF_STATE_NUMBER;
             }
             else if (c == '"') {
@@ -396,12 +645,15 @@ static MDF_Object *mdf_parse(MDF_Stream *stream, int nesting_level)
             break;
         case MDF_STATE_NUMBER:
             /* A number (float or int). Accept anything that can occur in a
-             * number (floating point, octal or hex) and let strtod or strtol
-             * sort it out later. */
+             * number (floating point, octal or hex) and let
+             * mdf_interpret_number sort it out later. */
 
             if (isxdigit(c) || c == 'x' || c == '.' ||
                 c == 'e' || c == 'E' || c == '+' || c == '-') {
-                bufAddC(&value, c);
+                if (number != NULL)
+                    number_len++;
+                else
+                    bufAddC(&value, c);
             }
             else if (isspace(c) || c == '{' || c == '}' || c == EOF) {
                 MDF_Object *obj =
@@ -409,15 +661,24 @@ static MDF_Object *mdf_parse(MDF_Stream *stream, int nesting_level)
                             c == '\n' ? stream->line - 1 : stream->line,
                             &root, &last);
 
-                if (mdf_interpret_number(bufGet(&value), obj) == 0) {
+                if (number == NULL) {
+                    number = bufGet(&value);
+                    number_len = bufLen(&value);
+                }
+
+                if (mdf_interpret_number(number, number_len, obj) == 0) {
                     state = MDF_STATE_NONE;
                 }
                 else {
-                    bufSetF(&stream->error, "%s:%d: unrecognized value \"%s\"",
-                            stream->file, stream->line, bufGet(&value));
+                    bufSetF(&stream->error,
+                            "%s:%d: unrecognized value \"%.*s\"",
+                            stream->file, stream->line,
+                            (int) number_len, number);
                     state = MDF_STATE_ERROR;
                 }
 
+                number = NULL;
+
                 mdf_unget_char(stream, c);
             }
             else {
@@ -556,6 +817,321 @@ MDF_Object *mdfParse(MDF_Stream *stream)
     return mdf_parse(stream, 0);
 }
 
+/*
+ * A single parse job, to be done by one of the threads started by
+ * mdf_run_jobs().
+ */
+typedef struct {
+    MDF_Stream *stream;     /* The stream to parse... */
+    int         line;       /* ... starting at this line. */
+    MDF_Object *root;       /* The result. */
+} MDF_Job;
+
+/*
+ * A set of parse jobs, shared by all threads that work on them.
+ */
+typedef struct {
+    MDF_Job *job;
+    int      count;
+    int      next;          /* Index of the next job to be picked up. */
+} MDF_JobList;
+
+/*
+ * Keep picking up jobs from the list at <arg> until there are none left.
+ */
+static void *mdf_worker(void *arg)
+{
+    MDF_JobList *jobs = arg;
+
+    int i;
+
+    while ((i = __atomic_fetch_add(&jobs->next, 1, __ATOMIC_RELAXED))
+            < jobs->count)
+    {
+        MDF_Job *job = jobs->job + i;
+
+        if (job->stream == NULL) continue;
+
+        job->stream->line = job->line;
+        job->root = mdf_parse(job->stream, 0);
+    }
+
+    return NULL;
+}
+
+/*
+ * Run the <count> jobs in <job>, using at most <threads> threads. If <threads>
+ * is 0 or less, use one thread per available processor. The calling thread is
+ * one of the workers.
+ */
+static void mdf_run_jobs(MDF_Job *job, int count, int threads)
+{
+    int i, started;
+
+    MDF_JobList jobs = { .job = job, .count = count, .next = 0 };
+
+    if (threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > count) threads = count;
+    if (threads < 1) threads = 1;
+
+    pthread_t *thread = calloc(threads, sizeof(pthread_t));
+
+    /* If we can't start as many threads as requested, simply make do with
+     * what we got. */
+
+    for (started = 1; started < threads; started++) {
+        if (pthread_create(&thread[started], NULL, mdf_worker, &jobs) != 0)
+            break;
+    }
+
+    mdf_worker(&jobs);
+
+    for (i = 1; i < started; i++) {
+        pthread_join(thread[i], NULL);
+    }
+
+    free(thread);
+}
+
+/*
+ * Read everything that is left in <stream> and return it in <text>.
+ */
+static void mdf_slurp(MDF_Stream *stream, Buffer *text)
+{
+    char block[65536];
+    size_t n;
+
+    if (stream->type == MDF_ST_STRING) {
+        bufSetS(text, stream->u.str);
+
+        stream->u.str += bufLen(text);
+
+        return;
+    }
+
+    while ((n = fread(block, 1, sizeof(block), stream->u.fp)) > 0) {
+        bufAdd(text, block, n);
+    }
+}
+
+/*
+ * Do a quick scan of the <len> bytes in <text>, looking for places where a
+ * top-level container ends. These are the places where it can safely be split
+ * into sections that can be parsed independently. The text is split into
+ * sections of (roughly) at least <min_size> bytes. The offset where each
+ * section starts is stored in <offset> and the line number it starts on in
+ * <line>, both of which have room for <max_sections> entries. The number of
+ * sections found is returned. If the scan finds something it doesn't like
+ * (e.g. unbalanced braces) it just stops splitting and lets the parser find
+ * out what's wrong.
+ */
+static int mdf_find_sections(const char *text, size_t len, size_t min_size,
+        size_t *offset, int *line, int max_sections)
+{
+    enum { NONE, COMMENT, STRING, ESCAPE } state = NONE;
+
+    size_t i;
+    int depth = 0, count = 1, cur_line = 1;
+
+    offset[0] = 0;
+    line[0] = 1;
+
+    for (i = 0; i < len && count < max_sections; i++) {
+        char c = text[i];
+
+        if (c == '\n' || (c == '\r' && (i + 1 == len || text[i + 1] != '\n'))) {
+            cur_line++;
+        }
+
+        switch(state) {
+        case NONE:
+            if (c == '#') {
+                state = COMMENT;
+            }
+            else if (c == '"') {
+                state = STRING;
+            }
+            else if (c == '{') {
+                depth++;
+            }
+            else if (c == '}' && --depth < 0) {
+                return count;
+            }
+            else if (c == '}' && depth == 0 &&
+                     i + 1 - offset[count - 1] >= min_size && i + 1 < len) {
+                offset[count] = i + 1;
+                line[count] = cur_line;
+                count++;
+            }
+            break;
+        case COMMENT:
+            if (c == '\n' || c == '\r') state = NONE;
+            break;
+        case STRING:
+            if (c == '\\')
+                state = ESCAPE;
+            else if (c == '"')
+                state = NONE;
+            break;
+        case ESCAPE:
+            state = STRING;
+            break;
+        }
+    }
+
+    return count;
+}
+
+/*
+ * Parse <stream> like mdfParse() does, but first split it up into sections
+ * at the end of top-level containers, parse those sections concurrently
+ * using at most <threads> threads and then link the results together in the
+ * original order. If <threads> is 0 or less, one thread per available
+ * processor is used. The result is the same as what mdfParse() would have
+ * returned, including the error message if the stream contains an error.
+ */
+MDF_Object *mdfParseParallel(MDF_Stream *stream, int threads)
+{
+    int i;
+
+    if (stream == NULL) return NULL;
+
+    if (threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    Buffer text = { 0 };
+
+    mdf_slurp(stream, &text);
+
+    /* Make more sections than threads, so that threads that happen to get
+     * the smaller sections can pick up another one. */
+
+    int max_sections = 4 * threads;
+
+    size_t len = bufLen(&text);
+    size_t min_size = MAX(len / max_sections, MDF_MIN_SECTION_SIZE);
+
+    size_t *offset = calloc(max_sections, sizeof(size_t));
+    int    *line   = calloc(max_sections, sizeof(int));
+
+    int count = mdf_find_sections(bufGet(&text), len, min_size,
+            offset, line, max_sections);
+
+    MDF_Stream *section = calloc(count, sizeof(MDF_Stream));
+    MDF_Job    *job     = calloc(count, sizeof(MDF_Job));
+
+    for (i = 0; i < count; i++) {
+        section[i].type  = MDF_ST_STRING;
+        section[i].file  = stream->file;
+        section[i].u.str = bufGet(&text) + offset[i];
+        section[i].end   = i == count - 1 ?
+            bufGet(&text) + len : bufGet(&text) + offset[i + 1];
+
+        job[i].stream = section + i;
+        job[i].line   = line[i];
+    }
+
+    mdf_run_jobs(job, count, threads);
+
+    MDF_Object *root = NULL, *last = NULL;
+
+    for (i = 0; i < count; i++) {
+        if (!bufIsEmpty(&section[i].error)) break;
+
+        if (job[i].root == NULL) continue;
+
+        /* Unnamed objects at the start of a section take their name from
+         * the last object of the previous section, as they would have if the
+         * two had been parsed in one go. */
+
+        if (last != NULL && last->name != NULL) {
+            MDF_Object *obj;
+
+            for (obj = job[i].root; obj && obj->name == NULL; obj = obj->next) {
+                obj->name = strdup(last->name);
+            }
+        }
+
+        if (last == NULL)
+            root = job[i].root;
+        else
+            last->next = job[i].root;
+
+        for (last = job[i].root; last->next != NULL; last = last->next);
+    }
+
+    /* If one of the sections had an error, run the whole text through the
+     * regular parser, so that the error is reported exactly as mdfParse()
+     * would have. */
+
+    if (i < count) {
+        MDF_Stream whole = {
+            .type = MDF_ST_STRING,
+            .file = stream->file,
+            .line = 1,
+            .u.str = bufGet(&text),
+            .end = bufGet(&text) + len
+        };
+
+        mdfFree(root);
+
+        for (; i < count; i++) {
+            mdfFree(job[i].root);
+        }
+
+        if ((root = mdf_parse(&whole, 0)) == NULL) {
+            bufSet(&stream->error, bufGet(&whole.error), bufLen(&whole.error));
+        }
+
+        bufClear(&whole.error);
+    }
+
+    for (i = 0; i < count; i++) {
+        bufClear(&section[i].error);
+    }
+
+    free(section);
+    free(job);
+    free(offset);
+    free(line);
+
+    bufClear(&text);
+
+    return root;
+}
+
+/*
+ * Parse the <count> streams in <streams> concurrently, using at most
+ * <threads> threads (or one per available processor if <threads> is 0 or
+ * less). The first object found in stream <i> is returned through
+ * <results[i]>. Returns 0 if all streams were parsed successfully, otherwise
+ * -1. In that case, use mdfError() to find out which streams had errors and
+ * why.
+ */
+int mdfParseBatch(MDF_Stream **streams, MDF_Object **results,
+        int count, int threads)
+{
+    int i, r = 0;
+
+    MDF_Job *job = calloc(count, sizeof(MDF_Job));
+
+    for (i = 0; i < count; i++) {
+        job[i].stream = streams[i];
+        job[i].line   = 1;
+    }
+
+    mdf_run_jobs(job, count, threads);
+
+    for (i = 0; i < count; i++) {
+        results[i] = job[i].root;
+
+        if (streams[i] == NULL || !bufIsEmpty(&streams[i]->error)) r = -1;
+    }
+
+    free(job);
+
+    return r;
+}
+
 /*
  * Return type <type> as a string.
  */
@@ -588,7 +1164,9 @@ const char *mdfError(const MDF_Stream *stream)
 }
 
 /*
- * Free the object list starting at <root>.
+ * Free the object list starting at <root>. Every object, name and string in
+ * the list has its own allocation from malloc(), so callers may also unlink,
+ * replace or free parts of it themselves.
  */
 void mdfFree(MDF_Object *root)
 {
@@ -625,6 +1203,441 @@ void mdfClose(MDF_Stream *stream)
     free(stream);
 }
 
+/* Output to a file descriptor is collected until there is at least this
+ * much of it, and then written in one go. */
+
+#define MDF_WRITE_BLOCK 65536
+
+/* Definition of a writer. */
+
+struct MDF_Writer {
+    Buffer *buf;        /* Where to write to, if writing to a Buffer... */
+    int     fd;         /* ... or a file descriptor. */
+    Buffer  pending;    /* Output not yet written to <fd>. */
+    int     flags;      /* Flags given when the writer was created. */
+    int     depth;      /* Current container nesting level. */
+    int     need_space; /* Separate the next object from the previous one. */
+    Buffer  error;      /* Error message, if any. */
+};
+
+/*
+ * Create a writer with flags <flags>.
+ */
+static MDF_Writer *mdf_create_writer(int flags)
+{
+    MDF_Writer *writer = calloc(1, sizeof(MDF_Writer));
+
+    writer->fd = -1;
+    writer->flags = flags;
+
+    return writer;
+}
+
+/*
+ * Return the buffer that <writer> should write its output to.
+ */
+static Buffer *mdf_output(MDF_Writer *writer)
+{
+    return writer->buf != NULL ? writer->buf : &writer->pending;
+}
+
+/*
+ * Write the output collected in <writer> to its file descriptor. Returns 0
+ * on success or -1 on failure.
+ */
+static int mdf_flush(MDF_Writer *writer)
+{
+    size_t done = 0;
+
+    while (done < bufLen(&writer->pending)) {
+        ssize_t r = write(writer->fd, bufGet(&writer->pending) + done,
+                bufLen(&writer->pending) - done);
+
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        else if (r < 0) {
+            bufSetF(&writer->error, "write failed: %s", strerror(errno));
+            bufTrim(&writer->pending, done, 0);
+            return -1;
+        }
+
+        done += r;
+    }
+
+    bufRewind(&writer->pending);
+
+    return 0;
+}
+
+/*
+ * Start writing an object with name <name> (which may be NULL) to <writer>.
+ * Returns 0 on success or -1 on failure.
+ */
+static int mdf_start_object(MDF_Writer *writer, const char *name)
+{
+    const char *p;
+
+    Buffer *out = mdf_output(writer);
+
+    if (!bufIsEmpty(&writer->error)) return -1;
+
+    if (name != NULL) {
+        for (p = name; *p != '\0'; p++) {
+            unsigned char c = *p;
+
+            if (!(c == '_' || isalpha(c) || (p > name && isdigit(c)))) {
+                bufSetF(&writer->error, "invalid name \"%s\"", name);
+                return -1;
+            }
+        }
+
+        if (p == name) {
+            bufSetF(&writer->error, "invalid name \"\"");
+            return -1;
+        }
+    }
+
+    if (writer->flags & MDF_PRETTY) {
+        int i;
+
+        for (i = 0; i < 4 * writer->depth; i++) bufAddC(out, ' ');
+    }
+    else if (writer->need_space) {
+        bufAddC(out, ' ');
+    }
+
+    if (name != NULL) {
+        bufAddS(out, name);
+        bufAddC(out, ' ');
+    }
+
+    return 0;
+}
+
+/*
+ * Finish writing an object to <writer>. Returns 0 on success or -1 on
+ * failure.
+ */
+static int mdf_end_object(MDF_Writer *writer)
+{
+    if (writer->flags & MDF_PRETTY) {
+        bufAddC(mdf_output(writer), '\n');
+    }
+
+    writer->need_space = TRUE;
+
+    if (writer->buf == NULL && bufLen(&writer->pending) >= MDF_WRITE_BLOCK) {
+        return mdf_flush(writer);
+    }
+
+    return 0;
+}
+
+/*
+ * Create a writer that appends its output to <buf>. <flags> is a bitwise OR
+ * of MDF_* flags, or 0.
+ */
+MDF_Writer *mdfWriteToBuffer(Buffer *buf, int flags)
+{
+    MDF_Writer *writer = mdf_create_writer(flags);
+
+    writer->buf = buf;
+
+    return writer;
+}
+
+/*
+ * Create a writer that writes its output to file descriptor <fd>. Output is
+ * collected and written in large blocks. <flags> is a bitwise OR of MDF_*
+ * flags, or 0.
+ */
+MDF_Writer *mdfWriteToFD(int fd, int flags)
+{
+    MDF_Writer *writer = mdf_create_writer(flags);
+
+    writer->fd = fd;
+
+    return writer;
+}
+
+/*
+ * Write a string object with name <name> and value <value> to <writer>.
+ * Characters that need it are escaped. <value> may only contain printable
+ * characters, tabs, carriage returns and newlines, because that is all that
+ * can be read back. <name> may be NULL, which means it will get the name of
+ * the preceding object when read back. Returns 0 on success or -1 on
+ * failure.
+ */
+int mdfWriteString(MDF_Writer *writer, const char *name, const char *value)
+{
+    const char *p, *start;
+
+    if (mdf_start_object(writer, name) != 0) return -1;
+
+    Buffer *out = mdf_output(writer);
+
+    bufAddC(out, '"');
+
+    for (start = p = value; *p != '\0'; p++) {
+        char esc;
+
+        if (*p == '\t')
+            esc = 't';
+        else if (*p == '\r')
+            esc = 'r';
+        else if (*p == '\n')
+            esc = 'n';
+        else if (*p == '"' || *p == '\\')
+            esc = *p;
+        else if (isprint((unsigned char) *p))
+            continue;
+        else {
+            bufSetF(&writer->error,
+                    "can't write character 0x%02x in string \"%s\"",
+                    (unsigned char) *p, value);
+            return -1;
+        }
+
+        bufAdd(out, start, p - start);
+        bufAddC(out, '\\');
+        bufAddC(out, esc);
+
+        start = p + 1;
+    }
+
+    bufAdd(out, start, p - start);
+    bufAddC(out, '"');
+
+    return mdf_end_object(writer);
+}
+
+/*
+ * Write an integer object with name <name> and value <value> to <writer>.
+ * <name> may be NULL (see mdfWriteString()). Returns 0 on success or -1 on
+ * failure.
+ */
+int mdfWriteInt(MDF_Writer *writer, const char *name, long value)
+{
+    if (mdf_start_object(writer, name) != 0) return -1;
+
+    bufAddF(mdf_output(writer), "%ld", value);
+
+    return mdf_end_object(writer);
+}
+
+/*
+ * Write a float object with name <name> and value <value> to <writer>. The
+ * shortest representation that reads back as exactly the same value is used,
+ * and it always looks like a float (so 1.0 is written as "1.0", not "1").
+ * Infinities and NaNs can't be written. <name> may be NULL (see
+ * mdfWriteString()). Returns 0 on success or -1 on failure.
+ */
+int mdfWriteFloat(MDF_Writer *writer, const char *name, double value)
+{
+    char text[32];
+    int precision;
+
+    if (!isfinite(value)) {
+        if (bufIsEmpty(&writer->error)) {
+            bufSetF(&writer->error, "can't write non-finite float %g", value);
+        }
+
+        return -1;
+    }
+
+    if (mdf_start_object(writer, name) != 0) return -1;
+
+    /* Make sure we use a decimal point, not a comma, regardless of what the
+     * current locale says. */
+
+    pthread_once(&mdf_locale_once, mdf_init_locale);
+
+    locale_t old_locale = (locale_t) 0;
+
+    if (mdf_locale != (locale_t) 0) old_locale = uselocale(mdf_locale);
+
+    for (precision = 15; precision < 17; precision++) {
+        snprintf(text, sizeof(text), "%.*g", precision, value);
+
+        if (strtod(text, NULL) == value) break;
+    }
+
+    if (precision == 17) snprintf(text, sizeof(text), "%.17g", value);
+
+    if (old_locale != (locale_t) 0) uselocale(old_locale);
+
+    bufAddS(mdf_output(writer), text);
+
+    if (strpbrk(text, ".eE") == NULL) bufAddS(mdf_output(writer), ".0");
+
+    return mdf_end_object(writer);
+}
+
+/*
+ * Start a container with name <name> on <writer>. Everything written after
+ * this, until the matching call to mdfWriteEnd(), goes into this container.
+ * <name> may be NULL (see mdfWriteString()). Returns 0 on success or -1 on
+ * failure.
+ */
+int mdfWriteBegin(MDF_Writer *writer, const char *name)
+{
+    if (mdf_start_object(writer, name) != 0) return -1;
+
+    bufAddC(mdf_output(writer), '{');
+
+    if (writer->flags & MDF_PRETTY) bufAddC(mdf_output(writer), '\n');
+
+    writer->need_space = TRUE;
+    writer->depth++;
+
+    return 0;
+}
+
+/*
+ * End the container that was started with the most recent call to
+ * mdfWriteBegin(). Returns 0 on success or -1 on failure.
+ */
+int mdfWriteEnd(MDF_Writer *writer)
+{
+    if (!bufIsEmpty(&writer->error)) return -1;
+
+    if (writer->depth == 0) {
+        bufSetF(&writer->error, "mdfWriteEnd without mdfWriteBegin");
+        return -1;
+    }
+
+    writer->depth--;
+
+    if (writer->flags & MDF_PRETTY) {
+        int i;
+
+        for (i = 0; i < 4 * writer->depth; i++) {
+            bufAddC(mdf_output(writer), ' ');
+        }
+
+        bufAddC(mdf_output(writer), '}');
+    }
+    else {
+        bufAddS(mdf_output(writer), " }");
+    }
+
+    return mdf_end_object(writer);
+}
+
+/*
+ * Write the list of objects starting at <root>, and everything they contain,
+ * to <writer>. Returns 0 on success or -1 on failure.
+ */
+int mdfWriteObjects(MDF_Writer *writer, const MDF_Object *root)
+{
+    const MDF_Object *obj;
+
+    for (obj = root; obj != NULL; obj = obj->next) {
+        int r;
+
+        switch(obj->type) {
+        case MDF_STRING:
+            r = mdfWriteString(writer, obj->name, obj->u.s);
+            break;
+        case MDF_INT:
+            r = mdfWriteInt(writer, obj->name, obj->u.i);
+            break;
+        case MDF_FLOAT:
+            r = mdfWriteFloat(writer, obj->name, obj->u.f);
+            break;
+        case MDF_CONTAINER:
+            if ((r = mdfWriteBegin(writer, obj->name)) == 0 &&
+                (r = mdfWriteObjects(writer, obj->u.c)) == 0)
+            {
+                r = mdfWriteEnd(writer);
+            }
+            break;
+        default:
+            bufSetF(&writer->error, "unknown object type %d", obj->type);
+            r = -1;
+            break;
+        }
+
+        if (r != 0) return r;
+    }
+
+    return 0;
+}
+
+/*
+ * Write any output that <writer> is still holding on to. Only has an effect
+ * on writers that write to a file descriptor. Returns 0 on success or -1 on
+ * failure.
+ */
+int mdfWriterFlush(MDF_Writer *writer)
+{
+    if (!bufIsEmpty(&writer->error)) return -1;
+
+    if (writer->buf == NULL) return mdf_flush(writer);
+
+    return 0;
+}
+
+/*
+ * Retrieve an error text from <writer>, in case any function has returned
+ * an error.
+ */
+const char *mdfWriterError(const MDF_Writer *writer)
+{
+    return bufGet(&writer->error);
+}
+
+/*
+ * Finish writing to <writer>: end the output with a newline (unless
+ * pretty-printing, which already does), write any pending output and free
+ * <writer>. Returns -1 if any error has occurred on <writer> or if there are
+ * still unfinished containers, otherwise 0.
+ */
+int mdfWriterClose(MDF_Writer *writer)
+{
+    int r = bufIsEmpty(&writer->error) && writer->depth == 0 ? 0 : -1;
+
+    if (r == 0 && !(writer->flags & MDF_PRETTY) && writer->need_space) {
+        bufAddC(mdf_output(writer), '\n');
+    }
+
+    if (r == 0 && writer->buf == NULL) r = mdf_flush(writer);
+
+    bufClear(&writer->pending);
+    bufClear(&writer->error);
+
+    free(writer);
+
+    return r;
+}
+
+/*
+ * Write the list of objects starting at <root> to <buf>, according to
+ * <flags>. Returns 0 on success or -1 on failure.
+ */
+int mdfFormat(Buffer *buf, const MDF_Object *root, int flags)
+{
+    MDF_Writer *writer = mdfWriteToBuffer(buf, flags);
+
+    int r = mdfWriteObjects(writer, root);
+
+    return mdfWriterClose(writer) == 0 ? r : -1;
+}
+
+/*
+ * Write the list of objects starting at <root> to file descriptor <fd>,
+ * according to <flags>. Returns 0 on success or -1 on failure.
+ */
+int mdfWrite(int fd, const MDF_Object *root, int flags)
+{
+    MDF_Writer *writer = mdfWriteToFD(fd, flags);
+
+    int r = mdfWriteObjects(writer, root);
+
+    return mdfWriterClose(writer) == 0 ? r : -1;
+}
+
 #ifdef TEST
 #include "utils.h"
 
@@ -751,6 +1764,255 @@ static Test test[] = {
 
 static int num_tests = sizeof(test) / sizeof(test[0]);
 
+/*
+ * Interpret <value> the way mdf_interpret_number() used to: by trying
+ * strtol() and strtod() on it and checking that they used all of <value>.
+ */
+static int ref_interpret(const char *value, MDF_Object *obj)
+{
+    char *end;
+
+    long i = strtol(value, &end, 0);
+
+    if (end == value + strlen(value)) {
+        obj->type = MDF_INT;
+        obj->u.i = i;
+
+        return 0;
+    }
+
+    double f = strtod(value, &end);
+
+    if (end == value + strlen(value)) {
+        obj->type = MDF_FLOAT;
+        obj->u.f = f;
+
+        return 0;
+    }
+
+    return -1;
+}
+
+/*
+ * Check that mdf_interpret_number() agrees with ref_interpret() on <value>.
+ */
+static void check_number(const char *value)
+{
+    MDF_Object new_obj = { 0 }, ref_obj = { 0 };
+
+    int new_r = mdf_interpret_number(value, strlen(value), &new_obj);
+    int ref_r = ref_interpret(value, &ref_obj);
+
+    make_sure_that(new_r == ref_r);
+
+    if (new_r != 0 || ref_r != 0) return;
+
+    make_sure_that(new_obj.type == ref_obj.type);
+
+    if (new_obj.type == MDF_INT) {
+        make_sure_that(new_obj.u.i == ref_obj.u.i);
+    }
+    else {
+        make_sure_that(memcmp(&new_obj.u.f, &ref_obj.u.f, sizeof(double)) == 0);
+    }
+}
+
+/*
+ * Return a random double, made from random bits. Infinities and NaNs are
+ * avoided.
+ */
+static double random_double(void)
+{
+    double f;
+    uint64_t bits;
+
+    do {
+        bits = ((uint64_t) random() << 62)
+             ^ ((uint64_t) random() << 31)
+             ^ ((uint64_t) random());
+
+        memcpy(&f, &bits, sizeof(f));
+    } while (!isfinite(f));
+
+    return f;
+}
+
+/*
+ * Print <count> random numbers using <fmt> into an MDF text, parse it, and
+ * check that every value is interpreted the same way as strtol/strtod would
+ * have. If <exact> is true, also check that floats survive the round trip
+ * unchanged.
+ */
+static void check_round_trip(const char *fmt, int count, int exact)
+{
+    int i;
+
+    Buffer text = { 0 }, num = { 0 };
+
+    double *original = calloc(count, sizeof(double));
+
+    for (i = 0; i < count; i++) {
+        original[i] = (i % 2) ? random_double() :
+            (random() - RAND_MAX / 2) / pow(10, random() % 12);
+
+        bufAddS(&text, "value ");
+        bufAddF(&text, fmt, original[i]);
+        bufAddC(&text, '\n');
+    }
+
+    MDF_Stream *stream = mdfOpenString(bufGet(&text));
+    MDF_Object *obj, *root = mdfParse(stream);
+
+    make_sure_that(root != NULL);
+
+    for (i = 0, obj = root; obj != NULL; i++, obj = obj->next) {
+        MDF_Object ref = { 0 };
+
+        bufSetF(&num, fmt, original[i]);
+
+        make_sure_that(ref_interpret(bufGet(&num), &ref) == 0);
+        make_sure_that(obj->type == ref.type);
+
+        if (obj->type == MDF_FLOAT) {
+            make_sure_that(memcmp(&obj->u.f, &ref.u.f, sizeof(double)) == 0);
+
+            if (exact) {
+                make_sure_that(memcmp(&obj->u.f, original + i,
+                            sizeof(double)) == 0);
+            }
+        }
+        else {
+            make_sure_that(obj->u.i == ref.u.i);
+        }
+    }
+
+    make_sure_that(i == count);
+
+    mdfFree(root);
+    mdfClose(stream);
+
+    free(original);
+
+    bufClear(&text);
+    bufClear(&num);
+}
+
+/*
+ * Generate a large MDF text with <count> top-level containers in <buf>. If
+ * <error_at> is not negative, put an error in container <error_at>.
+ */
+static void make_big_text(Buffer *buf, int count, int error_at)
+{
+    int i;
+
+    bufClear(buf);
+
+    for (i = 0; i < count; i++) {
+        if (i % 7 == 0) bufAddF(buf, "# Container %d\r\n", i);
+
+        bufAddF(buf, "%s {\n", i % 3 == 0 ? "" : "Section");
+        bufAddF(buf, "\tIndex %d\n\tName \"name {%d}\"\n", i, i);
+        bufAddF(buf, "\tValue %g\n", i * 0.25);
+        bufAddF(buf, "\tSub { Brace \"}\\\"}\" %s }\n",
+                i == error_at ? "$" : "0x10");
+        bufAddF(buf, "}\n");
+    }
+}
+
+/*
+ * Check that mdfParseParallel() on <text> gives the same result as mdfParse().
+ */
+static void check_parallel(const Buffer *text, int threads)
+{
+    Buffer seq_output = { 0 }, par_output = { 0 };
+
+    MDF_Stream *seq_stream = mdfOpenString(bufGet(text));
+    MDF_Stream *par_stream = mdfOpenString(bufGet(text));
+
+    MDF_Object *seq_object = mdfParse(seq_stream);
+    MDF_Object *par_object = mdfParseParallel(par_stream, threads);
+
+    dump(seq_object, &seq_output);
+    dump(par_object, &par_output);
+
+    make_sure_that(strcmp(bufGet(&seq_output), bufGet(&par_output)) == 0);
+    make_sure_that(strcmp(mdfError(seq_stream), mdfError(par_stream)) == 0);
+    make_sure_that((seq_object == NULL) == (par_object == NULL));
+
+    mdfFree(seq_object);
+    mdfFree(par_object);
+
+    mdfClose(seq_stream);
+    mdfClose(par_stream);
+
+    bufClear(&seq_output);
+    bufClear(&par_output);
+}
+
+/*
+ * Return TRUE if the object lists starting at <left> and <right> are
+ * identical, including their names.
+ */
+static int same_objects(const MDF_Object *left, const MDF_Object *right)
+{
+    while (left != NULL && right != NULL) {
+        if (left->type != right->type)
+            return FALSE;
+        else if ((left->name == NULL) != (right->name == NULL))
+            return FALSE;
+        else if (left->name != NULL && strcmp(left->name, right->name) != 0)
+            return FALSE;
+
+        switch(left->type) {
+        case MDF_STRING:
+            if (strcmp(left->u.s, right->u.s) != 0) return FALSE;
+            break;
+        case MDF_INT:
+            if (left->u.i != right->u.i) return FALSE;
+            break;
+        case MDF_FLOAT:
+            if (memcmp(&left->u.f, &right->u.f, sizeof(double)) != 0)
+                return FALSE;
+            break;
+        case MDF_CONTAINER:
+            if (!same_objects(left->u.c, right->u.c)) return FALSE;
+            break;
+        }
+
+        left = left->next;
+        right = right->next;
+    }
+
+    return left == NULL && right == NULL;
+}
+
+/*
+ * Parse <text>, write it out again using <flags>, and check that parsing the
+ * result gives exactly the same objects.
+ */
+static void check_rewrite(const char *text, int flags)
+{
+    Buffer output = { 0 };
+
+    MDF_Stream *stream = mdfOpenString(text);
+    MDF_Object *object = mdfParse(stream);
+
+    make_sure_that(mdfFormat(&output, object, flags) == 0);
+
+    MDF_Stream *restream = mdfOpenString(bufGet(&output));
+    MDF_Object *reobject = mdfParse(restream);
+
+    make_sure_that(same_objects(object, reobject));
+
+    mdfFree(object);
+    mdfFree(reobject);
+
+    mdfClose(stream);
+    mdfClose(restream);
+
+    bufClear(&output);
+}
+
 int main(void)
 {
     int i;
@@ -764,6 +2026,241 @@ int main(void)
         do_test(i, test + i);
     }
 
+    const char *numbers[] = {
+        "0", "-0", "+5", "-5", "0777", "08", "0x", "0x1e5", "0X1F", "-0x10",
+        "9223372036854775807", "9223372036854775808", "-9223372036854775808",
+        "-9223372036854775809", "0x7fffffffffffffff", "0x8000000000000000",
+        "-0x8000000000000000", "99999999999999999999999",
+        "1e5", "0e5", "1.5e-3", ".5", "5.", "-.5e+2", "1E10", "-0.0", "0.000",
+        "1e", "1e+", ".", "+", "-", "--1", "1.2.3", "1e5.5", "0x1.8",
+        "1e400", "-1e400", "1e-400", "4.9e-324", "1.7976931348623157e308",
+        "12345678901234567890123", "0.1234567890123456789012",
+        "9007199254740993", "9007199254740993.0", "1e22", "1e23", "1e-22",
+        "1e-23", "123456789e20", "3.14159265358979323846", "2.5e+0x",
+    };
+
+    for (i = 0; i < (int) (sizeof(numbers) / sizeof(numbers[0])); i++) {
+        check_number(numbers[i]);
+    }
+
+    srandom(1);
+
+    check_round_trip("%.17g", 100000, TRUE);
+    check_round_trip("%.15g", 100000, FALSE);
+    check_round_trip("%.6g",  100000, FALSE);
+    check_round_trip("%.3f",  100000, FALSE);
+
+    Buffer text = { 0 };
+
+    make_big_text(&text, 10000, -1);
+
+    check_parallel(&text, 1);
+    check_parallel(&text, 4);
+
+    make_big_text(&text, 10000, 8765);
+
+    make_sure_that(strstr(bufGet(&text), "$") != NULL);
+
+    check_parallel(&text, 4);
+
+    /* A run of unnamed containers that crosses the section boundaries. They
+     * all take their name from the first one. */
+
+    bufSetS(&text, "A { x 1 }\n");
+
+    for (i = 0; i < 100000; i++) bufAddF(&text, "{ y %d }\n", i);
+
+    check_parallel(&text, 4);
+
+    for (i = 0; i < num_tests; i++) {
+        bufSetS(&text, test[i].input);
+        check_parallel(&text, 4);
+    }
+
+    /* Also try a stream that reads from a file. */
+
+    FILE *fp = tmpfile();
+
+    make_big_text(&text, 10000, -1);
+
+    fwrite(bufGet(&text), 1, bufLen(&text), fp);
+    rewind(fp);
+
+    Buffer output = { 0 }, expected = { 0 };
+
+    MDF_Stream *stream = mdfOpenString(bufGet(&text));
+    MDF_Object *object = mdfParse(stream);
+
+    dump(object, &expected);
+
+    mdfFree(object);
+    mdfClose(stream);
+
+    stream = mdfOpenFP(fp);
+    object = mdfParseParallel(stream, 3);
+
+    dump(object, &output);
+
+    make_sure_that(strcmp(bufGet(&output), bufGet(&expected)) == 0);
+
+    mdfFree(object);
+    mdfClose(stream);
+    fclose(fp);
+
+    /* And parse a batch of streams, one of which has an error. */
+
+    MDF_Stream *streams[num_tests];
+    MDF_Object *results[num_tests];
+
+    for (i = 0; i < num_tests; i++) {
+        streams[i] = mdfOpenString(test[i].input);
+    }
+
+    make_sure_that(mdfParseBatch(streams, results, num_tests, 4) == -1);
+
+    for (i = 0; i < num_tests; i++) {
+        bufClear(&output);
+        dump(results[i], &output);
+
+        if (test[i].error) {
+            make_sure_that(results[i] == NULL);
+            make_sure_that(strcmp(mdfError(streams[i]), test[i].output) == 0);
+        }
+        else {
+            make_sure_that(strcmp(bufGet(&output), test[i].output) == 0);
+        }
+
+        mdfFree(results[i]);
+        mdfClose(streams[i]);
+    }
+
+    make_sure_that(mdfParseBatch(streams, results, 0, 4) == 0);
+
+    /* Write objects and read them back. */
+
+    for (i = 0; i < num_tests; i++) {
+        if (test[i].error) continue;
+
+        check_rewrite(test[i].input, 0);
+        check_rewrite(test[i].input, MDF_PRETTY);
+    }
+
+    make_big_text(&text, 1000, -1);
+
+    check_rewrite(bufGet(&text), 0);
+    check_rewrite(bufGet(&text), MDF_PRETTY);
+
+    MDF_Writer *writer = mdfWriteToBuffer(&output, 0);
+
+    make_sure_that(mdfWriteString(writer, "Text", "\"a\tb\r\nc\\\"") == 0);
+    make_sure_that(mdfWriteInt(writer, "Int", -12) == 0);
+    make_sure_that(mdfWriteFloat(writer, NULL, 1) == 0);
+    make_sure_that(mdfWriteBegin(writer, "Outer") == 0);
+    make_sure_that(mdfWriteBegin(writer, "Empty") == 0);
+    make_sure_that(mdfWriteEnd(writer) == 0);
+    make_sure_that(mdfWriteFloat(writer, "Third", 1.0 / 3) == 0);
+    make_sure_that(mdfWriteFloat(writer, "Tenth", 0.1) == 0);
+    make_sure_that(mdfWriteFloat(writer, "Big", 1e300) == 0);
+    make_sure_that(mdfWriteEnd(writer) == 0);
+    make_sure_that(mdfWriterClose(writer) == 0);
+
+    make_sure_that(strcmp(bufGet(&output),
+                "Text \"\\\"a\\tb\\r\\nc\\\\\\\"\" Int -12 1.0 "
+                "Outer { Empty { } Third 0.3333333333333333 Tenth 0.1 "
+                "Big 1e+300 }\n") == 0);
+
+    check_rewrite(bufGet(&output), 0);
+    check_rewrite(bufGet(&output), MDF_PRETTY);
+
+    bufRewind(&output);
+
+    writer = mdfWriteToBuffer(&output, MDF_PRETTY);
+
+    make_sure_that(mdfWriteBegin(writer, "Outer") == 0);
+    make_sure_that(mdfWriteInt(writer, "Inner", 1) == 0);
+    make_sure_that(mdfWriteEnd(writer) == 0);
+    make_sure_that(mdfWriteString(writer, "Last", "") == 0);
+    make_sure_that(mdfWriterClose(writer) == 0);
+
+    make_sure_that(strcmp(bufGet(&output),
+                "Outer {\n    Inner 1\n}\nLast \"\"\n") == 0);
+
+    /* Errors are sticky, and reported when closing the writer. */
+
+    writer = mdfWriteToBuffer(&output, 0);
+
+    make_sure_that(mdfWriteInt(writer, "1st", 1) == -1);
+    make_sure_that(strcmp(mdfWriterError(writer), "invalid name \"1st\"") == 0);
+    make_sure_that(mdfWriteInt(writer, "Second", 2) == -1);
+    make_sure_that(mdfWriterClose(writer) == -1);
+
+    writer = mdfWriteToBuffer(&output, 0);
+
+    make_sure_that(mdfWriteFloat(writer, "NaN", NAN) == -1);
+    make_sure_that(mdfWriterClose(writer) == -1);
+
+    writer = mdfWriteToBuffer(&output, 0);
+
+    make_sure_that(mdfWriteString(writer, "Bell", "\a") == -1);
+    make_sure_that(strcmp(mdfWriterError(writer),
+                "can't write character 0x07 in string \"\a\"") == 0);
+    make_sure_that(mdfWriterClose(writer) == -1);
+
+    /* Bytes outside ASCII are rejected, in names and in strings. */
+
+    writer = mdfWriteToBuffer(&output, 0);
+
+    make_sure_that(mdfWriteInt(writer, "Caf\xe9", 1) == -1);
+    make_sure_that(mdfWriterClose(writer) == -1);
+
+    writer = mdfWriteToBuffer(&output, 0);
+
+    make_sure_that(mdfWriteString(writer, "Text", "caf\xe9") == -1);
+    make_sure_that(strcmp(mdfWriterError(writer),
+                "can't write character 0xe9 in string \"caf\xe9\"") == 0);
+    make_sure_that(mdfWriterClose(writer) == -1);
+
+    writer = mdfWriteToBuffer(&output, 0);
+
+    make_sure_that(mdfWriteEnd(writer) == -1);
+    make_sure_that(mdfWriterClose(writer) == -1);
+
+    writer = mdfWriteToBuffer(&output, 0);
+
+    make_sure_that(mdfWriteBegin(writer, "Open") == 0);
+    make_sure_that(mdfWriterClose(writer) == -1);
+
+    /* Write a lot of data to a file descriptor and read it back. */
+
+    make_big_text(&text, 10000, -1);
+
+    stream = mdfOpenString(bufGet(&text));
+    object = mdfParse(stream);
+
+    fp = tmpfile();
+
+    make_sure_that(mdfWrite(fileno(fp), object, MDF_PRETTY) == 0);
+
+    rewind(fp);
+
+    MDF_Stream *restream = mdfOpenFP(fp);
+    MDF_Object *reobject = mdfParse(restream);
+
+    make_sure_that(ftell(fp) > MDF_WRITE_BLOCK);
+    make_sure_that(same_objects(object, reobject));
+
+    mdfFree(object);
+    mdfFree(reobject);
+
+    mdfClose(stream);
+    mdfClose(restream);
+
+    fclose(fp);
+
+    bufClear(&output);
+    bufClear(&expected);
+    bufClear(&text);
+
     return errors;
 }
 #endif
@@ -1,7 +1,7 @@
 #ifndef LIBJVS_MDF_H
 #define LIBJVS_MDF_H
 
-/* mdf.h: Minimal Data Format reader.
+/* mdf.h: Minimal Data Format reader and writer.
  *
  * A data file consists of a sequence of name/value pairs. Names are unquoted
  * strings, starting with a letter or underscore and followed by any number of
@@ -20,6 +20,10 @@
  * "next" pointer. Contents of the objects are stored in a union based on the
  * type of object described above.
  *
+ * Data can be written using an MDF_Writer, either object by object or as
+ * complete lists of MDF_Objects, to a Buffer or a file descriptor. Whatever is
+ * written can be read back using the functions above.
+ *
  * mdf.h is part of libjvs.
  *
  * Copyright:   (c) 2013-2024 Jacco van Schaik (jacco@jaccovanschaik.net)
@@ -35,8 +39,15 @@ extern "C" {
 
 #include <stdio.h>
 
+#include "buffer.h"
+
 typedef struct MDF_Stream MDF_Stream;
 typedef struct MDF_Object MDF_Object;
+typedef struct MDF_Writer MDF_Writer;
+
+/* Flags for MDF_Writers. */
+
+#define MDF_PRETTY  1       /* One object per line, indented per level. */
 
 /* MDF_Object types. */
 
@@ -89,6 +100,27 @@ MDF_Stream *mdfOpenString(const char *string);
  */
 MDF_Object *mdfParse(MDF_Stream *stream);
 
+/*
+ * Parse <stream> like mdfParse() does, but first split it up into sections
+ * at the end of top-level containers, parse those sections concurrently
+ * using at most <threads> threads and then link the results together in the
+ * original order. If <threads> is 0 or less, one thread per available
+ * processor is used. The result is the same as what mdfParse() would have
+ * returned, including the error message if the stream contains an error.
+ */
+MDF_Object *mdfParseParallel(MDF_Stream *stream, int threads);
+
+/*
+ * Parse the <count> streams in <streams> concurrently, using at most
+ * <threads> threads (or one per available processor if <threads> is 0 or
+ * less). The first object found in stream <i> is returned through
+ * <results[i]>. Returns 0 if all streams were parsed successfully, otherwise
+ * -1. In that case, use mdfError() to find out which streams had errors and
+ * why.
+ */
+int mdfParseBatch(MDF_Stream **streams, MDF_Object **results,
+        int count, int threads);
+
 /*
  * Return type <type> as a string.
  */
@@ -101,7 +133,9 @@ const char *mdfTypeName(const MDF_Type type);
 const char *mdfError(const MDF_Stream *stream);
 
 /*
- * Free the object list starting at <root>.
+ * Free the object list starting at <root>. Every object, name and string in
+ * the list has its own allocation from malloc(), so callers may also unlink,
+ * replace or free parts of it themselves.
  */
 void mdfFree(MDF_Object *root);
 
@@ -110,6 +144,98 @@ void mdfFree(MDF_Object *root);
  */
 void mdfClose(MDF_Stream *stream);
 
+/*
+ * Create a writer that appends its output to <buf>. <flags> is a bitwise OR
+ * of MDF_* flags, or 0.
+ */
+MDF_Writer *mdfWriteToBuffer(Buffer *buf, int flags);
+
+/*
+ * Create a writer that writes its output to file descriptor <fd>. Output is
+ * collected and written in large blocks. <flags> is a bitwise OR of MDF_*
+ * flags, or 0.
+ */
+MDF_Writer *mdfWriteToFD(int fd, int flags);
+
+/*
+ * Write a string object with name <name> and value <value> to <writer>.
+ * Characters that need it are escaped. <value> may only contain printable
+ * characters, tabs, carriage returns and newlines, because that is all that
+ * can be read back. <name> may be NULL, which means it will get the name of
+ * the preceding object when read back. Returns 0 on success or -1 on
+ * failure.
+ */
+int mdfWriteString(MDF_Writer *writer, const char *name, const char *value);
+
+/*
+ * Write an integer object with name <name> and value <value> to <writer>.
+ * <name> may be NULL (see mdfWriteString()). Returns 0 on success or -1 on
+ * failure.
+ */
+int mdfWriteInt(MDF_Writer *writer, const char *name, long value);
+
+/*
+ * Write a float object with name <name> and value <value> to <writer>. The
+ * shortest representation that reads back as exactly the same value is used,
+ * and it always looks like a float (so 1.0 is written as "1.0", not "1").
+ * Infinities and NaNs can't be written. <name> may be NULL (see
+ * mdfWriteString()). Returns 0 on success or -1 on failure.
+ */
+int mdfWriteFloat(MDF_Writer *writer, const char *name, double value);
+
+/*
+ * Start a container with name <name> on <writer>. Everything written after
+ * this, until the matching call to mdfWriteEnd(), goes into this container.
+ * <name> may be NULL (see mdfWriteString()). Returns 0 on success or -1 on
+ * failure.
+ */
+int mdfWriteBegin(MDF_Writer *writer, const char *name);
+
+/*
+ * End the container that was started with the most recent call to
+ * mdfWriteBegin(). Returns 0 on success or -1 on failure.
+ */
+int mdfWriteEnd(MDF_Writer *writer);
+
+/*
+ * Write the list of objects starting at <root>, and everything they contain,
+ * to <writer>. Returns 0 on success or -1 on failure.
+ */
+int mdfWriteObjects(MDF_Writer *writer, const MDF_Object *root);
+
+/*
+ * Write any output that <writer> is still holding on to. Only has an effect
+ * on writers that write to a file descriptor. Returns 0 on success or -1 on
+ * failure.
+ */
+int mdfWriterFlush(MDF_Writer *writer);
+
+/*
+ * Retrieve an error text from <writer>, in case any function has returned
+ * an error.
+ */
+const char *mdfWriterError(const MDF_Writer *writer);
+
+/*
+ * Finish writing to <writer>: end the output with a newline (unless
+ * pretty-printing, which already does), write any pending output and free
+ * <writer>. Returns -1 if any error has occurred on <writer> or if there are
+ * still unfinished containers, otherwise 0.
+ */
+int mdfWriterClose(MDF_Writer *writer);
+
+/*
+ * Write the list of objects starting at <root> to <buf>, according to
+ * <flags>. Returns 0 on success or -1 on failure.
+ */
+int mdfFormat(Buffer *buf, const MDF_Object *root, int flags);
+
+/*
+ * Write the list of objects starting at <root> to file descriptor <fd>,
+ * according to <flags>. Returns 0 on success or -1 on failure.
+ */
+int mdfWrite(int fd, const MDF_Object *root, int flags);
+
 #ifdef __cplusplus
 }
 #endif
@@ -46,7 +46,7 @@ struct Link {
 static Link *ml_create_link(MListNode *node, MList *list,
                         Link *prev_in_list, Link *next_in_list)
 {
-    Link *link = calloc(1, sizeof(Link));
+    Link *link = allocNew(list->alloc, sizeof(Link));
 
     link->list = list;
     link->node = node;
@@ -107,9 +107,11 @@ static void ml_disconnect_link(Link *link)
 
 static void ml_delete_link(Link *link)
 {
+    MList *list = link->list;
+
     ml_disconnect_link(link);
 
-    free(link);
+    allocFree(list->alloc, link, sizeof(Link));
 }
 
 /*
@@ -161,6 +163,27 @@ void mlInitialize(MList *list)
 {
     list->first_in_list = NULL;
     list->last_in_list  = NULL;
+    list->alloc         = NULL;
+}
+
+/*
+ * Use <alloc> to allocate and free the links in <list>, instead of calloc()
+ * and free(). <list> must be empty when this is called.
+ */
+
+void mlSetAllocator(MList *list, const Allocator *alloc)
+{
+    list->alloc = alloc;
+}
+
+/*
+ * Return the number of bytes that is allocated for each link, i.e. for every
+ * time a node is added to a list.
+ */
+
+size_t mlLinkSize(void)
+{
+    return sizeof(Link);
 }
 
 /*
@@ -435,6 +458,8 @@ void mlSort(MList *list, int(*cmp)(const void *a, const void *b))
     MList left = { 0 };      /* Left list (<list> is used as the right list). */
     int i, len = mlLength(list);
 
+    left.alloc = list->alloc;
+
     /* This is a standard Merge Sort... */
 
     if (len <= 1) return;   /* A list with 1 element is already sorted. */
@@ -494,6 +519,8 @@ int _mlContains(MList *list, MListNode *node)
 #ifdef TEST
 #include <stdio.h>
 
+#include "pool.h"
+
 typedef struct {
     MListNode _node;
     int i;
@@ -883,6 +910,34 @@ int main(void)
     TEST_PTR(mlNext(list1, data[4]), data[5]);
     TEST_PTR(mlNext(list1, data[5]), NULL);
 
+    /* Do it again, with the links coming from a pool. */
+
+    Pool *pool = poolCreate(mlLinkSize(), false);
+
+    mlClear(list1);
+    mlSetAllocator(list1, poolAllocator(pool));
+
+    mlAppendTail(list1, data[3]);
+    mlAppendTail(list1, data[1]);
+    mlAppendTail(list1, data[5]);
+    mlAppendTail(list1, data[0]);
+    mlAppendTail(list1, data[4]);
+    mlAppendTail(list1, data[2]);
+
+    mlSort(list1, Compare);
+
+    TEST_PTR(mlHead(list1), data[0]);
+    TEST_PTR(mlNext(list1, data[0]), data[1]);
+    TEST_PTR(mlNext(list1, data[1]), data[2]);
+    TEST_PTR(mlNext(list1, data[2]), data[3]);
+    TEST_PTR(mlNext(list1, data[3]), data[4]);
+    TEST_PTR(mlNext(list1, data[4]), data[5]);
+    TEST_PTR(mlNext(list1, data[5]), NULL);
+
+    mlDelete(list1);
+
+    poolDestroy(pool);
+
     exit(0);
 }
 #endif
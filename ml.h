@@ -19,15 +19,19 @@ extern "C" {
 
 #include <stdio.h>
 
+#include "alloc.h"
+
 typedef struct Link Link;
 
 /*
- * A linked list.
+ * A linked list. Its links are allocated using <alloc>, or calloc() if it is
+ * NULL.
  */
 
 typedef struct {
     Link *first_in_list;
     Link *last_in_list;
+    const Allocator *alloc;
 } MList;
 
 /*
@@ -59,6 +63,18 @@ MList *mlCreate(void);
  */
 void mlInitialize(MList *list);
 
+/*
+ * Use <alloc> to allocate and free the links in <list>, instead of calloc()
+ * and free(). <list> must be empty when this is called.
+ */
+void mlSetAllocator(MList *list, const Allocator *alloc);
+
+/*
+ * Return the number of bytes that is allocated for each link, i.e. for every
+ * time a node is added to a list.
+ */
+size_t mlLinkSize(void);
+
 /*
  * Clear out and delete a list
  */
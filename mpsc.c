@@ -0,0 +1,585 @@
+/*
+ * mpsc.c: Intrusive lock-free queue for many producers and one consumer.
+ *
+ * mpsc.c is part of libjvs.
+ *
+ * Copyright: (c) 2026 Jacco van Schaik (jacco@jaccovanschaik.net)
+ * Created:   2026-10-18
+ * Version:   $Id$
+ *
+ * This software is distributed under the terms of the MIT license. See
+ * http://www.opensource.org/licenses/mit-license.php for details.
+ */
+
+#include <stdlib.h>
+
+#include "mpsc.h"
+
+/*
+ * Initialize queue <queue>. Unlike a List, a zeroed MpscQueue is not valid.
+ */
+void mpscInit(MpscQueue *queue)
+{
+    memset(queue, 0, sizeof(MpscQueue));
+
+    queue->tail = &queue->stub;
+    queue->head = &queue->stub;
+}
+
+/*
+ * Create a new, empty queue.
+ */
+MpscQueue *mpscCreate(void)
+{
+    MpscQueue *queue = malloc(sizeof(MpscQueue));
+
+    mpscInit(queue);
+
+    return queue;
+}
+
+/*
+ * Add <node> to <queue>. May be called by any thread.
+ */
+void _mpscPush(MpscQueue *queue, MpscNode *node)
+{
+    __atomic_store_n(&node->next, NULL, __ATOMIC_RELAXED);
+
+    MpscNode *prev = __atomic_exchange_n(&queue->tail, node, __ATOMIC_ACQ_REL);
+
+    /* Until this store, the consumer can't get past <prev>. */
+
+    __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+}
+
+/*
+ * Add the <count> items in <item> (which must have an MpscNode as their first
+ * element) to <queue>, in order, using a single atomic exchange. Items pushed
+ * by other threads in the meantime come before or after all of them. May be
+ * called by any thread.
+ */
+void mpscPushBatch(MpscQueue *queue, void *const *item, int count)
+{
+    int i;
+
+    if (count <= 0) return;
+
+    MpscNode *first = item[0];
+    MpscNode *last = item[count - 1];
+
+    /* Link the items together first, so they can be added as a chain. */
+
+    for (i = 0; i < count - 1; i++) {
+        ((MpscNode *) item[i])->next = item[i + 1];
+    }
+
+    __atomic_store_n(&last->next, NULL, __ATOMIC_RELAXED);
+
+    MpscNode *prev = __atomic_exchange_n(&queue->tail, last, __ATOMIC_ACQ_REL);
+
+    __atomic_store_n(&prev->next, first, __ATOMIC_RELEASE);
+}
+
+/*
+ * Remove the oldest item from <queue> and return it, or return NULL if there
+ * is no item that can be removed right now. Must only be called by the
+ * consumer.
+ */
+void *mpscPop(MpscQueue *queue)
+{
+    MpscNode *head = queue->head;
+    MpscNode *next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+
+    if (head == &queue->stub) {
+        /* Skip the stub. */
+
+        if (next == NULL) return NULL;
+
+        queue->head = head = next;
+
+        next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+    }
+
+    if (next != NULL) {
+        queue->head = next;
+        return head;
+    }
+
+    /* <head> is the last item we can see. If it isn't the tail, a producer is
+     * busy linking its item to it, and we'll have to wait for it. */
+
+    if (head != __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE)) return NULL;
+
+    /* It really is the last item. We can't remove it without putting something
+     * else in its place, so push the stub back in behind it. */
+
+    _mpscPush(queue, &queue->stub);
+
+    next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+
+    if (next != NULL) {
+        queue->head = next;
+        return head;
+    }
+
+    return NULL;
+}
+
+/*
+ * Remove up to <max> items from <queue> and store them in <item>, oldest
+ * first. Returns the number of items that were removed. Must only be called
+ * by the consumer.
+ */
+int mpscPopBatch(MpscQueue *queue, void **item, int max)
+{
+    int count = 0;
+
+    while (count < max && (item[count] = mpscPop(queue)) != NULL) {
+        count++;
+    }
+
+    return count;
+}
+
+/*
+ * Return true if <queue> is empty, false otherwise. Must only be called by
+ * the consumer, and may be out of date immediately if producers are active.
+ */
+bool mpscIsEmpty(const MpscQueue *queue)
+{
+    return queue->head == &queue->stub &&
+           __atomic_load_n(&queue->stub.next, __ATOMIC_ACQUIRE) == NULL;
+}
+
+/*
+ * Free <queue>. The items that may still be in it are not freed.
+ */
+void mpscDestroy(MpscQueue *queue)
+{
+    free(queue);
+}
+
+#if defined(TEST) || defined(BENCH)
+#include <stdio.h>
+#include <stdint.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "utils.h"
+
+typedef struct {
+    MpscNode _node;
+    int producer;
+    int seq;
+} Message;
+#endif
+
+#ifdef TEST
+static int errors = 0;
+
+#define PRODUCERS 4
+#define MESSAGES  100000
+
+static MpscQueue shared;
+
+static void *producer(void *arg)
+{
+    int i, n, id = (intptr_t) arg;
+
+    Message *msg = calloc(MESSAGES, sizeof(Message));
+
+    void *batch[5];
+
+    for (i = 0; i < MESSAGES; i++) {
+        msg[i].producer = id;
+        msg[i].seq = i;
+    }
+
+    /* Odd producers push in batches, even ones one at a time. */
+
+    for (i = 0; i < MESSAGES; i += n) {
+        if (id % 2 == 0) {
+            mpscPush(&shared, msg + i);
+
+            n = 1;
+        }
+        else {
+            for (n = 0; n < 5 && i + n < MESSAGES; n++) {
+                batch[n] = msg + i + n;
+            }
+
+            mpscPushBatch(&shared, batch, n);
+        }
+
+        if (i % 64 == 0) sched_yield();
+    }
+
+    return msg;
+}
+
+int main(void)
+{
+    int i, n;
+    Message msg[10];
+    void *item[16];
+
+    MpscQueue *queue = mpscCreate();
+
+    make_sure_that(mpscIsEmpty(queue));
+    make_sure_that(mpscPop(queue) == NULL);
+
+    for (i = 0; i < 10; i++) {
+        msg[i].seq = i;
+    }
+
+    mpscPush(queue, msg + 0);
+    mpscPush(queue, msg + 1);
+
+    make_sure_that(!mpscIsEmpty(queue));
+    make_sure_that(mpscPop(queue) == msg + 0);
+    make_sure_that(mpscPop(queue) == msg + 1);
+    make_sure_that(mpscPop(queue) == NULL);
+    make_sure_that(mpscIsEmpty(queue));
+
+    /* Items can be pushed again once they've been popped. */
+
+    for (i = 0; i < 10; i++) item[i] = msg + i;
+
+    mpscPush(queue, msg + 0);
+    mpscPushBatch(queue, item + 1, 8);
+    mpscPush(queue, msg + 9);
+
+    make_sure_that(mpscPopBatch(queue, item, 4) == 4);
+    make_sure_that(item[0] == msg + 0);
+    make_sure_that(item[3] == msg + 3);
+
+    make_sure_that(mpscPopBatch(queue, item, 16) == 6);
+    make_sure_that(item[0] == msg + 4);
+    make_sure_that(item[5] == msg + 9);
+
+    make_sure_that(mpscIsEmpty(queue));
+
+    mpscDestroy(queue);
+
+    /* Several producer threads. */
+
+    pthread_t thread[PRODUCERS];
+    int next[PRODUCERS] = { 0 };
+    int received = 0, out_of_order = 0;
+
+    mpscInit(&shared);
+
+    for (i = 0; i < PRODUCERS; i++) {
+        pthread_create(&thread[i], NULL, producer, (void *) (intptr_t) i);
+    }
+
+    while (received < PRODUCERS * MESSAGES) {
+        if ((n = mpscPopBatch(&shared, item, 16)) == 0) {
+            sched_yield();
+            continue;
+        }
+
+        for (i = 0; i < n; i++) {
+            Message *m = item[i];
+
+            if (m->seq != next[m->producer]) out_of_order++;
+
+            next[m->producer] = m->seq + 1;
+        }
+
+        received += n;
+    }
+
+    make_sure_that(out_of_order == 0);
+    make_sure_that(mpscIsEmpty(&shared));
+
+    for (i = 0; i < PRODUCERS; i++) {
+        void *msgs;
+
+        pthread_join(thread[i], &msgs);
+
+        make_sure_that(next[i] == MESSAGES);
+
+        free(msgs);
+    }
+
+    return errors;
+}
+#endif
+
+#ifdef BENCH
+#include "spsc.h"
+#include "list.h"
+
+#define MESSAGES  4000000
+#define BATCH     32
+#define PINGS     100000
+
+typedef struct {
+    ListNode _node;
+    int producer;
+    int seq;
+} ListMessage;
+
+typedef enum {
+    USE_SPSC, USE_MPSC, USE_LIST
+} Kind;
+
+/*
+ * Everything the producer threads of a single run need.
+ */
+typedef struct {
+    Kind kind;
+    int batch;
+    int producers;
+    SpscRing ring;
+    MpscQueue queue;
+    pthread_mutex_t lock;
+    List list;
+    Message *msg;
+    ListMessage *list_msg;
+} Run;
+
+typedef struct {
+    Run *run;
+    int id;
+} Producer;
+
+static void *produce(void *arg)
+{
+    Producer *p = arg;
+    Run *run = p->run;
+
+    int i, n, count = MESSAGES / run->producers;
+    int first = p->id * count;
+
+    void *item[BATCH];
+
+    for (i = first; i < first + count; i += n) {
+        n = MIN(run->batch, first + count - i);
+
+        if (run->kind == USE_SPSC) {
+            int j;
+
+            for (j = 0; j < n; j++) item[j] = run->msg + i + j;
+
+            if (n == 1) {
+                n = spscPush(&run->ring, item[0]);
+            }
+            else {
+                n = spscPushBatch(&run->ring, item, n);
+            }
+
+            if (n == 0) sched_yield();
+        }
+        else if (run->kind == USE_MPSC) {
+            int j;
+
+            if (n == 1) {
+                mpscPush(&run->queue, run->msg + i);
+            }
+            else {
+                for (j = 0; j < n; j++) item[j] = run->msg + i + j;
+
+                mpscPushBatch(&run->queue, item, n);
+            }
+        }
+        else {
+            int j;
+
+            pthread_mutex_lock(&run->lock);
+
+            for (j = 0; j < n; j++) {
+                listAppendTail(&run->list, run->list_msg + i + j);
+            }
+
+            pthread_mutex_unlock(&run->lock);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Pop up to <max> messages from <run> into <item>.
+ */
+static int consume(Run *run, void **item, int max)
+{
+    int n = 0;
+
+    if (run->kind == USE_SPSC) {
+        n = spscPopBatch(&run->ring, item, max);
+    }
+    else if (run->kind == USE_MPSC) {
+        n = mpscPopBatch(&run->queue, item, max);
+    }
+    else {
+        pthread_mutex_lock(&run->lock);
+
+        while (n < max && (item[n] = listRemoveHead(&run->list)) != NULL) {
+            n++;
+        }
+
+        pthread_mutex_unlock(&run->lock);
+    }
+
+    return n;
+}
+
+/*
+ * Send MESSAGES messages from <producers> threads to this one, using <kind>
+ * of queue in batches of <batch>, and report the throughput.
+ */
+static void throughput(Kind kind, int producers, int batch)
+{
+    static const char *name[] = { "SpscRing", "MpscQueue", "List + mutex" };
+
+    int i, received = 0;
+
+    pthread_t thread[producers];
+    Producer producer[producers];
+
+    void *item[BATCH];
+
+    Run run = { 0 };
+
+    run.kind = kind;
+    run.batch = batch;
+    run.producers = producers;
+    run.msg = calloc(MESSAGES, sizeof(Message));
+    run.list_msg = calloc(MESSAGES, sizeof(ListMessage));
+
+    spscInit(&run.ring, 4096);
+    mpscInit(&run.queue);
+    pthread_mutex_init(&run.lock, NULL);
+
+    double start = dnow();
+
+    for (i = 0; i < producers; i++) {
+        producer[i].run = &run;
+        producer[i].id = i;
+
+        pthread_create(&thread[i], NULL, produce, producer + i);
+    }
+
+    int expected = producers * (MESSAGES / producers);
+
+    while (received < expected) {
+        int n = consume(&run, item, batch);
+
+        if (n == 0) sched_yield();
+
+        received += n;
+    }
+
+    double elapsed = dnow() - start;
+
+    for (i = 0; i < producers; i++) {
+        pthread_join(thread[i], NULL);
+    }
+
+    printf("%-14s %d producer%-2s batch %2d: %8.2f Mmsg/s\n",
+            name[kind], producers, producers == 1 ? "," : "s,",
+            batch, received / elapsed / 1e6);
+
+    spscClear(&run.ring);
+    pthread_mutex_destroy(&run.lock);
+
+    free(run.msg);
+    free(run.list_msg);
+}
+
+static SpscRing ping_ring, pong_ring;
+static MpscQueue ping_queue, pong_queue;
+
+/*
+ * Send every message that arrives on the ping queue of <kind> (in <arg>)
+ * straight back on the pong queue.
+ */
+static void *ponger(void *arg)
+{
+    int i;
+    void *msg;
+
+    Kind kind = (intptr_t) arg;
+
+    for (i = 0; i < PINGS; i++) {
+        if (kind == USE_SPSC) {
+            while ((msg = spscPop(&ping_ring)) == NULL) sched_yield();
+
+            spscPush(&pong_ring, msg);
+        }
+        else {
+            while ((msg = mpscPop(&ping_queue)) == NULL) sched_yield();
+
+            _mpscPush(&pong_queue, msg);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Ping-pong a message between two threads through two queues of <kind>, and
+ * report the average round-trip time.
+ */
+static void latency(Kind kind)
+{
+    int i;
+    pthread_t thread;
+
+    Message msg = { 0 };
+
+    spscInit(&ping_ring, 16);
+    spscInit(&pong_ring, 16);
+    mpscInit(&ping_queue);
+    mpscInit(&pong_queue);
+
+    pthread_create(&thread, NULL, ponger, (void *) (intptr_t) kind);
+
+    double start = dnow();
+
+    for (i = 0; i < PINGS; i++) {
+        if (kind == USE_SPSC) {
+            spscPush(&ping_ring, &msg);
+
+            while (spscPop(&pong_ring) == NULL) sched_yield();
+        }
+        else {
+            mpscPush(&ping_queue, &msg);
+
+            while (mpscPop(&pong_queue) == NULL) sched_yield();
+        }
+    }
+
+    double elapsed = dnow() - start;
+
+    pthread_join(thread, NULL);
+
+    printf("%-14s round trip: %8.0f ns\n",
+            kind == USE_SPSC ? "SpscRing" : "MpscQueue", 1e9 * elapsed / PINGS);
+
+    spscClear(&ping_ring);
+    spscClear(&pong_ring);
+}
+
+int main(void)
+{
+    int producers;
+
+    throughput(USE_SPSC, 1, 1);
+    throughput(USE_SPSC, 1, BATCH);
+
+    for (producers = 1; producers <= 8; producers *= 2) {
+        throughput(USE_MPSC, producers, 1);
+        throughput(USE_MPSC, producers, BATCH);
+        throughput(USE_LIST, producers, 1);
+        throughput(USE_LIST, producers, BATCH);
+    }
+
+    latency(USE_SPSC);
+    latency(USE_MPSC);
+
+    return 0;
+}
+#endif
@@ -0,0 +1,109 @@
+#ifndef MPSC_H
+#define MPSC_H
+
+/*
+ * mpsc.h: Intrusive lock-free queue for many producers and one consumer.
+ *
+ * This is Dmitry Vyukov's non-intrusive-node MPSC queue, made intrusive: to
+ * make a struct "queueable" it must have an "MpscNode" struct named "_node"
+ * as its first element, just like the ListNode in list.h. Pushing an item
+ * takes a single atomic exchange, however many producers there are, and
+ * popping takes no atomic read-modify-write operations at all. Nothing is
+ * allocated, and nothing ever blocks.
+ *
+ * Any number of threads may push at the same time, but only one thread may
+ * pop at any time. Items are popped in the order in which their pushes
+ * completed their atomic exchange, so items pushed by the same thread are
+ * popped in the order in which they were pushed.
+ *
+ * If a producer is interrupted between its exchange and linking its item to
+ * the previous one, the consumer can't get past that point until it resumes,
+ * so a pop may briefly return NULL even though there are items in the queue.
+ *
+ * mpsc.h is part of libjvs.
+ *
+ * Copyright: (c) 2026 Jacco van Schaik (jacco@jaccovanschaik.net)
+ * Created:   2026-10-18
+ * Version:   $Id$
+ *
+ * This software is distributed under the terms of the MIT license. See
+ * http://www.opensource.org/licenses/mit-license.php for details.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+
+#include "defs.h"
+
+typedef struct MpscNode MpscNode;
+
+struct MpscNode {
+    MpscNode *next;
+};
+
+typedef struct {
+    MpscNode *tail;             // Last item pushed, exchanged by producers.
+    char pad1[CACHE_LINE_SIZE - sizeof(MpscNode *)];
+    MpscNode *head;             // Next item to pop, used by the consumer.
+    MpscNode stub;              // Keeps the queue from ever being empty.
+    char pad2[CACHE_LINE_SIZE - 2 * sizeof(MpscNode *)];
+} MpscQueue;
+
+#define mpscPush(q, n)              _mpscPush((q), &(n)->_node)
+
+/*
+ * Initialize queue <queue>. Unlike a List, a zeroed MpscQueue is not valid.
+ */
+void mpscInit(MpscQueue *queue);
+
+/*
+ * Create a new, empty queue.
+ */
+MpscQueue *mpscCreate(void);
+
+/*
+ * Add <node> to <queue>. May be called by any thread.
+ */
+void _mpscPush(MpscQueue *queue, MpscNode *node);
+
+/*
+ * Add the <count> items in <item> (which must have an MpscNode as their first
+ * element) to <queue>, in order, using a single atomic exchange. Items pushed
+ * by other threads in the meantime come before or after all of them. May be
+ * called by any thread.
+ */
+void mpscPushBatch(MpscQueue *queue, void *const *item, int count);
+
+/*
+ * Remove the oldest item from <queue> and return it, or return NULL if there
+ * is no item that can be removed right now. Must only be called by the
+ * consumer.
+ */
+void *mpscPop(MpscQueue *queue);
+
+/*
+ * Remove up to <max> items from <queue> and store them in <item>, oldest
+ * first. Returns the number of items that were removed. Must only be called
+ * by the consumer.
+ */
+int mpscPopBatch(MpscQueue *queue, void **item, int max);
+
+/*
+ * Return true if <queue> is empty, false otherwise. Must only be called by
+ * the consumer, and may be out of date immediately if producers are active.
+ */
+bool mpscIsEmpty(const MpscQueue *queue);
+
+/*
+ * Free <queue>. The items that may still be in it are not freed.
+ */
+void mpscDestroy(MpscQueue *queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
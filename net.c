@@ -14,40 +14,155 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 #include "defs.h"
 #include "net.h"
+#include "hash.h"
+#include "pa.h"
+#include "list.h"
+#include "utils.h"
 #include "debug.h"
 
+/*
+ * The key under which an address is cached: its family and the address
+ * itself. IPv4-mapped IPv6 addresses are stored as plain IPv4 addresses.
+ */
+typedef struct {
+    uint8_t family;
+    uint8_t addr[16];
+} NetKey;
+
+/*
+ * Someone waiting for the result of a lookup.
+ */
+typedef struct {
+    ListNode _node;
+    void (*cb)(NetResolver *res, const char *host, void *udata);
+    void (*fwd_cb)(NetResolver *res, const NetAddr *addr, int count,
+                   void *udata);
+    uint16_t port;              // Port to put in the addresses for <fwd_cb>.
+    const void *udata;
+} NetWaiter;
+
+/*
+ * A lookup that has been handed to the resolver threads. For reverse lookups
+ * <key> is NULL, the address to look up is in <addr> and the result goes into
+ * <host>. For forward lookups <key> is the cache key for host name <name> and
+ * the results go into <result> and <count>. Only the results are touched by
+ * the resolver threads, everything else belongs to the thread that runs the
+ * dispatcher.
+ */
+typedef struct {
+    ListNode _node;
+    struct sockaddr_storage addr;
+    socklen_t len;
+    char host[NET_HOST_SIZE];
+    char *key, *name;
+    int family, socktype;
+    NetAddr result[NET_MAX_ADDR];
+    int count;
+    List waiters;
+} NetJob;
+
+/*
+ * An entry in the cache of forward lookups. <count> is -1 for host names that
+ * don't exist.
+ */
+typedef struct {
+    char *key;
+    double expires;
+    int count, error;
+    NetAddr addr[NET_MAX_ADDR];
+} NetFwdEntry;
+
+/*
+ * A cache entry. While a lookup is in progress <job> points to it, and <host>
+ * is NULL if there was no earlier result.
+ */
+typedef struct {
+    NetKey key;
+    char *host;
+    double expires;
+    NetJob *job;
+} NetEntry;
+
+struct NetResolver {
+    Dispatcher *dis;
+    double ttl;
+    double next_purge;
+    HashTable cache;
+    HashTable pending;          // Forward lookups in progress, by cache key.
+    int pipe_fd[2];             // Wakes up the dispatcher when <done> fills.
+    int n_threads;
+    pthread_t *thread;
+    pthread_mutex_t lock;       // Protects <queue>, <done> and <stop>.
+    pthread_cond_t cond;
+    List queue;                 // Jobs waiting for a resolver thread.
+    List done;                  // Finished jobs, waiting for the dispatcher.
+    NetJob *completing;         // Job whose waiters are being called.
+    bool stop;
+};
+
+/* The cache of forward lookups, shared by everyone in this process. */
+
+static pthread_mutex_t fwd_lock = PTHREAD_MUTEX_INITIALIZER;
+static HashTable fwd_cache;
+static double fwd_next_purge = 0;
+static double fwd_positive_ttl = 60;
+static double fwd_negative_ttl = 10;
+
 /*
  * Get the host name that belongs to IP address <big_endian_ip>. Returns the
  * fqdn if it can be found, otherwise an IP address in dotted-quad notation.
+ * This may block for a long time if DNS is slow, and the result is returned
+ * in a static buffer that is overwritten by the next call.
  */
 const char *netHost(uint32_t big_endian_ip)
 {
-    static char text_buffer[16];
-    struct hostent *ent;
+    static char text_buffer[NET_HOST_SIZE];
+
+    struct sockaddr_in addr = { 0 };
+
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = big_endian_ip;
 
-    if (big_endian_ip == 0) {
-        snprintf(text_buffer, sizeof(text_buffer), "0.0.0.0");
+    return netAddrHost((struct sockaddr *) &addr, sizeof(addr), false,
+            text_buffer, sizeof(text_buffer));
+}
 
-        return text_buffer;
+/*
+ * Write the host name of the IPv4 or IPv6 address in <addr>, whose length is
+ * <len>, to <buf>, which has room for <size> bytes (NET_HOST_SIZE is always
+ * enough), and return <buf>. If <numeric> is true, or if no name can be found,
+ * the numeric address is used instead. If <numeric> is true this never blocks.
+ * Returns NULL if <addr> is not an IPv4 or IPv6 address. This function is
+ * thread-safe.
+ */
+const char *netAddrHost(const struct sockaddr *addr, socklen_t len,
+        bool numeric, char *buf, size_t size)
+{
+    if (addr->sa_family != AF_INET && addr->sa_family != AF_INET6) {
+        return NULL;
     }
-    else if ((ent = gethostbyaddr((char *) &big_endian_ip,
-                    sizeof(big_endian_ip), AF_INET)) == NULL)
-    {
-        snprintf(text_buffer, sizeof(text_buffer), "%d.%d.%d.%d",
-                 (big_endian_ip & 0xFF000000) >> 24,
-                 (big_endian_ip & 0x00FF0000) >> 16,
-                 (big_endian_ip & 0x0000FF00) >> 8,
-                 (big_endian_ip & 0x000000FF));
 
-        return text_buffer;
+    if (!numeric &&
+        getnameinfo(addr, len, buf, size, NULL, 0, NI_NAMEREQD) == 0) {
+        return buf;
     }
-    else {
-        return ent->h_name;
+
+    if (getnameinfo(addr, len, buf, size, NULL, 0, NI_NUMERICHOST) == 0) {
+        return buf;
     }
+
+    return NULL;
 }
 
 /*
@@ -68,17 +183,46 @@ uint16_t netPort(const char *service, const char *protocol)
 }
 
 /*
- * Get hostname of peer.
+ * Get hostname of peer. Works for IPv4 and IPv6 sockets. Like netHost(), this
+ * may block and returns a static buffer.
  */
 const char *netPeerHost(int sd)
 {
-    struct sockaddr_in peeraddr;
+    static char text_buffer[NET_HOST_SIZE];
 
-    socklen_t len = sizeof(struct sockaddr_in);
+    return netPeerHostR(sd, false, text_buffer, sizeof(text_buffer));
+}
 
-    getpeername(sd, (struct sockaddr *) &peeraddr, &len);
+/*
+ * Write the host name of the peer of socket <sd> to <buf>, which has room for
+ * <size> bytes, and return <buf>, as netAddrHost() does. Returns NULL if the
+ * peer's address can't be found.
+ */
+const char *netPeerHostR(int sd, bool numeric, char *buf, size_t size)
+{
+    struct sockaddr_storage peeraddr;
 
-    return netHost(peeraddr.sin_addr.s_addr);
+    socklen_t len = sizeof(peeraddr);
+
+    if (getpeername(sd, (struct sockaddr *) &peeraddr, &len) != 0) {
+        return NULL;
+    }
+
+    return netAddrHost((struct sockaddr *) &peeraddr, len, numeric, buf, size);
+}
+
+/*
+ * Return the port (in network byte order) in <addr>, or 0 if it isn't an IPv4
+ * or IPv6 address.
+ */
+static uint16_t net_port(const struct sockaddr_storage *addr)
+{
+    if (addr->ss_family == AF_INET)
+        return ((const struct sockaddr_in *) addr)->sin_port;
+    else if (addr->ss_family == AF_INET6)
+        return ((const struct sockaddr_in6 *) addr)->sin6_port;
+    else
+        return 0;
 }
 
 /*
@@ -86,27 +230,42 @@ const char *netPeerHost(int sd)
  */
 uint16_t netPeerPort(int sd)
 {
-    struct sockaddr_in peeraddr;
+    struct sockaddr_storage peeraddr = { 0 };
 
-    socklen_t len = sizeof(struct sockaddr_in);
+    socklen_t len = sizeof(peeraddr);
 
     getpeername(sd, (struct sockaddr *) &peeraddr, &len);
 
-    return peeraddr.sin_port;
+    return net_port(&peeraddr);
 }
 
 /*
- * Get local hostname.
+ * Get local hostname. Like netHost(), this may block and returns a static
+ * buffer.
  */
 const char *netLocalHost(int sd)
 {
-    struct sockaddr_in sockaddr;
+    static char text_buffer[NET_HOST_SIZE];
 
-    socklen_t len = sizeof(struct sockaddr_in);
+    return netLocalHostR(sd, false, text_buffer, sizeof(text_buffer));
+}
 
-    getsockname(sd, (struct sockaddr *) &sockaddr, &len);
+/*
+ * Write the local host name of socket <sd> to <buf>, which has room for <size>
+ * bytes, and return <buf>, as netAddrHost() does. Returns NULL if the local
+ * address can't be found.
+ */
+const char *netLocalHostR(int sd, bool numeric, char *buf, size_t size)
+{
+    struct sockaddr_storage sockaddr;
+
+    socklen_t len = sizeof(sockaddr);
+
+    if (getsockname(sd, (struct sockaddr *) &sockaddr, &len) != 0) {
+        return NULL;
+    }
 
-    return netHost(sockaddr.sin_addr.s_addr);
+    return netAddrHost((struct sockaddr *) &sockaddr, len, numeric, buf, size);
 }
 
 /*
@@ -114,11 +273,1159 @@ const char *netLocalHost(int sd)
  */
 uint16_t netLocalPort(int sd)
 {
-    struct sockaddr_in peeraddr;
+    struct sockaddr_storage sockaddr = { 0 };
+
+    socklen_t len = sizeof(sockaddr);
+
+    getsockname(sd, (struct sockaddr *) &sockaddr, &len);
+
+    return ntohs(net_port(&sockaddr));
+}
+
+/*
+ * Write the key under which lookups of <host> for sockets of type <socktype>
+ * and family <family> are cached to <key>, which has room for <size> bytes.
+ */
+static void net_fwd_key(char *key, size_t size, const char *host,
+        int family, int socktype, bool passive)
+{
+    snprintf(key, size, "%d/%d/%c/%s", family, socktype,
+            host == NULL ? (passive ? 'P' : 'L') : 'H',
+            host == NULL ? "" : host);
+}
+
+/*
+ * Set the port in the <count> addresses in <addr> to <port>.
+ */
+static void net_set_port(NetAddr *addr, int count, uint16_t port)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (addr[i].addr.ss_family == AF_INET) {
+            ((struct sockaddr_in *) &addr[i].addr)->sin_port = htons(port);
+        }
+        else if (addr[i].addr.ss_family == AF_INET6) {
+            ((struct sockaddr_in6 *) &addr[i].addr)->sin6_port = htons(port);
+        }
+    }
+}
+
+/*
+ * Used by net_purge() and net_fwd_purge() to collect expired cache entries.
+ */
+typedef struct {
+    double now;
+    PointerArray expired;
+} NetPurge;
+
+/*
+ * Add forward cache entry <data> to the NetPurge in <udata> if it has
+ * expired.
+ */
+static void net_fwd_find_expired(HashTable *tbl, void *data, void *udata)
+{
+    NetFwdEntry *entry = data;
+    NetPurge *purge = udata;
+
+    UNUSED(tbl);
+
+    if (entry->expires <= purge->now) {
+        paSet(&purge->expired, paCount(&purge->expired), entry);
+    }
+}
+
+/*
+ * Remove expired entries from the forward cache. Must be called with
+ * <fwd_lock> held.
+ */
+static void net_fwd_purge(double now)
+{
+    NetPurge purge = { now, { 0 } };
+    int i;
+
+    hashTraverse(&fwd_cache, net_fwd_find_expired, &purge);
+
+    for (i = 0; i < paCount(&purge.expired); i++) {
+        NetFwdEntry *entry = paGet(&purge.expired, i);
+
+        hashDrop(&fwd_cache, HASH_STRING(entry->key));
+
+        free(entry->key);
+        free(entry);
+    }
+
+    paClear(&purge.expired);
+}
+
+/*
+ * Copy the cached result for <key> to <addr>, and the error code to <error>
+ * if it isn't NULL. Returns the number of addresses, -1 if the host name
+ * doesn't exist or -2 if it isn't in the cache.
+ */
+static int net_fwd_cached(const char *key, NetAddr *addr, int *error)
+{
+    int count = -2;
+
+    pthread_mutex_lock(&fwd_lock);
+
+    NetFwdEntry *entry = hashGet(&fwd_cache, HASH_STRING(key));
+
+    if (entry != NULL && entry->expires > dnow()) {
+        count = entry->count;
+
+        if (count > 0) {
+            memcpy(addr, entry->addr, count * sizeof(NetAddr));
+        }
+        else if (error != NULL) {
+            *error = entry->error;
+        }
+    }
+
+    pthread_mutex_unlock(&fwd_lock);
+
+    return count;
+}
+
+/*
+ * Look up <host> using getaddrinfo(), put the results in <addr> and store them
+ * in the forward cache under <key>. Returns the number of addresses found, or
+ * -1 (with the error code in <error> if it isn't NULL) if the lookup failed.
+ */
+static int net_fwd_lookup(const char *key, const char *host,
+        int family, int socktype, bool passive, NetAddr *addr, int *error)
+{
+    struct addrinfo *first_info, *info;
+    struct addrinfo hints = {
+        .ai_family   = family,
+        .ai_socktype = socktype,
+        .ai_flags    = passive ? AI_PASSIVE : 0
+    };
+
+    int r, count = 0;
+    double ttl;
+
+    if ((r = getaddrinfo(host, "0", &hints, &first_info)) != 0) {
+        if (error != NULL) *error = r;
+
+        count = -1;
+    }
+    else {
+        for (info = first_info; info != NULL && count < NET_MAX_ADDR;
+             info = info->ai_next) {
+            if (info->ai_addrlen > sizeof(addr[count].addr)) continue;
+
+            memset(&addr[count], 0, sizeof(NetAddr));
+            memcpy(&addr[count].addr, info->ai_addr, info->ai_addrlen);
+            addr[count].len = info->ai_addrlen;
+
+            count++;
+        }
+
+        freeaddrinfo(first_info);
+    }
+
+    /* Cache answers, including "no such host", but not temporary failures
+     * like a DNS server that can't be reached. */
+
+    if (count == 0) {
+        if (error != NULL) *error = r = EAI_NONAME;
+
+        count = -1;
+    }
+#ifdef EAI_NODATA
+    else if (count < 0 && r != EAI_NONAME && r != EAI_NODATA) {
+#else
+    else if (count < 0 && r != EAI_NONAME) {
+#endif
+        return -1;
+    }
+
+    pthread_mutex_lock(&fwd_lock);
+
+    /* The TTLs may be changed by netSetCacheTTL() in another thread. */
+
+    ttl = count > 0 ? fwd_positive_ttl : fwd_negative_ttl;
+
+    double now = dnow();
+
+    if (ttl > 0) {
+        NetFwdEntry *entry = hashGet(&fwd_cache, HASH_STRING(key));
+
+        if (entry == NULL) {
+            entry = calloc(1, sizeof(NetFwdEntry));
+            entry->key = strdup(key);
+
+            hashAdd(&fwd_cache, entry, HASH_STRING(entry->key));
+        }
+
+        entry->expires = now + ttl;
+        entry->count = count;
+        entry->error = r;
+
+        if (count > 0) {
+            memcpy(entry->addr, addr, count * sizeof(NetAddr));
+        }
+    }
+
+    if (now >= fwd_next_purge) {
+        net_fwd_purge(now);
+
+        fwd_next_purge = now + MAX(fwd_positive_ttl, fwd_negative_ttl);
+    }
+
+    pthread_mutex_unlock(&fwd_lock);
+
+    return count;
+}
+
+/*
+ * Look up the addresses of <host> (which may be NULL to get the loopback
+ * address, or the wildcard address if <passive> is true) for sockets of type
+ * <socktype> (SOCK_STREAM or SOCK_DGRAM) and address family <family> (AF_INET,
+ * AF_INET6 or AF_UNSPEC for both), and put them, with port <port>, in <addr>,
+ * which must have room for NET_MAX_ADDR entries. Results are cached (see
+ * netSetCacheTTL()), so repeated lookups of the same host don't block. Returns
+ * the number of addresses found, or -1 if <host> could not be resolved, in
+ * which case, if <error> is not NULL, the error code from getaddrinfo() is
+ * put in it. This function is thread-safe.
+ */
+int netResolve(const char *host, uint16_t port, int family, int socktype,
+        bool passive, NetAddr *addr, int *error)
+{
+    char key[NET_HOST_SIZE + 32];
+    int count;
+
+    net_fwd_key(key, sizeof(key), host, family, socktype, passive);
+
+    if ((count = net_fwd_cached(key, addr, error)) == -2) {
+        count = net_fwd_lookup(key, host, family, socktype, passive,
+                addr, error);
+    }
+
+    if (count > 0) net_set_port(addr, count, port);
+
+    return count;
+}
+
+/*
+ * Set the time (in seconds) for which netResolve() and netResolverForward()
+ * cache successful lookups to <positive>, and for which they cache names that
+ * don't exist to <negative>. The defaults are 60 and 10 seconds. A time of 0
+ * disables caching. Temporary failures are never cached.
+ */
+void netSetCacheTTL(double positive, double negative)
+{
+    pthread_mutex_lock(&fwd_lock);
+
+    fwd_positive_ttl = positive;
+    fwd_negative_ttl = negative;
+
+    pthread_mutex_unlock(&fwd_lock);
+}
+
+/*
+ * Free forward cache entry <data>.
+ */
+static void net_fwd_free_entry(HashTable *tbl, void *data, void *udata)
+{
+    NetFwdEntry *entry = data;
+
+    UNUSED(tbl);
+    UNUSED(udata);
+
+    free(entry->key);
+    free(entry);
+}
+
+/*
+ * Remove all entries from the cache used by netResolve() and
+ * netResolverForward().
+ */
+void netFlushCache(void)
+{
+    pthread_mutex_lock(&fwd_lock);
+
+    hashTraverse(&fwd_cache, net_fwd_free_entry, NULL);
+    hashClear(&fwd_cache);
+
+    pthread_mutex_unlock(&fwd_lock);
+}
+
+/*
+ * Fill <key> for the address in <addr>, whose length is <len>, and copy the
+ * address to <norm>, with IPv4-mapped IPv6 addresses converted to IPv4. If
+ * <norm> is NULL it is not filled in. Returns the length of the address in
+ * <norm>, or 0 if <addr> is not an IPv4 or IPv6 address.
+ */
+static socklen_t net_key(NetKey *key, struct sockaddr_storage *norm,
+        const struct sockaddr *addr, socklen_t len)
+{
+    struct sockaddr_in sin = { 0 };
+
+    memset(key, 0, sizeof(NetKey));
+
+    if (addr->sa_family == AF_INET && len >= sizeof(struct sockaddr_in)) {
+        memcpy(&sin, addr, sizeof(sin));
+    }
+    else if (addr->sa_family == AF_INET6 &&
+             len >= sizeof(struct sockaddr_in6)) {
+        const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *) addr;
+
+        if (IN6_IS_ADDR_V4MAPPED(&sin6->sin6_addr)) {
+            sin.sin_family = AF_INET;
+            memcpy(&sin.sin_addr, sin6->sin6_addr.s6_addr + 12, 4);
+        }
+        else {
+            key->family = AF_INET6;
+            memcpy(key->addr, &sin6->sin6_addr, 16);
+
+            if (norm != NULL) {
+                memset(norm, 0, sizeof(*norm));
+                memcpy(norm, sin6, sizeof(*sin6));
+            }
+
+            return sizeof(struct sockaddr_in6);
+        }
+    }
+    else {
+        return 0;
+    }
+
+    key->family = AF_INET;
+    memcpy(key->addr, &sin.sin_addr, 4);
+
+    if (norm != NULL) {
+        memset(norm, 0, sizeof(*norm));
+        memcpy(norm, &sin, sizeof(sin));
+    }
+
+    return sizeof(struct sockaddr_in);
+}
+
+/*
+ * Body of the resolver threads: take jobs off the queue, look them up, put
+ * them on the done list and wake up the dispatcher via the pipe.
+ */
+static void *net_resolver_thread(void *arg)
+{
+    NetResolver *res = arg;
+    NetJob *job;
+    bool wake;
+
+    for (;;) {
+        pthread_mutex_lock(&res->lock);
+
+        while (!res->stop && listIsEmpty(&res->queue)) {
+            pthread_cond_wait(&res->cond, &res->lock);
+        }
+
+        if (res->stop) {
+            pthread_mutex_unlock(&res->lock);
+            break;
+        }
+
+        job = listRemoveHead(&res->queue);
+
+        pthread_mutex_unlock(&res->lock);
+
+        if (job->key != NULL) {
+            job->count = net_fwd_lookup(job->key, job->name,
+                    job->family, job->socktype, false, job->result, NULL);
+        }
+        else {
+            netAddrHost((struct sockaddr *) &job->addr, job->len, false,
+                    job->host, sizeof(job->host));
+        }
+
+        pthread_mutex_lock(&res->lock);
+
+        wake = listIsEmpty(&res->done);
+
+        listAppendTail(&res->done, job);
+
+        pthread_mutex_unlock(&res->lock);
+
+        /* One byte is enough to wake up the dispatcher, which empties the
+         * whole list. The pipe is non-blocking, so a dispatcher that no longer
+         * reads it (because it is in netResolverDestroy()) can't make us hang
+         * here. If the pipe is full there's a wake-up pending anyway. */
+
+        while (wake && write(res->pipe_fd[1], "", 1) == -1 && errno == EINTR);
+    }
+
+    return NULL;
+}
+
+/*
+ * Free all waiters for <job>, and <job> itself.
+ */
+static void net_free_job(NetJob *job)
+{
+    NetWaiter *waiter;
+
+    while ((waiter = listRemoveHead(&job->waiters)) != NULL) {
+        free(waiter);
+    }
+
+    free(job->key);
+    free(job->name);
+    free(job);
+}
+
+/*
+ * Add cache entry <data> to the NetPurge in <udata> if it has expired.
+ */
+static void net_find_expired(HashTable *tbl, void *data, void *udata)
+{
+    NetEntry *entry = data;
+    NetPurge *purge = udata;
+
+    UNUSED(tbl);
+
+    if (entry->job == NULL && entry->expires <= purge->now) {
+        paSet(&purge->expired, paCount(&purge->expired), entry);
+    }
+}
+
+/*
+ * Remove expired entries from the cache of <res>.
+ */
+static void net_purge(NetResolver *res, double now)
+{
+    NetPurge purge = { now, { 0 } };
+    int i;
+
+    hashTraverse(&res->cache, net_find_expired, &purge);
+
+    for (i = 0; i < paCount(&purge.expired); i++) {
+        NetEntry *entry = paGet(&purge.expired, i);
+
+        hashDrop(&res->cache, HASH_VALUE(entry->key));
+
+        free(entry->host);
+        free(entry);
+    }
+
+    paClear(&purge.expired);
+}
+
+/*
+ * Handle finished forward lookup <job> for <res>: call its waiters and free
+ * it.
+ */
+static void net_forward_done(NetResolver *res, NetJob *job)
+{
+    NetAddr addr[NET_MAX_ADDR];
+    NetWaiter *waiter;
+
+    int count = MAX(job->count, 0);
+
+    hashDrop(&res->pending, HASH_STRING(job->key));
+
+    /* As with reverse lookups, new lookups can no longer reach this job, but
+     * netResolverCancel() can. Each callback gets its own copy of the results,
+     * with its own port. */
+
+    res->completing = job;
+
+    while ((waiter = listRemoveHead(&job->waiters)) != NULL) {
+        memcpy(addr, job->result, count * sizeof(NetAddr));
+
+        net_set_port(addr, count, waiter->port);
+
+        waiter->fwd_cb(res, addr, count, (void *) waiter->udata);
+
+        free(waiter);
+    }
+
+    res->completing = NULL;
+
+    net_free_job(job);
+}
+
+/*
+ * Called when the resolver threads have woken up the NetResolver in <udata>
+ * because there are finished jobs. Stores the results in the cache and calls
+ * the waiters.
+ */
+static void net_resolver_done(Dispatcher *dis, int fd, void *udata)
+{
+    NetResolver *res = udata;
+    NetJob *job;
+    char buf[64];
+
+    UNUSED(dis);
+
+    /* Empty the pipe first, so that a job that is finished while we're busy
+     * below wakes us up again. */
+
+    while (read(fd, buf, sizeof(buf)) > 0);
+
+    double now = dnow();
+
+    for (;;) {
+        NetKey key;
+        NetWaiter *waiter;
+
+        pthread_mutex_lock(&res->lock);
+        job = listRemoveHead(&res->done);
+        pthread_mutex_unlock(&res->lock);
+
+        if (job == NULL) break;
+
+        if (job->key != NULL) {
+            net_forward_done(res, job);
+            continue;
+        }
+
+        net_key(&key, NULL, (struct sockaddr *) &job->addr, job->len);
+
+        NetEntry *entry = hashGet(&res->cache, HASH_VALUE(key));
+
+        free(entry->host);
+
+        entry->host = strdup(job->host);
+        entry->expires = now + res->ttl;
+        entry->job = NULL;
+
+        /* A callback may start a new lookup for this address, which won't find
+         * this job anymore because it has been detached from its entry. It may
+         * also cancel waiters, which netResolverCancel() finds through
+         * <completing>. */
+
+        res->completing = job;
+
+        while ((waiter = listRemoveHead(&job->waiters)) != NULL) {
+            waiter->cb(res, entry->host, (void *) waiter->udata);
+            free(waiter);
+        }
+
+        res->completing = NULL;
+
+        free(job);
+    }
+
+    if (now >= res->next_purge) {
+        net_purge(res, now);
+
+        res->next_purge = now + res->ttl;
+    }
+}
+
+/*
+ * Create a resolver that looks up host names for addresses (and, using
+ * netResolverForward(), addresses for host names) in the background, using
+ * <threads> threads, and reports the results through dispatcher <dis>. Host
+ * names (including failed lookups, for which the numeric address is reported)
+ * are cached for <ttl> seconds.
+ */
+NetResolver *netResolverCreate(Dispatcher *dis, int threads, double ttl)
+{
+    int i;
+
+    NetResolver *res = calloc(1, sizeof(NetResolver));
+
+    if (pipe(res->pipe_fd) != 0) {
+        free(res);
+        return NULL;
+    }
+
+    fcntl(res->pipe_fd[0], F_SETFL, O_NONBLOCK);
+    fcntl(res->pipe_fd[1], F_SETFL, O_NONBLOCK);
+
+    res->dis = dis;
+    res->ttl = ttl;
+    res->next_purge = dnow() + ttl;
+    res->n_threads = MAX(threads, 1);
+    res->thread = calloc(res->n_threads, sizeof(pthread_t));
+
+    pthread_mutex_init(&res->lock, NULL);
+    pthread_cond_init(&res->cond, NULL);
+
+    for (i = 0; i < res->n_threads; i++) {
+        pthread_create(&res->thread[i], NULL, net_resolver_thread, res);
+    }
+
+    disOnData(dis, res->pipe_fd[0], net_resolver_done, res);
+
+    return res;
+}
+
+/*
+ * Look up the host name for the IPv4 or IPv6 address in <addr>, whose length
+ * is <len>. <cb> will be called with <res>, the host name (or the numeric
+ * address, if no name was found) and <udata>. If the name is in the cache,
+ * <cb> is called immediately and 0 is returned. Otherwise 1 is returned and
+ * <cb> is called from <res>'s dispatcher when the lookup is done. Returns -1
+ * (without calling <cb>) if <addr> is not an IPv4 or IPv6 address.
+ */
+int netResolverLookup(NetResolver *res,
+        const struct sockaddr *addr, socklen_t len,
+        void (*cb)(NetResolver *res, const char *host, void *udata),
+        void *udata)
+{
+    NetKey key;
+    struct sockaddr_storage norm;
+    socklen_t norm_len;
+
+    if ((norm_len = net_key(&key, &norm, addr, len)) == 0) return -1;
+
+    NetEntry *entry = hashGet(&res->cache, HASH_VALUE(key));
+
+    if (entry == NULL) {
+        entry = calloc(1, sizeof(NetEntry));
+        entry->key = key;
+
+        hashAdd(&res->cache, entry, HASH_VALUE(entry->key));
+    }
+    else if (entry->job == NULL && entry->expires > dnow()) {
+        cb(res, entry->host, udata);
+
+        return 0;
+    }
+
+    NetWaiter *waiter = calloc(1, sizeof(NetWaiter));
+
+    waiter->cb = cb;
+    waiter->udata = udata;
+
+    if (entry->job == NULL) {
+        NetJob *job = calloc(1, sizeof(NetJob));
+
+        job->addr = norm;
+        job->len = norm_len;
+
+        entry->job = job;
+
+        listAppendTail(&job->waiters, waiter);
+
+        pthread_mutex_lock(&res->lock);
+        listAppendTail(&res->queue, job);
+        pthread_cond_signal(&res->cond);
+        pthread_mutex_unlock(&res->lock);
+    }
+    else {
+        listAppendTail(&entry->job->waiters, waiter);
+    }
+
+    return 1;
+}
+
+/*
+ * Look up the host name of the peer of socket <sd>, as netResolverLookup()
+ * does.
+ */
+int netResolverLookupPeer(NetResolver *res, int sd,
+        void (*cb)(NetResolver *res, const char *host, void *udata),
+        void *udata)
+{
+    struct sockaddr_storage peeraddr;
+
+    socklen_t len = sizeof(peeraddr);
+
+    if (getpeername(sd, (struct sockaddr *) &peeraddr, &len) != 0) {
+        return -1;
+    }
+
+    return netResolverLookup(res, (struct sockaddr *) &peeraddr, len,
+            cb, udata);
+}
+
+/*
+ * Look up the addresses of <host> in the background, like netResolve() does
+ * for non-passive sockets, using the same cache. <cb> will be called with
+ * <res>, the addresses found, with port <port>, their number (0 if <host>
+ * could not be resolved) and <udata>. If <host> is in the cache, <cb> is
+ * called immediately and 0 is returned. Otherwise 1 is returned and <cb> is
+ * called from <res>'s dispatcher when the lookup is done.
+ */
+int netResolverForward(NetResolver *res, const char *host, uint16_t port,
+        int family, int socktype,
+        void (*cb)(NetResolver *res, const NetAddr *addr, int count,
+                   void *udata),
+        void *udata)
+{
+    char key[NET_HOST_SIZE + 32];
+    NetAddr addr[NET_MAX_ADDR];
+    int count;
+
+    net_fwd_key(key, sizeof(key), host, family, socktype, false);
+
+    /* If a lookup for <host> is already in progress, join it even if a
+     * resolver thread has already put its result in the cache, so that
+     * callbacks are called in the order in which lookups were requested. */
+
+    NetJob *job = hashGet(&res->pending, HASH_STRING(key));
+
+    if (job == NULL && (count = net_fwd_cached(key, addr, NULL)) != -2) {
+        count = MAX(count, 0);
+
+        net_set_port(addr, count, port);
+
+        cb(res, addr, count, udata);
+
+        return 0;
+    }
+
+    NetWaiter *waiter = calloc(1, sizeof(NetWaiter));
+
+    waiter->fwd_cb = cb;
+    waiter->port = port;
+    waiter->udata = udata;
+
+    if (job == NULL) {
+        job = calloc(1, sizeof(NetJob));
+
+        job->key = strdup(key);
+        job->name = host == NULL ? NULL : strdup(host);
+        job->family = family;
+        job->socktype = socktype;
+
+        hashAdd(&res->pending, job, HASH_STRING(job->key));
+
+        listAppendTail(&job->waiters, waiter);
+
+        pthread_mutex_lock(&res->lock);
+        listAppendTail(&res->queue, job);
+        pthread_cond_signal(&res->cond);
+        pthread_mutex_unlock(&res->lock);
+    }
+    else {
+        listAppendTail(&job->waiters, waiter);
+    }
+
+    return 1;
+}
+
+/*
+ * Return the cached host name for the address in <addr>, whose length is
+ * <len>, or NULL if it isn't in the cache (or has expired). Never blocks.
+ */
+const char *netResolverCached(NetResolver *res,
+        const struct sockaddr *addr, socklen_t len)
+{
+    NetKey key;
+
+    if (net_key(&key, NULL, addr, len) == 0) return NULL;
+
+    NetEntry *entry = hashGet(&res->cache, HASH_VALUE(key));
+
+    if (entry == NULL || entry->job != NULL || entry->expires <= dnow()) {
+        return NULL;
+    }
+
+    return entry->host;
+}
+
+/*
+ * Remove the waiters with user data <udata> from <job>.
+ */
+static void net_cancel_waiters(NetJob *job, const void *udata)
+{
+    NetWaiter *waiter, *next;
+
+    for (waiter = listHead(&job->waiters); waiter; waiter = next) {
+        next = listNext(waiter);
+
+        if (waiter->udata == udata) {
+            listRemove(&job->waiters, waiter);
+            free(waiter);
+        }
+    }
+}
+
+/*
+ * Remove the waiters with the user data in <udata> from the pending job of
+ * cache entry <data>.
+ */
+static void net_cancel(HashTable *tbl, void *data, void *udata)
+{
+    NetEntry *entry = data;
+
+    UNUSED(tbl);
+
+    if (entry->job != NULL) net_cancel_waiters(entry->job, udata);
+}
+
+/*
+ * Remove the waiters with the user data in <udata> from pending forward
+ * lookup <data>.
+ */
+static void net_fwd_cancel(HashTable *tbl, void *data, void *udata)
+{
+    UNUSED(tbl);
+
+    net_cancel_waiters(data, udata);
+}
+
+/*
+ * Cancel all pending callbacks with user data <udata>, for example because
+ * the connection they were for has been closed. This may also be called from
+ * one of the callbacks, in which case it also cancels the callbacks that were
+ * waiting for the same lookup and haven't been called yet.
+ */
+void netResolverCancel(NetResolver *res, const void *udata)
+{
+    hashTraverse(&res->cache, net_cancel, (void *) udata);
+    hashTraverse(&res->pending, net_fwd_cancel, (void *) udata);
+
+    if (res->completing != NULL) net_cancel_waiters(res->completing, udata);
+}
+
+/*
+ * Free cache entry <data>.
+ */
+static void net_free_entry(HashTable *tbl, void *data, void *udata)
+{
+    NetEntry *entry = data;
+
+    UNUSED(tbl);
+    UNUSED(udata);
+
+    free(entry->host);
+    free(entry);
+}
+
+/*
+ * Destroy resolver <res>. Pending callbacks will not be called. This waits
+ * for lookups that are in progress to finish.
+ */
+void netResolverDestroy(NetResolver *res)
+{
+    NetJob *job;
+    int i;
+
+    pthread_mutex_lock(&res->lock);
+    res->stop = true;
+    pthread_cond_broadcast(&res->cond);
+    pthread_mutex_unlock(&res->lock);
+
+    for (i = 0; i < res->n_threads; i++) {
+        pthread_join(res->thread[i], NULL);
+    }
+
+    /* Every job is now either still in the queue or on the done list. */
+
+    while ((job = listRemoveHead(&res->queue)) != NULL) {
+        net_free_job(job);
+    }
+
+    while ((job = listRemoveHead(&res->done)) != NULL) {
+        net_free_job(job);
+    }
+
+    if (disOwnsFd(res->dis, res->pipe_fd[0])) {
+        disDropData(res->dis, res->pipe_fd[0]);
+    }
+
+    close(res->pipe_fd[0]);
+    close(res->pipe_fd[1]);
+
+    hashTraverse(&res->cache, net_free_entry, NULL);
+    hashClear(&res->cache);
+
+    /* The forward jobs in here have already been freed above. */
+
+    hashClear(&res->pending);
+
+    pthread_mutex_destroy(&res->lock);
+    pthread_cond_destroy(&res->cond);
+
+    free(res->thread);
+    free(res);
+}
+
+#ifdef TEST
+#include <sys/un.h>
+
+static int errors = 0;
+
+static int lookups = 0;
+
+/*
+ * Called when a lookup started by the test is done. <udata> points to a
+ * buffer to copy the result to.
+ */
+static void lookup_done(NetResolver *res, const char *host, void *udata)
+{
+    UNUSED(res);
+
+    strcpy(udata, host);
+
+    lookups--;
+}
+
+/*
+ * Called when a forward lookup started by the test is done. <udata> points to
+ * an int that receives <count>, followed by room for one NetAddr to receive
+ * the first address.
+ */
+static void forward_done(NetResolver *res, const NetAddr *addr, int count,
+        void *udata)
+{
+    struct { int count; NetAddr addr; } *result = udata;
+
+    UNUSED(res);
+
+    result->count = count;
+
+    if (count > 0) result->addr = addr[0];
+
+    lookups--;
+}
+
+/*
+ * Called for lookups that have been cancelled. Should never happen.
+ */
+static void lookup_cancelled(NetResolver *res, const char *host, void *udata)
+{
+    UNUSED(res);
+    UNUSED(host);
+    UNUSED(udata);
+
+    errors++;
+}
+
+/*
+ * Called for forward lookups that have been cancelled. Should never happen.
+ */
+static void forward_cancelled(NetResolver *res, const NetAddr *addr,
+        int count, void *udata)
+{
+    UNUSED(res);
+    UNUSED(addr);
+    UNUSED(count);
+    UNUSED(udata);
+
+    errors++;
+}
+
+/*
+ * Called when a forward lookup started by the test is done. Cancels the
+ * waiter whose user data is in <udata>.
+ */
+static void forward_cancel_other(NetResolver *res, const NetAddr *addr,
+        int count, void *udata)
+{
+    UNUSED(addr);
+    UNUSED(count);
+
+    netResolverCancel(res, udata);
+
+    lookups--;
+}
+
+/*
+ * Called when the test takes too long.
+ */
+static void timeout(Dispatcher *dis, double t, void *udata)
+{
+    UNUSED(dis);
+    UNUSED(t);
+    UNUSED(udata);
+
+    fprintf(stderr, "Timeout waiting for lookups.\n");
+
+    lookups = -1;
+}
+
+int main(void)
+{
+    char buf[NET_HOST_SIZE], host4[NET_HOST_SIZE], host6[NET_HOST_SIZE];
+    char mapped[NET_HOST_SIZE], again[NET_HOST_SIZE];
+
+    struct sockaddr_in sin = { 0 };
+    struct sockaddr_in6 sin6 = { 0 }, sin6_mapped = { 0 };
+    struct sockaddr_un sun = { 0 };
+
+    sun.sun_family = AF_UNIX;
+
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    sin6.sin6_family = AF_INET6;
+    sin6.sin6_addr = in6addr_loopback;
+
+    sin6_mapped.sin6_family = AF_INET6;
+    inet_pton(AF_INET6, "::ffff:127.0.0.1", &sin6_mapped.sin6_addr);
+
+    /* The numeric fast path. */
+
+    make_sure_that(strcmp(netAddrHost((struct sockaddr *) &sin, sizeof(sin),
+                    true, buf, sizeof(buf)), "127.0.0.1") == 0);
+    make_sure_that(strcmp(netAddrHost((struct sockaddr *) &sin6, sizeof(sin6),
+                    true, buf, sizeof(buf)), "::1") == 0);
+    make_sure_that(netAddrHost((struct sockaddr *) &sun, sizeof(sun),
+                    true, buf, sizeof(buf)) == NULL);
+
+    make_sure_that(strcmp(netHost(0), "0.0.0.0") == 0);
+    make_sure_that(strcmp(netHost(htonl(0x7F000001)), "localhost") == 0);
+
+    /* The resolver. */
+
+    Dispatcher *dis = disCreate();
+    NetResolver *res = netResolverCreate(dis, 2, 60);
+
+    make_sure_that(netResolverLookup(res, (struct sockaddr *) &sun,
+                sizeof(sun), lookup_done, host4) == -1);
+
+    make_sure_that(netResolverCached(res,
+                (struct sockaddr *) &sin, sizeof(sin)) == NULL);
+
+    make_sure_that(netResolverLookup(res, (struct sockaddr *) &sin,
+                sizeof(sin), lookup_done, host4) == 1);
+    make_sure_that(netResolverLookup(res, (struct sockaddr *) &sin6,
+                sizeof(sin6), lookup_done, host6) == 1);
+
+    /* Same address as the first, so it shares its lookup... */
+
+    make_sure_that(netResolverLookup(res, (struct sockaddr *) &sin6_mapped,
+                sizeof(sin6_mapped), lookup_done, mapped) == 1);
+
+    /* ... and this one is cancelled before it is done. */
+
+    make_sure_that(netResolverLookup(res, (struct sockaddr *) &sin,
+                sizeof(sin), lookup_cancelled, again) == 1);
+
+    netResolverCancel(res, again);
+
+    lookups = 3;
+
+    double deadline = dnow() + 10;
+
+    disOnTime(dis, deadline, timeout, NULL);
+
+    while (lookups > 0) {
+        if (disHandleEvents(dis) != 0) break;
+    }
+
+    if (lookups >= 0) disDropTime(dis, deadline, timeout);
+
+    make_sure_that(lookups == 0);
+
+    make_sure_that(strcmp(host4, "localhost") == 0);
+    make_sure_that(strcmp(mapped, "localhost") == 0);
+    make_sure_that(host6[0] != '\0');
+
+    /* Now it should be cached. */
+
+    make_sure_that(strcmp(netResolverCached(res,
+                (struct sockaddr *) &sin, sizeof(sin)), "localhost") == 0);
+
+    again[0] = '\0';
+
+    make_sure_that(netResolverLookup(res, (struct sockaddr *) &sin,
+                sizeof(sin), lookup_done, again) == 0);
+    make_sure_that(strcmp(again, "localhost") == 0);
+
+    /* Forward lookups. */
+
+    NetAddr addr[NET_MAX_ADDR];
+    struct sockaddr_in *sa = (struct sockaddr_in *) &addr[0].addr;
+    struct { int count; NetAddr addr; } fwd1, fwd2, fwd3;
+
+    int r, error = 0;
+
+    r = netResolve("localhost", 1234, AF_INET, SOCK_STREAM, false, addr, NULL);
+
+    make_sure_that(r >= 1);
+    make_sure_that(sa->sin_family == AF_INET);
+    make_sure_that(sa->sin_addr.s_addr == htonl(INADDR_LOOPBACK));
+    make_sure_that(sa->sin_port == htons(1234));
+
+    /* Comes from the cache now, but with a different port. */
+
+    r = netResolve("localhost", 4321, AF_INET, SOCK_STREAM, false, addr, NULL);
+
+    make_sure_that(r >= 1);
+    make_sure_that(sa->sin_addr.s_addr == htonl(INADDR_LOOPBACK));
+    make_sure_that(sa->sin_port == htons(4321));
+
+    r = netResolve(NULL, 80, AF_INET, SOCK_DGRAM, true, addr, NULL);
+
+    make_sure_that(r == 1);
+    make_sure_that(sa->sin_addr.s_addr == htonl(INADDR_ANY));
+
+    r = netResolve("no-such-host.invalid", 80, AF_UNSPEC, SOCK_STREAM, false,
+            addr, &error);
+
+    make_sure_that(r == -1);
+    make_sure_that(error != 0);
+
+    /* The cached entry for "localhost" makes this one return immediately. */
+
+    make_sure_that(netResolverForward(res, "localhost", 80, AF_INET,
+                SOCK_STREAM, forward_done, &fwd1) == 0);
+    make_sure_that(fwd1.count >= 1);
+    make_sure_that(ntohs(((struct sockaddr_in *) &fwd1.addr.addr)->sin_port)
+            == 80);
+
+    netFlushCache();
+
+    make_sure_that(netResolverForward(res, "localhost", 80, AF_INET,
+                SOCK_STREAM, forward_done, &fwd1) == 1);
+    make_sure_that(netResolverForward(res, "localhost", 81, AF_INET,
+                SOCK_STREAM, forward_done, &fwd2) == 1);
+    make_sure_that(netResolverForward(res, "localhost", 82, AF_INET,
+                SOCK_STREAM, forward_cancelled, &fwd3) == 1);
+
+    netResolverCancel(res, &fwd3);
+
+    lookups = 2;
+
+    deadline = dnow() + 10;
+
+    disOnTime(dis, deadline, timeout, NULL);
+
+    while (lookups > 0) {
+        if (disHandleEvents(dis) != 0) break;
+    }
+
+    if (lookups >= 0) disDropTime(dis, deadline, timeout);
+
+    make_sure_that(lookups == 0);
+    make_sure_that(fwd1.count >= 1);
+    make_sure_that(fwd2.count == fwd1.count);
+    make_sure_that(ntohs(((struct sockaddr_in *) &fwd1.addr.addr)->sin_port)
+            == 80);
+    make_sure_that(ntohs(((struct sockaddr_in *) &fwd2.addr.addr)->sin_port)
+            == 81);
+
+    /* A callback can cancel a waiter for the same lookup. */
+
+    netFlushCache();
+
+    make_sure_that(netResolverForward(res, "localhost", 80, AF_INET,
+                SOCK_STREAM, forward_cancel_other, &fwd3) == 1);
+    make_sure_that(netResolverForward(res, "localhost", 81, AF_INET,
+                SOCK_STREAM, forward_cancelled, &fwd3) == 1);
+
+    lookups = 1;
+
+    deadline = dnow() + 10;
+
+    disOnTime(dis, deadline, timeout, NULL);
+
+    while (lookups > 0) {
+        if (disHandleEvents(dis) != 0) break;
+    }
+
+    if (lookups >= 0) disDropTime(dis, deadline, timeout);
+
+    make_sure_that(lookups == 0);
+
+    /* Destroying the resolver while lookups are still in progress. */
+
+    netFlushCache();
+
+    make_sure_that(netResolverForward(res, "localhost", 80, AF_INET,
+                SOCK_STREAM, forward_cancelled, &fwd3) == 1);
 
-    socklen_t len = sizeof(struct sockaddr_in);
+    netResolverDestroy(res);
 
-    getsockname(sd, (struct sockaddr *) &peeraddr, &len);
+    disDestroy(dis);
 
-    return ntohs(peeraddr.sin_port);
+    return errors;
 }
+#endif
@@ -18,38 +18,183 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/socket.h>
+
+#include "dis.h"
+
+/* Size of a buffer that can hold any host name or numeric address. */
+
+#define NET_HOST_SIZE 1025
+
+/* Maximum number of addresses kept for a host name. */
+
+#define NET_MAX_ADDR 16
+
+typedef struct NetResolver NetResolver;
+
+/*
+ * An IPv4 or IPv6 address and port, as returned by netResolve().
+ */
+typedef struct {
+    struct sockaddr_storage addr;
+    socklen_t len;
+} NetAddr;
 
 /*
  * Get the host name that belongs to IP address <big_endian_ip>. Returns the
  * fqdn if it can be found, otherwise an IP address in dotted-quad notation.
+ * This may block for a long time if DNS is slow, and the result is returned
+ * in a static buffer that is overwritten by the next call.
  */
 const char *netHost(uint32_t big_endian_ip);
 
+/*
+ * Write the host name of the IPv4 or IPv6 address in <addr>, whose length is
+ * <len>, to <buf>, which has room for <size> bytes (NET_HOST_SIZE is always
+ * enough), and return <buf>. If <numeric> is true, or if no name can be found,
+ * the numeric address is used instead. If <numeric> is true this never blocks.
+ * Returns NULL if <addr> is not an IPv4 or IPv6 address. This function is
+ * thread-safe.
+ */
+const char *netAddrHost(const struct sockaddr *addr, socklen_t len,
+        bool numeric, char *buf, size_t size);
+
 /*
  * Get the port that corresponds to service <service>.
  */
 uint16_t netPort(const char *service, const char *protocol);
 
 /*
- * Get hostname of peer.
+ * Get hostname of peer. Works for IPv4 and IPv6 sockets. Like netHost(), this
+ * may block and returns a static buffer.
  */
 const char *netPeerHost(int sd);
 
+/*
+ * Write the host name of the peer of socket <sd> to <buf>, which has room for
+ * <size> bytes, and return <buf>, as netAddrHost() does. Returns NULL if the
+ * peer's address can't be found.
+ */
+const char *netPeerHostR(int sd, bool numeric, char *buf, size_t size);
+
 /*
  * Get port number used by peer.
  */
 uint16_t netPeerPort(int sd);
 
 /*
- * Get local hostname.
+ * Get local hostname. Like netHost(), this may block and returns a static
+ * buffer.
  */
 const char *netLocalHost(int sd);
 
+/*
+ * Write the local host name of socket <sd> to <buf>, which has room for <size>
+ * bytes, and return <buf>, as netAddrHost() does. Returns NULL if the local
+ * address can't be found.
+ */
+const char *netLocalHostR(int sd, bool numeric, char *buf, size_t size);
+
 /*
  * Get local port number.
  */
 uint16_t netLocalPort(int sd);
 
+/*
+ * Look up the addresses of <host> (which may be NULL to get the loopback
+ * address, or the wildcard address if <passive> is true) for sockets of type
+ * <socktype> (SOCK_STREAM or SOCK_DGRAM) and address family <family> (AF_INET,
+ * AF_INET6 or AF_UNSPEC for both), and put them, with port <port>, in <addr>,
+ * which must have room for NET_MAX_ADDR entries. Results are cached (see
+ * netSetCacheTTL()), so repeated lookups of the same host don't block. Returns
+ * the number of addresses found, or -1 if <host> could not be resolved, in
+ * which case, if <error> is not NULL, the error code from getaddrinfo() is
+ * put in it. This function is thread-safe.
+ */
+int netResolve(const char *host, uint16_t port, int family, int socktype,
+        bool passive, NetAddr *addr, int *error);
+
+/*
+ * Set the time (in seconds) for which netResolve() and netResolverForward()
+ * cache successful lookups to <positive>, and for which they cache names that
+ * don't exist to <negative>. The defaults are 60 and 10 seconds. A time of 0
+ * disables caching. Temporary failures are never cached.
+ */
+void netSetCacheTTL(double positive, double negative);
+
+/*
+ * Remove all entries from the cache used by netResolve() and
+ * netResolverForward().
+ */
+void netFlushCache(void);
+
+/*
+ * Create a resolver that looks up host names for addresses (and, using
+ * netResolverForward(), addresses for host names) in the background, using
+ * <threads> threads, and reports the results through dispatcher <dis>. Host
+ * names (including failed lookups, for which the numeric address is reported)
+ * are cached for <ttl> seconds.
+ */
+NetResolver *netResolverCreate(Dispatcher *dis, int threads, double ttl);
+
+/*
+ * Look up the host name for the IPv4 or IPv6 address in <addr>, whose length
+ * is <len>. <cb> will be called with <res>, the host name (or the numeric
+ * address, if no name was found) and <udata>. If the name is in the cache,
+ * <cb> is called immediately and 0 is returned. Otherwise 1 is returned and
+ * <cb> is called from <res>'s dispatcher when the lookup is done. Returns -1
+ * (without calling <cb>) if <addr> is not an IPv4 or IPv6 address.
+ */
+int netResolverLookup(NetResolver *res,
+        const struct sockaddr *addr, socklen_t len,
+        void (*cb)(NetResolver *res, const char *host, void *udata),
+        void *udata);
+
+/*
+ * Look up the host name of the peer of socket <sd>, as netResolverLookup()
+ * does.
+ */
+int netResolverLookupPeer(NetResolver *res, int sd,
+        void (*cb)(NetResolver *res, const char *host, void *udata),
+        void *udata);
+
+/*
+ * Look up the addresses of <host> in the background, like netResolve() does
+ * for non-passive sockets, using the same cache. <cb> will be called with
+ * <res>, the addresses found, with port <port>, their number (0 if <host>
+ * could not be resolved) and <udata>. If <host> is in the cache, <cb> is
+ * called immediately and 0 is returned. Otherwise 1 is returned and <cb> is
+ * called from <res>'s dispatcher when the lookup is done.
+ */
+int netResolverForward(NetResolver *res, const char *host, uint16_t port,
+        int family, int socktype,
+        void (*cb)(NetResolver *res, const NetAddr *addr, int count,
+                   void *udata),
+        void *udata);
+
+/*
+ * Return the cached host name for the address in <addr>, whose length is
+ * <len>, or NULL if it isn't in the cache (or has expired). Never blocks.
+ */
+const char *netResolverCached(NetResolver *res,
+        const struct sockaddr *addr, socklen_t len);
+
+/*
+ * Cancel all pending callbacks with user data <udata>, for example because
+ * the connection they were for has been closed. This may also be called from
+ * one of the callbacks, in which case it also cancels the callbacks that were
+ * waiting for the same lookup and haven't been called yet.
+ */
+void netResolverCancel(NetResolver *res, const void *udata);
+
+/*
+ * Destroy resolver <res>. Pending callbacks will not be called. This waits
+ * for lookups that are in progress to finish.
+ */
+void netResolverDestroy(NetResolver *res);
+
 #ifdef __cplusplus
 }
 #endif
@@ -81,6 +81,22 @@ static void ns_handle_data(Dispatcher *dis, int fd, __attribute__((unused)) void
     }
 }
 
+static void ns_handle_write_error(Dispatcher *dis, int fd, int error,
+        __attribute__((unused)) void *udata)
+{
+    NS *ns = (NS *) dis;
+
+    P dbgPrint(stderr, "Write error, disconnecting.\n");
+
+    nsDisconnect(ns, fd);
+
+    if (ns->on_error_cb != NULL) {
+        P dbgPrint(stderr, "Calling on_error_cb.\n");
+
+        ns->on_error_cb(ns, fd, error, ns->on_error_udata);
+    }
+}
+
 static void ns_add_connection(NS *ns, int fd)
 {
     NS_Connection *conn = calloc(1, sizeof(NS_Connection));
@@ -90,6 +106,7 @@ static void ns_add_connection(NS *ns, int fd)
     P dbgPrint(stderr, "New connection on fd %d\n", fd);
 
     disOnData(&ns->dis, fd, ns_handle_data, NULL);
+    disOnWriteError(&ns->dis, fd, ns_handle_write_error, NULL);
 }
 
 static void ns_accept_connection(Dispatcher *dis, int fd,
@@ -97,7 +114,9 @@ static void ns_accept_connection(Dispatcher *dis, int fd,
 {
     NS *ns = (NS *) dis;
 
-    fd = tcpAccept(fd);
+    if ((fd = tcpAccept(fd)) < 0) return;
+
+    tcpApplyOptions(fd, &ns->options);
 
     ns_add_connection(ns, fd);
 
@@ -142,11 +161,29 @@ int nsListen(NS *ns, const char *host, uint16_t port)
         return -1;
     }
 
+    tcpApplyOptions(listen_fd, &ns->options);
+
     disOnData(&ns->dis, listen_fd, ns_accept_connection, NULL);
 
     return listen_fd;
 }
 
+/*
+ * Apply socket options <opts> (see tcp.h) to all listen sockets and
+ * connections that <ns> creates from now on, in addition to those set using
+ * tcpSetOptions(). Pass NULL to stop doing so. Since these are applied after
+ * the socket has been connected, buffer sizes for outgoing connections are
+ * better set using tcpSetOptions(), so they're in place before the TCP window
+ * scale is negotiated.
+ */
+void nsSetOptions(NS *ns, const TcpOptions *opts)
+{
+    if (opts == NULL)
+        memset(&ns->options, 0, sizeof(ns->options));
+    else
+        ns->options = *opts;
+}
+
 /*
  * Arrange for <cb> to be called when a new connection is accepted.
  */
@@ -157,8 +194,10 @@ void nsOnConnect(NS *ns, void (*cb)(NS *ns, int fd, void *udata), void *udata)
 }
 
 /*
- * Arrange for <cb> to be called when a connection is lost. *Not* called on
- * nsDisconnect().
+ * Arrange for <cb> to be called when the peer closes a connection (i.e. when
+ * reading from it returns end-of-file). Failures to read from or write to a
+ * connection are reported through nsOnError() instead. The connection has been
+ * closed when <cb> is called. *Not* called on nsDisconnect().
  */
 void nsOnDisconnect(NS *ns, void (*cb)(NS *ns, int fd, void *udata), void *udata)
 {
@@ -179,8 +218,10 @@ void nsOnSocket(NS *ns, void (*cb)(NS *ns, int fd, const char *buffer, int size,
 }
 
 /*
- * Arrange for <cb> to be called when a connection is lost. *Not* called on
- * nsDisconnect().
+ * Arrange for <cb> to be called when a connection is lost, either because
+ * reading from it failed or because data queued for it (see disOnWriteError())
+ * could not be sent. The connection has been closed when <cb> is called. *Not*
+ * called on nsDisconnect().
  */
 void nsOnError(NS *ns, void (*cb)(NS *ns, int fd, int error, void *udata), void *udata)
 {
@@ -198,6 +239,8 @@ int nsConnect(NS *ns, const char *host, uint16_t port)
     int fd = tcpConnect(host, port);
 
     if (fd >= 0) {
+        tcpApplyOptions(fd, &ns->options);
+
         ns_add_connection(ns, fd);
     }
 
@@ -259,6 +302,46 @@ void nsWrite(NS *ns, int fd, const char *data, size_t size)
     disWrite(&ns->dis, fd, data, size);
 }
 
+/*
+ * Send <length> bytes from file <file_fd>, starting at <offset>, to <fd>,
+ * which must be known to <ns>. The data is sent in order with the data given
+ * to nsWrite(), without blocking and, where possible, without copying it
+ * through user space (see disSendFile()). <file_fd> may be closed after this
+ * call. Returns 0 on success or -1 on failure. If the file turns out to be
+ * shorter than <length>, the connection is closed and the callback given to
+ * nsOnError() is called with EIO.
+ */
+int nsSendFile(NS *ns, int fd, int file_fd, off_t offset, size_t length)
+{
+    return disSendFile(&ns->dis, fd, file_fd, offset, length);
+}
+
+/*
+ * Enable zero-copy sends on <fd>, which must be known to <ns>, for buffers of
+ * at least <threshold> bytes given to nsWriteZeroCopy() (see
+ * disSetZeroCopy()). Returns 0 on success or -1 if zero-copy is not supported,
+ * in which case nsWriteZeroCopy() copies the data as nsWrite() does.
+ */
+int nsSetZeroCopy(NS *ns, int fd, size_t threshold)
+{
+    return disSetZeroCopy(&ns->dis, fd, threshold);
+}
+
+/*
+ * Send the <size> bytes in <data> to <fd>, which must be known to <ns>, in
+ * order with the data given to nsWrite(). If zero-copy has been enabled using
+ * nsSetZeroCopy() and <size> is at least its threshold, <data> is sent without
+ * copying it and must be left alone until <release> is called with <data>,
+ * <size> and <udata>. Otherwise it is copied and <release> is called
+ * immediately.
+ */
+void nsWriteZeroCopy(NS *ns, int fd, const void *data, size_t size,
+        void (*release)(const void *data, size_t size, void *udata),
+        void *udata)
+{
+    disWriteZeroCopy(&ns->dis, fd, data, size, release, udata);
+}
+
 /*
  * Pack the arguments following <fd> according to the strpack interface from
  * utils.h and send the resulting string to <fd> via <ns>.
@@ -18,6 +18,7 @@ extern "C" {
 #endif
 
 #include "dis.h"
+#include "tcp.h"
 
 #include <sys/select.h>
 #include <stdarg.h>
@@ -43,6 +44,8 @@ struct NS {
     void (*on_socket_cb)(NS *ns, int fd, const char *buffer, int size,
             void *udata);
     void *on_socket_udata;
+
+    TcpOptions options; /* Applied to all sockets, see nsSetOptions(). */
 };
 
 /*
@@ -65,14 +68,26 @@ NS *nsCreate(void);
  */
 int nsListen(NS *ns, const char *host, uint16_t port);
 
+/*
+ * Apply socket options <opts> (see tcp.h) to all listen sockets and
+ * connections that <ns> creates from now on, in addition to those set using
+ * tcpSetOptions(). Pass NULL to stop doing so. Since these are applied after
+ * the socket has been connected, buffer sizes for outgoing connections are
+ * better set using tcpSetOptions(), so they're in place before the TCP window
+ * scale is negotiated.
+ */
+void nsSetOptions(NS *ns, const TcpOptions *opts);
+
 /*
  * Arrange for <cb> to be called when a new connection is accepted.
  */
 void nsOnConnect(NS *ns, void (*cb)(NS *ns, int fd, void *udata), void *udata);
 
 /*
- * Arrange for <cb> to be called when a connection is lost. *Not* called on
- * nsDisconnect().
+ * Arrange for <cb> to be called when the peer closes a connection (i.e. when
+ * reading from it returns end-of-file). Failures to read from or write to a
+ * connection are reported through nsOnError() instead. The connection has been
+ * closed when <cb> is called. *Not* called on nsDisconnect().
  */
 void nsOnDisconnect(NS *ns, void (*cb)(NS *ns, int fd, void *udata), void *udata);
 
@@ -85,8 +100,10 @@ void nsOnSocket(NS *ns, void (*cb)(NS *ns, int fd, const char *buffer, int size,
         void *udata);
 
 /*
- * Arrange for <cb> to be called when a connection is lost. *Not* called on
- * nsDisconnect().
+ * Arrange for <cb> to be called when a connection is lost, either because
+ * reading from it failed or because data queued for it (see disOnWriteError())
+ * could not be sent. The connection has been closed when <cb> is called. *Not*
+ * called on nsDisconnect().
  */
 void nsOnError(NS *ns, void (*cb)(NS *ns, int fd, int error, void *udata), void *udata);
 
@@ -125,6 +142,37 @@ void nsDropData(NS *ns, int fd);
  */
 void nsWrite(NS *ns, int fd, const char *data, size_t size);
 
+/*
+ * Send <length> bytes from file <file_fd>, starting at <offset>, to <fd>,
+ * which must be known to <ns>. The data is sent in order with the data given
+ * to nsWrite(), without blocking and, where possible, without copying it
+ * through user space (see disSendFile()). <file_fd> may be closed after this
+ * call. Returns 0 on success or -1 on failure. If the file turns out to be
+ * shorter than <length>, the connection is closed and the callback given to
+ * nsOnError() is called with EIO.
+ */
+int nsSendFile(NS *ns, int fd, int file_fd, off_t offset, size_t length);
+
+/*
+ * Enable zero-copy sends on <fd>, which must be known to <ns>, for buffers of
+ * at least <threshold> bytes given to nsWriteZeroCopy() (see
+ * disSetZeroCopy()). Returns 0 on success or -1 if zero-copy is not supported,
+ * in which case nsWriteZeroCopy() copies the data as nsWrite() does.
+ */
+int nsSetZeroCopy(NS *ns, int fd, size_t threshold);
+
+/*
+ * Send the <size> bytes in <data> to <fd>, which must be known to <ns>, in
+ * order with the data given to nsWrite(). If zero-copy has been enabled using
+ * nsSetZeroCopy() and <size> is at least its threshold, <data> is sent without
+ * copying it and must be left alone until <release> is called with <data>,
+ * <size> and <udata>. Otherwise it is copied and <release> is called
+ * immediately.
+ */
+void nsWriteZeroCopy(NS *ns, int fd, const void *data, size_t size,
+        void (*release)(const void *data, size_t size, void *udata),
+        void *udata);
+
 /*
  * Pack the arguments following <fd> according to the strpack interface from
  * utils.h and send the resulting string to <fd> via <ns>.
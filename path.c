@@ -7,7 +7,10 @@
  * find the file.
  *
  * Note that the search tree is built when you call pathCreate and pathAdd, so
- * a file created anywhere in the search path after that will not be found.
+ * a file created anywhere in the search path after that will not be found,
+ * unless you call pathWatch(). In that case the directories in the path are
+ * watched using inotify, and the search tree is updated whenever files are
+ * created, deleted or renamed in them.
  *
  * Copyright: (c) 2020-2024 Jacco van Schaik (jacco@jaccovanschaik.net)
  * Created:   2020-09-08
@@ -31,10 +34,16 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <limits.h>
+#include <sys/inotify.h>
 
 typedef struct {
     ListNode _node;
     char *name;
+    int fd;             /* Open file descriptor for this directory. */
+    int index;          /* Position in the path. */
+    int wd;             /* inotify watch descriptor, or -1. */
+    int gone;           /* TRUE if the directory has been removed. */
 } PathDir;
 
 typedef struct {
@@ -44,13 +53,17 @@ typedef struct {
 } PathFile;
 
 /*
- * Create a PathDir for <dir>.
+ * Create a PathDir for <dir>, which has been opened as <fd>, at position
+ * <index> in the path.
  */
-static PathDir *path_create_dir(const char *dirname)
+static PathDir *path_create_dir(const char *dirname, int fd, int index)
 {
     PathDir *dir = calloc(1, sizeof(*dir));
 
-    dir->name = strdup(dirname);
+    dir->name  = strdup(dirname);
+    dir->fd    = fd;
+    dir->index = index;
+    dir->wd    = -1;
 
     return dir;
 }
@@ -69,25 +82,126 @@ static PathFile *path_create_file(const char *filename, const PathDir *dir)
 }
 
 /*
- * Add a PathFile entry for <filename> (and possibly a PathDir entry for
- * <dirname>, which is where it is located) to <path>.
+ * Remove <file> from <path> and free it.
  */
-static void path_add_file(Path *path, const char *dirname, const char *filename)
+static void path_remove_file(Path *path, PathFile *file)
 {
-    PathDir *dir;
-    PathFile *file;
+    hlDel(&path->files, file->name, strlen(file->name));
 
-    if ((dir = hlGet(&path->dirs, HASH_STRING(dirname))) == NULL) {
-        dir = path_create_dir(dirname);
+    free(file->name);
+    free(file);
+}
 
-        hlAdd(&path->dirs, dir, dirname, strlen(dirname));
-    }
+/*
+ * Add a PathFile entry for <filename>, which was found in <dir>, to <path>. If
+ * there already is an entry for <filename> it is kept, unless it refers to a
+ * directory that comes later in the path than <dir>.
+ */
+static void path_add_file(Path *path, const PathDir *dir, const char *filename)
+{
+    PathFile *file;
 
     if ((file = hlGet(&path->files, HASH_STRING(filename))) == NULL) {
         file = path_create_file(filename, dir);
 
         hlAdd(&path->files, file, filename, strlen(filename));
     }
+    else if (file->dir->index > dir->index) {
+        file->dir = dir;
+    }
+}
+
+/*
+ * Return TRUE if <filename> in <dir> is a regular file or a symbolic link
+ * (i.e. something we would have found while scanning <dir>).
+ */
+static int path_is_file(const PathDir *dir, const char *filename)
+{
+    struct stat statbuf;
+
+    if (fstatat(dir->fd, filename, &statbuf, AT_SYMLINK_NOFOLLOW) != 0) {
+        return FALSE;
+    }
+
+    int type = statbuf.st_mode & S_IFMT;
+
+    return type == S_IFREG || type == S_IFLNK;
+}
+
+/*
+ * Find out where <file> is now that it is no longer in the directory that
+ * <path> had for it. If it is in none of the other directories in <path> it
+ * is removed.
+ */
+static void path_relocate_file(Path *path, PathFile *file)
+{
+    const PathDir *old_dir = file->dir;
+    PathDir *dir;
+
+    for (dir = hlHead(&path->dirs); dir; dir = hlNext(dir)) {
+        if (dir == old_dir || dir->gone) continue;
+
+        if (path_is_file(dir, file->name)) {
+            file->dir = dir;
+            return;
+        }
+    }
+
+    path_remove_file(path, file);
+}
+
+/*
+ * Scan directory <dir> and add the files found there to <path>.
+ */
+static void path_scan_dir(Path *path, const PathDir *dir)
+{
+    DIR *dp;
+    struct dirent *entry;
+
+    /* fdopendir() takes over the file descriptor it is given, and we want to
+     * keep ours, so give it a new one. */
+
+    int dir_fd = openat(dir->fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (dir_fd < 0) {
+        return;
+    }
+    else if ((dp = fdopendir(dir_fd)) == NULL) {
+        close(dir_fd);
+        return;
+    }
+
+    while ((entry = readdir(dp)) != NULL) {
+        if (entry->d_type == DT_UNKNOWN) {
+            struct stat statbuf;
+
+            fstatat(dir_fd, entry->d_name, &statbuf, 0);
+
+            int type = statbuf.st_mode & S_IFMT;
+
+            if (type == S_IFREG || type == S_IFLNK) {
+                path_add_file(path, dir, entry->d_name);
+            }
+        }
+        else if (entry->d_type == DT_REG || entry->d_type == DT_LNK) {
+            path_add_file(path, dir, entry->d_name);
+        }
+    }
+
+    closedir(dp);
+}
+
+/*
+ * Start watching directory <dir> in <path>.
+ */
+static void path_watch_dir(Path *path, PathDir *dir)
+{
+    const uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+        IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+    if ((dir->wd = inotify_add_watch(path->watch_fd, dir->name, mask)) >= 0) {
+        paSet(&path->watches, dir->wd, dir);
+    }
 }
 
 /*
@@ -100,8 +214,8 @@ static void path_scan(Path *path, const char *path_str)
     const char *end = path_str - 1;
 
     do {
-        DIR *dir;
-        struct dirent *entry;
+        PathDir *dir;
+        int fd;
         const char *begin = end + 1;
         size_t length;
 
@@ -115,52 +229,162 @@ static void path_scan(Path *path, const char *path_str)
 
         bufSet(&dirname, begin, length);
 
-        if ((dir = opendir(bufGet(&dirname))) == NULL) continue;
+        if (hlContains(&path->dirs, HASH_STRING(bufGet(&dirname)))) {
+            continue;
+        }
 
-        int dir_fd = dirfd(dir);
+        fd = open(bufGet(&dirname), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
 
-        while ((entry = readdir(dir)) != NULL) {
-            if (entry->d_type == DT_UNKNOWN) {
-                struct stat statbuf;
+        if (fd < 0) continue;
 
-                fstatat(dir_fd, entry->d_name, &statbuf, 0);
+        dir = path_create_dir(bufGet(&dirname), fd,
+                listLength(&path->dirs.list));
 
-                int type = statbuf.st_mode & S_IFMT;
+        hlAdd(&path->dirs, dir, bufGet(&dirname), length);
 
-                if (type == S_IFREG || type == S_IFLNK) {
-                    path_add_file(path, bufGet(&dirname), entry->d_name);
-                }
-            }
-            else if (entry->d_type == DT_REG || entry->d_type == DT_LNK) {
-                path_add_file(path, bufGet(&dirname), entry->d_name);
-            }
-        }
+        /* Start watching before scanning, so that nothing created in
+         * between is missed. */
+
+        if (path->watch_fd >= 0) path_watch_dir(path, dir);
 
-        closedir(dir);
+        path_scan_dir(path, dir);
     } while (*end != '\0');
 
     bufClear(&dirname);
 }
 
 /*
- * Get the full name for the first file in <path> that has name <filename>.
- * Returns NULL if no such file exists.
+ * Forget all files in <path> and scan all its directories again. Used if we
+ * may have missed some changes.
  */
-static const char *path_get(Path *path, const char *filename)
+static void path_rescan(Path *path)
 {
-    static Buffer namebuf = { 0 };
+    PathDir *dir;
+    PathFile *file;
+
+    while ((file = hlHead(&path->files)) != NULL) {
+        path_remove_file(path, file);
+    }
+
+    for (dir = hlHead(&path->dirs); dir; dir = hlNext(dir)) {
+        if (!dir->gone) path_scan_dir(path, dir);
+    }
+}
 
+/*
+ * Handle inotify event <event> for <path>.
+ */
+static void path_handle_event(Path *path, const struct inotify_event *event)
+{
+    PathDir *dir;
     PathFile *file;
 
-    if ((file = hlGet(&path->files, HASH_STRING(filename))) == NULL) {
-        return NULL;
+    if (event->mask & IN_Q_OVERFLOW) {
+        path_rescan(path);
+        return;
     }
 
-    bufSetS(&namebuf, file->dir->name);
-    bufAddS(&namebuf, "/");
-    bufAddS(&namebuf, file->name);
+    if (event->wd < 0 || (dir = paGet(&path->watches, event->wd)) == NULL) {
+        return;
+    }
 
-    return bufGet(&namebuf);
+    if (event->mask & IN_IGNORED) {
+        paDrop(&path->watches, event->wd);
+        dir->wd = -1;
+        return;
+    }
+
+    if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+        PathFile *next_file;
+
+        dir->gone = TRUE;
+
+        for (file = hlHead(&path->files); file; file = next_file) {
+            next_file = hlNext(file);
+
+            if (file->dir == dir) path_relocate_file(path, file);
+        }
+
+        if (event->mask & IN_MOVE_SELF) {
+            inotify_rm_watch(path->watch_fd, dir->wd);
+        }
+
+        return;
+    }
+
+    if (event->len == 0 || (event->mask & IN_ISDIR)) return;
+
+    if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+        if (path_is_file(dir, event->name)) {
+            path_add_file(path, dir, event->name);
+        }
+    }
+    else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        file = hlGet(&path->files, HASH_STRING(event->name));
+
+        if (file != NULL && file->dir == dir) path_relocate_file(path, file);
+    }
+}
+
+/*
+ * Called by the Dispatcher when the inotify file descriptor for the Path in
+ * <udata> becomes readable.
+ */
+static void path_on_events(Dispatcher *dis, int fd, void *udata)
+{
+    UNUSED(dis);
+    UNUSED(fd);
+
+    pathHandleEvents(udata);
+}
+
+/*
+ * Convert fopen() mode <mode> to open() flags in <flags>. Returns 0 on
+ * success, or -1 if <mode> is invalid (in which case errno is set to EINVAL).
+ */
+static int path_mode_to_flags(const char *mode, int *flags)
+{
+    const char *p;
+
+    switch(mode[0]) {
+    case 'r':
+        *flags = O_RDONLY;
+        break;
+    case 'w':
+        *flags = O_WRONLY | O_CREAT | O_TRUNC;
+        break;
+    case 'a':
+        *flags = O_WRONLY | O_CREAT | O_APPEND;
+        break;
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (p = mode + 1; *p != '\0'; p++) {
+        if (*p == '+') {
+            *flags = (*flags & ~O_ACCMODE) | O_RDWR;
+        }
+        else if (*p == 'e') {
+            *flags |= O_CLOEXEC;
+        }
+        else if (*p == 'x') {
+            *flags |= O_EXCL;
+        }
+        else if (*p == ',') {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Open <filename> in <dir> with <flags>.
+ */
+static int path_open(const PathDir *dir, const char *filename, int flags)
+{
+    return openat(dir->fd, filename, flags, 0666);
 }
 
 /*
@@ -171,6 +395,8 @@ Path *pathCreate(const char *initial)
 {
     Path *path = calloc(1, sizeof(*path));
 
+    path->watch_fd = -1;
+
     if (initial) pathAdd(path, initial);
 
     return path;
@@ -190,29 +416,80 @@ void pathAdd(Path *path, const char *addition)
 
 /*
  * Get the full name for the first file in <path> that has name <filename>.
- * Returns NULL if no such file exists.
+ * Returns NULL if no such file exists. The returned name is overwritten by
+ * the next call to this function from the same thread.
  */
 const char *pathGet(Path *path, const char *filename)
 {
-    return path_get(path, filename);
+    static __thread char namebuf[PATH_MAX];
+
+    return pathGetR(path, filename, namebuf, sizeof(namebuf));
+}
+
+/*
+ * Get the full name for the first file in <path> that has name <filename>
+ * and write it into <buf>, which has room for <size> bytes (including the
+ * terminating null byte). Returns <buf>, or NULL if no such file exists (in
+ * which case errno is set to ENOENT) or if it doesn't fit in <buf> (in which
+ * case errno is set to ERANGE). Does not allocate memory, so it may be called
+ * from multiple threads at once, as long as no other thread is changing
+ * <path> at the same time.
+ */
+char *pathGetR(Path *path, const char *filename, char *buf, size_t size)
+{
+    PathFile *file;
+
+    if ((file = hlGet(&path->files, HASH_STRING(filename))) == NULL) {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    size_t dir_len  = strlen(file->dir->name);
+    size_t file_len = strlen(file->name);
+
+    if (dir_len + file_len + 2 > size) {
+        errno = ERANGE;
+        return NULL;
+    }
+
+    memcpy(buf, file->dir->name, dir_len);
+    buf[dir_len] = '/';
+    memcpy(buf + dir_len + 1, file->name, file_len + 1);
+
+    return buf;
 }
 
 /*
- * Use fopen() to open the first file in <path> that has name <filename>, using
- * mode <mode>. <filename> and <mode> are passed on to fopen() as-is. Unlike
- * fopen(), however, the file must already exist somewhere in <path> regardless
- * of <mode>, otherwise NULL is returned and errno is set to ENOENT.
+ * Open the first file in <path> that has name <filename>, using fopen()-style
+ * mode <mode>. Unlike fopen(), however, the file must already exist somewhere
+ * in <path> regardless of <mode>, otherwise NULL is returned and errno is set
+ * to ENOENT. The file is opened relative to its directory, which is kept open,
+ * so the full name is never built or resolved again. Like pathGetR(), this
+ * function may be called from multiple threads at once.
  */
 FILE *pathFOpen(Path *path, const char *filename, const char *mode)
 {
-    const char *fullpath;
+    PathFile *file;
     FILE *fp;
+    int fd, flags;
 
-    if ((fullpath = pathGet(path, filename)) == NULL) {
+    if ((file = hlGet(&path->files, HASH_STRING(filename))) == NULL) {
         errno = ENOENT;
         return NULL;
     }
-    else if ((fp = fopen(fullpath, mode)) == NULL) {
+    else if (path_mode_to_flags(mode, &flags) != 0) {
+        return NULL;
+    }
+    else if ((fd = path_open(file->dir, file->name, flags)) == -1) {
+        return NULL;
+    }
+    else if ((fp = fdopen(fd, mode)) == NULL) {
+        int saved_errno = errno;
+
+        close(fd);
+
+        errno = saved_errno;
+
         return NULL;
     }
     else {
@@ -221,21 +498,22 @@ FILE *pathFOpen(Path *path, const char *filename, const char *mode)
 }
 
 /*
- * Use open() to open the first file in <path> that has name <filename>, using
- * flags <flags>. <filename> and <flags> are passed on to open() as-is. Unlike
+ * Use openat() to open the first file in <path> that has name <filename>,
+ * using flags <flags>, relative to the directory it was found in. Unlike
  * open(), however, the file must already exist somewhere in <path> regardless
- * of <flags>, otherwise -1 is returned and errno is set to ENOENT.
+ * of <flags>, otherwise -1 is returned and errno is set to ENOENT. Like
+ * pathGetR(), this function may be called from multiple threads at once.
  */
 int pathOpen(Path *path, const char *filename, int flags)
 {
-    const char *fullpath;
+    PathFile *file;
     int fd;
 
-    if ((fullpath = pathGet(path, filename)) == NULL) {
+    if ((file = hlGet(&path->files, HASH_STRING(filename))) == NULL) {
         errno = ENOENT;
         return -1;
     }
-    else if ((fd = open(fullpath, flags)) == -1) {
+    else if ((fd = path_open(file->dir, file->name, flags)) == -1) {
         return -1;
     }
     else {
@@ -243,18 +521,97 @@ int pathOpen(Path *path, const char *filename, int flags)
     }
 }
 
+/*
+ * Start watching all directories in <path> (including the ones added later
+ * using pathAdd()) for files being created, deleted or renamed, and keep the
+ * file lookup table up to date accordingly. Changes are processed when
+ * pathHandleEvents() is called. If <dis> is not NULL, the file descriptor that
+ * reports changes is added to <dis>, which will then call pathHandleEvents()
+ * when necessary. Returns the file descriptor on which changes are reported,
+ * so callers that don't use a Dispatcher can wait for it to become readable
+ * themselves, or -1 if an error occurred (in which case errno is set).
+ */
+int pathWatch(Path *path, Dispatcher *dis)
+{
+    PathDir *dir;
+
+    if (path->watch_fd >= 0) return path->watch_fd;
+
+    if ((path->watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+        return -1;
+    }
+
+    for (dir = hlHead(&path->dirs); dir; dir = hlNext(dir)) {
+        path_watch_dir(path, dir);
+    }
+
+    /* Files may have come or gone since we scanned the directories. */
+
+    path_rescan(path);
+
+    if ((path->dis = dis) != NULL) {
+        disOnData(dis, path->watch_fd, path_on_events, path);
+    }
+
+    return path->watch_fd;
+}
+
+/*
+ * Process the changes that have been reported for the directories in <path>
+ * since the last call. Does not block if there are none. Returns 0 on success
+ * or -1 if an error occurred (in which case errno is set).
+ */
+int pathHandleEvents(Path *path)
+{
+    char buffer[16 * (sizeof(struct inotify_event) + NAME_MAX + 1)]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+    for ever {
+        ssize_t r = read(path->watch_fd, buffer, sizeof(buffer));
+
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        else if (r < 0 && errno == EAGAIN) {
+            return 0;
+        }
+        else if (r < 0) {
+            return -1;
+        }
+
+        const char *p = buffer;
+
+        while (p < buffer + r) {
+            const struct inotify_event *event =
+                (const struct inotify_event *) p;
+
+            path_handle_event(path, event);
+
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+/*
+ * Clear the contents of <path> but don't free <path> itself.
+ */
 void pathClear(Path *path)
 {
     PathDir *dir, *next_dir;
     PathFile *file, *next_file;
 
+    if (path->watch_fd >= 0) {
+        if (path->dis != NULL) disDropData(path->dis, path->watch_fd);
+
+        close(path->watch_fd);
+    }
+
+    paClear(&path->watches);
+
     for (file = hlHead(&path->files); file; file = next_file) {
         next_file = hlNext(file);
 
-        hlDel(&path->files, file->name, strlen(file->name));
-
-        free(file->name);
-        free(file);
+        path_remove_file(path, file);
     }
 
     for (dir = hlHead(&path->dirs); dir; dir = next_dir) {
@@ -262,6 +619,8 @@ void pathClear(Path *path)
 
         hlDel(&path->dirs, dir->name, strlen(dir->name));
 
+        close(dir->fd);
+
         free(dir->name);
         free(dir);
     }
@@ -280,8 +639,41 @@ void pathDestroy(Path *path)
 #ifdef TEST
 #include "utils.h"
 
+#include <pthread.h>
+
 static int errors = 0;
 
+/*
+ * Look up and open some files in the Path given in <arg> many times, and
+ * return the number of failures.
+ */
+static void *lookup_thread(void *arg)
+{
+    Path *path = arg;
+    char buf[PATH_MAX];
+    intptr_t failures = 0;
+    int i, fd;
+
+    for (i = 0; i < 10000; i++) {
+        const char *name = (i % 2) ? "path.c" : "path.h";
+
+        if (pathGetR(path, name, buf, sizeof(buf)) != buf ||
+            strcmp(buf + strlen(buf) - strlen(name), name) != 0)
+        {
+            failures++;
+        }
+
+        if ((fd = pathOpen(path, name, O_RDONLY)) < 0) {
+            failures++;
+        }
+        else {
+            close(fd);
+        }
+    }
+
+    return (void *) failures;
+}
+
 int main(void)
 {
     Path *path = pathCreate(getenv("PATH"));
@@ -303,6 +695,134 @@ int main(void)
     make_sure_that((fd = pathOpen(path, "path.c", O_RDONLY)) != -1);
     make_sure_that(close(fd) == 0);
 
+    char buf[9];
+
+    make_sure_that(pathGetR(path, "path.c", buf, sizeof(buf)) == buf);
+    make_sure_that(strcmp(buf, "./path.c") == 0);
+
+    errno = 0;
+    make_sure_that(pathGetR(path, "path.h", buf, sizeof(buf) - 1) == NULL);
+    make_sure_that(errno == ERANGE);
+
+    errno = 0;
+    make_sure_that(pathGetR(path, "no-such-file", buf, sizeof(buf)) == NULL);
+    make_sure_that(errno == ENOENT);
+
+    errno = 0;
+    make_sure_that(pathFOpen(path, "path.c", "q") == NULL);
+    make_sure_that(errno == EINVAL);
+
+    pthread_t thread[4];
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        pthread_create(&thread[i], NULL, lookup_thread, path);
+    }
+
+    for (i = 0; i < 4; i++) {
+        void *failures;
+
+        pthread_join(thread[i], &failures);
+
+        make_sure_that(failures == NULL);
+    }
+
+    pathDestroy(path);
+
+    /* Now watch two directories and change files in them. */
+
+    char top[] = "/tmp/path-test-XXXXXX";
+
+    make_sure_that(mkdtemp(top) != NULL);
+
+    Buffer dir1 = { 0 }, dir2 = { 0 }, search = { 0 };
+    Buffer name1 = { 0 }, name2 = { 0 }, name3 = { 0 };
+
+    bufSetF(&dir1, "%s/dir1", top);
+    bufSetF(&dir2, "%s/dir2", top);
+    bufSetF(&search, "%s:%s", bufGet(&dir1), bufGet(&dir2));
+
+    bufSetF(&name1, "%s/file", bufGet(&dir1));
+    bufSetF(&name2, "%s/file", bufGet(&dir2));
+    bufSetF(&name3, "%s/other", bufGet(&dir2));
+
+    make_sure_that(mkdir(bufGet(&dir1), 0700) == 0);
+    make_sure_that(mkdir(bufGet(&dir2), 0700) == 0);
+
+    path = pathCreate(bufGet(&search));
+
+    make_sure_that(pathGet(path, "file") == NULL);
+
+    make_sure_that(pathWatch(path, NULL) >= 0);
+
+    make_sure_that(close(creat(bufGet(&name2), 0600)) == 0);
+    make_sure_that(pathHandleEvents(path) == 0);
+    make_sure_that(pathGet(path, "file") != NULL);
+    make_sure_that(strcmp(pathGet(path, "file"), bufGet(&name2)) == 0);
+
+    make_sure_that(close(creat(bufGet(&name1), 0600)) == 0);
+    make_sure_that(pathHandleEvents(path) == 0);
+    make_sure_that(strcmp(pathGet(path, "file"), bufGet(&name1)) == 0);
+
+    make_sure_that(unlink(bufGet(&name1)) == 0);
+    make_sure_that(pathHandleEvents(path) == 0);
+    make_sure_that(strcmp(pathGet(path, "file"), bufGet(&name2)) == 0);
+
+    make_sure_that((fp = pathFOpen(path, "file", "a+")) != NULL);
+    make_sure_that(fputs("Hello\n", fp) >= 0);
+    make_sure_that(fclose(fp) == 0);
+
+    make_sure_that((fp = pathFOpen(path, "file", "re")) != NULL);
+    make_sure_that(fgets(buf, sizeof(buf), fp) != NULL);
+    make_sure_that(strcmp(buf, "Hello\n") == 0);
+    make_sure_that(fclose(fp) == 0);
+
+    make_sure_that(rename(bufGet(&name2), bufGet(&name3)) == 0);
+    make_sure_that(pathHandleEvents(path) == 0);
+    make_sure_that(pathGet(path, "file") == NULL);
+    make_sure_that(pathGet(path, "other") != NULL);
+    make_sure_that(strcmp(pathGet(path, "other"), bufGet(&name3)) == 0);
+
+    pathDestroy(path);
+
+    /* Same thing, serviced by a Dispatcher. */
+
+    Dispatcher *dis = disCreate();
+
+    path = pathCreate(bufGet(&search));
+
+    make_sure_that(pathWatch(path, dis) >= 0);
+    make_sure_that(pathGet(path, "file") == NULL);
+
+    make_sure_that(close(creat(bufGet(&name1), 0600)) == 0);
+    make_sure_that(disHandleEvents(dis) == 0);
+    make_sure_that(pathGet(path, "file") != NULL);
+    make_sure_that(strcmp(pathGet(path, "file"), bufGet(&name1)) == 0);
+
+    make_sure_that(rename(bufGet(&name3), bufGet(&name2)) == 0);
+    make_sure_that(unlink(bufGet(&name1)) == 0);
+    make_sure_that(disHandleEvents(dis) == 0);
+    make_sure_that(pathGet(path, "other") == NULL);
+    make_sure_that(strcmp(pathGet(path, "file"), bufGet(&name2)) == 0);
+
+    pathDestroy(path);
+
+    make_sure_that(disFdCount(dis) == 0);
+
+    disDestroy(dis);
+
+    unlink(bufGet(&name2));
+    rmdir(bufGet(&dir1));
+    rmdir(bufGet(&dir2));
+    rmdir(top);
+
+    bufClear(&dir1);
+    bufClear(&dir2);
+    bufClear(&search);
+    bufClear(&name1);
+    bufClear(&name2);
+    bufClear(&name3);
+
     return errors;
 }
 
@@ -10,7 +10,10 @@
  * find the file.
  *
  * Note that the search tree is built when you call pathCreate and pathAdd, so
- * a file created anywhere in the search path after that will not be found.
+ * a file created anywhere in the search path after that will not be found,
+ * unless you call pathWatch(). In that case the directories in the path are
+ * watched using inotify, and the search tree is updated whenever files are
+ * created, deleted or renamed in them.
  *
  * Copyright: (c) 2020-2024 Jacco van Schaik (jacco@jaccovanschaik.net)
  * Created:   2020-09-08
@@ -21,12 +24,17 @@
  */
 
 #include "hashlist.h"
+#include "dis.h"
+#include "pa.h"
 
 #include <stdio.h>
 
 typedef struct {
     HashList dirs;
     HashList files;
+    int watch_fd;           /* inotify file descriptor, or -1. */
+    PointerArray watches;   /* PathDirs, indexed by inotify watch descriptor. */
+    Dispatcher *dis;        /* Dispatcher that services <watch_fd>, if any. */
 } Path;
 
 /*
@@ -44,26 +52,60 @@ void pathAdd(Path *path, const char *addition);
 
 /*
  * Get the full name for the first file in <path> that has name <filename>.
- * Returns NULL if no such file exists.
+ * Returns NULL if no such file exists. The returned name is overwritten by
+ * the next call to this function from the same thread.
  */
 const char *pathGet(Path *path, const char *filename);
 
 /*
- * Use fopen() to open the first file in <path> that has name <filename>, using
- * mode <mode>. <filename> and <mode> are passed on to fopen() as-is. Unlike
- * fopen(), however, the file must already exist somewhere in <path> regardless
- * of <mode>, otherwise NULL is returned and errno is set to ENOENT.
+ * Get the full name for the first file in <path> that has name <filename>
+ * and write it into <buf>, which has room for <size> bytes (including the
+ * terminating null byte). Returns <buf>, or NULL if no such file exists (in
+ * which case errno is set to ENOENT) or if it doesn't fit in <buf> (in which
+ * case errno is set to ERANGE). Does not allocate memory, so it may be called
+ * from multiple threads at once, as long as no other thread is changing
+ * <path> at the same time.
+ */
+char *pathGetR(Path *path, const char *filename, char *buf, size_t size);
+
+/*
+ * Open the first file in <path> that has name <filename>, using fopen()-style
+ * mode <mode>. Unlike fopen(), however, the file must already exist somewhere
+ * in <path> regardless of <mode>, otherwise NULL is returned and errno is set
+ * to ENOENT. The file is opened relative to its directory, which is kept open,
+ * so the full name is never built or resolved again. Like pathGetR(), this
+ * function may be called from multiple threads at once.
  */
 FILE *pathFOpen(Path *path, const char *filename, const char *mode);
 
 /*
- * Use open() to open the first file in <path> that has name <filename>, using
- * flags <flags>. <filename> and <flags> are passed on to open() as-is. Unlike
+ * Use openat() to open the first file in <path> that has name <filename>,
+ * using flags <flags>, relative to the directory it was found in. Unlike
  * open(), however, the file must already exist somewhere in <path> regardless
- * of <flags>, otherwise -1 is returned and errno is set to ENOENT.
+ * of <flags>, otherwise -1 is returned and errno is set to ENOENT. Like
+ * pathGetR(), this function may be called from multiple threads at once.
  */
 int pathOpen(Path *path, const char *filename, int flags);
 
+/*
+ * Start watching all directories in <path> (including the ones added later
+ * using pathAdd()) for files being created, deleted or renamed, and keep the
+ * file lookup table up to date accordingly. Changes are processed when
+ * pathHandleEvents() is called. If <dis> is not NULL, the file descriptor that
+ * reports changes is added to <dis>, which will then call pathHandleEvents()
+ * when necessary. Returns the file descriptor on which changes are reported,
+ * so callers that don't use a Dispatcher can wait for it to become readable
+ * themselves, or -1 if an error occurred (in which case errno is set).
+ */
+int pathWatch(Path *path, Dispatcher *dis);
+
+/*
+ * Process the changes that have been reported for the directories in <path>
+ * since the last call. Does not block if there are none. Returns 0 on success
+ * or -1 if an error occurred (in which case errno is set).
+ */
+int pathHandleEvents(Path *path);
+
 /*
  * Destroy path <path>.
  */
@@ -0,0 +1,697 @@
+/*
+ * pool.c: Pool allocator for fixed-size objects.
+ *
+ * pool.c is part of libjvs.
+ *
+ * Copyright: (c) 2026 Jacco van Schaik (jacco@jaccovanschaik.net)
+ * Created:   2026-10-18
+ * Version:   $Id$
+ *
+ * This software is distributed under the terms of the MIT license. See
+ * http://www.opensource.org/licenses/mit-license.php for details.
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "defs.h"
+#include "pool.h"
+
+#define POOL_BLOCK_SIZE 16384   // Approximate size of a block of objects.
+#define POOL_MIN_OBJECTS 16     // Minimum number of objects in a block.
+#define POOL_CACHE_MAX  64      // Default maximum of free objects in a cache.
+
+/* A free object, linked into a free list. */
+
+typedef struct PoolObject PoolObject;
+
+struct PoolObject {
+    PoolObject *next;
+};
+
+/* A block of objects, as received from malloc(). The objects follow the
+ * header, which is padded to keep them aligned. */
+
+typedef struct PoolBlock PoolBlock;
+
+struct PoolBlock {
+    PoolBlock *next;
+};
+
+#define POOL_HEADER ((sizeof(PoolBlock) + 15) & ~15)
+
+struct Pool {
+    size_t size;                // Size of an object.
+    size_t count;               // Number of objects in a block.
+    bool shared;                // Can multiple threads use this pool?
+    pthread_mutex_t mutex;      // Protects the fields below if <shared>.
+    PoolObject *free_list;      // Free objects.
+    PoolBlock *blocks;          // All blocks received from malloc().
+    Allocator allocator;        // Allocator that uses this pool.
+};
+
+struct PoolCache {
+    Pool *pool;                 // The pool that this is a cache for.
+    PoolObject *free_list;      // Free objects in this cache...
+    size_t count;               // ... and how many there are.
+    size_t max;                 // Maximum number of objects in <free_list>.
+    Allocator allocator;        // Allocator that uses this cache.
+};
+
+/*
+ * Lock <pool>, if it's shared.
+ */
+static void pool_lock(Pool *pool)
+{
+    if (pool->shared) pthread_mutex_lock(&pool->mutex);
+}
+
+/*
+ * Unlock <pool>, if it's shared.
+ */
+static void pool_unlock(Pool *pool)
+{
+    if (pool->shared) pthread_mutex_unlock(&pool->mutex);
+}
+
+/*
+ * Get a new block of objects for <pool> and put them on its free list. Must be
+ * called with the pool locked.
+ */
+static void pool_grow(Pool *pool)
+{
+    size_t i;
+
+    PoolBlock *block = malloc(POOL_HEADER + pool->count * pool->size);
+
+    char *data = (char *) block + POOL_HEADER;
+
+    block->next = pool->blocks;
+    pool->blocks = block;
+
+    /* Link the objects so that they're handed out in address order. */
+
+    for (i = pool->count; i > 0; i--) {
+        PoolObject *obj = (PoolObject *) (data + (i - 1) * pool->size);
+
+        obj->next = pool->free_list;
+        pool->free_list = obj;
+    }
+}
+
+/*
+ * Remove up to <count> objects from <pool>, getting a new block if it has no
+ * free objects left, and return them as a list. The number of objects in the
+ * list is returned through <taken>.
+ */
+static PoolObject *pool_take(Pool *pool, size_t count, size_t *taken)
+{
+    PoolObject *head, *tail;
+
+    pool_lock(pool);
+
+    if (pool->free_list == NULL) pool_grow(pool);
+
+    head = tail = pool->free_list;
+
+    for (*taken = 1; *taken < count && tail->next != NULL; (*taken)++) {
+        tail = tail->next;
+    }
+
+    pool->free_list = tail->next;
+
+    pool_unlock(pool);
+
+    tail->next = NULL;
+
+    return head;
+}
+
+/*
+ * Return the list of objects from <head> to <tail> to <pool>.
+ */
+static void pool_give(Pool *pool, PoolObject *head, PoolObject *tail)
+{
+    pool_lock(pool);
+
+    tail->next = pool->free_list;
+    pool->free_list = head;
+
+    pool_unlock(pool);
+}
+
+/*
+ * Allocation function for the Allocator of pool <udata>.
+ */
+static void *pool_alloc(size_t size, void *udata)
+{
+    Pool *pool = udata;
+
+    return size <= pool->size ? poolAlloc(pool) : malloc(size);
+}
+
+/*
+ * Free function for the Allocator of pool <udata>.
+ */
+static void pool_free(void *ptr, size_t size, void *udata)
+{
+    Pool *pool = udata;
+
+    if (size <= pool->size)
+        poolFree(pool, ptr);
+    else
+        free(ptr);
+}
+
+/*
+ * Allocation function for the Allocator of pool cache <udata>.
+ */
+static void *pool_cache_alloc(size_t size, void *udata)
+{
+    PoolCache *cache = udata;
+
+    return size <= cache->pool->size ? poolCacheAlloc(cache) : malloc(size);
+}
+
+/*
+ * Free function for the Allocator of pool cache <udata>.
+ */
+static void pool_cache_free(void *ptr, size_t size, void *udata)
+{
+    PoolCache *cache = udata;
+
+    if (size <= cache->pool->size)
+        poolCacheFree(cache, ptr);
+    else
+        free(ptr);
+}
+
+/*
+ * Create a pool for objects of <size> bytes. Objects are aligned to the size
+ * of a pointer, or to 16 bytes if <size> is a multiple of 16. If <shared> is
+ * true the pool may be used by several threads at the same time, otherwise it
+ * may only be used by one thread at a time.
+ */
+Pool *poolCreate(size_t size, bool shared)
+{
+    Pool *pool = calloc(1, sizeof(Pool));
+
+    size_t align = (size % 16 == 0) ? 16 : sizeof(void *);
+
+    size = MAX(size, sizeof(PoolObject));
+
+    pool->size   = (size + align - 1) & ~(align - 1);
+    pool->count  = MAX(POOL_MIN_OBJECTS, POOL_BLOCK_SIZE / pool->size);
+    pool->shared = shared;
+
+    pthread_mutex_init(&pool->mutex, NULL);
+
+    pool->allocator.alloc = pool_alloc;
+    pool->allocator.free  = pool_free;
+    pool->allocator.udata = pool;
+
+    return pool;
+}
+
+/*
+ * Return the size of the objects in <pool>, which may have been rounded up
+ * from the size that was given to poolCreate().
+ */
+size_t poolSize(const Pool *pool)
+{
+    return pool->size;
+}
+
+/*
+ * Return an uninitialized object from <pool>.
+ */
+void *poolAlloc(Pool *pool)
+{
+    PoolObject *obj;
+
+    pool_lock(pool);
+
+    if (pool->free_list == NULL) pool_grow(pool);
+
+    obj = pool->free_list;
+    pool->free_list = obj->next;
+
+    pool_unlock(pool);
+
+    return obj;
+}
+
+/*
+ * Return <obj>, which was allocated from <pool>, to <pool>.
+ */
+void poolFree(Pool *pool, void *obj)
+{
+    pool_give(pool, obj, obj);
+}
+
+/*
+ * Return an Allocator that allocates from <pool>, for use with containers
+ * that accept one. Requests for more than poolSize() bytes are passed on to
+ * malloc() and free().
+ */
+const Allocator *poolAllocator(Pool *pool)
+{
+    return &pool->allocator;
+}
+
+/*
+ * Create a cache for the objects in shared pool <pool>, to be used by a single
+ * thread. The cache holds up to <max> free objects before it returns some of
+ * them to the pool. If <max> is 0, a default is used.
+ */
+PoolCache *poolCacheCreate(Pool *pool, size_t max)
+{
+    PoolCache *cache = calloc(1, sizeof(PoolCache));
+
+    cache->pool = pool;
+    cache->max  = max > 0 ? max : POOL_CACHE_MAX;
+
+    cache->allocator.alloc = pool_cache_alloc;
+    cache->allocator.free  = pool_cache_free;
+    cache->allocator.udata = cache;
+
+    return cache;
+}
+
+/*
+ * Return an uninitialized object from the pool behind <cache>.
+ */
+void *poolCacheAlloc(PoolCache *cache)
+{
+    PoolObject *obj;
+
+    if (cache->free_list == NULL) {
+        size_t wanted = MAX(1, cache->max / 2);
+
+        cache->free_list = pool_take(cache->pool, wanted, &cache->count);
+    }
+
+    obj = cache->free_list;
+    cache->free_list = obj->next;
+    cache->count--;
+
+    return obj;
+}
+
+/*
+ * Return <obj>, which was allocated from the same pool as <cache>, to
+ * <cache>. It doesn't have to have been allocated through <cache>.
+ */
+void poolCacheFree(PoolCache *cache, void *obj)
+{
+    PoolObject *head, *tail;
+
+    ((PoolObject *) obj)->next = cache->free_list;
+    cache->free_list = obj;
+
+    if (++cache->count <= cache->max) return;
+
+    /* Too many. Keep the most recently freed half, which is most likely to
+     * still be in the CPU cache, and give the rest back to the pool. */
+
+    size_t i, keep = cache->max / 2;
+
+    if (keep == 0) {
+        head = cache->free_list;
+        cache->free_list = NULL;
+    }
+    else {
+        for (tail = cache->free_list, i = 1; i < keep; i++) tail = tail->next;
+
+        head = tail->next;
+        tail->next = NULL;
+    }
+
+    cache->count = keep;
+
+    for (tail = head; tail->next != NULL; tail = tail->next);
+
+    pool_give(cache->pool, head, tail);
+}
+
+/*
+ * Return all free objects in <cache> to its pool.
+ */
+void poolCacheFlush(PoolCache *cache)
+{
+    PoolObject *tail;
+
+    if (cache->free_list == NULL) return;
+
+    for (tail = cache->free_list; tail->next != NULL; tail = tail->next);
+
+    pool_give(cache->pool, cache->free_list, tail);
+
+    cache->free_list = NULL;
+    cache->count = 0;
+}
+
+/*
+ * Return an Allocator that allocates from <cache>, for use with containers
+ * that accept one. Requests for more than poolSize() bytes are passed on to
+ * malloc() and free().
+ */
+const Allocator *poolCacheAllocator(PoolCache *cache)
+{
+    return &cache->allocator;
+}
+
+/*
+ * Flush <cache> and then free it.
+ */
+void poolCacheDestroy(PoolCache *cache)
+{
+    poolCacheFlush(cache);
+
+    free(cache);
+}
+
+/*
+ * Free <pool> and all the memory it has used. Every cache for this pool must
+ * have been destroyed before this is called, and all objects allocated from it
+ * become invalid.
+ */
+void poolDestroy(Pool *pool)
+{
+    PoolBlock *block;
+
+    while ((block = pool->blocks) != NULL) {
+        pool->blocks = block->next;
+
+        free(block);
+    }
+
+    pthread_mutex_destroy(&pool->mutex);
+
+    free(pool);
+}
+
+#if defined(TEST) || defined(BENCH)
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "utils.h"
+#endif
+
+#ifdef TEST
+static int errors = 0;
+
+#define THREADS 4
+#define ROUNDS  2000
+#define OBJECTS 100
+
+typedef struct {
+    Pool *pool;
+    int id;
+    int errors;
+} Worker;
+
+/*
+ * Repeatedly allocate a batch of objects from the pool in <arg>, fill them
+ * with a pattern that is unique to this thread, make sure no one else has
+ * touched them and then free them again.
+ */
+static void *worker(void *arg)
+{
+    Worker *w = arg;
+
+    int round, i;
+    uint64_t *obj[OBJECTS];
+
+    PoolCache *cache = poolCacheCreate(w->pool, 16);
+
+    for (round = 0; round < ROUNDS; round++) {
+        for (i = 0; i < OBJECTS; i++) {
+            obj[i] = poolCacheAlloc(cache);
+            obj[i][0] = w->id;
+            obj[i][1] = i;
+        }
+
+        for (i = 0; i < OBJECTS; i++) {
+            if (obj[i][0] != (uint64_t) w->id || obj[i][1] != (uint64_t) i) {
+                w->errors++;
+            }
+
+            /* Give some back directly, bypassing the cache. */
+
+            if (i % 3 == 0)
+                poolFree(w->pool, obj[i]);
+            else
+                poolCacheFree(cache, obj[i]);
+        }
+    }
+
+    poolCacheDestroy(cache);
+
+    return NULL;
+}
+
+int main(void)
+{
+    int i;
+    void *p, *q;
+
+    Pool *pool = poolCreate(3, false);
+
+    make_sure_that(poolSize(pool) == sizeof(void *));
+
+    poolDestroy(pool);
+
+    pool = poolCreate(20, false);
+
+    make_sure_that(poolSize(pool) == 24);
+
+    poolDestroy(pool);
+
+    pool = poolCreate(48, false);
+
+    make_sure_that(poolSize(pool) == 48);
+
+    /* Objects don't overlap, and freed objects are handed out again. */
+
+    p = poolAlloc(pool);
+    q = poolAlloc(pool);
+
+    make_sure_that(((uintptr_t) p % 16) == 0);
+    make_sure_that(((uintptr_t) q % 16) == 0);
+    make_sure_that((char *) q >= (char *) p + 48 ||
+                   (char *) p >= (char *) q + 48);
+
+    poolFree(pool, p);
+
+    make_sure_that(poolAlloc(pool) == p);
+
+    /* Use lots of them, to make the pool grow. */
+
+    void **obj = calloc(10000, sizeof(void *));
+
+    for (i = 0; i < 10000; i++) {
+        obj[i] = poolAlloc(pool);
+        memset(obj[i], i & 0xFF, 48);
+    }
+
+    for (i = 0; i < 10000; i++) {
+        if (((unsigned char *) obj[i])[47] != (i & 0xFF)) break;
+    }
+
+    make_sure_that(i == 10000);
+
+    for (i = 0; i < 10000; i++) {
+        poolFree(pool, obj[i]);
+    }
+
+    free(obj);
+
+    /* The Allocator hook passes larger requests on to malloc(). */
+
+    const Allocator *alloc = poolAllocator(pool);
+
+    p = allocNew(alloc, 40);
+    q = allocNew(alloc, 1000);
+
+    memset(q, 1, 1000);
+
+    allocFree(alloc, p, 40);
+    allocFree(alloc, q, 1000);
+
+    make_sure_that(poolAlloc(pool) == p);
+
+    poolDestroy(pool);
+
+    /* Several threads sharing a pool, each through its own cache. */
+
+    pthread_t thread[THREADS];
+    Worker w[THREADS];
+
+    pool = poolCreate(2 * sizeof(uint64_t), true);
+
+    for (i = 0; i < THREADS; i++) {
+        w[i].pool = pool;
+        w[i].id = i;
+        w[i].errors = 0;
+
+        pthread_create(&thread[i], NULL, worker, &w[i]);
+    }
+
+    for (i = 0; i < THREADS; i++) {
+        pthread_join(thread[i], NULL);
+
+        make_sure_that(w[i].errors == 0);
+    }
+
+    poolDestroy(pool);
+
+    return errors;
+}
+#endif
+
+#ifdef BENCH
+#include "arena.h"
+#include "hash.h"
+#include "ml.h"
+
+#define OBJECTS 1000000
+#define SIZE    48
+#define ROUNDS  250
+
+/*
+ * Allocate OBJECTS objects of SIZE bytes using <alloc>, then free them again,
+ * and report how long it took per object.
+ */
+static void bench_alloc(const char *name, const Allocator *alloc)
+{
+    int i;
+
+    void **obj = calloc(OBJECTS, sizeof(void *));
+
+    double start = dnow();
+
+    for (i = 0; i < OBJECTS; i++) {
+        obj[i] = allocNew(alloc, SIZE);
+    }
+
+    for (i = 0; i < OBJECTS; i++) {
+        allocFree(alloc, obj[i], SIZE);
+    }
+
+    double t = dnow() - start;
+
+    printf("%-24s %6.1f ns per object\n", name, 1e9 * t / OBJECTS);
+
+    free(obj);
+}
+
+/*
+ * Add HASH_BUCKETS entries to a hash table that uses <alloc> and remove them
+ * again, ROUNDS times, and report how long it took per entry.
+ */
+static void bench_hash(const char *name, const Allocator *alloc)
+{
+    int i, round;
+
+    HashTable *table = hashCreateTable();
+
+    hashSetAllocator(table, alloc);
+
+    double start = dnow();
+
+    for (round = 0; round < ROUNDS; round++) {
+        for (i = 0; i < HASH_BUCKETS; i++) {
+            hashAdd(table, table, HASH_VALUE(i));
+        }
+
+        for (i = 0; i < HASH_BUCKETS; i++) {
+            hashDrop(table, HASH_VALUE(i));
+        }
+    }
+
+    double t = dnow() - start;
+
+    printf("%-24s %6.1f ns per entry\n",
+            name, 1e9 * t / (ROUNDS * HASH_BUCKETS));
+
+    hashDestroy(table);
+}
+
+/*
+ * An item for bench_ml().
+ */
+typedef struct {
+    MListNode _node;
+} Item;
+
+/*
+ * Add HASH_BUCKETS items to a multi-list that uses <alloc> and remove them
+ * again, ROUNDS times, and report how long it took per item.
+ */
+static void bench_ml(const char *name, const Allocator *alloc)
+{
+    int i, round;
+
+    Item *item = calloc(HASH_BUCKETS, sizeof(Item));
+    MList *list = mlCreate();
+
+    mlSetAllocator(list, alloc);
+
+    double start = dnow();
+
+    for (round = 0; round < ROUNDS; round++) {
+        for (i = 0; i < HASH_BUCKETS; i++) {
+            mlAppendTail(list, item + i);
+        }
+
+        while (mlRemoveHead(list) != NULL);
+    }
+
+    double t = dnow() - start;
+
+    printf("%-24s %6.1f ns per item\n",
+            name, 1e9 * t / (ROUNDS * HASH_BUCKETS));
+
+    mlDelete(list);
+    free(item);
+}
+
+int main(void)
+{
+    Pool *pool = poolCreate(SIZE, false);
+    Pool *shared = poolCreate(SIZE, true);
+    PoolCache *cache = poolCacheCreate(shared, 0);
+    Arena *arena = arenaCreate(0);
+
+    bench_alloc("calloc/free", NULL);
+    bench_alloc("Pool", poolAllocator(pool));
+    bench_alloc("Pool, shared", poolAllocator(shared));
+    bench_alloc("PoolCache", poolCacheAllocator(cache));
+    bench_alloc("Arena", arenaAllocator(arena));
+
+    arenaClear(arena);
+
+    /* The containers get pools whose objects are exactly the size they ask
+     * for, otherwise the pool would pass every request on to malloc(). */
+
+    Pool *entry_pool = poolCreate(hashEntrySize(sizeof(int)), false);
+    Pool *link_pool = poolCreate(mlLinkSize(), false);
+
+    bench_hash("hash, calloc/free", NULL);
+    bench_hash("hash, Pool", poolAllocator(entry_pool));
+
+    bench_ml("ml, calloc/free", NULL);
+    bench_ml("ml, Pool", poolAllocator(link_pool));
+
+    poolDestroy(link_pool);
+    poolDestroy(entry_pool);
+    arenaDestroy(arena);
+    poolCacheDestroy(cache);
+    poolDestroy(shared);
+    poolDestroy(pool);
+
+    return 0;
+}
+#endif
@@ -0,0 +1,117 @@
+#ifndef POOL_H
+#define POOL_H
+
+/*
+ * pool.h: Pool allocator for fixed-size objects.
+ *
+ * A Pool hands out objects of a single size. It gets them from malloc() in
+ * blocks of many objects at a time, and keeps freed objects on a free list to
+ * hand out again, so that allocating and freeing an object only takes a few
+ * pointer operations. Memory is only returned to the system when the pool is
+ * destroyed.
+ *
+ * A pool that is created as shared can be used by several threads at once,
+ * using a mutex to protect its free list. To avoid taking that mutex for every
+ * object, each thread can use its own PoolCache, which keeps a small free list
+ * of its own and moves objects to and from the pool in batches.
+ *
+ * pool.h is part of libjvs.
+ *
+ * Copyright: (c) 2026 Jacco van Schaik (jacco@jaccovanschaik.net)
+ * Created:   2026-10-18
+ * Version:   $Id$
+ *
+ * This software is distributed under the terms of the MIT license. See
+ * http://www.opensource.org/licenses/mit-license.php for details.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "alloc.h"
+
+typedef struct Pool Pool;
+typedef struct PoolCache PoolCache;
+
+/*
+ * Create a pool for objects of <size> bytes. Objects are aligned to the size
+ * of a pointer, or to 16 bytes if <size> is a multiple of 16. If <shared> is
+ * true the pool may be used by several threads at the same time, otherwise it
+ * may only be used by one thread at a time.
+ */
+Pool *poolCreate(size_t size, bool shared);
+
+/*
+ * Return the size of the objects in <pool>, which may have been rounded up
+ * from the size that was given to poolCreate().
+ */
+size_t poolSize(const Pool *pool);
+
+/*
+ * Return an uninitialized object from <pool>.
+ */
+void *poolAlloc(Pool *pool);
+
+/*
+ * Return <obj>, which was allocated from <pool>, to <pool>.
+ */
+void poolFree(Pool *pool, void *obj);
+
+/*
+ * Return an Allocator that allocates from <pool>, for use with containers
+ * that accept one. Requests for more than poolSize() bytes are passed on to
+ * malloc() and free().
+ */
+const Allocator *poolAllocator(Pool *pool);
+
+/*
+ * Create a cache for the objects in shared pool <pool>, to be used by a single
+ * thread. The cache holds up to <max> free objects before it returns some of
+ * them to the pool. If <max> is 0, a default is used.
+ */
+PoolCache *poolCacheCreate(Pool *pool, size_t max);
+
+/*
+ * Return an uninitialized object from the pool behind <cache>.
+ */
+void *poolCacheAlloc(PoolCache *cache);
+
+/*
+ * Return <obj>, which was allocated from the same pool as <cache>, to
+ * <cache>. It doesn't have to have been allocated through <cache>.
+ */
+void poolCacheFree(PoolCache *cache, void *obj);
+
+/*
+ * Return all free objects in <cache> to its pool.
+ */
+void poolCacheFlush(PoolCache *cache);
+
+/*
+ * Return an Allocator that allocates from <cache>, for use with containers
+ * that accept one. Requests for more than poolSize() bytes are passed on to
+ * malloc() and free().
+ */
+const Allocator *poolCacheAllocator(PoolCache *cache);
+
+/*
+ * Flush <cache> and then free it.
+ */
+void poolCacheDestroy(PoolCache *cache);
+
+/*
+ * Free <pool> and all the memory it has used. Every cache for this pool must
+ * have been destroyed before this is called, and all objects allocated from it
+ * become invalid.
+ */
+void poolDestroy(Pool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,706 @@
+/*
+ * simd.c: Vectorized operations on arrays of doubles.
+ *
+ * Element-wise operations on arrays of doubles, using AVX2 or SSE2
+ * instructions if the processor supports them. Which instruction set to use
+ * is decided at runtime. Unless noted otherwise, each function performs
+ * exactly the same floating point operations on each element as a simple
+ * scalar loop would, so results are identical regardless of the instruction
+ * set that is used. Output arrays may be the same as input arrays, but they
+ * may not overlap them in any other way.
+ *
+ * simd.c is part of libjvs.
+ *
+ * Copyright: (c) 2026 Jacco van Schaik (jacco@jaccovanschaik.net)
+ * Created:   2026-10-18
+ * Version:   $Id$
+ *
+ * This software is distributed under the terms of the MIT license. See
+ * http://www.opensource.org/licenses/mit-license.php for details.
+ */
+
+#include <math.h>
+#include <pthread.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "simd.h"
+
+/* Element-wise operations on two arrays. */
+
+typedef enum {
+    SIMD_OP_ADD,
+    SIMD_OP_SUB,
+    SIMD_OP_MUL,
+    SIMD_OP_DIV
+} SimdOp;
+
+static pthread_once_t simd_once = PTHREAD_ONCE_INIT;
+
+static SimdLevel simd_best = SIMD_NONE;   /* Best level the CPU supports. */
+static SimdLevel simd_level = SIMD_NONE;  /* Level currently in use. */
+
+/*
+ * Find out which instruction sets the processor supports.
+ */
+static void simd_detect(void)
+{
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        simd_best = SIMD_AVX2;
+    else
+        simd_best = SIMD_SSE2;      /* Always available on x86_64. */
+#endif
+
+    simd_level = simd_best;
+}
+
+/*
+ * Perform <op> on the first <n> elements of <a> and <b> and write the results
+ * to <out>, one element at a time.
+ */
+static void simd_binary_scalar(SimdOp op,
+        double *out, const double *a, const double *b, size_t n)
+{
+    size_t i;
+
+    switch(op) {
+    case SIMD_OP_ADD:
+        for (i = 0; i < n; i++) out[i] = a[i] + b[i];
+        break;
+    case SIMD_OP_SUB:
+        for (i = 0; i < n; i++) out[i] = a[i] - b[i];
+        break;
+    case SIMD_OP_MUL:
+        for (i = 0; i < n; i++) out[i] = a[i] * b[i];
+        break;
+    case SIMD_OP_DIV:
+        for (i = 0; i < n; i++) out[i] = a[i] / b[i];
+        break;
+    }
+}
+
+#if defined(__x86_64__)
+
+/*
+ * Perform <op> on the first <n> elements of <a> and <b> and write the results
+ * to <out>, two elements at a time.
+ */
+static void simd_binary_sse2(SimdOp op,
+        double *out, const double *a, const double *b, size_t n)
+{
+    size_t i = 0;
+
+    switch(op) {
+    case SIMD_OP_ADD:
+        for (; i + 2 <= n; i += 2) _mm_storeu_pd(out + i,
+                _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        break;
+    case SIMD_OP_SUB:
+        for (; i + 2 <= n; i += 2) _mm_storeu_pd(out + i,
+                _mm_sub_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        break;
+    case SIMD_OP_MUL:
+        for (; i + 2 <= n; i += 2) _mm_storeu_pd(out + i,
+                _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        break;
+    case SIMD_OP_DIV:
+        for (; i + 2 <= n; i += 2) _mm_storeu_pd(out + i,
+                _mm_div_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        break;
+    }
+
+    simd_binary_scalar(op, out + i, a + i, b + i, n - i);
+}
+
+/*
+ * Perform <op> on the first <n> elements of <a> and <b> and write the results
+ * to <out>, four elements at a time.
+ */
+__attribute__((target("avx2")))
+static void simd_binary_avx2(SimdOp op,
+        double *out, const double *a, const double *b, size_t n)
+{
+    size_t i = 0;
+
+    switch(op) {
+    case SIMD_OP_ADD:
+        for (; i + 4 <= n; i += 4) _mm256_storeu_pd(out + i,
+                _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        break;
+    case SIMD_OP_SUB:
+        for (; i + 4 <= n; i += 4) _mm256_storeu_pd(out + i,
+                _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        break;
+    case SIMD_OP_MUL:
+        for (; i + 4 <= n; i += 4) _mm256_storeu_pd(out + i,
+                _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        break;
+    case SIMD_OP_DIV:
+        for (; i + 4 <= n; i += 4) _mm256_storeu_pd(out + i,
+                _mm256_div_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        break;
+    }
+
+    simd_binary_scalar(op, out + i, a + i, b + i, n - i);
+}
+
+/*
+ * Set out[i] to a[i] * <factor>, two elements at a time, for as long as
+ * possible. Returns the number of elements done.
+ */
+static size_t simd_scale_sse2(double *out, const double *a, double factor,
+        size_t n)
+{
+    __m128d f = _mm_set1_pd(factor);
+    size_t i;
+
+    for (i = 0; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(a + i), f));
+    }
+
+    return i;
+}
+
+/*
+ * Set out[i] to a[i] * <factor>, four elements at a time, for as long as
+ * possible. Returns the number of elements done.
+ */
+__attribute__((target("avx2")))
+static size_t simd_scale_avx2(double *out, const double *a, double factor,
+        size_t n)
+{
+    __m256d f = _mm256_set1_pd(factor);
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), f));
+    }
+
+    return i;
+}
+
+/*
+ * Set out[i] to the square root of a[i], two elements at a time, for as long
+ * as possible. Returns the number of elements done.
+ */
+static size_t simd_sqrt_sse2(double *out, const double *a, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(out + i, _mm_sqrt_pd(_mm_loadu_pd(a + i)));
+    }
+
+    return i;
+}
+
+/*
+ * Set out[i] to the square root of a[i], four elements at a time, for as long
+ * as possible. Returns the number of elements done.
+ */
+__attribute__((target("avx2")))
+static size_t simd_sqrt_avx2(double *out, const double *a, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(out + i, _mm256_sqrt_pd(_mm256_loadu_pd(a + i)));
+    }
+
+    return i;
+}
+
+/*
+ * Add <factor> * x[i] to y[i], two elements at a time, for as long as
+ * possible. Returns the number of elements done.
+ */
+static size_t simd_axpy_sse2(double *y, double factor, const double *x,
+        size_t n)
+{
+    __m128d f = _mm_set1_pd(factor);
+    size_t i;
+
+    for (i = 0; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(y + i, _mm_add_pd(_mm_loadu_pd(y + i),
+                                        _mm_mul_pd(_mm_loadu_pd(x + i), f)));
+    }
+
+    return i;
+}
+
+/*
+ * Add <factor> * x[i] to y[i], eight elements at a time, for as long as
+ * possible. Returns the number of elements done.
+ */
+__attribute__((target("avx2,fma")))
+static size_t simd_axpy_avx2(double *y, double factor, const double *x,
+        size_t n)
+{
+    __m256d f = _mm256_set1_pd(factor);
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m256d y0 = _mm256_loadu_pd(y + i);
+        __m256d y1 = _mm256_loadu_pd(y + i + 4);
+
+        y0 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i), f, y0);
+        y1 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i + 4), f, y1);
+
+        _mm256_storeu_pd(y + i, y0);
+        _mm256_storeu_pd(y + i + 4, y1);
+    }
+
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(y + i,
+                _mm256_fmadd_pd(_mm256_loadu_pd(x + i), f,
+                                _mm256_loadu_pd(y + i)));
+    }
+
+    return i;
+}
+
+/*
+ * Add the products a[i] * b[i] to <sum>, two elements at a time, for as long
+ * as possible. Returns the number of elements done.
+ */
+static size_t simd_dot_sse2(const double *a, const double *b, size_t n,
+        double *sum)
+{
+    __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+    double part[2];
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        acc0 = _mm_add_pd(acc0,
+                _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        acc1 = _mm_add_pd(acc1,
+                _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+    }
+
+    _mm_storeu_pd(part, _mm_add_pd(acc0, acc1));
+
+    *sum += part[0] + part[1];
+
+    return i;
+}
+
+/*
+ * Add the products a[i] * b[i] to <sum>, eight elements at a time, for as
+ * long as possible. Returns the number of elements done.
+ */
+__attribute__((target("avx2,fma")))
+static size_t simd_dot_avx2(const double *a, const double *b, size_t n,
+        double *sum)
+{
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    double part[4];
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i),
+                               _mm256_loadu_pd(b + i), acc0);
+        acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 4),
+                               _mm256_loadu_pd(b + i + 4), acc1);
+    }
+
+    _mm256_storeu_pd(part, _mm256_add_pd(acc0, acc1));
+
+    *sum += (part[0] + part[1]) + (part[2] + part[3]);
+
+    return i;
+}
+
+/*
+ * Add the products a[i] * b[i], a[i] * a[i] and b[i] * b[i] to sum[0],
+ * sum[1] and sum[2] respectively, two elements at a time, for as long as
+ * possible. Returns the number of elements done.
+ */
+static size_t simd_dot3_sse2(const double *a, const double *b, size_t n,
+        double sum[3])
+{
+    __m128d ab = _mm_setzero_pd(), aa = _mm_setzero_pd(), bb = _mm_setzero_pd();
+    double part[2];
+    size_t i;
+
+    for (i = 0; i + 2 <= n; i += 2) {
+        __m128d va = _mm_loadu_pd(a + i);
+        __m128d vb = _mm_loadu_pd(b + i);
+
+        ab = _mm_add_pd(ab, _mm_mul_pd(va, vb));
+        aa = _mm_add_pd(aa, _mm_mul_pd(va, va));
+        bb = _mm_add_pd(bb, _mm_mul_pd(vb, vb));
+    }
+
+    _mm_storeu_pd(part, ab);
+    sum[0] += part[0] + part[1];
+
+    _mm_storeu_pd(part, aa);
+    sum[1] += part[0] + part[1];
+
+    _mm_storeu_pd(part, bb);
+    sum[2] += part[0] + part[1];
+
+    return i;
+}
+
+/*
+ * Add the products a[i] * b[i], a[i] * a[i] and b[i] * b[i] to sum[0],
+ * sum[1] and sum[2] respectively, four elements at a time, for as long as
+ * possible. Returns the number of elements done.
+ */
+__attribute__((target("avx2,fma")))
+static size_t simd_dot3_avx2(const double *a, const double *b, size_t n,
+        double sum[3])
+{
+    __m256d ab = _mm256_setzero_pd();
+    __m256d aa = _mm256_setzero_pd();
+    __m256d bb = _mm256_setzero_pd();
+    double part[4];
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m256d va = _mm256_loadu_pd(a + i);
+        __m256d vb = _mm256_loadu_pd(b + i);
+
+        ab = _mm256_fmadd_pd(va, vb, ab);
+        aa = _mm256_fmadd_pd(va, va, aa);
+        bb = _mm256_fmadd_pd(vb, vb, bb);
+    }
+
+    _mm256_storeu_pd(part, ab);
+    sum[0] += (part[0] + part[1]) + (part[2] + part[3]);
+
+    _mm256_storeu_pd(part, aa);
+    sum[1] += (part[0] + part[1]) + (part[2] + part[3]);
+
+    _mm256_storeu_pd(part, bb);
+    sum[2] += (part[0] + part[1]) + (part[2] + part[3]);
+
+    return i;
+}
+
+#endif
+
+/*
+ * Perform <op> on the first <n> elements of <a> and <b> and write the results
+ * to <out>, using the best available instruction set.
+ */
+static void simd_binary(SimdOp op,
+        double *out, const double *a, const double *b, size_t n)
+{
+    switch(simdLevel()) {
+#if defined(__x86_64__)
+    case SIMD_AVX2:
+        simd_binary_avx2(op, out, a, b, n);
+        break;
+    case SIMD_SSE2:
+        simd_binary_sse2(op, out, a, b, n);
+        break;
+#endif
+    default:
+        simd_binary_scalar(op, out, a, b, n);
+        break;
+    }
+}
+
+/*
+ * Return the instruction set that is currently being used.
+ */
+SimdLevel simdLevel(void)
+{
+    pthread_once(&simd_once, simd_detect);
+
+    return simd_level;
+}
+
+/*
+ * Use instruction set <level> from now on, or the best one that the
+ * processor supports if it doesn't support <level>. Returns the instruction
+ * set that will actually be used. Mainly useful for testing and benchmarks.
+ */
+SimdLevel simdSetLevel(SimdLevel level)
+{
+    pthread_once(&simd_once, simd_detect);
+
+    simd_level = level > simd_best ? simd_best : level;
+
+    return simd_level;
+}
+
+/*
+ * Return the name of instruction set <level>.
+ */
+const char *simdLevelName(SimdLevel level)
+{
+    switch(level) {
+    case SIMD_NONE:
+        return "none";
+    case SIMD_SSE2:
+        return "sse2";
+    case SIMD_AVX2:
+        return "avx2";
+    default:
+        return "unknown";
+    }
+}
+
+/*
+ * Set out[i] to a[i] + b[i], for all 0 <= i < <n>.
+ */
+void simdAdd(double *out, const double *a, const double *b, size_t n)
+{
+    simd_binary(SIMD_OP_ADD, out, a, b, n);
+}
+
+/*
+ * Set out[i] to a[i] - b[i], for all 0 <= i < <n>.
+ */
+void simdSub(double *out, const double *a, const double *b, size_t n)
+{
+    simd_binary(SIMD_OP_SUB, out, a, b, n);
+}
+
+/*
+ * Set out[i] to a[i] * b[i], for all 0 <= i < <n>.
+ */
+void simdMul(double *out, const double *a, const double *b, size_t n)
+{
+    simd_binary(SIMD_OP_MUL, out, a, b, n);
+}
+
+/*
+ * Set out[i] to a[i] / b[i], for all 0 <= i < <n>.
+ */
+void simdDiv(double *out, const double *a, const double *b, size_t n)
+{
+    simd_binary(SIMD_OP_DIV, out, a, b, n);
+}
+
+/*
+ * Set out[i] to a[i] * <factor>, for all 0 <= i < <n>.
+ */
+void simdScale(double *out, const double *a, double factor, size_t n)
+{
+    size_t i = 0;
+
+    switch(simdLevel()) {
+#if defined(__x86_64__)
+    case SIMD_AVX2:
+        i = simd_scale_avx2(out, a, factor, n);
+        break;
+    case SIMD_SSE2:
+        i = simd_scale_sse2(out, a, factor, n);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    for (; i < n; i++) out[i] = a[i] * factor;
+}
+
+/*
+ * Set out[i] to the square root of a[i], for all 0 <= i < <n>.
+ */
+void simdSqrt(double *out, const double *a, size_t n)
+{
+    size_t i = 0;
+
+    switch(simdLevel()) {
+#if defined(__x86_64__)
+    case SIMD_AVX2:
+        i = simd_sqrt_avx2(out, a, n);
+        break;
+    case SIMD_SSE2:
+        i = simd_sqrt_sse2(out, a, n);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    for (; i < n; i++) out[i] = sqrt(a[i]);
+}
+
+/*
+ * Add <factor> * x[i] to y[i], for all 0 <= i < <n>. With AVX2 this uses
+ * fused multiply-add instructions, which round only once, so results may
+ * differ from those of a scalar loop in the last bit.
+ */
+void simdAxpy(double *y, double factor, const double *x, size_t n)
+{
+    size_t i = 0;
+
+    switch(simdLevel()) {
+#if defined(__x86_64__)
+    case SIMD_AVX2:
+        i = simd_axpy_avx2(y, factor, x, n);
+        break;
+    case SIMD_SSE2:
+        i = simd_axpy_sse2(y, factor, x, n);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    for (; i < n; i++) y[i] += factor * x[i];
+}
+
+/*
+ * Return the sum of a[i] * b[i], for all 0 <= i < <n>. The SSE2 and AVX2
+ * versions add the products in a different order than a scalar loop would
+ * (and AVX2 uses fused multiply-add), so the result may differ slightly from
+ * that of a scalar loop. The difference is bounded by <n> * DBL_EPSILON times
+ * the sum of the absolute values of the products.
+ */
+double simdDot(const double *a, const double *b, size_t n)
+{
+    double sum = 0;
+    size_t i = 0;
+
+    switch(simdLevel()) {
+#if defined(__x86_64__)
+    case SIMD_AVX2:
+        i = simd_dot_avx2(a, b, n, &sum);
+        break;
+    case SIMD_SSE2:
+        i = simd_dot_sse2(a, b, n, &sum);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    for (; i < n; i++) sum += a[i] * b[i];
+
+    return sum;
+}
+
+/*
+ * Return the sum of a[i] * b[i], for all 0 <= i < <n>, and put the sums of
+ * a[i] * a[i] and b[i] * b[i] (the squared lengths of <a> and <b>) in <aa>
+ * and <bb>, in a single pass over both arrays. The same caveat about
+ * rounding as for simdDot() applies.
+ */
+double simdDotSquares(const double *a, const double *b, size_t n,
+        double *aa, double *bb)
+{
+    double sum[3] = { 0, 0, 0 };
+    size_t i = 0;
+
+    switch(simdLevel()) {
+#if defined(__x86_64__)
+    case SIMD_AVX2:
+        i = simd_dot3_avx2(a, b, n, sum);
+        break;
+    case SIMD_SSE2:
+        i = simd_dot3_sse2(a, b, n, sum);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    for (; i < n; i++) {
+        sum[0] += a[i] * b[i];
+        sum[1] += a[i] * a[i];
+        sum[2] += b[i] * b[i];
+    }
+
+    *aa = sum[1];
+    *bb = sum[2];
+
+    return sum[0];
+}
+
+#ifdef TEST
+#include "utils.h"
+
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int errors = 0;
+
+#define N 1027
+
+int main(void)
+{
+    double a[N], b[N], out[N];
+    int level;
+    size_t i;
+
+    srandom(1);
+
+    for (i = 0; i < N; i++) {
+        a[i] = (random() - RAND_MAX / 2) / 1000.0;
+        b[i] = (random() - RAND_MAX / 2) / 1000.0 + 0.5;
+    }
+
+    make_sure_that(strcmp(simdLevelName(SIMD_AVX2), "avx2") == 0);
+
+    for (level = SIMD_NONE; level <= SIMD_AVX2; level++) {
+        if (simdSetLevel(level) != (SimdLevel) level) continue;
+
+        make_sure_that(simdLevel() == (SimdLevel) level);
+
+        simdAdd(out, a, b, N);
+        for (i = 0; i < N; i++) make_sure_that(out[i] == a[i] + b[i]);
+
+        simdSub(out, a, b, N);
+        for (i = 0; i < N; i++) make_sure_that(out[i] == a[i] - b[i]);
+
+        simdMul(out, a, b, N);
+        for (i = 0; i < N; i++) make_sure_that(out[i] == a[i] * b[i]);
+
+        simdDiv(out, a, b, N);
+        for (i = 0; i < N; i++) make_sure_that(out[i] == a[i] / b[i]);
+
+        simdScale(out, a, 0.3, N);
+        for (i = 0; i < N; i++) make_sure_that(out[i] == a[i] * 0.3);
+
+        simdMul(out, a, a, N);
+        simdSqrt(out, out, N);
+        for (i = 0; i < N; i++) make_sure_that(out[i] == sqrt(a[i] * a[i]));
+
+        memcpy(out, b, sizeof(out));
+        simdAxpy(out, -0.7, a, N);
+        for (i = 0; i < N; i++) {
+            make_sure_that(fabs(out[i] - (b[i] + -0.7 * a[i])) <=
+                    DBL_EPSILON * (fabs(b[i]) + fabs(0.7 * a[i])));
+        }
+
+        double sum = 0, mag = 0, aa = 0, bb = 0, r_aa, r_bb;
+
+        for (i = 0; i < N; i++) {
+            sum += a[i] * b[i];
+            mag += fabs(a[i] * b[i]);
+            aa  += a[i] * a[i];
+            bb  += b[i] * b[i];
+        }
+
+        make_sure_that(fabs(simdDot(a, b, N) - sum) <= N * DBL_EPSILON * mag);
+        make_sure_that(fabs(simdDotSquares(a, b, N, &r_aa, &r_bb) - sum) <=
+                N * DBL_EPSILON * mag);
+        make_sure_that(fabs(r_aa - aa) <= N * DBL_EPSILON * aa);
+        make_sure_that(fabs(r_bb - bb) <= N * DBL_EPSILON * bb);
+
+        make_sure_that(simdDot(a, b, 0) == 0);
+        make_sure_that(simdDot(a, b, 1) == a[0] * b[0]);
+
+        /* In place. */
+
+        memcpy(out, a, sizeof(out));
+        simdAdd(out, out, b, N);
+        for (i = 0; i < N; i++) make_sure_that(out[i] == a[i] + b[i]);
+    }
+
+    return errors;
+}
+#endif
@@ -0,0 +1,115 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+/*
+ * simd.h: Vectorized operations on arrays of doubles.
+ *
+ * Element-wise operations on arrays of doubles, using AVX2 or SSE2
+ * instructions if the processor supports them. Which instruction set to use
+ * is decided at runtime. Unless noted otherwise, each function performs
+ * exactly the same floating point operations on each element as a simple
+ * scalar loop would, so results are identical regardless of the instruction
+ * set that is used. Output arrays may be the same as input arrays, but they
+ * may not overlap them in any other way.
+ *
+ * simd.h is part of libjvs.
+ *
+ * Copyright: (c) 2026 Jacco van Schaik (jacco@jaccovanschaik.net)
+ * Created:   2026-10-18
+ * Version:   $Id$
+ *
+ * This software is distributed under the terms of the MIT license. See
+ * http://www.opensource.org/licenses/mit-license.php for details.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/* Instruction sets that may be used. */
+
+typedef enum {
+    SIMD_NONE,      /* Plain scalar code. */
+    SIMD_SSE2,      /* SSE2 (2 doubles at a time). */
+    SIMD_AVX2       /* AVX2 and FMA (4 doubles at a time). */
+} SimdLevel;
+
+/*
+ * Return the instruction set that is currently being used.
+ */
+SimdLevel simdLevel(void);
+
+/*
+ * Use instruction set <level> from now on, or the best one that the
+ * processor supports if it doesn't support <level>. Returns the instruction
+ * set that will actually be used. Mainly useful for testing and benchmarks.
+ */
+SimdLevel simdSetLevel(SimdLevel level);
+
+/*
+ * Return the name of instruction set <level>.
+ */
+const char *simdLevelName(SimdLevel level);
+
+/*
+ * Set out[i] to a[i] + b[i], for all 0 <= i < <n>.
+ */
+void simdAdd(double *out, const double *a, const double *b, size_t n);
+
+/*
+ * Set out[i] to a[i] - b[i], for all 0 <= i < <n>.
+ */
+void simdSub(double *out, const double *a, const double *b, size_t n);
+
+/*
+ * Set out[i] to a[i] * b[i], for all 0 <= i < <n>.
+ */
+void simdMul(double *out, const double *a, const double *b, size_t n);
+
+/*
+ * Set out[i] to a[i] / b[i], for all 0 <= i < <n>.
+ */
+void simdDiv(double *out, const double *a, const double *b, size_t n);
+
+/*
+ * Set out[i] to a[i] * <factor>, for all 0 <= i < <n>.
+ */
+void simdScale(double *out, const double *a, double factor, size_t n);
+
+/*
+ * Set out[i] to the square root of a[i], for all 0 <= i < <n>.
+ */
+void simdSqrt(double *out, const double *a, size_t n);
+
+/*
+ * Add <factor> * x[i] to y[i], for all 0 <= i < <n>. With AVX2 this uses
+ * fused multiply-add instructions, which round only once, so results may
+ * differ from those of a scalar loop in the last bit.
+ */
+void simdAxpy(double *y, double factor, const double *x, size_t n);
+
+/*
+ * Return the sum of a[i] * b[i], for all 0 <= i < <n>. The SSE2 and AVX2
+ * versions add the products in a different order than a scalar loop would
+ * (and AVX2 uses fused multiply-add), so the result may differ slightly from
+ * that of a scalar loop. The difference is bounded by <n> * DBL_EPSILON times
+ * the sum of the absolute values of the products.
+ */
+double simdDot(const double *a, const double *b, size_t n);
+
+/*
+ * Return the sum of a[i] * b[i], for all 0 <= i < <n>, and put the sums of
+ * a[i] * a[i] and b[i] * b[i] (the squared lengths of <a> and <b>) in <aa>
+ * and <bb>, in a single pass over both arrays. The same caveat about
+ * rounding as for simdDot() applies.
+ */
+double simdDotSquares(const double *a, const double *b, size_t n,
+        double *aa, double *bb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
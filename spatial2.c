@@ -0,0 +1,981 @@
+/*
+ * spatial2.c: Spatial indexes for 2-dimensional geometry.
+ *
+ * spatial2.c is part of libjvs.
+ *
+ * Copyright: (c) 2026 Jacco van Schaik (jacco@jaccovanschaik.net)
+ * Created:   2026-10-18
+ * Version:   $Id$
+ *
+ * This software is distributed under the terms of the MIT license. See
+ * http://www.opensource.org/licenses/mit-license.php for details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "defs.h"
+#include "simd.h"
+
+#include "spatial2.h"
+
+/*
+ * Maximum depth of an R-tree. Each level divides the number of nodes by
+ * RTREE2_FANOUT, so this is plenty for any number of objects that fits in an
+ * int.
+ */
+#define RTREE2_MAX_DEPTH 16
+
+/*
+ * An object (or a node) with its bounding box, while building an R-tree.
+ */
+typedef struct {
+    Box2 box;
+    int index;
+} RTree2Entry;
+
+/*
+ * Return the bounding box of circle <c>.
+ */
+Box2 g2CircleBox(Circle2 c)
+{
+    Box2 b = {
+        v2Make(c.c.r[0] - c.r, c.c.r[1] - c.r),
+        v2Make(c.c.r[0] + c.r, c.c.r[1] + c.r)
+    };
+
+    return b;
+}
+
+/*
+ * Return the bounding box of the line segment from l.pv to l.pv + l.dv.
+ */
+Box2 g2SegmentBox(Line2 l)
+{
+    Vector2 end = v2Sum(l.pv, l.dv);
+
+    Box2 b = {
+        v2Make(MIN(l.pv.r[0], end.r[0]), MIN(l.pv.r[1], end.r[1])),
+        v2Make(MAX(l.pv.r[0], end.r[0]), MAX(l.pv.r[1], end.r[1]))
+    };
+
+    return b;
+}
+
+/*
+ * Return the bounding box of polygon <poly>.
+ */
+Box2 g2PolygonBox2(const Polygon2 *poly)
+{
+    Box2 b;
+
+    g2PolygonBox(poly, &b.min, &b.max);
+
+    return b;
+}
+
+/*
+ * Return true if boxes <a> and <b> overlap (or touch).
+ */
+bool g2BoxOverlap(Box2 a, Box2 b)
+{
+    return a.min.r[0] <= b.max.r[0] && a.max.r[0] >= b.min.r[0] &&
+           a.min.r[1] <= b.max.r[1] && a.max.r[1] >= b.min.r[1];
+}
+
+/*
+ * Return the distance from point <p> to box <b>, which is 0 if <p> is inside
+ * <b>.
+ */
+double g2BoxDistance(Box2 b, Vector2 p)
+{
+    double dx = MAX(0, MAX(b.min.r[0] - p.r[0], p.r[0] - b.max.r[0]));
+    double dy = MAX(0, MAX(b.min.r[1] - p.r[1], p.r[1] - b.max.r[1]));
+
+    return hypot(dx, dy);
+}
+
+/*
+ * Return the column of <grid> that contains x-coordinate <x>, clamped to the
+ * grid.
+ */
+static int g2_grid_col(const Grid2 *grid, double x)
+{
+    double col = floor((x - grid->bounds.min.r[0]) / grid->cell_size);
+
+    return CLAMP(col, 0, grid->nx - 1);
+}
+
+/*
+ * Return the row of <grid> that contains y-coordinate <y>, clamped to the
+ * grid.
+ */
+static int g2_grid_row(const Grid2 *grid, double y)
+{
+    double row = floor((y - grid->bounds.min.r[1]) / grid->cell_size);
+
+    return CLAMP(row, 0, grid->ny - 1);
+}
+
+/*
+ * Create a grid with square cells of size <cell_size> covering <bounds>, and
+ * add the <count> objects whose bounding boxes are in <box>. Objects that
+ * extend beyond <bounds> are added to the cells on its edge.
+ */
+Grid2 *g2GridCreate(Box2 bounds, double cell_size, const Box2 *box, int count)
+{
+    int i, x, y, n_cells;
+
+    Grid2 *grid = calloc(1, sizeof(Grid2));
+
+    grid->bounds = bounds;
+    grid->cell_size = cell_size;
+    grid->count = count;
+
+    double width  = bounds.max.r[0] - bounds.min.r[0];
+    double height = bounds.max.r[1] - bounds.min.r[1];
+
+    grid->nx = MAX(1, (int) ceil(width / cell_size));
+    grid->ny = MAX(1, (int) ceil(height / cell_size));
+
+    n_cells = grid->nx * grid->ny;
+
+    grid->box = malloc(count * sizeof(Box2));
+    grid->cell_start = calloc(n_cells + 1, sizeof(int));
+
+    memcpy(grid->box, box, count * sizeof(Box2));
+
+    /* First count the objects in each cell, then turn the counts into start
+     * indexes, and then fill in the objects. */
+
+    for (i = 0; i < count; i++) {
+        int x0 = g2_grid_col(grid, box[i].min.r[0]);
+        int x1 = g2_grid_col(grid, box[i].max.r[0]);
+        int y0 = g2_grid_row(grid, box[i].min.r[1]);
+        int y1 = g2_grid_row(grid, box[i].max.r[1]);
+
+        for (y = y0; y <= y1; y++) {
+            for (x = x0; x <= x1; x++) {
+                grid->cell_start[y * grid->nx + x + 1]++;
+            }
+        }
+    }
+
+    for (i = 0; i < n_cells; i++) {
+        grid->cell_start[i + 1] += grid->cell_start[i];
+    }
+
+    int *fill = malloc(n_cells * sizeof(int));
+
+    memcpy(fill, grid->cell_start, n_cells * sizeof(int));
+
+    grid->cell_obj = malloc(MAX(1, grid->cell_start[n_cells]) * sizeof(int));
+
+    for (i = 0; i < count; i++) {
+        int x0 = g2_grid_col(grid, box[i].min.r[0]);
+        int x1 = g2_grid_col(grid, box[i].max.r[0]);
+        int y0 = g2_grid_row(grid, box[i].min.r[1]);
+        int y1 = g2_grid_row(grid, box[i].max.r[1]);
+
+        for (y = y0; y <= y1; y++) {
+            for (x = x0; x <= x1; x++) {
+                grid->cell_obj[fill[y * grid->nx + x]++] = i;
+            }
+        }
+    }
+
+    free(fill);
+
+    return grid;
+}
+
+/*
+ * Call <hit> for each object in <grid> whose bounding box overlaps <query>,
+ * passing in <index>, the index of the object and <udata>. Returns the
+ * number of objects found.
+ */
+static int g2_grid_query(const Grid2 *grid, Box2 query, size_t index,
+        void (*hit)(size_t query, int obj, void *udata), void *udata)
+{
+    int x, y, i, found = 0;
+
+    int x0 = g2_grid_col(grid, query.min.r[0]);
+    int x1 = g2_grid_col(grid, query.max.r[0]);
+    int y0 = g2_grid_row(grid, query.min.r[1]);
+    int y1 = g2_grid_row(grid, query.max.r[1]);
+
+    if (query.min.r[0] > query.max.r[0] || query.min.r[1] > query.max.r[1])
+        return 0;
+
+    for (y = y0; y <= y1; y++) {
+        for (x = x0; x <= x1; x++) {
+            int c = y * grid->nx + x;
+
+            for (i = grid->cell_start[c]; i < grid->cell_start[c + 1]; i++) {
+                int obj = grid->cell_obj[i];
+                const Box2 *b = &grid->box[obj];
+
+                if (!g2BoxOverlap(*b, query)) continue;
+
+                /* An object may be in several cells that overlap the query.
+                 * Only report it from the cell that contains the lower-left
+                 * corner of the overlap. */
+
+                double ox = MAX(b->min.r[0], query.min.r[0]);
+                double oy = MAX(b->min.r[1], query.min.r[1]);
+
+                if (g2_grid_col(grid, ox) != x || g2_grid_row(grid, oy) != y)
+                    continue;
+
+                hit(index, obj, udata);
+
+                found++;
+            }
+        }
+    }
+
+    return found;
+}
+
+/*
+ * Collects query results into an array, for g2GridQuery() and
+ * g2TreeQuery().
+ */
+typedef struct {
+    int *obj;
+    int max_obj;
+    int count;
+} G2Collector;
+
+/*
+ * Add object <obj> to the G2Collector in <udata>, if there is still room.
+ */
+static void g2_collect(size_t query, int obj, void *udata)
+{
+    G2Collector *collector = udata;
+
+    UNUSED(query);
+
+    if (collector->count < collector->max_obj) {
+        collector->obj[collector->count] = obj;
+    }
+
+    collector->count++;
+}
+
+/*
+ * Put the indexes of the objects whose bounding boxes overlap <query> into
+ * <obj>, which has room for <max_obj> entries. Each object is reported once.
+ * Returns the number of objects found, which may be more than <max_obj> (in
+ * which case only the first <max_obj> are put in <obj>).
+ */
+int g2GridQuery(const Grid2 *grid, Box2 query, int *obj, int max_obj)
+{
+    G2Collector collector = { obj, max_obj, 0 };
+
+    g2_grid_query(grid, query, 0, g2_collect, &collector);
+
+    return collector.count;
+}
+
+/*
+ * Call <hit> for each combination of a query box in <query> (there are <n>)
+ * and an object whose bounding box overlaps it, passing in the index of the
+ * query box, the index of the object and <udata>.
+ */
+void g2GridQueryMany(const Grid2 *grid, const Box2 *query, size_t n,
+        void (*hit)(size_t query, int obj, void *udata), void *udata)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        g2_grid_query(grid, query[i], i, hit, udata);
+    }
+}
+
+/*
+ * Return the index of the object nearest to point <p>, or -1 if the grid is
+ * empty, and put its distance in <dist> (if it isn't NULL). The distance to an
+ * object is found by calling <distance> with the index of the object, <p> and
+ * <udata>. It may not return less than the distance to the object's bounding
+ * box. If <distance> is NULL, the distance to the bounding box is used.
+ */
+int g2GridNearest(const Grid2 *grid, Vector2 p,
+        double (*distance)(int obj, Vector2 p, void *udata), void *udata,
+        double *dist)
+{
+    int r, x, y, i, best_obj = -1;
+    double best = INFINITY;
+
+    int cx = g2_grid_col(grid, p.r[0]);
+    int cy = g2_grid_row(grid, p.r[1]);
+
+    int max_r = MAX(MAX(cx, grid->nx - 1 - cx), MAX(cy, grid->ny - 1 - cy));
+
+    /* Search rings of cells around the one that contains <p>. Any cell in
+     * ring <r> is at least (r - 1) cells away from <p> in x or y, even for
+     * the cells on the edge of the grid, which may also contain objects that
+     * lie outside it. */
+
+    for (r = 0; r <= max_r; r++) {
+        if ((r - 1) * grid->cell_size > best) break;
+
+        for (y = MAX(0, cy - r); y <= MIN(grid->ny - 1, cy + r); y++) {
+            int on_edge = (y == cy - r || y == cy + r);
+            int step = on_edge ? 1 : 2 * r;
+
+            for (x = cx - r; x <= cx + r; x += MAX(1, step)) {
+                if (x < 0 || x >= grid->nx) continue;
+
+                int c = y * grid->nx + x;
+
+                for (i = grid->cell_start[c]; i < grid->cell_start[c + 1];
+                     i++) {
+                    int obj = grid->cell_obj[i];
+
+                    if (g2BoxDistance(grid->box[obj], p) >= best) continue;
+
+                    double d = distance ?
+                        distance(obj, p, udata) :
+                        g2BoxDistance(grid->box[obj], p);
+
+                    if (d < best) {
+                        best = d;
+                        best_obj = obj;
+                    }
+                }
+            }
+        }
+    }
+
+    if (dist != NULL) *dist = best;
+
+    return best_obj;
+}
+
+/*
+ * Destroy grid <grid>.
+ */
+void g2GridDestroy(Grid2 *grid)
+{
+    free(grid->box);
+    free(grid->cell_start);
+    free(grid->cell_obj);
+
+    free(grid);
+}
+
+/*
+ * Compare the centers of the entries at <p1> and <p2> in x for qsort().
+ */
+static int g2_compare_x(const void *p1, const void *p2)
+{
+    const RTree2Entry *e1 = p1, *e2 = p2;
+
+    double c1 = e1->box.min.r[0] + e1->box.max.r[0];
+    double c2 = e2->box.min.r[0] + e2->box.max.r[0];
+
+    return c1 < c2 ? -1 : c1 > c2 ? 1 : e1->index - e2->index;
+}
+
+/*
+ * Compare the centers of the entries at <p1> and <p2> in y for qsort().
+ */
+static int g2_compare_y(const void *p1, const void *p2)
+{
+    const RTree2Entry *e1 = p1, *e2 = p2;
+
+    double c1 = e1->box.min.r[1] + e1->box.max.r[1];
+    double c2 = e2->box.min.r[1] + e2->box.max.r[1];
+
+    return c1 < c2 ? -1 : c1 > c2 ? 1 : e1->index - e2->index;
+}
+
+/*
+ * Pack the <count> entries in <entry> into new nodes of <tree>, using the
+ * Sort-Tile-Recursive algorithm: sort them by x, cut them into vertical
+ * slices, sort each slice by y and fill nodes from it. On return, <entry>
+ * contains the new nodes, and the number of them is returned.
+ */
+static int g2_tree_pack(RTree2 *tree, RTree2Entry *entry, int count, int leaf)
+{
+    int i, j, n_new;
+
+    int n_nodes  = (count + RTREE2_FANOUT - 1) / RTREE2_FANOUT;
+    int n_slices = (int) ceil(sqrt(n_nodes));
+    int slice    = n_slices * RTREE2_FANOUT;
+
+    qsort(entry, count, sizeof(RTree2Entry), g2_compare_x);
+
+    for (i = 0; i < count; i += slice) {
+        qsort(entry + i, MIN(slice, count - i), sizeof(RTree2Entry),
+                g2_compare_y);
+    }
+
+    tree->node = realloc(tree->node,
+            (tree->n_nodes + n_nodes) * sizeof(RTree2Node));
+
+    /* Fill the nodes slice by slice, so that a node never straddles two
+     * slices. */
+
+    n_new = 0;
+
+    for (i = 0; i < count; i += slice) {
+        int slice_end = MIN(i + slice, count);
+
+        for (j = i; j < slice_end; j += RTREE2_FANOUT) {
+            int k, n = MIN(RTREE2_FANOUT, slice_end - j);
+
+            RTree2Node *node = &tree->node[tree->n_nodes];
+            Box2 box = {
+                v2Make(INFINITY, INFINITY), v2Make(-INFINITY, -INFINITY)
+            };
+
+            node->count = n;
+            node->leaf = leaf;
+
+            for (k = 0; k < RTREE2_FANOUT; k++) {
+                if (k < n) {
+                    const Box2 *b = &entry[j + k].box;
+
+                    node->min_x[k] = b->min.r[0];
+                    node->min_y[k] = b->min.r[1];
+                    node->max_x[k] = b->max.r[0];
+                    node->max_y[k] = b->max.r[1];
+                    node->child[k] = entry[j + k].index;
+
+                    box.min.r[0] = MIN(box.min.r[0], b->min.r[0]);
+                    box.min.r[1] = MIN(box.min.r[1], b->min.r[1]);
+                    box.max.r[0] = MAX(box.max.r[0], b->max.r[0]);
+                    box.max.r[1] = MAX(box.max.r[1], b->max.r[1]);
+                }
+                else {
+                    node->min_x[k] = node->min_y[k] = INFINITY;
+                    node->max_x[k] = node->max_y[k] = -INFINITY;
+                    node->child[k] = -1;
+                }
+            }
+
+            /* The entries for this level have all been read up to here, so
+             * the new entry can safely overwrite them. */
+
+            entry[n_new].box = box;
+            entry[n_new].index = tree->n_nodes;
+
+            n_new++;
+            tree->n_nodes++;
+        }
+    }
+
+    return n_new;
+}
+
+/*
+ * Create an R-tree for the <count> objects whose bounding boxes are in <box>.
+ */
+RTree2 *g2TreeCreate(const Box2 *box, int count)
+{
+    int i;
+
+    RTree2 *tree = calloc(1, sizeof(RTree2));
+
+    tree->count = count;
+    tree->root = -1;
+
+    if (count == 0) return tree;
+
+    RTree2Entry *entry = malloc(count * sizeof(RTree2Entry));
+
+    for (i = 0; i < count; i++) {
+        entry[i].box = box[i];
+        entry[i].index = i;
+    }
+
+    /* Pack the objects into leaves, and then keep packing nodes into parent
+     * nodes until only one is left. */
+
+    count = g2_tree_pack(tree, entry, count, 1);
+
+    while (count > 1) {
+        count = g2_tree_pack(tree, entry, count, 0);
+    }
+
+    tree->root = entry[0].index;
+
+    free(entry);
+
+    return tree;
+}
+
+/*
+ * Return a mask with bit <i> set if the box of child <i> of <node> overlaps
+ * <query>, one child at a time.
+ */
+static unsigned int g2_node_overlap(const RTree2Node *node, const Box2 *query)
+{
+    unsigned int i, mask = 0;
+
+    for (i = 0; i < RTREE2_FANOUT; i++) {
+        if (node->min_x[i] <= query->max.r[0] &&
+            node->max_x[i] >= query->min.r[0] &&
+            node->min_y[i] <= query->max.r[1] &&
+            node->max_y[i] >= query->min.r[1]) {
+            mask |= 1 << i;
+        }
+    }
+
+    return mask;
+}
+
+#if defined(__x86_64__)
+
+/*
+ * Return a mask with bit <i> set if the box of child <i> of <node> overlaps
+ * <query>, two children at a time.
+ */
+static unsigned int g2_node_overlap_sse2(const RTree2Node *node,
+        const Box2 *query)
+{
+    __m128d q_min_x = _mm_set1_pd(query->min.r[0]);
+    __m128d q_min_y = _mm_set1_pd(query->min.r[1]);
+    __m128d q_max_x = _mm_set1_pd(query->max.r[0]);
+    __m128d q_max_y = _mm_set1_pd(query->max.r[1]);
+
+    unsigned int i, mask = 0;
+
+    for (i = 0; i < RTREE2_FANOUT; i += 2) {
+        __m128d overlap = _mm_and_pd(
+                _mm_and_pd(
+                    _mm_cmple_pd(_mm_loadu_pd(node->min_x + i), q_max_x),
+                    _mm_cmpge_pd(_mm_loadu_pd(node->max_x + i), q_min_x)),
+                _mm_and_pd(
+                    _mm_cmple_pd(_mm_loadu_pd(node->min_y + i), q_max_y),
+                    _mm_cmpge_pd(_mm_loadu_pd(node->max_y + i), q_min_y)));
+
+        mask |= _mm_movemask_pd(overlap) << i;
+    }
+
+    return mask;
+}
+
+/*
+ * Return a mask with bit <i> set if the box of child <i> of <node> overlaps
+ * <query>, four children at a time.
+ */
+__attribute__((target("avx2")))
+static unsigned int g2_node_overlap_avx2(const RTree2Node *node,
+        const Box2 *query)
+{
+    __m256d q_min_x = _mm256_set1_pd(query->min.r[0]);
+    __m256d q_min_y = _mm256_set1_pd(query->min.r[1]);
+    __m256d q_max_x = _mm256_set1_pd(query->max.r[0]);
+    __m256d q_max_y = _mm256_set1_pd(query->max.r[1]);
+
+    unsigned int i, mask = 0;
+
+    for (i = 0; i < RTREE2_FANOUT; i += 4) {
+        __m256d overlap = _mm256_and_pd(
+                _mm256_and_pd(
+                    _mm256_cmp_pd(_mm256_loadu_pd(node->min_x + i),
+                                  q_max_x, _CMP_LE_OQ),
+                    _mm256_cmp_pd(_mm256_loadu_pd(node->max_x + i),
+                                  q_min_x, _CMP_GE_OQ)),
+                _mm256_and_pd(
+                    _mm256_cmp_pd(_mm256_loadu_pd(node->min_y + i),
+                                  q_max_y, _CMP_LE_OQ),
+                    _mm256_cmp_pd(_mm256_loadu_pd(node->max_y + i),
+                                  q_min_y, _CMP_GE_OQ)));
+
+        mask |= _mm256_movemask_pd(overlap) << i;
+    }
+
+    return mask;
+}
+
+#endif
+
+/*
+ * Call <hit> for each object in <tree> whose bounding box overlaps <query>,
+ * passing in <index>, the index of the object and <udata>, using overlap test
+ * <overlap>.
+ */
+static void g2_tree_query(const RTree2 *tree, const Box2 *query, size_t index,
+        unsigned int (*overlap)(const RTree2Node *node, const Box2 *query),
+        void (*hit)(size_t query, int obj, void *udata), void *udata)
+{
+    int stack[RTREE2_MAX_DEPTH * RTREE2_FANOUT];
+    int depth = 0;
+
+    if (tree->root < 0) return;
+
+    stack[depth++] = tree->root;
+
+    while (depth > 0) {
+        const RTree2Node *node = &tree->node[stack[--depth]];
+
+        unsigned int mask = overlap(node, query);
+
+        while (mask != 0) {
+            int i = __builtin_ctz(mask);
+
+            mask &= mask - 1;
+
+            if (node->leaf)
+                hit(index, node->child[i], udata);
+            else
+                stack[depth++] = node->child[i];
+        }
+    }
+}
+
+/*
+ * Return the best function to test the children of an R-tree node for
+ * overlap with a query box.
+ */
+static unsigned int (*g2_node_overlap_func(void))(const RTree2Node *node,
+        const Box2 *query)
+{
+    switch(simdLevel()) {
+#if defined(__x86_64__)
+    case SIMD_AVX2:
+        return g2_node_overlap_avx2;
+    case SIMD_SSE2:
+        return g2_node_overlap_sse2;
+#endif
+    default:
+        return g2_node_overlap;
+    }
+}
+
+/*
+ * Put the indexes of the objects whose bounding boxes overlap <query> into
+ * <obj>, which has room for <max_obj> entries. Returns the number of objects
+ * found, which may be more than <max_obj> (in which case only the first
+ * <max_obj> are put in <obj>).
+ */
+int g2TreeQuery(const RTree2 *tree, Box2 query, int *obj, int max_obj)
+{
+    G2Collector collector = { obj, max_obj, 0 };
+
+    g2_tree_query(tree, &query, 0, g2_node_overlap_func(),
+            g2_collect, &collector);
+
+    return collector.count;
+}
+
+/*
+ * Call <hit> for each combination of a query box in <query> (there are <n>)
+ * and an object whose bounding box overlaps it, passing in the index of the
+ * query box, the index of the object and <udata>.
+ */
+void g2TreeQueryMany(const RTree2 *tree, const Box2 *query, size_t n,
+        void (*hit)(size_t query, int obj, void *udata), void *udata)
+{
+    size_t i;
+
+    unsigned int (*overlap)(const RTree2Node *node, const Box2 *query) =
+        g2_node_overlap_func();
+
+    for (i = 0; i < n; i++) {
+        g2_tree_query(tree, &query[i], i, overlap, hit, udata);
+    }
+}
+
+/*
+ * Look for objects nearer to <p> than *<best> below node <index> of <tree>,
+ * and update *<best> and *<best_obj> if any are found.
+ */
+static void g2_tree_nearest(const RTree2 *tree, int index, Vector2 p,
+        double (*distance)(int obj, Vector2 p, void *udata), void *udata,
+        double *best, int *best_obj)
+{
+    const RTree2Node *node = &tree->node[index];
+
+    double d[RTREE2_FANOUT];
+    int order[RTREE2_FANOUT];
+    int i, j;
+
+    /* Visit the children nearest-first, so that the best distance found so
+     * far shrinks quickly and prunes the rest. */
+
+    for (i = 0; i < node->count; i++) {
+        Box2 b = {
+            v2Make(node->min_x[i], node->min_y[i]),
+            v2Make(node->max_x[i], node->max_y[i])
+        };
+
+        d[i] = g2BoxDistance(b, p);
+
+        for (j = i; j > 0 && d[order[j - 1]] > d[i]; j--) {
+            order[j] = order[j - 1];
+        }
+
+        order[j] = i;
+    }
+
+    for (i = 0; i < node->count; i++) {
+        int k = order[i];
+
+        if (d[k] >= *best) break;
+
+        if (node->leaf) {
+            double dist = distance ? distance(node->child[k], p, udata) : d[k];
+
+            if (dist < *best) {
+                *best = dist;
+                *best_obj = node->child[k];
+            }
+        }
+        else {
+            g2_tree_nearest(tree, node->child[k], p, distance, udata,
+                    best, best_obj);
+        }
+    }
+}
+
+/*
+ * Return the index of the object nearest to point <p>, or -1 if the tree is
+ * empty, and put its distance in <dist> (if it isn't NULL). The distance to an
+ * object is found by calling <distance> with the index of the object, <p> and
+ * <udata>. It may not return less than the distance to the object's bounding
+ * box. If <distance> is NULL, the distance to the bounding box is used.
+ */
+int g2TreeNearest(const RTree2 *tree, Vector2 p,
+        double (*distance)(int obj, Vector2 p, void *udata), void *udata,
+        double *dist)
+{
+    double best = INFINITY;
+    int best_obj = -1;
+
+    if (tree->root >= 0) {
+        g2_tree_nearest(tree, tree->root, p, distance, udata,
+                &best, &best_obj);
+    }
+
+    if (dist != NULL) *dist = best;
+
+    return best_obj;
+}
+
+/*
+ * Destroy R-tree <tree>.
+ */
+void g2TreeDestroy(RTree2 *tree)
+{
+    free(tree->node);
+
+    free(tree);
+}
+
+#ifdef TEST
+#include "utils.h"
+
+static int errors = 0;
+
+#define N_OBJ   2000
+#define N_QUERY 200
+
+static Circle2 circle[N_OBJ];
+static Box2 box[N_OBJ];
+
+/*
+ * Return the distance from <p> to circle <obj>.
+ */
+static double circle_distance(int obj, Vector2 p, void *udata)
+{
+    UNUSED(udata);
+
+    return MAX(0, v2Len(v2Diff(p, circle[obj].c)) - circle[obj].r);
+}
+
+/*
+ * Count the hits passed in by g2GridQueryMany() and g2TreeQueryMany().
+ */
+static void count_hits(size_t query, int obj, void *udata)
+{
+    int *hits = udata;
+
+    UNUSED(obj);
+
+    hits[query]++;
+}
+
+/*
+ * Compare integers for qsort().
+ */
+static int compare_int(const void *p1, const void *p2)
+{
+    return *(const int *) p1 - *(const int *) p2;
+}
+
+/*
+ * Return a random number between <min> and <max>.
+ */
+static double random_between(double min, double max)
+{
+    return min + (max - min) * random() / RAND_MAX;
+}
+
+int main(void)
+{
+    int i, j, level;
+    static int found[N_OBJ], expected[N_OBJ];
+
+    srandom(1);
+
+    /* Clustered circles, with a few large ones and some outside the grid
+     * bounds. */
+
+    for (i = 0; i < N_OBJ; i++) {
+        bool spread = (i % 3 == 0);
+
+        double cx = spread ? random_between(0, 100)   : random_between(0, 20);
+        double cy = spread ? random_between(-10, 110) : random_between(0, 20);
+        double r  = i % 100 == 0 ? random_between(5, 30) : random_between(0, 1);
+
+        circle[i].c = v2Make(cx, cy);
+        circle[i].r = r;
+
+        box[i] = g2CircleBox(circle[i]);
+    }
+
+    Box2 bounds = { v2Make(0, 0), v2Make(100, 100) };
+
+    Grid2 *grid = g2GridCreate(bounds, 5, box, N_OBJ);
+    RTree2 *tree = g2TreeCreate(box, N_OBJ);
+
+    make_sure_that(grid->nx == 20 && grid->ny == 20);
+    make_sure_that(tree->root >= 0);
+
+    Box2 query[N_QUERY];
+
+    for (i = 0; i < N_QUERY; i++) {
+        double x = random_between(-10, 110), y = random_between(-10, 110);
+        double w = random_between(0, 15),   h = random_between(0, 15);
+
+        query[i].min = v2Make(x, y);
+        query[i].max = v2Make(x + w, y + h);
+    }
+
+    for (level = SIMD_NONE; level <= SIMD_AVX2; level++) {
+        int bad_grid = 0, bad_tree = 0, n;
+
+        simdSetLevel(level);
+
+        for (i = 0; i < N_QUERY; i++) {
+            int n_expected = 0;
+
+            for (j = 0; j < N_OBJ; j++) {
+                if (g2BoxOverlap(box[j], query[i])) expected[n_expected++] = j;
+            }
+
+            n = g2GridQuery(grid, query[i], found, N_OBJ);
+            qsort(found, MIN(n, N_OBJ), sizeof(int), compare_int);
+
+            if (n != n_expected ||
+                memcmp(found, expected, n * sizeof(int)) != 0) bad_grid++;
+
+            n = g2TreeQuery(tree, query[i], found, N_OBJ);
+            qsort(found, MIN(n, N_OBJ), sizeof(int), compare_int);
+
+            if (n != n_expected ||
+                memcmp(found, expected, n * sizeof(int)) != 0) bad_tree++;
+        }
+
+        make_sure_that(bad_grid == 0);
+        make_sure_that(bad_tree == 0);
+    }
+
+    /* Batch queries. */
+
+    int grid_hits[N_QUERY] = { 0 }, tree_hits[N_QUERY] = { 0 };
+
+    g2GridQueryMany(grid, query, N_QUERY, count_hits, grid_hits);
+    g2TreeQueryMany(tree, query, N_QUERY, count_hits, tree_hits);
+
+    int bad = 0;
+
+    for (i = 0; i < N_QUERY; i++) {
+        if (grid_hits[i] != g2GridQuery(grid, query[i], found, 0)) bad++;
+        if (tree_hits[i] != grid_hits[i]) bad++;
+    }
+
+    make_sure_that(bad == 0);
+
+    /* Nearest neighbours, by box and by the exact distance to the circles. */
+
+    int bad_grid = 0, bad_tree = 0;
+
+    for (i = 0; i < N_QUERY; i++) {
+        Vector2 p = v2Make(random_between(-50, 150), random_between(-50, 150));
+        double best_box = INFINITY, best_circle = INFINITY, d;
+
+        for (j = 0; j < N_OBJ; j++) {
+            best_box = MIN(best_box, g2BoxDistance(box[j], p));
+            best_circle = MIN(best_circle, circle_distance(j, p, NULL));
+        }
+
+        j = g2GridNearest(grid, p, NULL, NULL, &d);
+        if (j < 0 || d != best_box) bad_grid++;
+
+        j = g2GridNearest(grid, p, circle_distance, NULL, &d);
+        if (j < 0 || d != best_circle) bad_grid++;
+
+        j = g2TreeNearest(tree, p, NULL, NULL, &d);
+        if (j < 0 || d != best_box) bad_tree++;
+
+        j = g2TreeNearest(tree, p, circle_distance, NULL, &d);
+        if (j < 0 || d != best_circle || circle_distance(j, p, NULL) != d)
+            bad_tree++;
+    }
+
+    make_sure_that(bad_grid == 0);
+    make_sure_that(bad_tree == 0);
+
+    /* Limited room for results. */
+
+    Box2 everything = { v2Make(-100, -100), v2Make(200, 200) };
+
+    make_sure_that(g2TreeQuery(tree, everything, found, 10) == N_OBJ);
+    make_sure_that(g2GridQuery(grid, everything, found, 10) == N_OBJ);
+
+    g2GridDestroy(grid);
+    g2TreeDestroy(tree);
+
+    /* Empty indexes. */
+
+    grid = g2GridCreate(bounds, 10, NULL, 0);
+    tree = g2TreeCreate(NULL, 0);
+
+    make_sure_that(g2GridQuery(grid, everything, found, N_OBJ) == 0);
+    make_sure_that(g2TreeQuery(tree, everything, found, N_OBJ) == 0);
+    make_sure_that(g2GridNearest(grid, v2Make(0, 0), NULL, NULL, NULL) == -1);
+    make_sure_that(g2TreeNearest(tree, v2Make(0, 0), NULL, NULL, NULL) == -1);
+
+    g2GridDestroy(grid);
+    g2TreeDestroy(tree);
+
+    /* A single object, and other kinds of objects. */
+
+    Line2 segment = { v2Make(1, 1), v2Make(2, -3) };
+    Box2 seg_box = g2SegmentBox(segment);
+
+    make_sure_that(seg_box.min.r[0] == 1 && seg_box.min.r[1] == -2);
+    make_sure_that(seg_box.max.r[0] == 3 && seg_box.max.r[1] == 1);
+
+    tree = g2TreeCreate(&seg_box, 1);
+
+    make_sure_that(tree->n_nodes == 1);
+    make_sure_that(g2TreeQuery(tree, everything, found, N_OBJ) == 1);
+    make_sure_that(found[0] == 0);
+
+    g2TreeDestroy(tree);
+
+    return errors;
+}
+#endif
@@ -0,0 +1,179 @@
+#ifndef SPATIAL2_H
+#define SPATIAL2_H
+
+/*
+ * spatial2.h: Spatial indexes for 2-dimensional geometry.
+ *
+ * Two indexes are provided: a uniform grid (Grid2), which works best for
+ * objects that are spread evenly over a known area, and an R-tree (RTree2),
+ * bulk-loaded using the Sort-Tile-Recursive algorithm, for data that is
+ * clustered. Both are built once from the bounding boxes of a set of objects
+ * (circles, line segments, polygons, ...) and refer to them by their index in
+ * that set. Queries only look at the bounding boxes; exact tests against the
+ * objects themselves are left to the caller, or done using a distance
+ * callback for nearest-neighbour searches.
+ *
+ * spatial2.h is part of libjvs.
+ *
+ * Copyright: (c) 2026 Jacco van Schaik (jacco@jaccovanschaik.net)
+ * Created:   2026-10-18
+ * Version:   $Id$
+ *
+ * This software is distributed under the terms of the MIT license. See
+ * http://www.opensource.org/licenses/mit-license.php for details.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include "geometry2.h"
+
+/* Number of children of an R-tree node. */
+
+#define RTREE2_FANOUT 8
+
+typedef struct {
+    Vector2 min;    // Lower-left corner
+    Vector2 max;    // Upper-right corner
+} Box2;
+
+typedef struct {
+    Box2 bounds;        // Area covered by the grid
+    double cell_size;   // Width and height of a cell
+    int nx, ny;         // Number of cells in x and y
+    int count;          // Number of objects
+    Box2 *box;          // Bounding box of each object
+    int *cell_start;    // Objects in cell c are cell_obj[cell_start[c]] up to
+    int *cell_obj;      // cell_obj[cell_start[c + 1]], with c = y * nx + x.
+} Grid2;
+
+/*
+ * An R-tree node. The bounding boxes of its children are stored as separate
+ * arrays so they can be tested several at a time. Unused slots have an empty
+ * box (min > max), which never overlaps anything.
+ */
+typedef struct {
+    double min_x[RTREE2_FANOUT], min_y[RTREE2_FANOUT];
+    double max_x[RTREE2_FANOUT], max_y[RTREE2_FANOUT];
+    int child[RTREE2_FANOUT];   // Object index (in leaves) or node index.
+    int count;                  // Number of children in use.
+    int leaf;                   // True if the children are objects.
+} RTree2Node;
+
+typedef struct {
+    int count;          // Number of objects
+    int n_nodes;        // Number of nodes
+    int root;           // Index of the root node, or -1 if there is none.
+    RTree2Node *node;
+} RTree2;
+
+/*
+ * Return the bounding box of circle <c>.
+ */
+Box2 g2CircleBox(Circle2 c);
+
+/*
+ * Return the bounding box of the line segment from l.pv to l.pv + l.dv.
+ */
+Box2 g2SegmentBox(Line2 l);
+
+/*
+ * Return the bounding box of polygon <poly>.
+ */
+Box2 g2PolygonBox2(const Polygon2 *poly);
+
+/*
+ * Return true if boxes <a> and <b> overlap (or touch).
+ */
+bool g2BoxOverlap(Box2 a, Box2 b);
+
+/*
+ * Return the distance from point <p> to box <b>, which is 0 if <p> is inside
+ * <b>.
+ */
+double g2BoxDistance(Box2 b, Vector2 p);
+
+/*
+ * Create a grid with square cells of size <cell_size> covering <bounds>, and
+ * add the <count> objects whose bounding boxes are in <box>. Objects that
+ * extend beyond <bounds> are added to the cells on its edge.
+ */
+Grid2 *g2GridCreate(Box2 bounds, double cell_size, const Box2 *box, int count);
+
+/*
+ * Put the indexes of the objects whose bounding boxes overlap <query> into
+ * <obj>, which has room for <max_obj> entries. Each object is reported once.
+ * Returns the number of objects found, which may be more than <max_obj> (in
+ * which case only the first <max_obj> are put in <obj>).
+ */
+int g2GridQuery(const Grid2 *grid, Box2 query, int *obj, int max_obj);
+
+/*
+ * Call <hit> for each combination of a query box in <query> (there are <n>)
+ * and an object whose bounding box overlaps it, passing in the index of the
+ * query box, the index of the object and <udata>.
+ */
+void g2GridQueryMany(const Grid2 *grid, const Box2 *query, size_t n,
+        void (*hit)(size_t query, int obj, void *udata), void *udata);
+
+/*
+ * Return the index of the object nearest to point <p>, or -1 if the grid is
+ * empty, and put its distance in <dist> (if it isn't NULL). The distance to an
+ * object is found by calling <distance> with the index of the object, <p> and
+ * <udata>. It may not return less than the distance to the object's bounding
+ * box. If <distance> is NULL, the distance to the bounding box is used.
+ */
+int g2GridNearest(const Grid2 *grid, Vector2 p,
+        double (*distance)(int obj, Vector2 p, void *udata), void *udata,
+        double *dist);
+
+/*
+ * Destroy grid <grid>.
+ */
+void g2GridDestroy(Grid2 *grid);
+
+/*
+ * Create an R-tree for the <count> objects whose bounding boxes are in <box>.
+ */
+RTree2 *g2TreeCreate(const Box2 *box, int count);
+
+/*
+ * Put the indexes of the objects whose bounding boxes overlap <query> into
+ * <obj>, which has room for <max_obj> entries. Returns the number of objects
+ * found, which may be more than <max_obj> (in which case only the first
+ * <max_obj> are put in <obj>).
+ */
+int g2TreeQuery(const RTree2 *tree, Box2 query, int *obj, int max_obj);
+
+/*
+ * Call <hit> for each combination of a query box in <query> (there are <n>)
+ * and an object whose bounding box overlaps it, passing in the index of the
+ * query box, the index of the object and <udata>.
+ */
+void g2TreeQueryMany(const RTree2 *tree, const Box2 *query, size_t n,
+        void (*hit)(size_t query, int obj, void *udata), void *udata);
+
+/*
+ * Return the index of the object nearest to point <p>, or -1 if the tree is
+ * empty, and put its distance in <dist> (if it isn't NULL). The distance to an
+ * object is found by calling <distance> with the index of the object, <p> and
+ * <udata>. It may not return less than the distance to the object's bounding
+ * box. If <distance> is NULL, the distance to the bounding box is used.
+ */
+int g2TreeNearest(const RTree2 *tree, Vector2 p,
+        double (*distance)(int obj, Vector2 p, void *udata), void *udata,
+        double *dist);
+
+/*
+ * Destroy R-tree <tree>.
+ */
+void g2TreeDestroy(RTree2 *tree);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,325 @@
+/*
+ * spsc.c: Bounded lock-free queue for one producer and one consumer thread.
+ *
+ * spsc.c is part of libjvs.
+ *
+ * Copyright: (c) 2026 Jacco van Schaik (jacco@jaccovanschaik.net)
+ * Created:   2026-10-18
+ * Version:   $Id$
+ *
+ * This software is distributed under the terms of the MIT license. See
+ * http://www.opensource.org/licenses/mit-license.php for details.
+ */
+
+#include <stdlib.h>
+
+#include "spsc.h"
+
+/*
+ * Initialize <ring> to hold at least <capacity> items. The capacity is
+ * rounded up to a power of 2.
+ */
+void spscInit(SpscRing *ring, size_t capacity)
+{
+    size_t size = 1;
+
+    while (size < capacity) size <<= 1;
+
+    memset(ring, 0, sizeof(SpscRing));
+
+    ring->mask = size - 1;
+    ring->slot = calloc(size, sizeof(void *));
+}
+
+/*
+ * Create a ring that holds at least <capacity> items. The capacity is rounded
+ * up to a power of 2.
+ */
+SpscRing *spscCreate(size_t capacity)
+{
+    SpscRing *ring = malloc(sizeof(SpscRing));
+
+    spscInit(ring, capacity);
+
+    return ring;
+}
+
+/*
+ * Return the number of items that <ring> can hold.
+ */
+size_t spscCapacity(const SpscRing *ring)
+{
+    return ring->mask + 1;
+}
+
+/*
+ * Return the number of items in <ring>. If this is called while the other
+ * threads are pushing or popping, the answer may be out of date immediately.
+ */
+size_t spscCount(const SpscRing *ring)
+{
+    size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    return tail - head;
+}
+
+/*
+ * Return the number of free slots in <ring>, as seen by the producer, which
+ * is about to add items at <tail>. At least <wanted> slots are needed, so if
+ * the cached head says there aren't enough, the real head is fetched.
+ */
+static size_t spsc_room(SpscRing *ring, size_t tail, size_t wanted)
+{
+    size_t room = ring->mask + 1 - (tail - ring->head_cache);
+
+    if (room < wanted) {
+        ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+        room = ring->mask + 1 - (tail - ring->head_cache);
+    }
+
+    return room;
+}
+
+/*
+ * Return the number of items in <ring>, as seen by the consumer, which is
+ * about to remove items at <head>. At least <wanted> items are needed, so if
+ * the cached tail says there aren't enough, the real tail is fetched.
+ */
+static size_t spsc_available(SpscRing *ring, size_t head, size_t wanted)
+{
+    size_t available = ring->tail_cache - head;
+
+    if (available < wanted) {
+        ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+        available = ring->tail_cache - head;
+    }
+
+    return available;
+}
+
+/*
+ * Add <item>, which must not be NULL, to <ring>. Returns true on success or
+ * false if the ring is full. Must only be called by the producer.
+ */
+bool spscPush(SpscRing *ring, void *item)
+{
+    size_t tail = ring->tail;
+
+    if (spsc_room(ring, tail, 1) == 0) return false;
+
+    ring->slot[tail & ring->mask] = item;
+
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+/*
+ * Add as many of the <count> items in <item> to <ring> as will fit, in order.
+ * Returns the number of items that were added. Must only be called by the
+ * producer.
+ */
+size_t spscPushBatch(SpscRing *ring, void *const *item, size_t count)
+{
+    size_t i, tail = ring->tail;
+
+    size_t room = spsc_room(ring, tail, count);
+
+    count = MIN(count, room);
+
+    for (i = 0; i < count; i++) {
+        ring->slot[(tail + i) & ring->mask] = item[i];
+    }
+
+    if (count > 0) {
+        __atomic_store_n(&ring->tail, tail + count, __ATOMIC_RELEASE);
+    }
+
+    return count;
+}
+
+/*
+ * Remove the oldest item from <ring> and return it, or return NULL if the ring
+ * is empty. Must only be called by the consumer.
+ */
+void *spscPop(SpscRing *ring)
+{
+    size_t head = ring->head;
+
+    if (spsc_available(ring, head, 1) == 0) return NULL;
+
+    void *item = ring->slot[head & ring->mask];
+
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+    return item;
+}
+
+/*
+ * Remove up to <max> items from <ring> and store them in <item>, oldest first.
+ * Returns the number of items that were removed. Must only be called by the
+ * consumer.
+ */
+size_t spscPopBatch(SpscRing *ring, void **item, size_t max)
+{
+    size_t i, head = ring->head;
+
+    size_t available = spsc_available(ring, head, max);
+
+    size_t count = MIN(max, available);
+
+    for (i = 0; i < count; i++) {
+        item[i] = ring->slot[(head + i) & ring->mask];
+    }
+
+    if (count > 0) {
+        __atomic_store_n(&ring->head, head + count, __ATOMIC_RELEASE);
+    }
+
+    return count;
+}
+
+/*
+ * Clear <ring>, freeing the memory used for its slots but not the items that
+ * may still be in it.
+ */
+void spscClear(SpscRing *ring)
+{
+    free(ring->slot);
+
+    memset(ring, 0, sizeof(SpscRing));
+}
+
+/*
+ * Clear <ring> and then free it.
+ */
+void spscDestroy(SpscRing *ring)
+{
+    spscClear(ring);
+
+    free(ring);
+}
+
+#ifdef TEST
+#include <stdint.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "utils.h"
+
+static int errors = 0;
+
+#define ITEMS 1000000
+
+static void *producer(void *arg)
+{
+    SpscRing *ring = arg;
+
+    void *batch[7];
+
+    uintptr_t next = 1;
+
+    while (next <= ITEMS) {
+        size_t i, n = 0;
+
+        /* Alternate single and batch pushes. */
+
+        if (next % 2) {
+            n = spscPush(ring, (void *) next);
+        }
+        else {
+            n = MIN(7, ITEMS + 1 - next);
+
+            for (i = 0; i < n; i++) batch[i] = (void *) (next + i);
+
+            n = spscPushBatch(ring, batch, n);
+        }
+
+        /* Let the consumer run, in case we're on a single CPU. */
+
+        if (n == 0) sched_yield();
+
+        next += n;
+    }
+
+    return NULL;
+}
+
+int main(void)
+{
+    size_t i;
+    void *item[16];
+
+    SpscRing *ring = spscCreate(5);
+
+    make_sure_that(spscCapacity(ring) == 8);
+    make_sure_that(spscCount(ring) == 0);
+    make_sure_that(spscPop(ring) == NULL);
+
+    /* Fill it up, wrapping around the end of the slots. */
+
+    for (i = 0; i < 6; i++) {
+        make_sure_that(spscPush(ring, (void *) (i + 1)));
+    }
+
+    for (i = 0; i < 6; i++) {
+        make_sure_that(spscPop(ring) == (void *) (i + 1));
+    }
+
+    for (i = 0; i < 16; i++) item[i] = (void *) (i + 100);
+
+    make_sure_that(spscPushBatch(ring, item, 16) == 8);
+    make_sure_that(spscCount(ring) == 8);
+    make_sure_that(!spscPush(ring, (void *) 1));
+    make_sure_that(spscPushBatch(ring, item, 16) == 0);
+
+    make_sure_that(spscPopBatch(ring, item, 3) == 3);
+    make_sure_that(item[0] == (void *) 100);
+    make_sure_that(item[2] == (void *) 102);
+
+    make_sure_that(spscPopBatch(ring, item, 16) == 5);
+    make_sure_that(item[0] == (void *) 103);
+    make_sure_that(item[4] == (void *) 107);
+
+    make_sure_that(spscPopBatch(ring, item, 16) == 0);
+
+    spscDestroy(ring);
+
+    /* A producer and a consumer thread. */
+
+    pthread_t thread;
+
+    uintptr_t expected = 1;
+
+    ring = spscCreate(64);
+
+    pthread_create(&thread, NULL, producer, ring);
+
+    while (expected <= ITEMS) {
+        size_t n = spscPopBatch(ring, item, 1 + expected % 16);
+
+        if (n == 0) n = (item[0] = spscPop(ring)) != NULL;
+
+        if (n == 0) sched_yield();
+
+        for (i = 0; i < n; i++) {
+            if (item[i] != (void *) expected) break;
+
+            expected++;
+        }
+
+        if (i < n) break;
+    }
+
+    make_sure_that(expected == ITEMS + 1);
+
+    pthread_join(thread, NULL);
+
+    spscDestroy(ring);
+
+    return errors;
+}
+#endif
@@ -0,0 +1,115 @@
+#ifndef SPSC_H
+#define SPSC_H
+
+/*
+ * spsc.h: Bounded lock-free queue for one producer and one consumer thread.
+ *
+ * An SpscRing holds pointers in a ring buffer whose size is a power of 2. The
+ * producer only writes the tail index and the consumer only writes the head
+ * index, and these are kept in separate cache lines. Each side also keeps a
+ * private copy of the other side's index, and only reads the real one (which
+ * means fetching the other thread's cache line) when that copy says the ring
+ * is full or empty. The batch functions move many items for the price of a
+ * single index update.
+ *
+ * Only one thread may push and only one thread may pop at any time. Nothing
+ * ever blocks: a push on a full ring or a pop from an empty ring simply fails.
+ * NULL pointers can't be queued, since a pop returns NULL if there is nothing
+ * to pop.
+ *
+ * spsc.h is part of libjvs.
+ *
+ * Copyright: (c) 2026 Jacco van Schaik (jacco@jaccovanschaik.net)
+ * Created:   2026-10-18
+ * Version:   $Id$
+ *
+ * This software is distributed under the terms of the MIT license. See
+ * http://www.opensource.org/licenses/mit-license.php for details.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "defs.h"
+
+typedef struct {
+    size_t tail;                // Written by the producer...
+    size_t head_cache;          // ... which also keeps this copy of <head>.
+    char pad1[CACHE_LINE_SIZE - 2 * sizeof(size_t)];
+    size_t head;                // Written by the consumer...
+    size_t tail_cache;          // ... which also keeps this copy of <tail>.
+    char pad2[CACHE_LINE_SIZE - 2 * sizeof(size_t)];
+    size_t mask;                // Capacity - 1.
+    void **slot;
+    char pad3[CACHE_LINE_SIZE - sizeof(size_t) - sizeof(void **)];
+} SpscRing;
+
+/*
+ * Initialize <ring> to hold at least <capacity> items. The capacity is
+ * rounded up to a power of 2.
+ */
+void spscInit(SpscRing *ring, size_t capacity);
+
+/*
+ * Create a ring that holds at least <capacity> items. The capacity is rounded
+ * up to a power of 2.
+ */
+SpscRing *spscCreate(size_t capacity);
+
+/*
+ * Return the number of items that <ring> can hold.
+ */
+size_t spscCapacity(const SpscRing *ring);
+
+/*
+ * Return the number of items in <ring>. If this is called while the other
+ * threads are pushing or popping, the answer may be out of date immediately.
+ */
+size_t spscCount(const SpscRing *ring);
+
+/*
+ * Add <item>, which must not be NULL, to <ring>. Returns true on success or
+ * false if the ring is full. Must only be called by the producer.
+ */
+bool spscPush(SpscRing *ring, void *item);
+
+/*
+ * Add as many of the <count> items in <item> to <ring> as will fit, in order.
+ * Returns the number of items that were added. Must only be called by the
+ * producer.
+ */
+size_t spscPushBatch(SpscRing *ring, void *const *item, size_t count);
+
+/*
+ * Remove the oldest item from <ring> and return it, or return NULL if the ring
+ * is empty. Must only be called by the consumer.
+ */
+void *spscPop(SpscRing *ring);
+
+/*
+ * Remove up to <max> items from <ring> and store them in <item>, oldest first.
+ * Returns the number of items that were removed. Must only be called by the
+ * consumer.
+ */
+size_t spscPopBatch(SpscRing *ring, void **item, size_t max);
+
+/*
+ * Clear <ring>, freeing the memory used for its slots but not the items that
+ * may still be in it.
+ */
+void spscClear(SpscRing *ring);
+
+/*
+ * Clear <ring> and then free it.
+ */
+void spscDestroy(SpscRing *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -20,18 +20,104 @@
 #include <netdb.h>
 #include <errno.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <netinet/tcp.h>
 
 #include "net.h"
 #include "tcp.h"
 #include "defs.h"
+#include "utils.h"
 #include "debug.h"
 
 static struct linger linger = { 1, 5 }; /* 5 second linger */
 
+static TcpOptions tcp_options;          /* Set using tcpSetOptions(). */
+
+/* The stages in the life of a socket at which options are applied. */
+
+typedef enum {
+    TCP_STAGE_LISTEN,                   /* Before listen(). */
+    TCP_STAGE_CONNECT,                  /* Before connect(). */
+    TCP_STAGE_CONNECTED                 /* After connect() or accept(). */
+} TcpStage;
+
+/*
+ * Set option <name> at level <level> to <value> on socket <sd>. Returns 0 on
+ * success or -1 on failure.
+ */
+static int tcp_set(int sd, int level, int name, const char *text, int value)
+{
+    if (setsockopt(sd, level, name, &value, sizeof(value)) != 0) {
+        P dbgError(stderr, "setsockopt(%s) failed", text);
+        return -1;
+    }
+
+    return 0;
+}
+
 /*
- * Create a socket
+ * Apply those options in <opts> that make sense at stage <stage> to socket
+ * <sd>. Options that aren't supported on this platform are ignored. Returns
+ * 0 if all options were set successfully, or -1 if at least one failed.
  */
-static int tcp_socket(int family)
+static int tcp_apply(int sd, const TcpOptions *opts, TcpStage stage)
+{
+    int r = 0;
+
+    /* Buffer sizes must be set before connect() or listen() to have an
+     * effect on the TCP window scale. */
+
+    if (opts->sndbuf > 0) {
+        r |= tcp_set(sd, SOL_SOCKET, SO_SNDBUF, "SNDBUF", opts->sndbuf);
+    }
+
+    if (opts->rcvbuf > 0) {
+        r |= tcp_set(sd, SOL_SOCKET, SO_RCVBUF, "RCVBUF", opts->rcvbuf);
+    }
+
+#ifdef SO_BUSY_POLL
+    if (opts->busy_poll > 0) {
+        r |= tcp_set(sd, SOL_SOCKET, SO_BUSY_POLL, "BUSY_POLL",
+                opts->busy_poll);
+    }
+#endif
+
+    if (opts->nodelay && stage != TCP_STAGE_CONNECT) {
+        r |= tcp_set(sd, IPPROTO_TCP, TCP_NODELAY, "NODELAY", 1);
+    }
+
+#ifdef TCP_QUICKACK
+    if (opts->quickack && stage == TCP_STAGE_CONNECTED) {
+        r |= tcp_set(sd, IPPROTO_TCP, TCP_QUICKACK, "QUICKACK", 1);
+    }
+#endif
+
+#ifdef TCP_FASTOPEN
+    if (opts->fastopen > 0 && stage == TCP_STAGE_LISTEN) {
+        r |= tcp_set(sd, IPPROTO_TCP, TCP_FASTOPEN, "FASTOPEN",
+                opts->fastopen);
+    }
+#endif
+
+#ifdef TCP_FASTOPEN_CONNECT
+    if (opts->fastopen_connect && stage == TCP_STAGE_CONNECT) {
+        r |= tcp_set(sd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT,
+                "FASTOPEN_CONNECT", 1);
+    }
+#endif
+
+    return r;
+}
+
+/*
+ * Create a socket, and apply the options set with tcpSetOptions() that are
+ * appropriate for <stage>.
+ */
+static int tcp_socket(int family, TcpStage stage)
 {
     int sd;                            /* socket descriptor */
 
@@ -45,6 +131,9 @@ static int tcp_socket(int family)
         close(sd);
         sd = -1;
     }
+    else {
+        tcp_apply(sd, &tcp_options, stage);
+    }
 
     return sd;
 }
@@ -58,44 +147,30 @@ static int tcp_socket(int family)
  */
 static int tcp_listen(const char *host, uint16_t port, int family)
 {
-    struct addrinfo *info = NULL, *first_info = NULL;
-    struct addrinfo  hint = {
-        .ai_family   = family,
-        .ai_socktype = SOCK_STREAM,
-        .ai_flags    = AI_PASSIVE
-    };
+    NetAddr addr[NET_MAX_ADDR];
 
-    char port_str[6];
-
-    snprintf(port_str, sizeof(port_str), "%hu", port);
-
-    int r;
+    int i, r, count;
 
 #if 0
     fprintf(stderr, "%s: host \"%s\", port %hu, family %d\n",
             __func__, host, port, family);
 #endif
 
-    if ((r = getaddrinfo(host, port_str, &hint, &first_info)) != 0) {
+    count = netResolve(host, port, family, SOCK_STREAM, true, addr, &r);
+
+    if (count < 0) {
         dbgPrint(stderr, "getaddrinfo for %s:%hu failed: %s",
                 host, port, gai_strerror(r));
         return -1;
     }
 
-#if 0
-    for (info = first_info; info != NULL; info = info->ai_next) {
-        fprintf(stderr, "flags: %d, ", info->ai_flags);
-        fprintf(stderr, "family: %d, ", info->ai_family);
-        fprintf(stderr, "socktype: %d, ", info->ai_socktype);
-        fprintf(stderr, "protocol: %d\n", info->ai_protocol);
-    }
-#endif
-
     int lsd = -1;
     int one =  1;
 
-    for (info = first_info; lsd == -1 && info != NULL; info = info->ai_next) {
-        if ((lsd = tcp_socket(info->ai_family)) == -1) {
+    for (i = 0; lsd == -1 && i < count; i++) {
+        const struct sockaddr *sa = (const struct sockaddr *) &addr[i].addr;
+
+        if ((lsd = tcp_socket(sa->sa_family, TCP_STAGE_LISTEN)) == -1) {
             P dbgError(stderr, "tcp_socket() failed");
         }
 #if 0
@@ -114,7 +189,7 @@ static int tcp_listen(const char *host, uint16_t port, int family)
             close(lsd);
             lsd = -1;
         }
-        else if (bind(lsd, info->ai_addr, info->ai_addrlen) < 0) {
+        else if (bind(lsd, sa, addr[i].len) < 0) {
             P dbgAbort(stderr, "bind() failed");
             close(lsd);
             lsd = -1;
@@ -126,50 +201,22 @@ static int tcp_listen(const char *host, uint16_t port, int family)
         }
     }
 
-    freeaddrinfo(first_info);
-
     return lsd;
 }
 
 /*
- * Make an IPv4 connection to <port> on <host> and return the corresponding
- * file descriptor.
+ * Make a TCP connection to the first of the <count> addresses in <addr> that
+ * accepts it, and return the corresponding file descriptor.
  */
-static int tcp_connect(const char *host, uint16_t port, int family)
+static int tcp_connect_addr(const NetAddr *addr, int count)
 {
-    int r, sd = -1;
-
-    char port_as_text[6];
-    struct addrinfo *first_info, *info;
-
-    struct addrinfo hints = {
-        .ai_family = family,
-        .ai_socktype = SOCK_STREAM
-    };
+    int i, r = 0, sd = -1;
 
-    snprintf(port_as_text, sizeof(port_as_text), "%hu", port);
+    for (i = 0; sd == -1 && i < count; i++) {
+        const struct sockaddr *sa = (const struct sockaddr *) &addr[i].addr;
 
-    if ((r = getaddrinfo(host, port_as_text, &hints, &first_info)) != 0) {
-        dbgPrint(stderr, "%s: getaddrinfo failed: %s",
-                __func__, gai_strerror(r));
-
-        return -1;
-    }
-
-#if 0
-    fprintf(stderr, "%s(\"%s\", %hu, %d):\n", __func__, host, port, family);
-
-    for (info = first_info; info != NULL; info = info->ai_next) {
-        fprintf(stderr, "flags: %d, ", info->ai_flags);
-        fprintf(stderr, "family: %d, ", info->ai_family);
-        fprintf(stderr, "socktype: %d, ", info->ai_socktype);
-        fprintf(stderr, "protocol: %d\n", info->ai_protocol);
-    }
-#endif
-
-    for (info = first_info; sd == -1 && info != NULL; info = info->ai_next) {
-        if ((sd = tcp_socket(info->ai_family)) == -1 ||
-            (r = connect(sd, info->ai_addr, info->ai_addrlen)) == -1)
+        if ((sd = tcp_socket(sa->sa_family, TCP_STAGE_CONNECT)) == -1 ||
+            (r = connect(sd, sa, addr[i].len)) == -1)
         {
             if (sd != -1) {
                 close(sd);
@@ -178,20 +225,42 @@ static int tcp_connect(const char *host, uint16_t port, int family)
         }
     }
 
-    freeaddrinfo(first_info);
-
-    if (sd == -1) {
+    if (sd == -1 && r == 0) {
         P dbgError(stderr, "socket() failed");
         return -1;
     }
-    else if (r == -1) {
+    else if (sd == -1) {
         P dbgError(stderr, "connect() failed");
         return -1;
     }
 
+    tcp_apply(sd, &tcp_options, TCP_STAGE_CONNECTED);
+
     return sd;
 }
 
+/*
+ * Make a connection to <port> on <host>, using address family <family>, and
+ * return the corresponding file descriptor.
+ */
+static int tcp_connect(const char *host, uint16_t port, int family)
+{
+    NetAddr addr[NET_MAX_ADDR];
+
+    int r, count;
+
+    count = netResolve(host, port, family, SOCK_STREAM, false, addr, &r);
+
+    if (count < 0) {
+        dbgPrint(stderr, "%s: getaddrinfo failed: %s",
+                __func__, gai_strerror(r));
+
+        return -1;
+    }
+
+    return tcp_connect_addr(addr, count);
+}
+
 /*
  * Open an IPv4 listen port on <host> and <port> and return the corresponding
  * file descriptor. If <host> is NULL the socket will listen on all
@@ -248,15 +317,27 @@ int tcpListen(const char *host, uint16_t port)
 /*
  * Make a TCP connection to <port> on <host> and return the corresponding file
  * descriptor. The connection will be IPv4 or IPv6 depending on the first
- * usable addrinfo returned by getaddrinfo.
+ * usable addrinfo returned by getaddrinfo. The addresses of <host> are cached
+ * (see netResolve()), so reconnecting doesn't do a new lookup every time.
  */
 int tcpConnect(const char *host, uint16_t port)
 {
     return tcp_connect(host, port, AF_UNSPEC);
 }
 
+/*
+ * Make a TCP connection to the first of the <count> addresses in <addr> (as
+ * returned by netResolve() or netResolverForward()) that accepts it, and
+ * return the corresponding file descriptor. No name lookups are done.
+ */
+int tcpConnectAddr(const NetAddr *addr, int count)
+{
+    return tcp_connect_addr(addr, count);
+}
+
 /*
  * Accept an incoming (IPv4 or IPv6) connection request on a listen socket.
+ * The options set using tcpSetOptions() are applied to the new socket.
  */
 int tcpAccept(int sd)
 {
@@ -269,33 +350,137 @@ int tcpAccept(int sd)
     if (csd == -1) {
         P dbgError(stderr, "accept failed");
     }
+    else {
+        tcp_apply(csd, &tcp_options, TCP_STAGE_CONNECTED);
+    }
 
     return csd;
 }
 
 /*
- * Read from <fd> until <buf> contains exactly <len> bytes.
+ * Set the options that tcpListen(), tcpConnect(), tcpAccept() and their
+ * variants apply to every socket they create to <opts>. Pass NULL to go back
+ * to the default, which is not to change any options. Not thread-safe, so
+ * this should be called before any other threads use these functions.
  */
-int tcpRead(int fd, void *buf, int len)
+void tcpSetOptions(const TcpOptions *opts)
 {
-    int res, n = 0;
+    if (opts == NULL)
+        memset(&tcp_options, 0, sizeof(tcp_options));
+    else
+        tcp_options = *opts;
+}
 
-    while (1) {
-        if ((res = read(fd, (char *) buf + n, len - n)) == 0) {
-            break;
+/*
+ * Return the options set using tcpSetOptions().
+ */
+const TcpOptions *tcpGetOptions(void)
+{
+    return &tcp_options;
+}
+
+/*
+ * Apply the options in <opts> to socket <sd>. Options that only make sense at
+ * a certain stage (TCP_FASTOPEN on listen sockets, TCP_FASTOPEN_CONNECT before
+ * connect() and TCP_QUICKACK after connect() or accept()) are only applied at
+ * that stage. Sockets that are neither listening nor connected are assumed to
+ * be about to call connect(). Options that aren't supported by the platform
+ * are ignored. Returns 0 if all options were set successfully or -1
+ * otherwise, but the socket can be used in either case.
+ */
+int tcpApplyOptions(int sd, const TcpOptions *opts)
+{
+    struct sockaddr_storage peer;
+    socklen_t len;
+
+    int listening = 0;
+
+    len = sizeof(listening);
+
+    if (getsockopt(sd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len) == 0 &&
+        listening) {
+        return tcp_apply(sd, opts, TCP_STAGE_LISTEN);
+    }
+
+    len = sizeof(peer);
+
+    if (getpeername(sd, (struct sockaddr *) &peer, &len) == 0) {
+        return tcp_apply(sd, opts, TCP_STAGE_CONNECTED);
+    }
+    else {
+        return tcp_apply(sd, opts, TCP_STAGE_CONNECT);
+    }
+}
+
+/*
+ * Wait until <fd> is ready for <events> (POLLIN or POLLOUT), or until time
+ * <deadline> (as returned by dnow()) if it is not negative. Returns 1 if <fd>
+ * is ready, 0 if the deadline has passed (with errno set to ETIMEDOUT) or -1
+ * if an error occurred.
+ */
+static int tcp_wait(int fd, short events, double deadline)
+{
+    struct pollfd pfd = { .fd = fd, .events = events };
+
+    int r, timeout = -1;
+
+    do {
+        if (deadline >= 0) {
+            double remaining = deadline - dnow();
+
+            if (remaining <= 0) {
+                errno = ETIMEDOUT;
+                return 0;
+            }
+
+            timeout = remaining < INT_MAX / 1000.0 ?
+                ceil(1000 * remaining) : INT_MAX;
         }
-        else if (res > 0 && (n += res) == len) {
+    } while ((r = poll(&pfd, 1, timeout)) == -1 && errno == EINTR);
+
+    if (r == 0) {
+        errno = ETIMEDOUT;
+    }
+
+    /* POLLERR and POLLHUP also count as ready, so that the caller's next read
+     * or write reports what happened. */
+
+    return r;
+}
+
+/*
+ * Read from <fd> until <buf> contains exactly <len> bytes, end-of-file is
+ * reached, or <deadline> (if not negative) passes. If there is a deadline <fd>
+ * must be a socket, so that reads can be made non-blocking using
+ * MSG_DONTWAIT.
+ */
+static int tcp_read(int fd, void *buf, int len, double deadline)
+{
+    int res = 0, n = 0;
+
+    while (n < len) {
+        if (deadline < 0) {
+            res = read(fd, (char *) buf + n, len - n);
+        }
+        else {
+            res = recv(fd, (char *) buf + n, len - n, MSG_DONTWAIT);
+        }
+
+        if (res == 0) {
             break;
         }
-        else if (res < 0 && errno == EINTR) {
-            errno = 0;
-            continue;
+        else if (res > 0) {
+            n += res;
         }
-        else if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-            errno = 0;
-            usleep(100000);
+        else if (errno == EINTR) {
             continue;
         }
+        else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            break;
+        }
+        else if ((res = tcp_wait(fd, POLLIN, deadline)) != 1) {
+            break;
+        }
     }
 
     if (res == -1) {
@@ -308,15 +493,61 @@ int tcpRead(int fd, void *buf, int len)
 }
 
 /*
- * Write all of the <len> bytes in <buf> to <fd>.
+ * Write the <count> buffers in <iov> to <fd>, until they have all been
+ * written or <deadline> (if not negative) passes. <iov> is modified. As with
+ * tcp_read(), if there is a deadline <fd> must be a socket.
  */
-int tcpWrite(int fd, const void *buf, int len)
+static ssize_t tcp_write(int fd, struct iovec *iov, int count,
+        double deadline)
 {
-    int res, n = 0;
+    ssize_t res = 0, n = 0;
 
-    do {
-        res = write(fd, (const char *) buf + n, len - n);
-    } while ((res > 0 || errno == EINTR) && (n += res) < len);
+    struct msghdr msg = { 0 };
+
+    while (count > 0) {
+        if (iov->iov_len == 0) {
+            iov++;
+            count--;
+            continue;
+        }
+
+        if (deadline < 0) {
+            res = writev(fd, iov, MIN(count, IOV_MAX));
+        }
+        else {
+            msg.msg_iov = iov;
+            msg.msg_iovlen = MIN(count, IOV_MAX);
+
+            res = sendmsg(fd, &msg, MSG_DONTWAIT);
+        }
+
+        if (res > 0) {
+            n += res;
+
+            /* Skip the buffers that were written completely, then adjust the
+             * one that was written partially (if any). */
+
+            while (count > 0 && (size_t) res >= iov->iov_len) {
+                res -= iov->iov_len;
+                iov++;
+                count--;
+            }
+
+            if (count > 0) {
+                iov->iov_base = (char *) iov->iov_base + res;
+                iov->iov_len -= res;
+            }
+        }
+        else if (res == -1 && errno == EINTR) {
+            continue;
+        }
+        else if (res == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            break;
+        }
+        else if ((res = tcp_wait(fd, POLLOUT, deadline)) != 1) {
+            break;
+        }
+    }
 
     if (res == -1) {
         P dbgError(stderr, "write failed");
@@ -327,7 +558,80 @@ int tcpWrite(int fd, const void *buf, int len)
     }
 }
 
+/*
+ * Read from <fd> until <buf> contains exactly <len> bytes. If <fd> is
+ * non-blocking, this waits for more data to arrive using poll(). Returns the
+ * number of bytes read, which is less than <len> if end-of-file was reached,
+ * or -1 if an error occurred.
+ */
+int tcpRead(int fd, void *buf, int len)
+{
+    return tcp_read(fd, buf, len, -1);
+}
+
+/*
+ * Write all of the <len> bytes in <buf> to <fd>. If <fd> is non-blocking,
+ * this waits for room in the send buffer using poll(). Returns <len>, or -1
+ * if an error occurred.
+ */
+int tcpWrite(int fd, const void *buf, int len)
+{
+    struct iovec iov = { (void *) buf, len };
+
+    return tcp_write(fd, &iov, 1, -1);
+}
+
+/*
+ * Read from <fd> until <buf> contains exactly <len> bytes, as tcpRead() does,
+ * but give up at time <deadline> (as returned by dnow()), even if <fd> is a
+ * blocking socket. Returns the number of bytes read, which is less than <len>
+ * if end-of-file was reached or if the deadline passed (in which case errno is
+ * set to ETIMEDOUT), or -1 if an error occurred.
+ */
+int tcpReadTimeout(int fd, void *buf, int len, double deadline)
+{
+    return tcp_read(fd, buf, len, MAX(deadline, 0));
+}
+
+/*
+ * Write all of the <len> bytes in <buf> to <fd>, as tcpWrite() does, but give
+ * up at time <deadline> (as returned by dnow()), even if <fd> is a blocking
+ * socket. Returns the number of bytes written, which is less than <len> if the
+ * deadline passed (in which case errno is set to ETIMEDOUT), or -1 if an error
+ * occurred.
+ */
+int tcpWriteTimeout(int fd, const void *buf, int len, double deadline)
+{
+    struct iovec iov = { (void *) buf, len };
+
+    return tcp_write(fd, &iov, 1, MAX(deadline, 0));
+}
+
+/*
+ * Write all of the data in the <count> buffers in <iov> to <fd>, using as few
+ * writev() calls as possible. <iov> itself is not modified. Returns the total
+ * number of bytes written, or -1 if an error occurred.
+ */
+ssize_t tcpWriteV(int fd, const struct iovec *iov, int count)
+{
+    struct iovec local[16], *copy = local;
+
+    if (count > 16 && (copy = malloc(count * sizeof(struct iovec))) == NULL) {
+        return -1;
+    }
+
+    memcpy(copy, iov, count * sizeof(struct iovec));
+
+    ssize_t r = tcp_write(fd, copy, count, -1);
+
+    if (copy != local) free(copy);
+
+    return r;
+}
+
 #ifdef TEST
+#include <pthread.h>
+
 #include "net.h"
 
 static int errors = 0;
@@ -429,6 +733,210 @@ static int test_connection(const char *host, uint16_t port, int family)
     }
 }
 
+static void test_timeouts(void)
+{
+    char buf[16];
+    double t0;
+    int r;
+
+    if (make_connection(NULL, 0, AF_INET) != 0) {
+        errors++;
+        return;
+    }
+
+    /* Nothing to read: wait until the deadline. */
+
+    t0 = dnow();
+    r = tcpReadTimeout(client_fd, buf, sizeof(buf), t0 + 0.05);
+
+    make_sure_that(r == 0);
+    make_sure_that(errno == ETIMEDOUT);
+    make_sure_that(dnow() - t0 >= 0.05);
+
+    /* Some data, but not enough. */
+
+    make_sure_that(tcpWrite(server_fd, "abc", 3) == 3);
+
+    r = tcpReadTimeout(client_fd, buf, 6, dnow() + 0.05);
+
+    make_sure_that(r == 3);
+    make_sure_that(errno == ETIMEDOUT);
+    make_sure_that(strncmp(buf, "abc", 3) == 0);
+
+    /* Non-blocking socket, with the rest arriving a bit later. */
+
+    fcntl(client_fd, F_SETFL, O_NONBLOCK);
+
+    make_sure_that(tcpWrite(server_fd, "def", 3) == 3);
+    make_sure_that(tcpRead(client_fd, buf, 3) == 3);
+    make_sure_that(strncmp(buf, "def", 3) == 0);
+
+    /* Nobody reads, so the send and receive buffers fill up. */
+
+    size_t size = 64 << 20;
+    char *big = calloc(1, size);
+
+    t0 = dnow();
+    r = tcpWriteTimeout(server_fd, big, size, t0 + 0.1);
+
+    make_sure_that(r > 0 && r < (int) size);
+    make_sure_that(errno == ETIMEDOUT);
+    make_sure_that(dnow() - t0 >= 0.1);
+
+    free(big);
+
+    close(listen_fd);
+    close(client_fd);
+    close(server_fd);
+}
+
+typedef struct {
+    int fd;
+    char *buf;
+    int len, r;
+} Reader;
+
+static void *reader(void *arg)
+{
+    Reader *rd = arg;
+
+    rd->r = tcpRead(rd->fd, rd->buf, rd->len);
+
+    return NULL;
+}
+
+static void test_writev(void)
+{
+    int i;
+    ssize_t r;
+
+    struct iovec iov[3];
+    size_t size[3] = { 3, 5 << 20, 1 << 20 };
+    size_t total = size[0] + size[1] + size[2];
+
+    if (make_connection(NULL, 0, AF_INET) != 0) {
+        errors++;
+        return;
+    }
+
+    /* The second buffer is bigger than the socket buffers, so writev() will
+     * return after a partial write, probably in the middle of it. */
+
+    for (i = 0; i < 3; i++) {
+        iov[i].iov_base = malloc(size[i]);
+        iov[i].iov_len = size[i];
+
+        memset(iov[i].iov_base, 'a' + i, size[i]);
+    }
+
+    Reader rd = { client_fd, malloc(total), total, 0 };
+
+    pthread_t thread;
+
+    pthread_create(&thread, NULL, reader, &rd);
+
+    r = tcpWriteV(server_fd, iov, 3);
+
+    pthread_join(thread, NULL);
+
+    make_sure_that(r == (ssize_t) total);
+    make_sure_that(rd.r == (int) total);
+
+    /* The iovec array must be untouched. */
+
+    for (i = 0; i < 3; i++) {
+        make_sure_that(iov[i].iov_len == size[i]);
+    }
+
+    make_sure_that(memcmp(rd.buf, iov[0].iov_base, size[0]) == 0);
+    make_sure_that(memcmp(rd.buf + size[0], iov[1].iov_base, size[1]) == 0);
+    make_sure_that(memcmp(rd.buf + size[0] + size[1], iov[2].iov_base,
+                size[2]) == 0);
+
+    for (i = 0; i < 3; i++) {
+        free(iov[i].iov_base);
+    }
+
+    free(rd.buf);
+
+    close(listen_fd);
+    close(client_fd);
+    close(server_fd);
+}
+
+/*
+ * Return the value of integer socket option <name> at <level> on <fd>.
+ */
+static int get_option(int fd, int level, int name)
+{
+    int value = -1;
+    socklen_t len = sizeof(value);
+
+    getsockopt(fd, level, name, &value, &len);
+
+    return value;
+}
+
+static void test_options(void)
+{
+    TcpOptions latency = TCP_OPTIONS_LATENCY;
+    TcpOptions bulk = TCP_OPTIONS_BULK;
+    TcpOptions none = { 0 };
+
+    /* Busy polling may need privileges we don't have. */
+
+    latency.busy_poll = 0;
+
+    tcpSetOptions(&latency);
+
+    make_sure_that(tcpGetOptions()->nodelay == 1);
+
+    if (make_connection(NULL, 0, AF_INET) != 0) {
+        errors++;
+        return;
+    }
+
+    make_sure_that(get_option(client_fd, IPPROTO_TCP, TCP_NODELAY) != 0);
+    make_sure_that(get_option(server_fd, IPPROTO_TCP, TCP_NODELAY) != 0);
+
+#ifdef TCP_FASTOPEN_CONNECT
+    /* Deferred connects are only done when asked for explicitly. */
+
+    make_sure_that(get_option(client_fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT)
+            == 0);
+#endif
+
+    close(client_fd);
+    close(server_fd);
+    close(listen_fd);
+
+    tcpSetOptions(NULL);
+
+    make_sure_that(tcpGetOptions()->nodelay == 0);
+
+    if (make_connection(NULL, 0, AF_INET) != 0) {
+        errors++;
+        return;
+    }
+
+    make_sure_that(get_option(client_fd, IPPROTO_TCP, TCP_NODELAY) == 0);
+
+    /* The kernel doubles the requested size, but also caps it. */
+
+    int old_size = get_option(client_fd, SOL_SOCKET, SO_RCVBUF);
+
+    bulk.rcvbuf = bulk.sndbuf = old_size / 4;
+
+    make_sure_that(tcpApplyOptions(client_fd, &none) == 0);
+    make_sure_that(tcpApplyOptions(client_fd, &bulk) == 0);
+    make_sure_that(get_option(client_fd, SOL_SOCKET, SO_RCVBUF)
+            == old_size / 2);
+
+    close(client_fd);
+    close(server_fd);
+    close(listen_fd);
+}
+
 int main(void)
 {
     errors += test_connection(NULL, 54321, AF_UNSPEC);
@@ -448,6 +956,10 @@ int main(void)
     errors += test_connection(NULL, 0, AF_INET);
     errors += test_connection(NULL, 0, AF_INET6);
 
+    test_timeouts();
+    test_writev();
+    test_options();
+
     return errors;
 }
 
@@ -18,6 +18,47 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include <sys/uio.h>
+
+#include "net.h"
+
+/*
+ * Options for TCP sockets. A field that is 0 means "leave this option alone",
+ * so a zeroed TcpOptions struct changes nothing.
+ */
+typedef struct {
+    int nodelay;        // 1 to set TCP_NODELAY (disable Nagle's algorithm).
+    int quickack;       // 1 to set TCP_QUICKACK (no delayed ACKs).
+    int busy_poll;      // SO_BUSY_POLL time in microseconds.
+    int sndbuf;         // SO_SNDBUF size in bytes.
+    int rcvbuf;         // SO_RCVBUF size in bytes.
+    int fastopen;       // TCP_FASTOPEN queue length for listen sockets.
+    int fastopen_connect; // 1 to set TCP_FASTOPEN_CONNECT on clients.
+} TcpOptions;
+
+/* About <fastopen_connect>: with TCP_FASTOPEN_CONNECT, connect() returns 0
+ * straight away if the kernel has a Fast Open cookie for the server, and the
+ * handshake only happens (carrying the first data) on the first write. That
+ * means that connect() errors such as ECONNREFUSED are reported by the first
+ * write or read instead, and that tcpConnect() and tcpConnectAddr() can't
+ * fall back to the next address of a host when the first one doesn't answer.
+ * Only use it for servers that are known to be reachable. */
+
+/* Options for latency-sensitive traffic: small messages are sent and
+ * acknowledged immediately, and listen sockets accept TCP Fast Open. Client
+ * side Fast Open is not included (see above). Note that Linux may turn
+ * TCP_QUICKACK off again by itself, and that SO_BUSY_POLL values above
+ * net.core.busy_read need CAP_NET_ADMIN. */
+
+#define TCP_OPTIONS_LATENCY { \
+    .nodelay = 1, .quickack = 1, .busy_poll = 50, .fastopen = 256 \
+}
+
+/* Options for bulk transfers: large, fixed-size socket buffers. */
+
+#define TCP_OPTIONS_BULK { \
+    .sndbuf = 4 << 20, .rcvbuf = 4 << 20 \
+}
 
 /*
  * Open an IPv4 listen port on <host> and <port> and return the corresponding
@@ -60,25 +101,88 @@ int tcpListen(const char *host, uint16_t port);
 /*
  * Make a TCP connection to <port> on <host> and return the corresponding file
  * descriptor. The connection will be IPv4 or IPv6 depending on the first
- * usable addrinfo returned by getaddrinfo.
+ * usable addrinfo returned by getaddrinfo. The addresses of <host> are cached
+ * (see netResolve()), so reconnecting doesn't do a new lookup every time.
  */
 int tcpConnect(const char *host, uint16_t port);
 
+/*
+ * Make a TCP connection to the first of the <count> addresses in <addr> (as
+ * returned by netResolve() or netResolverForward()) that accepts it, and
+ * return the corresponding file descriptor. No name lookups are done.
+ */
+int tcpConnectAddr(const NetAddr *addr, int count);
+
 /*
  * Accept an incoming (IPv4 or IPv6) connection request on a listen socket.
+ * The options set using tcpSetOptions() are applied to the new socket.
  */
 int tcpAccept(int sd);
 
 /*
- * Read from <fd> until <buf> contains exactly <len> bytes.
+ * Set the options that tcpListen(), tcpConnect(), tcpAccept() and their
+ * variants apply to every socket they create to <opts>. Pass NULL to go back
+ * to the default, which is not to change any options. Not thread-safe, so
+ * this should be called before any other threads use these functions.
+ */
+void tcpSetOptions(const TcpOptions *opts);
+
+/*
+ * Return the options set using tcpSetOptions().
+ */
+const TcpOptions *tcpGetOptions(void);
+
+/*
+ * Apply the options in <opts> to socket <sd>. Options that only make sense at
+ * a certain stage (TCP_FASTOPEN on listen sockets, TCP_FASTOPEN_CONNECT before
+ * connect() and TCP_QUICKACK after connect() or accept()) are only applied at
+ * that stage. Sockets that are neither listening nor connected are assumed to
+ * be about to call connect(). Options that aren't supported by the platform
+ * are ignored. Returns 0 if all options were set successfully or -1
+ * otherwise, but the socket can be used in either case.
+ */
+int tcpApplyOptions(int sd, const TcpOptions *opts);
+
+/*
+ * Read from <fd> until <buf> contains exactly <len> bytes. If <fd> is
+ * non-blocking, this waits for more data to arrive using poll(). Returns the
+ * number of bytes read, which is less than <len> if end-of-file was reached,
+ * or -1 if an error occurred.
  */
 int tcpRead(int fd, void *buf, int len);
 
 /*
- * Write all of the <len> bytes in <buf> to <fd>.
+ * Write all of the <len> bytes in <buf> to <fd>. If <fd> is non-blocking,
+ * this waits for room in the send buffer using poll(). Returns <len>, or -1
+ * if an error occurred.
  */
 int tcpWrite(int fd, const void *buf, int len);
 
+/*
+ * Read from <fd> until <buf> contains exactly <len> bytes, as tcpRead() does,
+ * but give up at time <deadline> (as returned by dnow()), even if <fd> is a
+ * blocking socket. Returns the number of bytes read, which is less than <len>
+ * if end-of-file was reached or if the deadline passed (in which case errno is
+ * set to ETIMEDOUT), or -1 if an error occurred.
+ */
+int tcpReadTimeout(int fd, void *buf, int len, double deadline);
+
+/*
+ * Write all of the <len> bytes in <buf> to <fd>, as tcpWrite() does, but give
+ * up at time <deadline> (as returned by dnow()), even if <fd> is a blocking
+ * socket. Returns the number of bytes written, which is less than <len> if the
+ * deadline passed (in which case errno is set to ETIMEDOUT), or -1 if an error
+ * occurred.
+ */
+int tcpWriteTimeout(int fd, const void *buf, int len, double deadline);
+
+/*
+ * Write all of the data in the <count> buffers in <iov> to <fd>, using as few
+ * writev() calls as possible. <iov> itself is not modified. Returns the total
+ * number of bytes written, or -1 if an error occurred.
+ */
+ssize_t tcpWriteV(int fd, const struct iovec *iov, int count);
+
 #ifdef __cplusplus
 }
 #endif
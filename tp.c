@@ -0,0 +1,1080 @@
+/*
+ * tp.c: Thread pool with work-stealing.
+ *
+ * The deques follow "Correct and Efficient Work-Stealing for Weak Memory
+ * Models" by Lê, Pop, Cohen and Zappa Nardelli (PPoPP 2013), using GCC's
+ * __atomic builtins instead of C11 atomics.
+ *
+ * tp.c is part of libjvs.
+ *
+ * Copyright: (c) 2026 Jacco van Schaik (jacco@jaccovanschaik.net)
+ * Created:   2026-10-18
+ * Version:   $Id$
+ *
+ * This software is distributed under the terms of the MIT license. See
+ * http://www.opensource.org/licenses/mit-license.php for details.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "defs.h"
+#include "list.h"
+
+#include "tp.h"
+
+/*
+ * Initial number of slots in a deque. It grows as needed.
+ */
+#define TP_DEQUE_SIZE 256
+
+struct TpTask {
+    ListNode _node;             // For the shared queue.
+    void (*run)(ThreadPool *tp, TpTask *task);
+    void (*func)(void *arg);
+    void *arg;
+    int64_t pending;            // 1 until the task has finished.
+    int refs;                   // Handle and worker, for tpSubmit() tasks.
+};
+
+/*
+ * A parallel loop started by tpParallelFor().
+ */
+typedef struct {
+    void (*func)(size_t begin, size_t end, void *arg);
+    void *arg;
+    size_t grain;
+    int64_t pending;            // Number of unfinished chunks.
+} TP_Loop;
+
+/*
+ * A task that handles indexes <begin> to <end> of <loop>.
+ */
+typedef struct {
+    TpTask task;
+    TP_Loop *loop;
+    size_t begin, end;
+} TP_Chunk;
+
+/*
+ * A task submitted through a bridge.
+ */
+typedef struct {
+    TpTask task;
+    TpBridge *bridge;
+    void (*done)(TpBridge *bridge, void *arg, void *udata);
+    void *udata;
+} TP_Post;
+
+/*
+ * The slots of a deque. When a deque grows, its old array is kept (in
+ * <retired>) until the pool is destroyed, because thieves may still be
+ * reading from it.
+ */
+typedef struct TP_Array TP_Array;
+
+struct TP_Array {
+    TP_Array *retired;
+    int64_t size;               // Always a power of 2.
+    TpTask *task[];
+};
+
+typedef struct {
+    int64_t top;                // Thieves take tasks here...
+    char pad1[CACHE_LINE_SIZE - sizeof(int64_t)];
+    int64_t bottom;             // ... the owner pushes and takes them here.
+    char pad2[CACHE_LINE_SIZE - sizeof(int64_t)];
+    TP_Array *array;
+    ThreadPool *tp;
+    pthread_t thread;
+    uint32_t rng;               // State for choosing a victim to steal from.
+    int index;
+    char pad3[CACHE_LINE_SIZE];
+} TP_Worker;
+
+struct ThreadPool {
+    int n_workers;
+    TP_Worker *worker;
+
+    pthread_mutex_t queue_lock; // Protects <queue>.
+    List queue;                 // Tasks submitted from outside the pool.
+    int64_t queued;             // Number of tasks in <queue>.
+
+    pthread_mutex_t lock;       // Used with <wake>.
+    pthread_cond_t wake;
+    int sleepers;               // Threads waiting on <wake>.
+    uint64_t epoch;             // Incremented for every new task.
+    uint32_t next_victim;       // For threads that aren't workers.
+    bool stop;
+};
+
+struct TpBridge {
+    ThreadPool *tp;
+    Dispatcher *dis;
+    int pipe_fd[2];             // Wakes up the dispatcher when <done> fills.
+    pthread_mutex_t lock;       // Protects <done>.
+    List done;                  // Finished posts, waiting for the dispatcher.
+    int64_t running;            // Posts that haven't finished yet.
+    int pending;                // Posts that haven't been reported yet.
+};
+
+/*
+ * The worker that the current thread belongs to, if any.
+ */
+static __thread TP_Worker *tp_self = NULL;
+
+/*
+ * Return the worker of <tp> that is running the current thread, or NULL.
+ */
+static TP_Worker *tp_current(const ThreadPool *tp)
+{
+    return (tp_self != NULL && tp_self->tp == tp) ? tp_self : NULL;
+}
+
+/*
+ * Replace the array of <worker>'s deque, which contains the tasks from <top>
+ * to <bottom>, with one that is twice as large. Returns the new array.
+ */
+static TP_Array *tp_grow(TP_Worker *worker, TP_Array *old,
+        int64_t top, int64_t bottom)
+{
+    int64_t i;
+
+    TP_Array *new =
+        malloc(sizeof(TP_Array) + 2 * old->size * sizeof(TpTask *));
+
+    new->size = 2 * old->size;
+    new->retired = old;
+
+    for (i = top; i < bottom; i++) {
+        new->task[i & (new->size - 1)] = old->task[i & (old->size - 1)];
+    }
+
+    __atomic_store_n(&worker->array, new, __ATOMIC_RELEASE);
+
+    return new;
+}
+
+/*
+ * Push <task> onto the bottom of <worker>'s deque. Only called by <worker>.
+ */
+static void tp_push(TP_Worker *worker, TpTask *task)
+{
+    int64_t b = __atomic_load_n(&worker->bottom, __ATOMIC_RELAXED);
+    int64_t t = __atomic_load_n(&worker->top, __ATOMIC_ACQUIRE);
+
+    TP_Array *a = __atomic_load_n(&worker->array, __ATOMIC_RELAXED);
+
+    if (b - t > a->size - 1) a = tp_grow(worker, a, t, b);
+
+    /* The paper uses a relaxed store followed by a release fence. Making the
+     * store itself a release store costs nothing extra on x86, and lets tools
+     * like ThreadSanitizer (which don't understand fences) see why thieves can
+     * safely use the task. */
+
+    __atomic_store_n(&a->task[b & (a->size - 1)], task, __ATOMIC_RELEASE);
+    __atomic_store_n(&worker->bottom, b + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Take the task at the bottom of <worker>'s deque, or return NULL if it is
+ * empty. Only called by <worker>.
+ */
+static TpTask *tp_take(TP_Worker *worker)
+{
+    TpTask *task = NULL;
+
+    int64_t b = __atomic_load_n(&worker->bottom, __ATOMIC_RELAXED) - 1;
+
+    TP_Array *a = __atomic_load_n(&worker->array, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&worker->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    int64_t t = __atomic_load_n(&worker->top, __ATOMIC_RELAXED);
+
+    if (t > b) {
+        /* Empty. */
+
+        __atomic_store_n(&worker->bottom, b + 1, __ATOMIC_RELAXED);
+
+        return NULL;
+    }
+
+    task = __atomic_load_n(&a->task[b & (a->size - 1)], __ATOMIC_RELAXED);
+
+    if (t == b) {
+        /* The last task, so race thieves for it. */
+
+        if (!__atomic_compare_exchange_n(&worker->top, &t, t + 1, false,
+                    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            task = NULL;
+        }
+
+        __atomic_store_n(&worker->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+
+    return task;
+}
+
+/*
+ * Steal the task at the top of <worker>'s deque. Returns NULL if it is empty
+ * or if another thread got there first.
+ */
+static TpTask *tp_steal(TP_Worker *worker)
+{
+    int64_t t = __atomic_load_n(&worker->top, __ATOMIC_ACQUIRE);
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    int64_t b = __atomic_load_n(&worker->bottom, __ATOMIC_ACQUIRE);
+
+    if (t >= b) return NULL;
+
+    TP_Array *a = __atomic_load_n(&worker->array, __ATOMIC_ACQUIRE);
+
+    TpTask *task =
+        __atomic_load_n(&a->task[t & (a->size - 1)], __ATOMIC_ACQUIRE);
+
+    if (!__atomic_compare_exchange_n(&worker->top, &t, t + 1, false,
+                __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return NULL;
+    }
+
+    return task;
+}
+
+/*
+ * Take the first task from the shared queue of <tp>, or return NULL if there
+ * is none.
+ */
+static TpTask *tp_dequeue(ThreadPool *tp)
+{
+    TpTask *task = NULL;
+
+    if (__atomic_load_n(&tp->queued, __ATOMIC_ACQUIRE) == 0) return NULL;
+
+    pthread_mutex_lock(&tp->queue_lock);
+
+    if ((task = listRemoveHead(&tp->queue)) != NULL) {
+        __atomic_sub_fetch(&tp->queued, 1, __ATOMIC_RELEASE);
+    }
+
+    pthread_mutex_unlock(&tp->queue_lock);
+
+    return task;
+}
+
+/*
+ * Find a task to run for <self>, which is a worker of <tp> or NULL for other
+ * threads. Returns NULL if no task was found.
+ */
+static TpTask *tp_find(ThreadPool *tp, TP_Worker *self)
+{
+    int i;
+    uint32_t victim;
+    TpTask *task;
+
+    if (self != NULL && (task = tp_take(self)) != NULL) return task;
+
+    if ((task = tp_dequeue(tp)) != NULL) return task;
+
+    if (self != NULL) {
+        /* xorshift32 */
+
+        self->rng ^= self->rng << 13;
+        self->rng ^= self->rng >> 17;
+        self->rng ^= self->rng << 5;
+
+        victim = self->rng;
+    }
+    else {
+        victim = __atomic_fetch_add(&tp->next_victim, 1, __ATOMIC_RELAXED);
+    }
+
+    for (i = 0; i < tp->n_workers; i++) {
+        TP_Worker *worker = tp->worker + (victim + i) % tp->n_workers;
+
+        if (worker == self) continue;
+
+        if ((task = tp_steal(worker)) != NULL) return task;
+    }
+
+    return NULL;
+}
+
+/*
+ * Wake up a thread that is waiting for work in <tp>, if there is any.
+ */
+static void tp_wake(ThreadPool *tp)
+{
+    __atomic_add_fetch(&tp->epoch, 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&tp->sleepers, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&tp->lock);
+        pthread_cond_signal(&tp->wake);
+        pthread_mutex_unlock(&tp->lock);
+    }
+}
+
+/*
+ * Decrement <*pending>, and if it becomes 0 wake up the threads that may be
+ * waiting for that.
+ */
+static void tp_complete(ThreadPool *tp, int64_t *pending)
+{
+    if (__atomic_sub_fetch(pending, 1, __ATOMIC_SEQ_CST) == 0 &&
+        __atomic_load_n(&tp->sleepers, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&tp->lock);
+        pthread_cond_broadcast(&tp->wake);
+        pthread_mutex_unlock(&tp->lock);
+    }
+}
+
+/*
+ * Wait for new work in <tp>, unless its epoch has changed since it was
+ * <seen>, the pool is stopping, or <pending> (if not NULL) has become 0.
+ */
+static void tp_sleep(ThreadPool *tp, uint64_t seen, const int64_t *pending)
+{
+    pthread_mutex_lock(&tp->lock);
+
+    __atomic_add_fetch(&tp->sleepers, 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&tp->epoch, __ATOMIC_SEQ_CST) == seen &&
+        !__atomic_load_n(&tp->stop, __ATOMIC_SEQ_CST) &&
+        (pending == NULL || __atomic_load_n(pending, __ATOMIC_SEQ_CST) != 0)) {
+        pthread_cond_wait(&tp->wake, &tp->lock);
+    }
+
+    __atomic_sub_fetch(&tp->sleepers, 1, __ATOMIC_SEQ_CST);
+
+    pthread_mutex_unlock(&tp->lock);
+}
+
+/*
+ * Schedule <task> to be run by <tp>.
+ */
+static void tp_schedule(ThreadPool *tp, TpTask *task)
+{
+    TP_Worker *self = tp_current(tp);
+
+    if (self != NULL) {
+        tp_push(self, task);
+    }
+    else {
+        pthread_mutex_lock(&tp->queue_lock);
+
+        listAppendTail(&tp->queue, task);
+        __atomic_add_fetch(&tp->queued, 1, __ATOMIC_RELEASE);
+
+        pthread_mutex_unlock(&tp->queue_lock);
+    }
+
+    tp_wake(tp);
+}
+
+/*
+ * Wait until <*pending> becomes 0, running tasks from <tp> in the meantime.
+ */
+static void tp_wait_for(ThreadPool *tp, const int64_t *pending)
+{
+    TpTask *task;
+
+    TP_Worker *self = tp_current(tp);
+
+    while (__atomic_load_n(pending, __ATOMIC_ACQUIRE) != 0) {
+        uint64_t seen = __atomic_load_n(&tp->epoch, __ATOMIC_SEQ_CST);
+
+        if ((task = tp_find(tp, self)) != NULL) {
+            task->run(tp, task);
+        }
+        else {
+            tp_sleep(tp, seen, pending);
+        }
+    }
+}
+
+/*
+ * Release a reference to <task>, and free it if that was the last one.
+ */
+static void tp_release(TpTask *task)
+{
+    if (__atomic_sub_fetch(&task->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(task);
+    }
+}
+
+/*
+ * Run <task>, which was submitted using tpSubmit().
+ */
+static void tp_run_task(ThreadPool *tp, TpTask *task)
+{
+    task->func(task->arg);
+
+    tp_complete(tp, &task->pending);
+
+    tp_release(task);
+}
+
+/*
+ * Run <task>, which is a chunk of a parallel loop. Keeps splitting off the
+ * second half of its range as a new chunk, until the range is small enough
+ * to handle.
+ */
+static void tp_run_chunk(ThreadPool *tp, TpTask *task)
+{
+    TP_Chunk *chunk = (TP_Chunk *) task;
+    TP_Loop *loop = chunk->loop;
+
+    while (chunk->end - chunk->begin > loop->grain) {
+        size_t mid = chunk->begin + (chunk->end - chunk->begin) / 2;
+
+        TP_Chunk *second = calloc(1, sizeof(TP_Chunk));
+
+        second->task.run = tp_run_chunk;
+        second->loop = loop;
+        second->begin = mid;
+        second->end = chunk->end;
+
+        chunk->end = mid;
+
+        __atomic_add_fetch(&loop->pending, 1, __ATOMIC_RELAXED);
+
+        tp_schedule(tp, &second->task);
+    }
+
+    loop->func(chunk->begin, chunk->end, loop->arg);
+
+    tp_complete(tp, &loop->pending);
+
+    free(chunk);
+}
+
+/*
+ * Main function of worker thread <arg>.
+ */
+static void *tp_worker_main(void *arg)
+{
+    TP_Worker *worker = arg;
+    ThreadPool *tp = worker->tp;
+    TpTask *task;
+
+    tp_self = worker;
+
+    for (;;) {
+        uint64_t seen = __atomic_load_n(&tp->epoch, __ATOMIC_SEQ_CST);
+
+        if ((task = tp_find(tp, worker)) != NULL) {
+            task->run(tp, task);
+        }
+        else if (__atomic_load_n(&tp->stop, __ATOMIC_SEQ_CST)) {
+            break;
+        }
+        else {
+            tp_sleep(tp, seen, NULL);
+        }
+    }
+
+    tp_self = NULL;
+
+    return NULL;
+}
+
+/*
+ * Create a thread pool with <threads> worker threads. If <threads> is 0 or
+ * less, one thread per online CPU is started.
+ */
+ThreadPool *tpCreate(int threads)
+{
+    int i;
+
+    ThreadPool *tp = calloc(1, sizeof(ThreadPool));
+
+    if (threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    tp->n_workers = MAX(threads, 1);
+    tp->worker = calloc(tp->n_workers, sizeof(TP_Worker));
+
+    pthread_mutex_init(&tp->queue_lock, NULL);
+    pthread_mutex_init(&tp->lock, NULL);
+    pthread_cond_init(&tp->wake, NULL);
+
+    for (i = 0; i < tp->n_workers; i++) {
+        TP_Worker *worker = tp->worker + i;
+
+        worker->array = calloc(1,
+                sizeof(TP_Array) + TP_DEQUE_SIZE * sizeof(TpTask *));
+        worker->array->size = TP_DEQUE_SIZE;
+
+        worker->tp = tp;
+        worker->index = i;
+        worker->rng = 2654435761u * (i + 1);
+    }
+
+    /* Start the threads only when all deques exist, since they steal from
+     * each other. */
+
+    for (i = 0; i < tp->n_workers; i++) {
+        pthread_create(&tp->worker[i].thread, NULL,
+                tp_worker_main, tp->worker + i);
+    }
+
+    return tp;
+}
+
+/*
+ * Return the number of worker threads in <tp>.
+ */
+int tpThreads(const ThreadPool *tp)
+{
+    return tp->n_workers;
+}
+
+/*
+ * Return the index (0 .. tpThreads() - 1) of the worker thread of <tp> that
+ * calls this function, or -1 if it isn't called from one of them.
+ */
+int tpWorker(const ThreadPool *tp)
+{
+    TP_Worker *self = tp_current(tp);
+
+    return self ? self->index : -1;
+}
+
+/*
+ * Submit a task that calls <func> with <arg> to <tp>. This may be called from
+ * any thread. Returns a handle that must be passed to tpWait() or tpDetach().
+ */
+TpTask *tpSubmit(ThreadPool *tp, void (*func)(void *arg), void *arg)
+{
+    TpTask *task = calloc(1, sizeof(TpTask));
+
+    task->run = tp_run_task;
+    task->func = func;
+    task->arg = arg;
+    task->pending = 1;
+    task->refs = 2;
+
+    tp_schedule(tp, task);
+
+    return task;
+}
+
+/*
+ * Return true if <task> has finished, false otherwise.
+ */
+bool tpIsDone(const TpTask *task)
+{
+    return __atomic_load_n(&task->pending, __ATOMIC_ACQUIRE) == 0;
+}
+
+/*
+ * Wait until <task>, submitted to <tp>, has finished, running other tasks of
+ * <tp> in the meantime. <task> is freed and may not be used again.
+ */
+void tpWait(ThreadPool *tp, TpTask *task)
+{
+    tp_wait_for(tp, &task->pending);
+
+    tp_release(task);
+}
+
+/*
+ * Indicate that nobody will wait for <task>, so it can be freed as soon as it
+ * has finished. <task> may not be used again.
+ */
+void tpDetach(TpTask *task)
+{
+    tp_release(task);
+}
+
+/*
+ * Call <func> for consecutive ranges of indexes that together cover <begin>
+ * to (but not including) <end>, in parallel, using <tp>. Ranges are split in
+ * half until they're no longer than <grain> indexes, and <func> is called
+ * with the first index of a range, the index just past its end, and <arg>.
+ * Returns when all calls have returned. May be called from inside a task.
+ */
+void tpParallelFor(ThreadPool *tp, size_t begin, size_t end, size_t grain,
+        void (*func)(size_t begin, size_t end, void *arg), void *arg)
+{
+    if (end <= begin) return;
+
+    TP_Loop loop = { func, arg, MAX(grain, 1), 1 };
+
+    TP_Chunk *chunk = calloc(1, sizeof(TP_Chunk));
+
+    chunk->task.run = tp_run_chunk;
+    chunk->loop = &loop;
+    chunk->begin = begin;
+    chunk->end = end;
+
+    /* Run the first chunk here, which schedules the rest. */
+
+    tp_run_chunk(tp, &chunk->task);
+
+    tp_wait_for(tp, &loop.pending);
+}
+
+/*
+ * Wait until all tasks have finished, stop the worker threads and delete
+ * <tp>. All bridges for <tp> must have been destroyed before this is called.
+ */
+void tpDestroy(ThreadPool *tp)
+{
+    int i;
+
+    pthread_mutex_lock(&tp->lock);
+
+    __atomic_store_n(&tp->stop, true, __ATOMIC_SEQ_CST);
+
+    pthread_cond_broadcast(&tp->wake);
+
+    pthread_mutex_unlock(&tp->lock);
+
+    for (i = 0; i < tp->n_workers; i++) {
+        pthread_join(tp->worker[i].thread, NULL);
+    }
+
+    for (i = 0; i < tp->n_workers; i++) {
+        TP_Array *array = tp->worker[i].array;
+
+        while (array != NULL) {
+            TP_Array *retired = array->retired;
+
+            free(array);
+
+            array = retired;
+        }
+    }
+
+    pthread_mutex_destroy(&tp->queue_lock);
+    pthread_mutex_destroy(&tp->lock);
+    pthread_cond_destroy(&tp->wake);
+
+    free(tp->worker);
+    free(tp);
+}
+
+/*
+ * Run <task>, which was submitted through a bridge, put it on the bridge's
+ * done list and wake up the bridge's dispatcher.
+ */
+static void tp_run_post(ThreadPool *tp, TpTask *task)
+{
+    TP_Post *post = (TP_Post *) task;
+    TpBridge *bridge = post->bridge;
+    bool wake;
+
+    task->func(task->arg);
+
+    pthread_mutex_lock(&bridge->lock);
+
+    wake = listIsEmpty(&bridge->done);
+
+    listAppendTail(&bridge->done, task);
+
+    pthread_mutex_unlock(&bridge->lock);
+
+    /* As in the NetResolver, one byte is enough to make the dispatcher empty
+     * the whole list. The pipe is non-blocking, so this can't hang when the
+     * dispatcher isn't reading it (for example because it is waiting in
+     * tpBridgeDestroy()). If the pipe is full a wake-up is pending anyway. */
+
+    while (wake && write(bridge->pipe_fd[1], "", 1) == -1 && errno == EINTR);
+
+    tp_complete(tp, &bridge->running);
+}
+
+/*
+ * Called by the dispatcher when the workers have woken up the bridge in
+ * <udata>, through pipe <fd>, because there are finished posts.
+ */
+static void tp_bridge_done(Dispatcher *dis, int fd, void *udata)
+{
+    TpBridge *bridge = udata;
+    TP_Post *post;
+    char buf[64];
+
+    UNUSED(dis);
+
+    /* Empty the pipe first, so that a post that finishes while we're busy
+     * below wakes us up again. */
+
+    while (read(fd, buf, sizeof(buf)) > 0);
+
+    for (;;) {
+        pthread_mutex_lock(&bridge->lock);
+        post = listRemoveHead(&bridge->done);
+        pthread_mutex_unlock(&bridge->lock);
+
+        if (post == NULL) break;
+
+        bridge->pending--;
+
+        post->done(bridge, post->task.arg, post->udata);
+
+        free(post);
+    }
+}
+
+/*
+ * Create a bridge that runs tasks on <tp> and reports their completion
+ * through Dispatcher <dis>.
+ */
+TpBridge *tpBridgeCreate(ThreadPool *tp, Dispatcher *dis)
+{
+    TpBridge *bridge = calloc(1, sizeof(TpBridge));
+
+    if (pipe(bridge->pipe_fd) != 0) {
+        free(bridge);
+        return NULL;
+    }
+
+    fcntl(bridge->pipe_fd[0], F_SETFL, O_NONBLOCK);
+    fcntl(bridge->pipe_fd[1], F_SETFL, O_NONBLOCK);
+
+    pthread_mutex_init(&bridge->lock, NULL);
+
+    bridge->tp = tp;
+    bridge->dis = dis;
+
+    disOnData(dis, bridge->pipe_fd[0], tp_bridge_done, bridge);
+
+    return bridge;
+}
+
+/*
+ * Call <func> with <arg> in a task on the pool of <bridge>, and when it has
+ * returned call <done> with <bridge>, <arg> and <udata> from the dispatcher
+ * of <bridge>. Must be called from the thread that runs the dispatcher.
+ */
+void tpBridgeSubmit(TpBridge *bridge,
+        void (*func)(void *arg), void *arg,
+        void (*done)(TpBridge *bridge, void *arg, void *udata), void *udata)
+{
+    TP_Post *post = calloc(1, sizeof(TP_Post));
+
+    post->task.run = tp_run_post;
+    post->task.func = func;
+    post->task.arg = arg;
+    post->bridge = bridge;
+    post->done = done;
+    post->udata = udata;
+
+    bridge->pending++;
+
+    __atomic_add_fetch(&bridge->running, 1, __ATOMIC_RELAXED);
+
+    tp_schedule(bridge->tp, &post->task);
+}
+
+/*
+ * Return the number of tasks submitted through <bridge> whose <done> callback
+ * hasn't been called yet.
+ */
+int tpBridgePending(const TpBridge *bridge)
+{
+    return bridge->pending;
+}
+
+/*
+ * Wait for all tasks submitted through <bridge> to finish and delete it. The
+ * <done> callbacks of tasks that haven't been reported yet are not called.
+ */
+void tpBridgeDestroy(TpBridge *bridge)
+{
+    TP_Post *post;
+
+    tp_wait_for(bridge->tp, &bridge->running);
+
+    disDropData(bridge->dis, bridge->pipe_fd[0]);
+
+    close(bridge->pipe_fd[0]);
+    close(bridge->pipe_fd[1]);
+
+    /* All posts have finished, so they're all on the done list now. */
+
+    while ((post = listRemoveHead(&bridge->done)) != NULL) {
+        free(post);
+    }
+
+    pthread_mutex_destroy(&bridge->lock);
+
+    free(bridge);
+}
+
+#ifdef TEST
+#include "utils.h"
+
+static int errors = 0;
+
+static ThreadPool *pool;
+
+static int64_t counter = 0;
+
+static void increment(void *arg)
+{
+    UNUSED(arg);
+
+    __atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Submit more tasks from inside a task than fit in a deque at first.
+ */
+static void spawn_many(void *arg)
+{
+    int i;
+    TpTask **task = arg;
+
+    for (i = 0; i < 1000; i++) {
+        task[i] = tpSubmit(pool, increment, NULL);
+    }
+
+    for (i = 0; i < 1000; i++) {
+        tpWait(pool, task[i]);
+    }
+}
+
+typedef struct {
+    int n;
+    long result;
+} Fib;
+
+/*
+ * Calculate Fibonacci numbers by submitting and waiting for tasks from inside
+ * tasks.
+ */
+static void fib(void *arg)
+{
+    Fib *f = arg;
+
+    if (f->n < 12) {
+        long a = 0, b = 1;
+        int i;
+
+        for (i = 0; i < f->n; i++) {
+            long c = a + b;
+            a = b;
+            b = c;
+        }
+
+        f->result = a;
+
+        return;
+    }
+
+    Fib f1 = { f->n - 1, 0 }, f2 = { f->n - 2, 0 };
+
+    TpTask *task = tpSubmit(pool, fib, &f1);
+
+    fib(&f2);
+
+    tpWait(pool, task);
+
+    f->result = f1.result + f2.result;
+}
+
+static char *visited;
+static int64_t sum;
+
+static void visit(size_t begin, size_t end, void *arg)
+{
+    size_t i;
+    int64_t s = 0;
+
+    UNUSED(arg);
+
+    for (i = begin; i < end; i++) {
+        visited[i]++;
+        s += i;
+    }
+
+    __atomic_add_fetch(&sum, s, __ATOMIC_RELAXED);
+}
+
+static void nested_loop(void *arg)
+{
+    int64_t *result = arg;
+
+    sum = 0;
+
+    tpParallelFor(pool, 0, 1000, 10, visit, NULL);
+
+    *result = sum;
+}
+
+static pthread_t main_thread;
+static int reported = 0;
+
+static void square(void *arg)
+{
+    int *value = arg;
+
+    *value *= *value;
+}
+
+static void report(TpBridge *bridge, void *arg, void *udata)
+{
+    int *value = arg;
+
+    UNUSED(bridge);
+
+    make_sure_that(pthread_equal(pthread_self(), main_thread));
+    make_sure_that(*value == (intptr_t) udata * (intptr_t) udata);
+
+    reported++;
+}
+
+static void count_report(TpBridge *bridge, void *arg, void *udata)
+{
+    UNUSED(bridge);
+    UNUSED(arg);
+    UNUSED(udata);
+
+    reported++;
+}
+
+static void timeout(Dispatcher *dis, double t, void *udata)
+{
+    UNUSED(dis);
+    UNUSED(t);
+    UNUSED(udata);
+}
+
+int main(void)
+{
+    int i;
+    TpTask *task[1000];
+
+    pool = tpCreate(4);
+
+    make_sure_that(tpThreads(pool) == 4);
+    make_sure_that(tpWorker(pool) == -1);
+
+    /* Lots of small tasks from outside the pool. */
+
+    for (i = 0; i < 1000; i++) {
+        task[i] = tpSubmit(pool, increment, NULL);
+    }
+
+    for (i = 0; i < 1000; i++) {
+        tpWait(pool, task[i]);
+    }
+
+    make_sure_that(counter == 1000);
+
+    tpWait(pool, tpSubmit(pool, spawn_many, task));
+
+    make_sure_that(counter == 2000);
+
+    for (i = 0; i < 100; i++) {
+        tpDetach(tpSubmit(pool, increment, NULL));
+    }
+
+    /* Tasks that wait for other tasks. */
+
+    Fib f = { 30, 0 };
+
+    fib(&f);
+
+    make_sure_that(f.result == 832040);
+
+    /* A parallel loop from outside the pool... */
+
+    size_t n = 1000000;
+
+    visited = calloc(n, 1);
+
+    tpParallelFor(pool, 0, n, 1000, visit, NULL);
+
+    make_sure_that(sum == (int64_t) (n * (n - 1) / 2));
+
+    for (i = 0; i < (int) n; i++) {
+        if (visited[i] != 1) break;
+    }
+
+    make_sure_that(i == (int) n);
+
+    free(visited);
+
+    /* ... and one from inside. */
+
+    int64_t result = 0;
+
+    visited = calloc(1000, 1);
+
+    tpWait(pool, tpSubmit(pool, nested_loop, &result));
+
+    make_sure_that(result == 1000 * 999 / 2);
+
+    free(visited);
+
+    /* Reporting back to a dispatcher. */
+
+    int value[10];
+
+    main_thread = pthread_self();
+
+    Dispatcher *dis = disCreate();
+    TpBridge *bridge = tpBridgeCreate(pool, dis);
+
+    for (i = 0; i < 10; i++) {
+        value[i] = i;
+
+        tpBridgeSubmit(bridge, square, value + i, report, (void *)(intptr_t) i);
+    }
+
+    make_sure_that(tpBridgePending(bridge) == 10);
+
+    double deadline = dnow() + 5;
+
+    disOnTime(dis, deadline, timeout, NULL);
+
+    while (reported < 10 && dnow() < deadline) {
+        disHandleEvents(dis);
+    }
+
+    make_sure_that(reported == 10);
+    make_sure_that(tpBridgePending(bridge) == 0);
+
+    /* More finished tasks than fit in a pipe, first reported... */
+
+    for (i = 0; i < 20000; i++) {
+        tpBridgeSubmit(bridge, increment, NULL, count_report, NULL);
+    }
+
+    deadline = dnow() + 5;
+
+    disOnTime(dis, deadline, timeout, NULL);
+
+    while (reported < 20010 && dnow() < deadline) {
+        disHandleEvents(dis);
+    }
+
+    make_sure_that(reported == 20010);
+    make_sure_that(tpBridgePending(bridge) == 0);
+
+    /* ... then left unreported when the bridge is destroyed. */
+
+    for (i = 0; i < 20000; i++) {
+        tpBridgeSubmit(bridge, increment, NULL, count_report, NULL);
+    }
+
+    tpBridgeDestroy(bridge);
+    disDestroy(dis);
+
+    tpDestroy(pool);
+
+    make_sure_that(reported == 20010);
+    make_sure_that(counter == 42100);
+
+    return errors;
+}
+#endif
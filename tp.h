@@ -0,0 +1,132 @@
+#ifndef TP_H
+#define TP_H
+
+/*
+ * tp.h: Thread pool with work-stealing.
+ *
+ * Every worker thread in a ThreadPool has its own double-ended queue of tasks
+ * (a Chase-Lev deque). Tasks that are submitted from inside a task go to the
+ * front of the current worker's deque, which only that worker uses, without
+ * locking. Tasks submitted from other threads go into a shared queue. Idle
+ * workers first take the most recent task from their own deque, then look in
+ * the shared queue, and then steal the oldest task from the deques of other
+ * workers.
+ *
+ * Threads that wait for a task (using tpWait()) or a loop (tpParallelFor())
+ * run other tasks in the meantime, so tasks may submit and wait for other
+ * tasks without running out of workers.
+ *
+ * A TpBridge runs tasks on a pool and then reports their completion from a
+ * Dispatcher's loop, so that their results can be used without locking.
+ *
+ * tp.h is part of libjvs.
+ *
+ * Copyright: (c) 2026 Jacco van Schaik (jacco@jaccovanschaik.net)
+ * Created:   2026-10-18
+ * Version:   $Id$
+ *
+ * This software is distributed under the terms of the MIT license. See
+ * http://www.opensource.org/licenses/mit-license.php for details.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "dis.h"
+
+typedef struct ThreadPool ThreadPool;
+typedef struct TpTask TpTask;
+typedef struct TpBridge TpBridge;
+
+/*
+ * Create a thread pool with <threads> worker threads. If <threads> is 0 or
+ * less, one thread per online CPU is started.
+ */
+ThreadPool *tpCreate(int threads);
+
+/*
+ * Return the number of worker threads in <tp>.
+ */
+int tpThreads(const ThreadPool *tp);
+
+/*
+ * Return the index (0 .. tpThreads() - 1) of the worker thread of <tp> that
+ * calls this function, or -1 if it isn't called from one of them.
+ */
+int tpWorker(const ThreadPool *tp);
+
+/*
+ * Submit a task that calls <func> with <arg> to <tp>. This may be called from
+ * any thread. Returns a handle that must be passed to tpWait() or tpDetach().
+ */
+TpTask *tpSubmit(ThreadPool *tp, void (*func)(void *arg), void *arg);
+
+/*
+ * Return true if <task> has finished, false otherwise.
+ */
+bool tpIsDone(const TpTask *task);
+
+/*
+ * Wait until <task>, submitted to <tp>, has finished, running other tasks of
+ * <tp> in the meantime. <task> is freed and may not be used again.
+ */
+void tpWait(ThreadPool *tp, TpTask *task);
+
+/*
+ * Indicate that nobody will wait for <task>, so it can be freed as soon as it
+ * has finished. <task> may not be used again.
+ */
+void tpDetach(TpTask *task);
+
+/*
+ * Call <func> for consecutive ranges of indexes that together cover <begin>
+ * to (but not including) <end>, in parallel, using <tp>. Ranges are split in
+ * half until they're no longer than <grain> indexes, and <func> is called
+ * with the first index of a range, the index just past its end, and <arg>.
+ * Returns when all calls have returned. May be called from inside a task.
+ */
+void tpParallelFor(ThreadPool *tp, size_t begin, size_t end, size_t grain,
+        void (*func)(size_t begin, size_t end, void *arg), void *arg);
+
+/*
+ * Wait until all tasks have finished, stop the worker threads and delete
+ * <tp>. All bridges for <tp> must have been destroyed before this is called.
+ */
+void tpDestroy(ThreadPool *tp);
+
+/*
+ * Create a bridge that runs tasks on <tp> and reports their completion
+ * through Dispatcher <dis>.
+ */
+TpBridge *tpBridgeCreate(ThreadPool *tp, Dispatcher *dis);
+
+/*
+ * Call <func> with <arg> in a task on the pool of <bridge>, and when it has
+ * returned call <done> with <bridge>, <arg> and <udata> from the dispatcher
+ * of <bridge>. Must be called from the thread that runs the dispatcher.
+ */
+void tpBridgeSubmit(TpBridge *bridge,
+        void (*func)(void *arg), void *arg,
+        void (*done)(TpBridge *bridge, void *arg, void *udata), void *udata);
+
+/*
+ * Return the number of tasks submitted through <bridge> whose <done> callback
+ * hasn't been called yet.
+ */
+int tpBridgePending(const TpBridge *bridge);
+
+/*
+ * Wait for all tasks submitted through <bridge> to finish and delete it. The
+ * <done> callbacks of tasks that haven't been reported yet are not called.
+ */
+void tpBridgeDestroy(TpBridge *bridge);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -58,38 +58,25 @@ static int udp_socket(int family)
 
 /*
  * Send <data> with size <size> via <sd> to <port> on <host>, <port>, using
- * address family <family>. Note that this function does a hostname lookup for
- * every call, which can be slow. If possible, use udpConnect() to set a
- * default destination address, after which you can simply write() to the
- * socket without incurring this overhead.
+ * address family <family>. The addresses of <host> are cached (see
+ * netResolve()), so this only does a hostname lookup for the first call.
  */
 static int udp_send(int sd, const char *host, uint16_t port, int family,
         const char *data, size_t size)
 {
-    int r;
-
-    char port_as_text[6];
-    struct addrinfo *info;
+    NetAddr addr[NET_MAX_ADDR];
 
-    struct addrinfo hints = {
-        .ai_family = family,
-        .ai_socktype = SOCK_DGRAM
-    };
-
-    snprintf(port_as_text, sizeof(port_as_text), "%hu", port);
+    int r;
 
-    if ((r = getaddrinfo(host, port_as_text, &hints, &info)) != 0) {
+    if (netResolve(host, port, family, SOCK_DGRAM, false, addr, &r) < 0) {
         dbgError(stderr, "%s: getaddrinfo failed (%s)",
                 __func__, gai_strerror(r));
 
-        r = -1;
+        return -1;
     }
 
-    r = sendto(sd, data, size, 0, info->ai_addr, info->ai_addrlen);
-
-    freeaddrinfo(info);
-
-    return r;
+    return sendto(sd, data, size, 0, (struct sockaddr *) &addr[0].addr,
+            addr[0].len);
 }
 
 /*
@@ -98,31 +85,25 @@ static int udp_send(int sd, const char *host, uint16_t port, int family,
  */
 static int udp_connect(int sd, const char *host, uint16_t port, int family)
 {
-    int r;
-
-    char port_as_text[6];
-    struct addrinfo *info;
-
-    struct addrinfo hints = {
-        .ai_family = family,
-        .ai_socktype = SOCK_DGRAM
-    };
+    NetAddr addr[NET_MAX_ADDR];
 
-    snprintf(port_as_text, sizeof(port_as_text), "%hu", port);
+    int r;
 
-    if ((r = getaddrinfo(host, port_as_text, &hints, &info)) != 0) {
+    if (netResolve(host, port, family, SOCK_DGRAM, false, addr, &r) < 0) {
         dbgError(stderr, "%s: getaddrinfo failed (%s)",
                 __func__, gai_strerror(r));
 
         r = -1;
     }
-    else if (connect(sd, info->ai_addr, info->ai_addrlen) != 0) {
+    else if (connect(sd, (struct sockaddr *) &addr[0].addr, addr[0].len) != 0)
+    {
         dbgError(stderr, "%s: connect failed", __func__);
 
         r = -1;
     }
-
-    freeaddrinfo(info);
+    else {
+        r = 0;
+    }
 
     return r;
 }
@@ -133,33 +114,24 @@ static int udp_connect(int sd, const char *host, uint16_t port, int family)
  */
 static int udp_bind(int sd, const char *host, uint16_t port, int family)
 {
-    struct addrinfo *info = NULL;
-    struct addrinfo  hint = {
-        .ai_family = family,
-        .ai_socktype = SOCK_DGRAM
-    };
-
-    char port_str[6];
-
-    snprintf(port_str, sizeof(port_str), "%hu", port);
+    NetAddr addr[NET_MAX_ADDR];
 
     int r;
 
-    if ((r = getaddrinfo(host, port_str, &hint, &info)) != 0) {
+    if (netResolve(host, port, family, SOCK_DGRAM, false, addr, &r) < 0) {
         dbgError(stderr, "%s: getaddrinfo for %s:%hu failed (%s)",
                 __func__, host, port, gai_strerror(r));
 
         r = -1;
     }
-    else if ((r = bind(sd, info->ai_addr, info->ai_addrlen)) != 0) {
+    else if ((r = bind(sd, (struct sockaddr *) &addr[0].addr,
+                    addr[0].len)) != 0) {
         dbgError(stderr, "%s: bind to %s:%hu failed: %s",
                 __func__, host, port, strerror(errno));
 
         r = -1;
     }
 
-    freeaddrinfo(info);
-
     return r;
 }
 
@@ -190,10 +162,9 @@ int udpConnect(int sd, const char *host, uint16_t port)
 
 /*
  * Send <data> with size <size> via IPv4 UDP socket <sd> to <host>, <port>.
- * Note that this function does a hostname lookup for every call, which can be
- * slow. If possible, use udpConnect() to set a default destination address,
- * after which you can simply write() to the socket without incurring this
- * overhead.
+ * The addresses of <host> are cached (see netResolve()), but to avoid even
+ * the cache lookup use udpConnect() to set a default destination address,
+ * after which you can simply write() to the socket, or use udpSendAddr().
  */
 int udpSend(int sd, const char *host, uint16_t port,
         const char *data, size_t size)
@@ -228,10 +199,9 @@ int udp6Connect(int sd, const char *host, uint16_t port)
 
 /*
  * Send <data> with size <size> via IPv6 UDP socket <sd> to <host>, <port>.
- * Note that this function does a hostname lookup for every call, which can be
- * slow. If possible, use udpConnect() to set a default destination address,
- * after which you can simply write() to the socket without incurring this
- * overhead.
+ * The addresses of <host> are cached (see netResolve()), but to avoid even
+ * the cache lookup use udpConnect() to set a default destination address,
+ * after which you can simply write() to the socket, or use udpSendAddr().
  */
 int udp6Send(int sd, const char *host, uint16_t port,
         const char *data, size_t size)
@@ -240,15 +210,43 @@ int udp6Send(int sd, const char *host, uint16_t port,
 }
 
 /*
- * Add the socket given by <sd> to the multicast group given by <group> (a
- * dotted-quad ip address).
+ * Connect UDP socket <sd> to address <addr> (as returned by netResolve() or
+ * netResolverForward()). No name lookups are done.
  */
-int udpMulticastJoin(int sd, const char *group)
+int udpConnectAddr(int sd, const NetAddr *addr)
+{
+    if (connect(sd, (const struct sockaddr *) &addr->addr, addr->len) != 0) {
+        dbgError(stderr, "%s: connect failed", __func__);
+
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Send <data> with size <size> via UDP socket <sd> to address <addr> (as
+ * returned by netResolve() or netResolverForward()). No name lookups are done.
+ */
+int udpSendAddr(int sd, const NetAddr *addr, const char *data, size_t size)
+{
+    return sendto(sd, data, size, 0,
+            (const struct sockaddr *) &addr->addr, addr->len);
+}
+
+/*
+ * Add the socket given by <sd> to the multicast group given by <group> on the
+ * network interface with address <interface> (both dotted-quad ip addresses).
+ * If <interface> is NULL the kernel chooses the interface, as it does for
+ * udpMulticastJoin().
+ */
+int udpMulticastJoinOn(int sd, const char *group, const char *interface)
 {
     struct ip_mreq mreq;
 
     mreq.imr_multiaddr.s_addr = inet_addr(group);
-    mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+    mreq.imr_interface.s_addr =
+        interface ? inet_addr(interface) : htonl(INADDR_ANY);
 
     if (setsockopt(sd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
     {
@@ -259,6 +257,15 @@ int udpMulticastJoin(int sd, const char *group)
     return 0;
 }
 
+/*
+ * Add the socket given by <sd> to the multicast group given by <group> (a
+ * dotted-quad ip address).
+ */
+int udpMulticastJoin(int sd, const char *group)
+{
+    return udpMulticastJoinOn(sd, group, NULL);
+}
+
 /*
  * Allow (if <allow_loop> is 1) or disallow (if it is 0) multicast packets to be
  * looped back to the sending network interface. The default is that packets do
@@ -299,15 +306,17 @@ int udpMulticastInterface(int sd, const char *address)
 }
 
 /*
- * Remove the socket given by <sd> from the multicast group given by <group> (a
- * dotted-quad ip address).
+ * Remove the socket given by <sd> from the multicast group given by <group>
+ * that it joined on the interface with address <interface> using
+ * udpMulticastJoinOn().
  */
-int udpMulticastLeave(int sd, const char *group)
+int udpMulticastLeaveOn(int sd, const char *group, const char *interface)
 {
     struct ip_mreq mreq;
 
     mreq.imr_multiaddr.s_addr = inet_addr(group);
-    mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+    mreq.imr_interface.s_addr =
+        interface ? inet_addr(interface) : htonl(INADDR_ANY);
 
     if (setsockopt(sd, IPPROTO_IP, IP_DROP_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
     {
@@ -318,6 +327,15 @@ int udpMulticastLeave(int sd, const char *group)
     return 0;
 }
 
+/*
+ * Remove the socket given by <sd> from the multicast group given by <group> (a
+ * dotted-quad ip address).
+ */
+int udpMulticastLeave(int sd, const char *group)
+{
+    return udpMulticastLeaveOn(sd, group, NULL);
+}
+
 #ifdef TEST
 #include "net.h"
 
@@ -20,6 +20,8 @@ extern "C" {
 #include <stdint.h>
 #include <stddef.h>
 
+#include "net.h"
+
 /*
  * Create an unbound IPv4 UDP socket.
  */
@@ -38,10 +40,9 @@ int udpConnect(int sd, const char *host, uint16_t port);
 
 /*
  * Send <data> with size <size> via IPv4 UDP socket <sd> to <host>, <port>.
- * Note that this function does a hostname lookup for every call, which can be
- * slow. If possible, use udpConnect() to set a default destination address,
- * after which you can simply write() to the socket without incurring this
- * overhead.
+ * The addresses of <host> are cached (see netResolve()), but to avoid even
+ * the cache lookup use udpConnect() to set a default destination address,
+ * after which you can simply write() to the socket, or use udpSendAddr().
  */
 int udpSend(int sd, const char *host, uint16_t port,
         const char *data, size_t size);
@@ -64,20 +65,39 @@ int udp6Connect(int sd, const char *host, uint16_t port);
 
 /*
  * Send <data> with size <size> via IPv6 UDP socket <sd> to <host>, <port>.
- * Note that this function does a hostname lookup for every call, which can be
- * slow. If possible, use udpConnect() to set a default destination address,
- * after which you can simply write() to the socket without incurring this
- * overhead.
+ * The addresses of <host> are cached (see netResolve()), but to avoid even
+ * the cache lookup use udpConnect() to set a default destination address,
+ * after which you can simply write() to the socket, or use udpSendAddr().
  */
 int udp6Send(int sd, const char *host, uint16_t port,
         const char *data, size_t size);
 
+/*
+ * Connect UDP socket <sd> to address <addr> (as returned by netResolve() or
+ * netResolverForward()). No name lookups are done.
+ */
+int udpConnectAddr(int sd, const NetAddr *addr);
+
+/*
+ * Send <data> with size <size> via UDP socket <sd> to address <addr> (as
+ * returned by netResolve() or netResolverForward()). No name lookups are done.
+ */
+int udpSendAddr(int sd, const NetAddr *addr, const char *data, size_t size);
+
 /*
  * Add the socket given by <sd> to the multicast group given by <group> (a
  * dotted-quad ip address).
  */
 int udpMulticastJoin(int sd, const char *group);
 
+/*
+ * Add the socket given by <sd> to the multicast group given by <group> on the
+ * network interface with address <interface> (both dotted-quad ip addresses).
+ * If <interface> is NULL the kernel chooses the interface, as it does for
+ * udpMulticastJoin().
+ */
+int udpMulticastJoinOn(int sd, const char *group, const char *interface);
+
 /*
  * Allow (if <allow_loop> is 1) or disallow (if it is 0) multicast packets to be
  * looped back to the sending network interface. The default is that packets do
@@ -97,6 +117,13 @@ int udpMulticastInterface(int sd, const char *address);
  */
 int udpMulticastLeave(int sd, const char *group);
 
+/*
+ * Remove the socket given by <sd> from the multicast group given by <group>
+ * that it joined on the interface with address <interface> using
+ * udpMulticastJoinOn().
+ */
+int udpMulticastLeaveOn(int sd, const char *group, const char *interface);
+
 #ifdef __cplusplus
 }
 #endif
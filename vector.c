@@ -13,51 +13,103 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
 #include <assert.h>
 #include <math.h>
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 #include "defs.h"
+#include "simd.h"
 
 #include "vector.h"
 
+/*
+ * Block sizes for mMul(): a block of M_BLOCK_ROWS rows by M_BLOCK_INNER
+ * columns of the first matrix (64 kB) is kept in the cache while it is
+ * applied to all columns of the second matrix.
+ */
+#define M_BLOCK_ROWS    64
+#define M_BLOCK_INNER   128
+
+/*
+ * mTranspose() copies square blocks of this size at a time.
+ */
+#define M_BLOCK_TRANSPOSE 32
+
+/*
+ * Return a pointer to the first coefficient of column <col> in <m>.
+ */
+static inline double *m_column(const Matrix *m, int col)
+{
+   return m->data + (size_t) col * m->n_rows;
+}
+
 /*
  * Create a new vector with <n_rows> rows. The vector is initialized to all
  * zeroes.
  */
 Vector *vNew(int n_rows)
 {
-   Vector *v = calloc(1, sizeof(Vector));
+   /* The rows directly follow the Vector itself, in the same allocation. */
+
+   Vector *v = calloc(1, sizeof(Vector) + n_rows * sizeof(double));
 
    v->n_rows = n_rows;
 
-   v->row = calloc(n_rows, sizeof(double));
+   v->row = (double *) (v + 1);
 
    return v;
 }
 
 /*
- * Delete (free) vector <v>.
+ * Delete (free) vector <v>, which must have been created using vNew() or
+ * vDup().
  */
 void vDel(Vector *v)
 {
-   free(v->row);
-
    free(v);
 }
 
 /*
- * Return the length of vector <v>.
+ * Initialize <v> as a vector with <n_rows> rows, stored in the caller-supplied
+ * array <rows>, which must stay valid for as long as <v> is used. The
+ * contents of <rows> are left as they are. Useful to treat existing data as a
+ * Vector, or to keep vectors on the stack or in an arena. Don't call vDel() on
+ * <v>. Returns <v>.
  */
-double vLen(Vector *v)
+Vector *vInit(Vector *v, double *rows, int n_rows)
 {
-   int i;
-   double sum = 0;
+   v->n_rows = n_rows;
+   v->row = rows;
 
-   for (i = 0; i < v->n_rows; i++) {
-      sum += SQR(v->row[i]);
-   }
+   return v;
+}
 
-   return sqrt(sum);
+/*
+ * Initialize fixed-capacity vector <fv> with <n_rows> rows (at most
+ * VECTOR_FIXED_ROWS), all set to zero, and return a pointer to its Vector.
+ * Don't call vDel() on it.
+ */
+Vector *vFixed(FixedVector *fv, int n_rows)
+{
+   assert(n_rows >= 0 && n_rows <= VECTOR_FIXED_ROWS);
+
+   memset(fv->storage, 0, n_rows * sizeof(double));
+
+   return vInit(&fv->vec, fv->storage, n_rows);
+}
+
+/*
+ * Return the length of vector <v>. The squares are added up in an order that
+ * depends on the SIMD level (see simd.h), so the result may differ by rounding
+ * from a serial sum.
+ */
+double vLen(Vector *v)
+{
+   return sqrt(simdDot(v->row, v->row, v->n_rows));
 }
 
 /*
@@ -103,13 +155,9 @@ double vGetRow(Vector *v, int row)
  */
 void vAdd(Vector *v_out, Vector *v1, Vector *v2)
 {
-   int i;
-
    assert(v_out->n_rows == v1->n_rows && v1->n_rows == v2->n_rows);
 
-   for (i = 0; i < v1->n_rows; i++) {
-      v_out->row[i] = v1->row[i] + v2->row[i];
-   }
+   simdAdd(v_out->row, v1->row, v2->row, v1->n_rows);
 }
 
 /*
@@ -117,13 +165,9 @@ void vAdd(Vector *v_out, Vector *v1, Vector *v2)
  */
 void vSub(Vector *v_out, Vector *v1, Vector *v2)
 {
-   int i;
-
    assert(v_out->n_rows == v1->n_rows && v1->n_rows == v2->n_rows);
 
-   for (i = 0; i < v1->n_rows; i++) {
-      v_out->row[i] = v1->row[i] - v2->row[i];
-   }
+   simdSub(v_out->row, v1->row, v2->row, v1->n_rows);
 }
 
 /*
@@ -132,12 +176,10 @@ void vSub(Vector *v_out, Vector *v1, Vector *v2)
  */
 void vCopy(Vector *v_out, Vector *v_in)
 {
-   int i;
-
    assert(v_out->n_rows == v_in->n_rows);
 
-   for (i = 0; i < v_in->n_rows; i++) {
-      v_out->row[i] = v_in->row[i];
+   if (v_out != v_in) {
+      memcpy(v_out->row, v_in->row, v_in->n_rows * sizeof(double));
    }
 }
 
@@ -158,13 +200,9 @@ Vector *vDup(Vector *v_in)
  */
 void vScale(Vector *v_out, Vector *v_in, double factor)
 {
-   int i;
-
    assert(v_out->n_rows == v_in->n_rows);
 
-   for (i = 0; i < v_in->n_rows; i++) {
-      v_out->row[i] = v_in->row[i] * factor;
-   }
+   simdScale(v_out->row, v_in->row, factor, v_in->n_rows);
 }
 
 /*
@@ -179,21 +217,46 @@ void vNorm(Vector *v_out, Vector *v_in)
 }
 
 /*
- * Return the dot-product of vectors <v1> and <v2>.
+ * Return the dot-product of vectors <v1> and <v2>. As with vLen(), the result
+ * may differ by rounding from a serial sum of the products.
  */
 double vDotP(Vector *v1, Vector *v2)
 {
-   int i;
+   assert(v1->n_rows == v2->n_rows);
+
+   return simdDot(v1->row, v2->row, v1->n_rows);
+}
+
+/*
+ * Add <factor> times vector <x> to vector <y>, in place. With AVX2 this uses
+ * fused multiply-adds, which round once instead of twice, so the result may
+ * differ in the last bit from what y[i] + factor * x[i] gives.
+ */
+void vAxpy(Vector *y, double factor, const Vector *x)
+{
+   assert(y->n_rows == x->n_rows);
+
+   simdAxpy(y->row, factor, x->row, x->n_rows);
+}
 
-   double sum = 0;
+/*
+ * Return the dot-product of vectors <v1> and <v2>, and put their lengths in
+ * <len1> and <len2>, using a single pass over both vectors. Useful to find
+ * the angle between them, for example. The results may differ by rounding
+ * from those of vDotP() and vLen().
+ */
+double vDotLen(const Vector *v1, const Vector *v2, double *len1, double *len2)
+{
+   double sq1, sq2, dot;
 
    assert(v1->n_rows == v2->n_rows);
 
-   for (i = 0; i < v1->n_rows; i++) {
-      sum += v1->row[i] * v2->row[i];
-   }
+   dot = simdDotSquares(v1->row, v2->row, v1->n_rows, &sq1, &sq2);
 
-   return sum;
+   *len1 = sqrt(sq1);
+   *len2 = sqrt(sq2);
+
+   return dot;
 }
 
 /*
@@ -202,19 +265,905 @@ double vDotP(Vector *v1, Vector *v2)
  */
 void vCrossP(Vector *v_out, Vector *v1, Vector *v2)
 {
-   Vector *v_tmp;
+   double x, y, z;
 
    assert(v_out->n_rows == v1->n_rows &&
           v1->n_rows == v2->n_rows &&
           v2->n_rows == 3);
 
-   v_tmp = vNew(v_out->n_rows);
+   x = v1->row[1] * v2->row[2] - v1->row[2] * v2->row[1];
+   y = v1->row[2] * v2->row[0] - v1->row[0] * v2->row[2];
+   z = v1->row[0] * v2->row[1] - v1->row[1] * v2->row[0];
+
+   v_out->row[0] = x;
+   v_out->row[1] = y;
+   v_out->row[2] = z;
+}
+
+/*
+ * Create a new matrix with <n_rows> rows and <n_cols> columns. The matrix is
+ * initialized to all zeroes.
+ */
+Matrix *mNew(int n_rows, int n_cols)
+{
+   /* The coefficients directly follow the Matrix, like in vNew(). */
+
+   Matrix *m = calloc(1,
+         sizeof(Matrix) + (size_t) n_rows * n_cols * sizeof(double));
+
+   m->n_rows = n_rows;
+   m->n_cols = n_cols;
+
+   m->data = (double *) (m + 1);
+
+   return m;
+}
+
+/*
+ * Delete (free) matrix <m>.
+ */
+void mDel(Matrix *m)
+{
+   free(m);
+}
+
+/*
+ * Set matrix <m> using the provided values. The values are given row by row
+ * (so the first n_cols values are the first row), which is the "natural" way
+ * to write a matrix down. Be sure to pass in the correct number of values!
+ */
+void mSet(Matrix *m, ...)
+{
+   int row, col;
+   va_list ap;
+
+   va_start(ap, m);
+
+   for (row = 0; row < m->n_rows; row++) {
+      for (col = 0; col < m->n_cols; col++) {
+         m_column(m, col)[row] = va_arg(ap, double);
+      }
+   }
+
+   va_end(ap);
+}
+
+/*
+ * Set the coefficient at row <row> and column <col> of matrix <m> to
+ * <value>.
+ */
+void mSetElement(Matrix *m, int row, int col, double value)
+{
+   assert(row >= 0 && row < m->n_rows);
+   assert(col >= 0 && col < m->n_cols);
+
+   m_column(m, col)[row] = value;
+}
+
+/*
+ * Return the coefficient at row <row> and column <col> of matrix <m>.
+ */
+double mGetElement(const Matrix *m, int row, int col)
+{
+   assert(row >= 0 && row < m->n_rows);
+   assert(col >= 0 && col < m->n_cols);
+
+   return m_column(m, col)[row];
+}
+
+/*
+ * Set square matrix <m> to the identity matrix.
+ */
+void mIdentity(Matrix *m)
+{
+   int i;
+
+   assert(m->n_rows == m->n_cols);
+
+   memset(m->data, 0, (size_t) m->n_rows * m->n_cols * sizeof(double));
+
+   for (i = 0; i < m->n_rows; i++) {
+      m_column(m, i)[i] = 1;
+   }
+}
+
+/*
+ * Copy matrix <m_in> to matrix <m_out>. Both matrices must already have the
+ * same size.
+ */
+void mCopy(Matrix *m_out, const Matrix *m_in)
+{
+   assert(m_out->n_rows == m_in->n_rows && m_out->n_cols == m_in->n_cols);
+
+   memcpy(m_out->data, m_in->data,
+         (size_t) m_in->n_rows * m_in->n_cols * sizeof(double));
+}
+
+/*
+ * Duplicate <m_in> and return the result.
+ */
+Matrix *mDup(const Matrix *m_in)
+{
+   Matrix *m_out = mNew(m_in->n_rows, m_in->n_cols);
+
+   mCopy(m_out, m_in);
+
+   return m_out;
+}
+
+/*
+ * Copy column <col> of matrix <m> into vector <v_out>, which must have as
+ * many rows as <m>.
+ */
+void mGetColumn(Vector *v_out, const Matrix *m, int col)
+{
+   assert(col >= 0 && col < m->n_cols);
+   assert(v_out->n_rows == m->n_rows);
+
+   memcpy(v_out->row, m_column(m, col), m->n_rows * sizeof(double));
+}
+
+/*
+ * Set column <col> of matrix <m> to vector <v_in>, which must have as many
+ * rows as <m>.
+ */
+void mSetColumn(Matrix *m, int col, const Vector *v_in)
+{
+   assert(col >= 0 && col < m->n_cols);
+   assert(v_in->n_rows == m->n_rows);
+
+   memcpy(m_column(m, col), v_in->row, m->n_rows * sizeof(double));
+}
+
+/*
+ * Put the transpose of matrix <m_in> into <m_out>, which must have as many
+ * rows as <m_in> has columns and vice versa. <m_out> must not be the same
+ * matrix as <m_in>.
+ */
+void mTranspose(Matrix *m_out, const Matrix *m_in)
+{
+   int row0, col0, row, col;
+
+   assert(m_out->n_rows == m_in->n_cols && m_out->n_cols == m_in->n_rows);
+   assert(m_out != m_in);
+
+   for (col0 = 0; col0 < m_in->n_cols; col0 += M_BLOCK_TRANSPOSE) {
+      int col1 = MIN(col0 + M_BLOCK_TRANSPOSE, m_in->n_cols);
+
+      for (row0 = 0; row0 < m_in->n_rows; row0 += M_BLOCK_TRANSPOSE) {
+         int row1 = MIN(row0 + M_BLOCK_TRANSPOSE, m_in->n_rows);
+
+         for (col = col0; col < col1; col++) {
+            const double *in = m_column(m_in, col);
+
+            for (row = row0; row < row1; row++) {
+               m_column(m_out, row)[col] = in[row];
+            }
+         }
+      }
+   }
+}
+
+#if defined(__x86_64__)
+
+/*
+ * Add the product of the <n_rows> by <n_inner> block of <m1> that starts at
+ * row <row0> and column <inner0> and the corresponding rows of <m2> to
+ * <m_out>, using AVX2 and FMA for blocks of 8 rows by 4 columns at a time.
+ * Returns the number of rows done for each column of <m_out> (the remaining
+ * rows and columns are left for m_mul_block()).
+ */
+__attribute__((target("avx2,fma")))
+static int m_mul_block_avx2(Matrix *m_out, const Matrix *m1, const Matrix *m2,
+      int row0, int n_rows, int inner0, int n_inner, int *n_cols_done)
+{
+   int row, col, k;
+
+   int rows_done = n_rows - n_rows % 8;
+   int cols_done = m2->n_cols - m2->n_cols % 4;
+
+   for (col = 0; col < cols_done; col += 4) {
+      const double *b[4];
+      double *c[4];
+      int j;
+
+      for (j = 0; j < 4; j++) {
+         b[j] = m_column(m2, col + j) + inner0;
+         c[j] = m_column(m_out, col + j) + row0;
+      }
+
+      for (row = 0; row < rows_done; row += 8) {
+         __m256d acc[4][2];
+
+         for (j = 0; j < 4; j++) {
+            acc[j][0] = _mm256_loadu_pd(c[j] + row);
+            acc[j][1] = _mm256_loadu_pd(c[j] + row + 4);
+         }
+
+         for (k = 0; k < n_inner; k++) {
+            const double *a = m_column(m1, inner0 + k) + row0 + row;
+
+            __m256d a0 = _mm256_loadu_pd(a);
+            __m256d a1 = _mm256_loadu_pd(a + 4);
+
+            for (j = 0; j < 4; j++) {
+               __m256d bkj = _mm256_broadcast_sd(b[j] + k);
+
+               acc[j][0] = _mm256_fmadd_pd(a0, bkj, acc[j][0]);
+               acc[j][1] = _mm256_fmadd_pd(a1, bkj, acc[j][1]);
+            }
+         }
+
+         for (j = 0; j < 4; j++) {
+            _mm256_storeu_pd(c[j] + row, acc[j][0]);
+            _mm256_storeu_pd(c[j] + row + 4, acc[j][1]);
+         }
+      }
+   }
+
+   *n_cols_done = cols_done;
+
+   return rows_done;
+}
+
+#endif
+
+/*
+ * Add the product of the <n_rows> by <n_inner> block of <m1> that starts at
+ * row <row0> and column <inner0> and the corresponding rows of <m2> to
+ * <m_out>.
+ */
+static void m_mul_block(Matrix *m_out, const Matrix *m1, const Matrix *m2,
+      int row0, int n_rows, int inner0, int n_inner)
+{
+   int col, k, rows_done = 0, cols_done = 0;
+
+#if defined(__x86_64__)
+   if (simdLevel() == SIMD_AVX2) {
+      rows_done = m_mul_block_avx2(m_out, m1, m2,
+            row0, n_rows, inner0, n_inner, &cols_done);
+   }
+#endif
+
+   /* Whatever is left is done one column at a time: first the rows that the
+    * tiles above didn't cover, then the columns they didn't cover. */
+
+   for (col = 0; col < m2->n_cols; col++) {
+      int first = col < cols_done ? rows_done : 0;
+
+      double *c = m_column(m_out, col) + row0;
+      const double *b = m_column(m2, col) + inner0;
+
+      if (first == n_rows) continue;
+
+      for (k = 0; k < n_inner; k++) {
+         const double *a = m_column(m1, inner0 + k) + row0;
+
+         simdAxpy(c + first, b[k], a + first, n_rows - first);
+      }
+   }
+}
+
+/*
+ * Multiply matrices <m1> and <m2> and put the result in <m_out>, which must
+ * have as many rows as <m1> and as many columns as <m2>. <m_out> must not be
+ * the same matrix as <m1> or <m2>.
+ */
+void mMul(Matrix *m_out, const Matrix *m1, const Matrix *m2)
+{
+   int row0, inner0;
+
+   assert(m1->n_cols == m2->n_rows);
+   assert(m_out->n_rows == m1->n_rows && m_out->n_cols == m2->n_cols);
+   assert(m_out != m1 && m_out != m2);
+
+   memset(m_out->data, 0,
+         (size_t) m_out->n_rows * m_out->n_cols * sizeof(double));
+
+   for (inner0 = 0; inner0 < m1->n_cols; inner0 += M_BLOCK_INNER) {
+      int n_inner = MIN(M_BLOCK_INNER, m1->n_cols - inner0);
+
+      for (row0 = 0; row0 < m1->n_rows; row0 += M_BLOCK_ROWS) {
+         int n_rows = MIN(M_BLOCK_ROWS, m1->n_rows - row0);
+
+         m_mul_block(m_out, m1, m2, row0, n_rows, inner0, n_inner);
+      }
+   }
+}
+
+/*
+ * Multiply matrix <m> with vector <v_in> and put the result in <v_out>.
+ * <v_in> must have as many rows as <m> has columns, <v_out> as many as <m>
+ * has rows, and <v_out> must not be the same vector as <v_in>.
+ */
+void mApply(Vector *v_out, const Matrix *m, const Vector *v_in)
+{
+   int col;
+
+   assert(v_in->n_rows == m->n_cols && v_out->n_rows == m->n_rows);
+   assert(v_out != v_in);
+
+   memset(v_out->row, 0, v_out->n_rows * sizeof(double));
+
+   for (col = 0; col < m->n_cols; col++) {
+      simdAxpy(v_out->row, v_in->row[col], m_column(m, col), m->n_rows);
+   }
+}
+
+/*
+ * Replace square matrix <m> with its LU decomposition, using partial
+ * pivoting: the strictly lower part of <m> is set to L (whose diagonal is all
+ * ones and not stored) and the upper part, including the diagonal, to U. The
+ * row permutation is stored in <perm>, which must have room for n_rows
+ * entries: row i of L * U is row perm[i] of the original matrix. Returns 0 on
+ * success or -1 if <m> is singular, in which case <m> is left in an
+ * undefined state.
+ */
+int mLU(Matrix *m, int *perm)
+{
+   int n = m->n_rows, i, j, k;
+
+   assert(m->n_rows == m->n_cols);
+
+   for (i = 0; i < n; i++) perm[i] = i;
+
+   for (k = 0; k < n; k++) {
+      double *col_k = m_column(m, k);
+      int pivot = k;
+
+      for (i = k + 1; i < n; i++) {
+         if (fabs(col_k[i]) > fabs(col_k[pivot])) pivot = i;
+      }
+
+      if (col_k[pivot] == 0) return -1;
+
+      if (pivot != k) {
+         for (j = 0; j < n; j++) {
+            double *col_j = m_column(m, j);
+            double tmp = col_j[k];
+
+            col_j[k] = col_j[pivot];
+            col_j[pivot] = tmp;
+         }
+
+         int tmp = perm[k];
+
+         perm[k] = perm[pivot];
+         perm[pivot] = tmp;
+      }
+
+      /* Column k below the diagonal becomes column k of L, and its
+       * contribution is removed from the columns to the right of it. */
+
+      simdScale(col_k + k + 1, col_k + k + 1, 1 / col_k[k], n - k - 1);
+
+      for (j = k + 1; j < n; j++) {
+         double *col_j = m_column(m, j);
+
+         simdAxpy(col_j + k + 1, -col_j[k], col_k + k + 1, n - k - 1);
+      }
+   }
+
+   return 0;
+}
+
+/*
+ * Solve A * x = <b> for x and put it in <x>, where A is the matrix whose LU
+ * decomposition mLU() put into <lu> and <perm>. <x> may be the same vector as
+ * <b>.
+ */
+void mLUSolve(Vector *x, const Matrix *lu, const int *perm, const Vector *b)
+{
+   int n = lu->n_rows, i, k;
+
+   assert(lu->n_rows == lu->n_cols);
+   assert(x->n_rows == n && b->n_rows == n);
+
+   double *y = calloc(n, sizeof(double));
+
+   for (i = 0; i < n; i++) y[i] = b->row[perm[i]];
+
+   /* Solve L * y = P * b... */
+
+   for (k = 0; k < n; k++) {
+      simdAxpy(y + k + 1, -y[k], m_column(lu, k) + k + 1, n - k - 1);
+   }
+
+   /* ... and then U * x = y. */
+
+   for (k = n - 1; k >= 0; k--) {
+      const double *col_k = m_column(lu, k);
+
+      y[k] /= col_k[k];
+
+      simdAxpy(y, -y[k], col_k, k);
+   }
+
+   memcpy(x->row, y, n * sizeof(double));
+
+   free(y);
+}
+
+/*
+ * Replace symmetric, positive definite matrix <m> with its Cholesky
+ * decomposition L, a lower triangular matrix with L * transpose(L) equal to
+ * <m>. Only the lower part of <m> is used; the upper part is set to zero.
+ * Returns 0 on success or -1 if <m> is not positive definite, in which case
+ * <m> is left in an undefined state.
+ */
+int mCholesky(Matrix *m)
+{
+   int n = m->n_rows, j, k;
+
+   assert(m->n_rows == m->n_cols);
+
+   for (j = 0; j < n; j++) {
+      double *col_j = m_column(m, j);
+
+      for (k = 0; k < j; k++) {
+         const double *col_k = m_column(m, k);
+
+         simdAxpy(col_j + j, -col_k[j], col_k + j, n - j);
+      }
+
+      if (!(col_j[j] > 0)) return -1;
+
+      double d = sqrt(col_j[j]);
+
+      simdScale(col_j + j + 1, col_j + j + 1, 1 / d, n - j - 1);
+
+      col_j[j] = d;
+
+      memset(col_j, 0, j * sizeof(double));
+   }
+
+   return 0;
+}
+
+/*
+ * Solve A * x = <b> for x and put it in <x>, where A is the matrix whose
+ * Cholesky decomposition mCholesky() put into <l>. <x> may be the same vector
+ * as <b>.
+ */
+void mCholeskySolve(Vector *x, const Matrix *l, const Vector *b)
+{
+   int n = l->n_rows, i, k;
+
+   assert(l->n_rows == l->n_cols);
+   assert(x->n_rows == n && b->n_rows == n);
+
+   if (x != b) vCopy(x, (Vector *) b);
+
+   double *y = x->row;
+
+   /* Solve L * y = b... */
+
+   for (k = 0; k < n; k++) {
+      const double *col_k = m_column(l, k);
+
+      y[k] /= col_k[k];
+
+      simdAxpy(y + k + 1, -y[k], col_k + k + 1, n - k - 1);
+   }
+
+   /* ... and then transpose(L) * x = y. Row k of transpose(L) is column k
+    * of L. */
+
+   for (k = n - 1; k >= 0; k--) {
+      const double *col_k = m_column(l, k);
+
+      double sum = y[k];
+
+      for (i = k + 1; i < n; i++) {
+         sum -= col_k[i] * y[i];
+      }
+
+      y[k] = sum / col_k[k];
+   }
+}
+
+/*
+ * Solve <a> * x = <b> for x and put it in <x>. <a> must be square and is not
+ * changed. Returns 0 on success or -1 if <a> is singular.
+ */
+int mSolve(Vector *x, const Matrix *a, const Vector *b)
+{
+   Matrix *lu = mDup(a);
+   int *perm = calloc(a->n_rows, sizeof(int));
+
+   int r = mLU(lu, perm);
+
+   if (r == 0) mLUSolve(x, lu, perm, b);
+
+   free(perm);
+   mDel(lu);
+
+   return r;
+}
+
+/*
+ * Find the x that minimizes the length of <a> * x - <b> (a "least squares
+ * fit") and put it in <x>. <a> must have at least as many rows as columns, and
+ * its columns must be linearly independent. Returns 0 on success or -1 if
+ * they are not.
+ */
+int mLeastSquares(Vector *x, const Matrix *a, const Vector *b)
+{
+   int r;
+
+   assert(a->n_rows >= a->n_cols);
+   assert(x->n_rows == a->n_cols && b->n_rows == a->n_rows);
+
+   /* Solve the "normal equations" transpose(a) * a * x = transpose(a) * b. */
+
+   Matrix *at  = mNew(a->n_cols, a->n_rows);
+   Matrix *ata = mNew(a->n_cols, a->n_cols);
+   Vector *atb = vNew(a->n_cols);
+
+   mTranspose(at, a);
+   mMul(ata, at, a);
+   mApply(atb, at, b);
+
+   if ((r = mCholesky(ata)) == 0) mCholeskySolve(x, ata, atb);
+
+   vDel(atb);
+   mDel(ata);
+   mDel(at);
+
+   return r;
+}
+
+#ifdef TEST
+#include <float.h>
+
+#include "utils.h"
+
+static int errors = 0;
+
+/*
+ * Return a new <n_rows> by <n_cols> matrix filled with random numbers
+ * between -1 and 1.
+ */
+static Matrix *random_matrix(int n_rows, int n_cols)
+{
+   int row, col;
+
+   Matrix *m = mNew(n_rows, n_cols);
+
+   for (col = 0; col < n_cols; col++) {
+      for (row = 0; row < n_rows; row++) {
+         mSetElement(m, row, col, 2.0 * random() / RAND_MAX - 1);
+      }
+   }
+
+   return m;
+}
+
+/*
+ * Check mMul() for an <n_rows> by <n_inner> times <n_inner> by <n_cols>
+ * product against a plain triple loop.
+ */
+static void check_mul(int n_rows, int n_inner, int n_cols)
+{
+   int row, col, k, bad = 0;
+
+   Matrix *m1 = random_matrix(n_rows, n_inner);
+   Matrix *m2 = random_matrix(n_inner, n_cols);
+   Matrix *m3 = mNew(n_rows, n_cols);
+
+   mMul(m3, m1, m2);
+
+   for (row = 0; row < n_rows; row++) {
+      for (col = 0; col < n_cols; col++) {
+         double sum = 0, mag = 0;
+
+         for (k = 0; k < n_inner; k++) {
+            sum += mGetElement(m1, row, k) * mGetElement(m2, k, col);
+            mag += fabs(mGetElement(m1, row, k) * mGetElement(m2, k, col));
+         }
+
+         double err = fabs(mGetElement(m3, row, col) - sum);
+
+         if (err > n_inner * mag * DBL_EPSILON) bad++;
+      }
+   }
+
+   make_sure_that(bad == 0);
+
+   mDel(m1);
+   mDel(m2);
+   mDel(m3);
+}
+
+/*
+ * Return the largest absolute value in <a> * <x> - <b>.
+ */
+static double residual(const Matrix *a, const Vector *x, const Vector *b)
+{
+   int row;
+   double max = 0;
+
+   Vector *ax = vNew(a->n_rows);
+
+   mApply(ax, a, x);
+
+   for (row = 0; row < a->n_rows; row++) {
+      max = MAX(max, fabs(ax->row[row] - b->row[row]));
+   }
+
+   vDel(ax);
+
+   return max;
+}
+
+int main(void)
+{
+   int row, col, i;
+   SimdLevel level;
+
+   srandom(1);
+
+   /* Vectors: allocated, views and fixed-capacity. */
+
+   double data[3] = { 1, 2, 2 };
+   double len1, len2;
+   FixedVector fixed;
+   Vector view, *u;
+
+   vInit(&view, data, 3);
+
+   make_sure_that(vLen(&view) == 3);
+
+   u = vFixed(&fixed, 3);
+
+   make_sure_that(u->n_rows == 3);
+   make_sure_that(vLen(u) == 0);
+
+   vSet(u, 0.0, 1.0, 0.0);
+
+   vAxpy(&view, 2, u);
+
+   make_sure_that(data[0] == 1 && data[1] == 4 && data[2] == 2);
+
+   make_sure_that(vDotP(u, &view) == 4);
+   make_sure_that(vDotLen(u, &view, &len1, &len2) == 4);
+   make_sure_that(len1 == 1);
+   make_sure_that(close_to(len2, sqrt(21)));
+
+   Vector *x_axis = vNew(3), *y_axis = vNew(3);
+
+   vSet(x_axis, 1.0, 0.0, 0.0);
+   vSet(y_axis, 0.0, 1.0, 0.0);
+
+   vCrossP(u, x_axis, y_axis);
+
+   make_sure_that(u->row[0] == 0 && u->row[1] == 0 && u->row[2] == 1);
+
+   vCrossP(y_axis, y_axis, x_axis);   /* In place. */
+
+   make_sure_that(y_axis->row[2] == -1);
+
+   vDel(x_axis);
+   vDel(y_axis);
+
+   /* Long vectors, against plain loops at all instruction set levels. */
+
+   for (level = SIMD_NONE; level <= SIMD_AVX2; level++) {
+      Vector *a = vNew(1001), *b = vNew(1001), *c = vNew(1001);
+      double dot = 0, mag = 0, sq_a = 0, sq_b = 0;
+
+      simdSetLevel(level);
+
+      for (i = 0; i < 1001; i++) {
+         a->row[i] = 2.0 * random() / RAND_MAX - 1;
+         b->row[i] = 2.0 * random() / RAND_MAX - 1;
+
+         dot  += a->row[i] * b->row[i];
+         mag  += fabs(a->row[i] * b->row[i]);
+         sq_a += SQR(a->row[i]);
+         sq_b += SQR(b->row[i]);
+      }
+
+      make_sure_that(fabs(vDotP(a, b) - dot) <= 1001 * DBL_EPSILON * mag);
+      make_sure_that(fabs(vDotLen(a, b, &len1, &len2) - dot) <=
+            1001 * DBL_EPSILON * mag);
+      make_sure_that(close_to(len1, sqrt(sq_a)));
+      make_sure_that(close_to(len2, sqrt(sq_b)));
+      make_sure_that(close_to(vLen(a), sqrt(sq_a)));
+
+      vCopy(c, a);
+      vAxpy(c, -1, a);
+
+      make_sure_that(vLen(c) == 0);
+
+      vSub(c, a, b);
+      vAdd(c, c, b);
+      vSub(c, c, a);
+
+      make_sure_that(vLen(c) < 1e-12);
+
+      vDel(a);
+      vDel(b);
+      vDel(c);
+   }
+
+   Matrix *m = mNew(2, 3);
+
+   mSet(m, 1.0, 2.0, 3.0,
+           4.0, 5.0, 6.0);
+
+   make_sure_that(mGetElement(m, 0, 2) == 3);
+   make_sure_that(mGetElement(m, 1, 0) == 4);
+   make_sure_that(m->data[1] == 4);     /* Column-major. */
+
+   Matrix *t = mNew(3, 2);
+
+   mTranspose(t, m);
+
+   make_sure_that(mGetElement(t, 2, 0) == 3);
+   make_sure_that(mGetElement(t, 0, 1) == 4);
+
+   Vector *v = vNew(3), *w = vNew(2);
+
+   vSet(v, 1.0, 0.0, -1.0);
+
+   mApply(w, m, v);
+
+   make_sure_that(w->row[0] == -2);
+   make_sure_that(w->row[1] == -2);
+
+   mGetColumn(w, m, 1);
+
+   make_sure_that(w->row[0] == 2 && w->row[1] == 5);
+
+   mDel(m);
+   mDel(t);
+   vDel(v);
+   vDel(w);
+
+   /* A transpose larger than one block. */
+
+   m = random_matrix(70, 45);
+   t = mNew(45, 70);
+
+   mTranspose(t, m);
+
+   int bad = 0;
+
+   for (row = 0; row < 70; row++) {
+      for (col = 0; col < 45; col++) {
+         if (mGetElement(m, row, col) != mGetElement(t, col, row)) bad++;
+      }
+   }
+
+   make_sure_that(bad == 0);
+
+   mDel(m);
+   mDel(t);
+
+   /* Products of various shapes, including ones that don't fit the tiles or
+    * the cache blocks, at all instruction set levels. */
+
+   for (level = SIMD_NONE; level <= SIMD_AVX2; level++) {
+      simdSetLevel(level);
+
+      check_mul(1, 1, 1);
+      check_mul(3, 5, 7);
+      check_mul(8, 8, 4);
+      check_mul(17, 9, 13);
+      check_mul(130, 260, 67);
+   }
+
+   simdSetLevel(SIMD_AVX2);
+
+   /* LU solves. */
+
+   Matrix *a = random_matrix(50, 50);
+   Vector *x = vNew(50), *b = vNew(50);
+
+   for (i = 0; i < 50; i++) b->row[i] = i;
+
+   make_sure_that(mSolve(x, a, b) == 0);
+   make_sure_that(residual(a, x, b) < 1e-10);
+
+   /* A pivot is needed right away here. */
+
+   m = mNew(2, 2);
+   v = vNew(2);
+   w = vNew(2);
+
+   mSet(m, 0.0, 1.0,
+           2.0, 3.0);
+   vSet(v, 4.0, 8.0);
+
+   make_sure_that(mSolve(w, m, v) == 0);
+   make_sure_that(close_to(w->row[0], -2));
+   make_sure_that(close_to(w->row[1], 4));
+
+   mSet(m, 1.0, 2.0,
+           2.0, 4.0);
+
+   make_sure_that(mSolve(w, m, v) == -1);
+
+   /* Cholesky. */
+
+   mSet(m, 4.0, 2.0,
+           2.0, 3.0);
+
+   make_sure_that(mCholesky(m) == 0);
+   make_sure_that(close_to(mGetElement(m, 0, 0), 2));
+   make_sure_that(close_to(mGetElement(m, 1, 0), 1));
+   make_sure_that(close_to(mGetElement(m, 1, 1), sqrt(2)));
+   make_sure_that(mGetElement(m, 0, 1) == 0);
+
+   mSet(m, 1.0, 2.0,
+           2.0, 1.0);
+
+   make_sure_that(mCholesky(m) == -1);
+
+   mDel(m);
+   vDel(v);
+   vDel(w);
+
+   /* A random symmetric positive definite matrix: a^T * a + I. */
+
+   Matrix *at = mNew(50, 50), *spd = mNew(50, 50), *l;
+
+   mTranspose(at, a);
+   mMul(spd, at, a);
+
+   for (i = 0; i < 50; i++) {
+      mSetElement(spd, i, i, mGetElement(spd, i, i) + 1);
+   }
+
+   l = mDup(spd);
+
+   make_sure_that(mCholesky(l) == 0);
+
+   mCholeskySolve(x, l, b);
+
+   make_sure_that(residual(spd, x, b) < 1e-9);
+
+   /* In place. */
+
+   vCopy(x, b);
+   mCholeskySolve(x, l, x);
+
+   make_sure_that(residual(spd, x, b) < 1e-9);
+
+   mDel(l);
+   mDel(spd);
+   mDel(at);
+   mDel(a);
+   vDel(x);
+   vDel(b);
+
+   /* Fit a straight line y = 2x + 1 through noisy points. */
+
+   a = mNew(100, 2);
+   b = vNew(100);
+   x = vNew(2);
+
+   for (i = 0; i < 100; i++) {
+      mSetElement(a, i, 0, i);
+      mSetElement(a, i, 1, 1);
+      b->row[i] = 2 * i + 1 + (i % 2 ? 0.01 : -0.01);
+   }
+
+   make_sure_that(mLeastSquares(x, a, b) == 0);
+   make_sure_that(fabs(x->row[0] - 2) < 1e-4);
+   make_sure_that(fabs(x->row[1] - 1) < 1e-3);
+
+   /* Two identical columns can't be fitted. */
+
+   for (i = 0; i < 100; i++) mSetElement(a, i, 1, i);
 
-   v_tmp->row[0] = v1->row[1] * v2->row[2] + v1->row[2] * v2->row[1];
-   v_tmp->row[1] = v1->row[2] * v2->row[0] + v1->row[0] * v2->row[2];
-   v_tmp->row[2] = v1->row[0] * v2->row[1] + v1->row[1] * v2->row[0];
+   make_sure_that(mLeastSquares(x, a, b) == -1);
 
-   vCopy(v_out, v_tmp);
+   mDel(a);
+   vDel(b);
+   vDel(x);
 
-   vDel(v_tmp);
+   return errors;
 }
+#endif
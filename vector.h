@@ -24,10 +24,31 @@ typedef struct {
    double *row;
 } Vector;
 
+/*
+ * Maximum number of rows in a FixedVector.
+ */
+#define VECTOR_FIXED_ROWS 16
+
+/*
+ * A vector that carries storage for up to VECTOR_FIXED_ROWS rows with it, so
+ * that it can live on the stack or inside another struct without any
+ * allocation. Initialize it using vFixed() and then use its <vec> member like
+ * any other Vector. Don't copy it by value: <vec> points into the original.
+ */
+typedef struct {
+   Vector vec;
+   double storage[VECTOR_FIXED_ROWS];
+} FixedVector;
+
+/*
+ * A dense matrix. Its coefficients are stored column by column in one
+ * contiguous block, so that data[col * n_rows + row] is the coefficient at
+ * row <row> and column <col>.
+ */
 typedef struct {
    int n_rows;
    int n_cols;
-   Vector *col;
+   double *data;
 } Matrix;
 
 /*
@@ -37,12 +58,31 @@ typedef struct {
 Vector *vNew(int n_rows);
 
 /*
- * Delete (free) vector <v>.
+ * Delete (free) vector <v>, which must have been created using vNew() or
+ * vDup().
  */
 void vDel(Vector *v);
 
 /*
- * Return the length of vector <v>.
+ * Initialize <v> as a vector with <n_rows> rows, stored in the caller-supplied
+ * array <rows>, which must stay valid for as long as <v> is used. The
+ * contents of <rows> are left as they are. Useful to treat existing data as a
+ * Vector, or to keep vectors on the stack or in an arena. Don't call vDel() on
+ * <v>. Returns <v>.
+ */
+Vector *vInit(Vector *v, double *rows, int n_rows);
+
+/*
+ * Initialize fixed-capacity vector <fv> with <n_rows> rows (at most
+ * VECTOR_FIXED_ROWS), all set to zero, and return a pointer to its Vector.
+ * Don't call vDel() on it.
+ */
+Vector *vFixed(FixedVector *fv, int n_rows);
+
+/*
+ * Return the length of vector <v>. The squares are added up in an order that
+ * depends on the SIMD level (see simd.h), so the result may differ by rounding
+ * from a serial sum.
  */
 double vLen(Vector *v);
 
@@ -95,16 +135,158 @@ void vScale(Vector *v_out, Vector *v_in, double factor);
 void vNorm(Vector *v_out, Vector *v_in);
 
 /*
- * Return the dot-product of vectors <v1> and <v2>.
+ * Return the dot-product of vectors <v1> and <v2>. As with vLen(), the result
+ * may differ by rounding from a serial sum of the products.
  */
 double vDotP(Vector *v1, Vector *v2);
 
+/*
+ * Add <factor> times vector <x> to vector <y>, in place. With AVX2 this uses
+ * fused multiply-adds, which round once instead of twice, so the result may
+ * differ in the last bit from what y[i] + factor * x[i] gives.
+ */
+void vAxpy(Vector *y, double factor, const Vector *x);
+
+/*
+ * Return the dot-product of vectors <v1> and <v2>, and put their lengths in
+ * <len1> and <len2>, using a single pass over both vectors. Useful to find
+ * the angle between them, for example. The results may differ by rounding
+ * from those of vDotP() and vLen().
+ */
+double vDotLen(const Vector *v1, const Vector *v2, double *len1, double *len2);
+
 /*
  * Calculate the cross-product of vectors <v1> and <v2> and put the result into
  * <v_out>. All three vectors must have 3 rows.
  */
 void vCrossP(Vector *v_out, Vector *v1, Vector *v2);
 
+/*
+ * Create a new matrix with <n_rows> rows and <n_cols> columns. The matrix is
+ * initialized to all zeroes.
+ */
+Matrix *mNew(int n_rows, int n_cols);
+
+/*
+ * Delete (free) matrix <m>.
+ */
+void mDel(Matrix *m);
+
+/*
+ * Set matrix <m> using the provided values. The values are given row by row
+ * (so the first n_cols values are the first row), which is the "natural" way
+ * to write a matrix down. Be sure to pass in the correct number of values!
+ */
+void mSet(Matrix *m, ...);
+
+/*
+ * Set the coefficient at row <row> and column <col> of matrix <m> to
+ * <value>.
+ */
+void mSetElement(Matrix *m, int row, int col, double value);
+
+/*
+ * Return the coefficient at row <row> and column <col> of matrix <m>.
+ */
+double mGetElement(const Matrix *m, int row, int col);
+
+/*
+ * Set square matrix <m> to the identity matrix.
+ */
+void mIdentity(Matrix *m);
+
+/*
+ * Copy matrix <m_in> to matrix <m_out>. Both matrices must already have the
+ * same size.
+ */
+void mCopy(Matrix *m_out, const Matrix *m_in);
+
+/*
+ * Duplicate <m_in> and return the result.
+ */
+Matrix *mDup(const Matrix *m_in);
+
+/*
+ * Copy column <col> of matrix <m> into vector <v_out>, which must have as
+ * many rows as <m>.
+ */
+void mGetColumn(Vector *v_out, const Matrix *m, int col);
+
+/*
+ * Set column <col> of matrix <m> to vector <v_in>, which must have as many
+ * rows as <m>.
+ */
+void mSetColumn(Matrix *m, int col, const Vector *v_in);
+
+/*
+ * Put the transpose of matrix <m_in> into <m_out>, which must have as many
+ * rows as <m_in> has columns and vice versa. <m_out> must not be the same
+ * matrix as <m_in>.
+ */
+void mTranspose(Matrix *m_out, const Matrix *m_in);
+
+/*
+ * Multiply matrices <m1> and <m2> and put the result in <m_out>, which must
+ * have as many rows as <m1> and as many columns as <m2>. <m_out> must not be
+ * the same matrix as <m1> or <m2>.
+ */
+void mMul(Matrix *m_out, const Matrix *m1, const Matrix *m2);
+
+/*
+ * Multiply matrix <m> with vector <v_in> and put the result in <v_out>.
+ * <v_in> must have as many rows as <m> has columns, <v_out> as many as <m>
+ * has rows, and <v_out> must not be the same vector as <v_in>.
+ */
+void mApply(Vector *v_out, const Matrix *m, const Vector *v_in);
+
+/*
+ * Replace square matrix <m> with its LU decomposition, using partial
+ * pivoting: the strictly lower part of <m> is set to L (whose diagonal is all
+ * ones and not stored) and the upper part, including the diagonal, to U. The
+ * row permutation is stored in <perm>, which must have room for n_rows
+ * entries: row i of L * U is row perm[i] of the original matrix. Returns 0 on
+ * success or -1 if <m> is singular, in which case <m> is left in an
+ * undefined state.
+ */
+int mLU(Matrix *m, int *perm);
+
+/*
+ * Solve A * x = <b> for x and put it in <x>, where A is the matrix whose LU
+ * decomposition mLU() put into <lu> and <perm>. <x> may be the same vector as
+ * <b>.
+ */
+void mLUSolve(Vector *x, const Matrix *lu, const int *perm, const Vector *b);
+
+/*
+ * Replace symmetric, positive definite matrix <m> with its Cholesky
+ * decomposition L, a lower triangular matrix with L * transpose(L) equal to
+ * <m>. Only the lower part of <m> is used; the upper part is set to zero.
+ * Returns 0 on success or -1 if <m> is not positive definite, in which case
+ * <m> is left in an undefined state.
+ */
+int mCholesky(Matrix *m);
+
+/*
+ * Solve A * x = <b> for x and put it in <x>, where A is the matrix whose
+ * Cholesky decomposition mCholesky() put into <l>. <x> may be the same vector
+ * as <b>.
+ */
+void mCholeskySolve(Vector *x, const Matrix *l, const Vector *b);
+
+/*
+ * Solve <a> * x = <b> for x and put it in <x>. <a> must be square and is not
+ * changed. Returns 0 on success or -1 if <a> is singular.
+ */
+int mSolve(Vector *x, const Matrix *a, const Vector *b);
+
+/*
+ * Find the x that minimizes the length of <a> * x - <b> (a "least squares
+ * fit") and put it in <x>. <a> must have at least as many rows as columns, and
+ * its columns must be linearly independent. Returns 0 on success or -1 if
+ * they are not.
+ */
+int mLeastSquares(Vector *x, const Matrix *a, const Vector *b);
+
 #ifdef __cplusplus
 }
 #endif
@@ -12,7 +12,10 @@
  */
 
 #include <math.h>
+#include <string.h>
 
+#include "defs.h"
+#include "simd.h"
 #include "vector2.h"
 
 /*
@@ -152,11 +155,397 @@ double v2Angle(Vector2 v1, Vector2 v2)
     return acos(v2Cos(v1, v2));
 }
 
+/* Number of vectors that batch functions handle at a time, so that
+ * intermediate results stay in the cache. */
+
+#define V2_CHUNK 256
+
+/*
+ * Return <a> advanced by <offset> vectors.
+ */
+static Vector2Array v2_offset(Vector2Array a, size_t offset)
+{
+    Vector2Array r;
+    int c;
+
+    for (c = 0; c < 2; c++) r.r[c] = a.r[c] + offset;
+
+    return r;
+}
+
+/*
+ * Copy the <n> (at most V2_CHUNK) vectors in <v> into <soa>, one array per
+ * coordinate, and return it as a Vector2Array.
+ */
+static Vector2Array v2_split(double soa[2][V2_CHUNK],
+        const Vector2 *v, size_t n)
+{
+    Vector2Array r;
+    size_t i;
+    int c;
+
+    for (c = 0; c < 2; c++) {
+        for (i = 0; i < n; i++) soa[c][i] = v[i].r[c];
+
+        r.r[c] = soa[c];
+    }
+
+    return r;
+}
+
+/*
+ * Copy the <n> vectors in <soa> into <v>.
+ */
+static void v2_join(Vector2 *v, Vector2Array soa, size_t n)
+{
+    size_t i;
+    int c;
+
+    for (c = 0; c < 2; c++) {
+        for (i = 0; i < n; i++) v[i].r[c] = soa.r[c][i];
+    }
+}
+
+/*
+ * Set out[i] to the dot product of a[i] and b[i] for the <n> (at most
+ * V2_CHUNK) vectors in <a> and <b>.
+ */
+static void v2_dot(double *out, Vector2Array a, Vector2Array b, size_t n)
+{
+    double sum[V2_CHUNK], product[V2_CHUNK];
+    int c;
+
+    simdMul(sum, a.r[0], b.r[0], n);
+
+    for (c = 1; c < 2; c++) {
+        simdMul(product, a.r[c], b.r[c], n);
+        simdAdd(sum, sum, product, n);
+    }
+
+    memcpy(out, sum, n * sizeof(double));
+}
+
+/*
+ * Set out[i] to the sum of a[i] and b[i] for the <n> vectors in <a> and <b>.
+ */
+void v2aSum(Vector2Array out, Vector2Array a, Vector2Array b, size_t n)
+{
+    int c;
+
+    for (c = 0; c < 2; c++) simdAdd(out.r[c], a.r[c], b.r[c], n);
+}
+
+/*
+ * Set out[i] to the difference of a[i] and b[i] for the <n> vectors in <a>
+ * and <b>.
+ */
+void v2aDiff(Vector2Array out, Vector2Array a, Vector2Array b, size_t n)
+{
+    int c;
+
+    for (c = 0; c < 2; c++) simdSub(out.r[c], a.r[c], b.r[c], n);
+}
+
+/*
+ * Set out[i] to a[i] scaled with factor <scale> for the <n> vectors in <a>.
+ */
+void v2aScale(Vector2Array out, Vector2Array a, double scale, size_t n)
+{
+    int c;
+
+    for (c = 0; c < 2; c++) simdScale(out.r[c], a.r[c], scale, n);
+}
+
+/*
+ * Set out[i] to the dot product of a[i] and b[i] for the <n> vectors in <a>
+ * and <b>.
+ */
+void v2aDot(double *out, Vector2Array a, Vector2Array b, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i += V2_CHUNK) {
+        v2_dot(out + i, v2_offset(a, i), v2_offset(b, i), MIN(V2_CHUNK, n - i));
+    }
+}
+
+/*
+ * Set out[i] to the length of a[i] for the <n> vectors in <a>.
+ */
+void v2aLen(double *out, Vector2Array a, size_t n)
+{
+    v2aDot(out, a, a, n);
+
+    simdSqrt(out, out, n);
+}
+
+/*
+ * Set out[i] to a[i] normalized, i.e. with its length set to 1, for the <n>
+ * vectors in <a>. Gives the same results as v2Normalize().
+ */
+void v2aNormalize(Vector2Array out, Vector2Array a, size_t n)
+{
+    double len[V2_CHUNK];
+    size_t i;
+    int c;
+
+    for (i = 0; i < n; i += V2_CHUNK) {
+        size_t count = MIN(V2_CHUNK, n - i);
+
+        Vector2Array chunk = v2_offset(a, i);
+
+        v2_dot(len, chunk, chunk, count);
+
+        simdSqrt(len, len, count);
+
+        for (c = 0; c < 2; c++) {
+            simdDiv(out.r[c] + i, chunk.r[c], len, count);
+        }
+    }
+}
+
+/*
+ * Set out[i] to the sum of a[i] and b[i], for 0 <= i < <n>.
+ */
+void v2SumMany(Vector2 *out, const Vector2 *a, const Vector2 *b, size_t n)
+{
+    simdAdd(out->r, a->r, b->r, 2 * n);
+}
+
+/*
+ * Set out[i] to the difference of a[i] and b[i], for 0 <= i < <n>.
+ */
+void v2DiffMany(Vector2 *out, const Vector2 *a, const Vector2 *b, size_t n)
+{
+    simdSub(out->r, a->r, b->r, 2 * n);
+}
+
+/*
+ * Set out[i] to a[i] scaled with factor <scale>, for 0 <= i < <n>.
+ */
+void v2ScaleMany(Vector2 *out, const Vector2 *a, double scale, size_t n)
+{
+    simdScale(out->r, a->r, scale, 2 * n);
+}
+
+/*
+ * Set out[i] to the dot product of a[i] and b[i], for 0 <= i < <n>.
+ */
+void v2DotMany(double *out, const Vector2 *a, const Vector2 *b, size_t n)
+{
+    double a_soa[2][V2_CHUNK], b_soa[2][V2_CHUNK];
+    size_t i;
+
+    for (i = 0; i < n; i += V2_CHUNK) {
+        size_t count = MIN(V2_CHUNK, n - i);
+
+        v2_dot(out + i,
+                v2_split(a_soa, a + i, count),
+                v2_split(b_soa, b + i, count), count);
+    }
+}
+
+/*
+ * Set out[i] to the length of a[i], for 0 <= i < <n>.
+ */
+void v2LenMany(double *out, const Vector2 *a, size_t n)
+{
+    double a_soa[2][V2_CHUNK];
+    size_t i;
+
+    for (i = 0; i < n; i += V2_CHUNK) {
+        size_t count = MIN(V2_CHUNK, n - i);
+
+        Vector2Array chunk = v2_split(a_soa, a + i, count);
+
+        v2_dot(out + i, chunk, chunk, count);
+    }
+
+    simdSqrt(out, out, n);
+}
+
+/*
+ * Set out[i] to a[i] normalized, i.e. with its length set to 1, for
+ * 0 <= i < <n>. Gives the same results as v2Normalize().
+ */
+void v2NormalizeMany(Vector2 *out, const Vector2 *a, size_t n)
+{
+    double a_soa[2][V2_CHUNK];
+    size_t i;
+
+    for (i = 0; i < n; i += V2_CHUNK) {
+        size_t count = MIN(V2_CHUNK, n - i);
+
+        Vector2Array chunk = v2_split(a_soa, a + i, count);
+
+        v2aNormalize(chunk, chunk, count);
+
+        v2_join(out + i, chunk, count);
+    }
+}
+
 #ifdef TEST
 #include "utils.h"
 
+#include <stdlib.h>
+
 static int errors = 0;
 
+#define N 1001
+
+/*
+ * Return a random coordinate.
+ */
+static double random_coordinate(void)
+{
+    return (random() - RAND_MAX / 2) / 1e6;
+}
+
+/*
+ * Return TRUE if <v1> and <v2> are exactly the same.
+ */
+static int same_vector(Vector2 v1, Vector2 v2)
+{
+    return memcmp(&v1, &v2, sizeof(Vector2)) == 0;
+}
+
+/*
+ * Return vector <i> from <soa>.
+ */
+static Vector2 soa_get(Vector2Array soa, size_t i)
+{
+    Vector2 v;
+    int c;
+
+    for (c = 0; c < 2; c++) v.r[c] = soa.r[c][i];
+
+    return v;
+}
+
+/*
+ * Check that the batch functions give the same results as the single-vector
+ * functions for each available instruction set.
+ */
+static void check_batch(void)
+{
+    static Vector2 a[N], b[N], out[N];
+    static double coords[3 * 2][N], scalar[N];
+
+    Vector2Array soa_a, soa_b, soa_out;
+    int c, level;
+    size_t i;
+
+    for (c = 0; c < 2; c++) {
+        soa_a.r[c]   = coords[c];
+        soa_b.r[c]   = coords[2 + c];
+        soa_out.r[c] = coords[4 + c];
+    }
+
+    srandom(1);
+
+    for (i = 0; i < N; i++) {
+        v2Set(&a[i], random_coordinate(), random_coordinate());
+        v2Set(&b[i], random_coordinate(), random_coordinate());
+
+        soa_a.r[0][i] = a[i].r[0];
+        soa_b.r[0][i] = b[i].r[0];
+        soa_a.r[1][i] = a[i].r[1];
+        soa_b.r[1][i] = b[i].r[1];
+    }
+
+    for (level = SIMD_NONE; level <= SIMD_AVX2; level++) {
+        if (simdSetLevel(level) != (SimdLevel) level) continue;
+
+        v2aSum(soa_out, soa_a, soa_b, N);
+
+        for (i = 0; i < N; i++) {
+            Vector2 v = v2Sum(a[i], b[i]);
+
+            make_sure_that(same_vector(soa_get(soa_out, i), v));
+        }
+
+        v2aDiff(soa_out, soa_a, soa_b, N);
+
+        for (i = 0; i < N; i++) {
+            Vector2 v = v2Diff(a[i], b[i]);
+
+            make_sure_that(same_vector(soa_get(soa_out, i), v));
+        }
+
+        v2aScale(soa_out, soa_a, 1.7, N);
+
+        for (i = 0; i < N; i++) {
+            Vector2 v = v2Scaled(a[i], 1.7);
+
+            make_sure_that(same_vector(soa_get(soa_out, i), v));
+        }
+
+        v2aDot(scalar, soa_a, soa_b, N);
+
+        for (i = 0; i < N; i++) {
+            make_sure_that(scalar[i] == v2Dot(a[i], b[i]));
+        }
+
+        v2aLen(scalar, soa_a, N);
+
+        for (i = 0; i < N; i++) {
+            make_sure_that(scalar[i] == v2Len(a[i]));
+        }
+
+        v2aNormalize(soa_out, soa_a, N);
+
+        for (i = 0; i < N; i++) {
+            Vector2 v = a[i];
+
+            v2Normalize(&v);
+
+            make_sure_that(same_vector(soa_get(soa_out, i), v));
+        }
+
+        v2SumMany(out, a, b, N);
+
+        for (i = 0; i < N; i++) {
+            make_sure_that(same_vector(out[i], v2Sum(a[i], b[i])));
+        }
+
+        v2DiffMany(out, a, b, N);
+
+        for (i = 0; i < N; i++) {
+            make_sure_that(same_vector(out[i], v2Diff(a[i], b[i])));
+        }
+
+        v2ScaleMany(out, a, 1.7, N);
+
+        for (i = 0; i < N; i++) {
+            make_sure_that(same_vector(out[i], v2Scaled(a[i], 1.7)));
+        }
+
+        v2DotMany(scalar, a, b, N);
+
+        for (i = 0; i < N; i++) {
+            make_sure_that(scalar[i] == v2Dot(a[i], b[i]));
+        }
+
+        v2LenMany(scalar, a, N);
+
+        for (i = 0; i < N; i++) {
+            make_sure_that(scalar[i] == v2Len(a[i]));
+        }
+
+        memcpy(out, a, sizeof(out));
+
+        v2NormalizeMany(out, out, N);
+
+        for (i = 0; i < N; i++) {
+            Vector2 v = a[i];
+
+            v2Normalize(&v);
+
+            make_sure_that(same_vector(out[i], v));
+        }
+    }
+}
+
 int main(void)
 {
     Vector2 v1 = v2New();
@@ -231,6 +620,8 @@ int main(void)
 
     make_sure_that(close_to(v2Angle(v1, v2), angle));
 
+    check_batch();
+
     return errors;
 }
 #endif
@@ -18,6 +18,8 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+
 typedef struct {
     double r[2];
 } Vector2;
@@ -102,6 +104,87 @@ double v2Cos(Vector2 v1, Vector2 v2);
  */
 double v2Angle(Vector2 v1, Vector2 v2);
 
+/*
+ * Batch functions.
+ *
+ * The functions below work on <n> vectors at a time, stored either as
+ * "structure of arrays" (Vector2Array, with a separate array for each
+ * coordinate) or as "array of structures" (plain arrays of Vector2). They
+ * use SIMD instructions where possible (see simd.h), but perform exactly the
+ * same operations as the single-vector functions, so their results are
+ * identical.
+ * Output arrays may be the same as input arrays, but may not overlap them in
+ * any other way.
+ */
+
+typedef struct {
+    double *r[2];
+} Vector2Array;
+
+/*
+ * Set out[i] to the sum of a[i] and b[i] for the <n> vectors in <a> and <b>.
+ */
+void v2aSum(Vector2Array out, Vector2Array a, Vector2Array b, size_t n);
+
+/*
+ * Set out[i] to the difference of a[i] and b[i] for the <n> vectors in <a>
+ * and <b>.
+ */
+void v2aDiff(Vector2Array out, Vector2Array a, Vector2Array b, size_t n);
+
+/*
+ * Set out[i] to a[i] scaled with factor <scale> for the <n> vectors in <a>.
+ */
+void v2aScale(Vector2Array out, Vector2Array a, double scale, size_t n);
+
+/*
+ * Set out[i] to the dot product of a[i] and b[i] for the <n> vectors in <a>
+ * and <b>.
+ */
+void v2aDot(double *out, Vector2Array a, Vector2Array b, size_t n);
+
+/*
+ * Set out[i] to the length of a[i] for the <n> vectors in <a>.
+ */
+void v2aLen(double *out, Vector2Array a, size_t n);
+
+/*
+ * Set out[i] to a[i] normalized, i.e. with its length set to 1, for the <n>
+ * vectors in <a>. Gives the same results as v2Normalize().
+ */
+void v2aNormalize(Vector2Array out, Vector2Array a, size_t n);
+
+/*
+ * Set out[i] to the sum of a[i] and b[i], for 0 <= i < <n>.
+ */
+void v2SumMany(Vector2 *out, const Vector2 *a, const Vector2 *b, size_t n);
+
+/*
+ * Set out[i] to the difference of a[i] and b[i], for 0 <= i < <n>.
+ */
+void v2DiffMany(Vector2 *out, const Vector2 *a, const Vector2 *b, size_t n);
+
+/*
+ * Set out[i] to a[i] scaled with factor <scale>, for 0 <= i < <n>.
+ */
+void v2ScaleMany(Vector2 *out, const Vector2 *a, double scale, size_t n);
+
+/*
+ * Set out[i] to the dot product of a[i] and b[i], for 0 <= i < <n>.
+ */
+void v2DotMany(double *out, const Vector2 *a, const Vector2 *b, size_t n);
+
+/*
+ * Set out[i] to the length of a[i], for 0 <= i < <n>.
+ */
+void v2LenMany(double *out, const Vector2 *a, size_t n);
+
+/*
+ * Set out[i] to a[i] normalized, i.e. with its length set to 1, for
+ * 0 <= i < <n>. Gives the same results as v2Normalize().
+ */
+void v2NormalizeMany(Vector2 *out, const Vector2 *a, size_t n);
+
 #ifdef __cplusplus
 }
 #endif
@@ -12,7 +12,10 @@
  */
 
 #include <math.h>
+#include <string.h>
 
+#include "defs.h"
+#include "simd.h"
 #include "vector3.h"
 
 /*
@@ -168,11 +171,465 @@ Vector3 v3Cross(Vector3 v1, Vector3 v2)
             v1.r[0] * v2.r[1] - v1.r[1] * v2.r[0]);
 }
 
+/* Number of vectors that batch functions handle at a time, so that
+ * intermediate results stay in the cache. */
+
+#define V3_CHUNK 256
+
+/*
+ * Return <a> advanced by <offset> vectors.
+ */
+static Vector3Array v3_offset(Vector3Array a, size_t offset)
+{
+    Vector3Array r;
+    int c;
+
+    for (c = 0; c < 3; c++) r.r[c] = a.r[c] + offset;
+
+    return r;
+}
+
+/*
+ * Copy the <n> (at most V3_CHUNK) vectors in <v> into <soa>, one array per
+ * coordinate, and return it as a Vector3Array.
+ */
+static Vector3Array v3_split(double soa[3][V3_CHUNK],
+        const Vector3 *v, size_t n)
+{
+    Vector3Array r;
+    size_t i;
+    int c;
+
+    for (c = 0; c < 3; c++) {
+        for (i = 0; i < n; i++) soa[c][i] = v[i].r[c];
+
+        r.r[c] = soa[c];
+    }
+
+    return r;
+}
+
+/*
+ * Copy the <n> vectors in <soa> into <v>.
+ */
+static void v3_join(Vector3 *v, Vector3Array soa, size_t n)
+{
+    size_t i;
+    int c;
+
+    for (c = 0; c < 3; c++) {
+        for (i = 0; i < n; i++) v[i].r[c] = soa.r[c][i];
+    }
+}
+
+/*
+ * Set out[i] to the dot product of a[i] and b[i] for the <n> (at most
+ * V3_CHUNK) vectors in <a> and <b>.
+ */
+static void v3_dot(double *out, Vector3Array a, Vector3Array b, size_t n)
+{
+    double sum[V3_CHUNK], product[V3_CHUNK];
+    int c;
+
+    simdMul(sum, a.r[0], b.r[0], n);
+
+    for (c = 1; c < 3; c++) {
+        simdMul(product, a.r[c], b.r[c], n);
+        simdAdd(sum, sum, product, n);
+    }
+
+    memcpy(out, sum, n * sizeof(double));
+}
+
+/*
+ * Set out[i] to the sum of a[i] and b[i] for the <n> vectors in <a> and <b>.
+ */
+void v3aSum(Vector3Array out, Vector3Array a, Vector3Array b, size_t n)
+{
+    int c;
+
+    for (c = 0; c < 3; c++) simdAdd(out.r[c], a.r[c], b.r[c], n);
+}
+
+/*
+ * Set out[i] to the difference of a[i] and b[i] for the <n> vectors in <a>
+ * and <b>.
+ */
+void v3aDiff(Vector3Array out, Vector3Array a, Vector3Array b, size_t n)
+{
+    int c;
+
+    for (c = 0; c < 3; c++) simdSub(out.r[c], a.r[c], b.r[c], n);
+}
+
+/*
+ * Set out[i] to a[i] scaled with factor <scale> for the <n> vectors in <a>.
+ */
+void v3aScale(Vector3Array out, Vector3Array a, double scale, size_t n)
+{
+    int c;
+
+    for (c = 0; c < 3; c++) simdScale(out.r[c], a.r[c], scale, n);
+}
+
+/*
+ * Set out[i] to the dot product of a[i] and b[i] for the <n> vectors in <a>
+ * and <b>.
+ */
+void v3aDot(double *out, Vector3Array a, Vector3Array b, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i += V3_CHUNK) {
+        v3_dot(out + i, v3_offset(a, i), v3_offset(b, i), MIN(V3_CHUNK, n - i));
+    }
+}
+
+/*
+ * Set out[i] to the length of a[i] for the <n> vectors in <a>.
+ */
+void v3aLen(double *out, Vector3Array a, size_t n)
+{
+    v3aDot(out, a, a, n);
+
+    simdSqrt(out, out, n);
+}
+
+/*
+ * Set out[i] to a[i] normalized, i.e. with its length set to 1, for the <n>
+ * vectors in <a>. Gives the same results as v3Normalize().
+ */
+void v3aNormalize(Vector3Array out, Vector3Array a, size_t n)
+{
+    double len[V3_CHUNK];
+    size_t i;
+    int c;
+
+    for (i = 0; i < n; i += V3_CHUNK) {
+        size_t count = MIN(V3_CHUNK, n - i);
+
+        Vector3Array chunk = v3_offset(a, i);
+
+        v3_dot(len, chunk, chunk, count);
+
+        simdSqrt(len, len, count);
+
+        for (c = 0; c < 3; c++) {
+            simdDiv(out.r[c] + i, chunk.r[c], len, count);
+        }
+    }
+}
+
+/*
+ * Set out[i] to the cross product of a[i] and b[i] for the <n> vectors in <a>
+ * and <b>.
+ */
+void v3aCross(Vector3Array out, Vector3Array a, Vector3Array b, size_t n)
+{
+    double cross[3][V3_CHUNK], product[V3_CHUNK];
+    size_t i;
+    int c;
+
+    for (i = 0; i < n; i += V3_CHUNK) {
+        size_t count = MIN(V3_CHUNK, n - i);
+
+        Vector3Array a_chunk = v3_offset(a, i);
+        Vector3Array b_chunk = v3_offset(b, i);
+
+        for (c = 0; c < 3; c++) {
+            int c1 = (c + 1) % 3, c2 = (c + 2) % 3;
+
+            simdMul(cross[c], a_chunk.r[c1], b_chunk.r[c2], count);
+            simdMul(product, a_chunk.r[c2], b_chunk.r[c1], count);
+            simdSub(cross[c], cross[c], product, count);
+        }
+
+        for (c = 0; c < 3; c++) {
+            memcpy(out.r[c] + i, cross[c], count * sizeof(double));
+        }
+    }
+}
+
+/*
+ * Set out[i] to the sum of a[i] and b[i], for 0 <= i < <n>.
+ */
+void v3SumMany(Vector3 *out, const Vector3 *a, const Vector3 *b, size_t n)
+{
+    simdAdd(out->r, a->r, b->r, 3 * n);
+}
+
+/*
+ * Set out[i] to the difference of a[i] and b[i], for 0 <= i < <n>.
+ */
+void v3DiffMany(Vector3 *out, const Vector3 *a, const Vector3 *b, size_t n)
+{
+    simdSub(out->r, a->r, b->r, 3 * n);
+}
+
+/*
+ * Set out[i] to a[i] scaled with factor <scale>, for 0 <= i < <n>.
+ */
+void v3ScaleMany(Vector3 *out, const Vector3 *a, double scale, size_t n)
+{
+    simdScale(out->r, a->r, scale, 3 * n);
+}
+
+/*
+ * Set out[i] to the dot product of a[i] and b[i], for 0 <= i < <n>.
+ */
+void v3DotMany(double *out, const Vector3 *a, const Vector3 *b, size_t n)
+{
+    double a_soa[3][V3_CHUNK], b_soa[3][V3_CHUNK];
+    size_t i;
+
+    for (i = 0; i < n; i += V3_CHUNK) {
+        size_t count = MIN(V3_CHUNK, n - i);
+
+        v3_dot(out + i,
+                v3_split(a_soa, a + i, count),
+                v3_split(b_soa, b + i, count), count);
+    }
+}
+
+/*
+ * Set out[i] to the length of a[i], for 0 <= i < <n>.
+ */
+void v3LenMany(double *out, const Vector3 *a, size_t n)
+{
+    double a_soa[3][V3_CHUNK];
+    size_t i;
+
+    for (i = 0; i < n; i += V3_CHUNK) {
+        size_t count = MIN(V3_CHUNK, n - i);
+
+        Vector3Array chunk = v3_split(a_soa, a + i, count);
+
+        v3_dot(out + i, chunk, chunk, count);
+    }
+
+    simdSqrt(out, out, n);
+}
+
+/*
+ * Set out[i] to a[i] normalized, i.e. with its length set to 1, for
+ * 0 <= i < <n>. Gives the same results as v3Normalize().
+ */
+void v3NormalizeMany(Vector3 *out, const Vector3 *a, size_t n)
+{
+    double a_soa[3][V3_CHUNK];
+    size_t i;
+
+    for (i = 0; i < n; i += V3_CHUNK) {
+        size_t count = MIN(V3_CHUNK, n - i);
+
+        Vector3Array chunk = v3_split(a_soa, a + i, count);
+
+        v3aNormalize(chunk, chunk, count);
+
+        v3_join(out + i, chunk, count);
+    }
+}
+
+/*
+ * Set out[i] to the cross product of a[i] and b[i], for 0 <= i < <n>.
+ */
+void v3CrossMany(Vector3 *out, const Vector3 *a, const Vector3 *b, size_t n)
+{
+    double a_soa[3][V3_CHUNK], b_soa[3][V3_CHUNK];
+    size_t i;
+
+    for (i = 0; i < n; i += V3_CHUNK) {
+        size_t count = MIN(V3_CHUNK, n - i);
+
+        Vector3Array a_chunk = v3_split(a_soa, a + i, count);
+        Vector3Array b_chunk = v3_split(b_soa, b + i, count);
+
+        v3aCross(a_chunk, a_chunk, b_chunk, count);
+
+        v3_join(out + i, a_chunk, count);
+    }
+}
+
 #ifdef TEST
 #include "utils.h"
 
+#include <stdlib.h>
+
 static int errors = 0;
 
+#define N 1001
+
+/*
+ * Return a random coordinate.
+ */
+static double random_coordinate(void)
+{
+    return (random() - RAND_MAX / 2) / 1e6;
+}
+
+/*
+ * Return TRUE if <v1> and <v2> are exactly the same.
+ */
+static int same_vector(Vector3 v1, Vector3 v2)
+{
+    return memcmp(&v1, &v2, sizeof(Vector3)) == 0;
+}
+
+/*
+ * Return vector <i> from <soa>.
+ */
+static Vector3 soa_get(Vector3Array soa, size_t i)
+{
+    Vector3 v;
+    int c;
+
+    for (c = 0; c < 3; c++) v.r[c] = soa.r[c][i];
+
+    return v;
+}
+
+/*
+ * Check that the batch functions give the same results as the single-vector
+ * functions for each available instruction set.
+ */
+static void check_batch(void)
+{
+    static Vector3 a[N], b[N], out[N];
+    static double coords[3 * 3][N], scalar[N];
+
+    Vector3Array soa_a, soa_b, soa_out;
+    int c, level;
+    size_t i;
+
+    for (c = 0; c < 3; c++) {
+        soa_a.r[c]   = coords[c];
+        soa_b.r[c]   = coords[3 + c];
+        soa_out.r[c] = coords[6 + c];
+    }
+
+    srandom(1);
+
+    for (i = 0; i < N; i++) {
+        v3Set(&a[i], random_coordinate(), random_coordinate(),
+                random_coordinate());
+        v3Set(&b[i], random_coordinate(), random_coordinate(),
+                random_coordinate());
+
+        soa_a.r[0][i] = a[i].r[0];
+        soa_b.r[0][i] = b[i].r[0];
+        soa_a.r[1][i] = a[i].r[1];
+        soa_b.r[1][i] = b[i].r[1];
+        soa_a.r[2][i] = a[i].r[2];
+        soa_b.r[2][i] = b[i].r[2];
+    }
+
+    for (level = SIMD_NONE; level <= SIMD_AVX2; level++) {
+        if (simdSetLevel(level) != (SimdLevel) level) continue;
+
+        v3aSum(soa_out, soa_a, soa_b, N);
+
+        for (i = 0; i < N; i++) {
+            Vector3 v = v3Sum(a[i], b[i]);
+
+            make_sure_that(same_vector(soa_get(soa_out, i), v));
+        }
+
+        v3aDiff(soa_out, soa_a, soa_b, N);
+
+        for (i = 0; i < N; i++) {
+            Vector3 v = v3Diff(a[i], b[i]);
+
+            make_sure_that(same_vector(soa_get(soa_out, i), v));
+        }
+
+        v3aScale(soa_out, soa_a, 1.7, N);
+
+        for (i = 0; i < N; i++) {
+            Vector3 v = v3Scaled(a[i], 1.7);
+
+            make_sure_that(same_vector(soa_get(soa_out, i), v));
+        }
+
+        v3aDot(scalar, soa_a, soa_b, N);
+
+        for (i = 0; i < N; i++) {
+            make_sure_that(scalar[i] == v3Dot(a[i], b[i]));
+        }
+
+        v3aLen(scalar, soa_a, N);
+
+        for (i = 0; i < N; i++) {
+            make_sure_that(scalar[i] == v3Len(a[i]));
+        }
+
+        v3aNormalize(soa_out, soa_a, N);
+
+        for (i = 0; i < N; i++) {
+            Vector3 v = a[i];
+
+            v3Normalize(&v);
+
+            make_sure_that(same_vector(soa_get(soa_out, i), v));
+        }
+
+        v3aCross(soa_out, soa_a, soa_b, N);
+
+        for (i = 0; i < N; i++) {
+            Vector3 v = v3Cross(a[i], b[i]);
+
+            make_sure_that(same_vector(soa_get(soa_out, i), v));
+        }
+
+        v3CrossMany(out, a, b, N);
+
+        for (i = 0; i < N; i++) {
+            make_sure_that(same_vector(out[i], v3Cross(a[i], b[i])));
+        }
+
+        v3SumMany(out, a, b, N);
+
+        for (i = 0; i < N; i++) {
+            make_sure_that(same_vector(out[i], v3Sum(a[i], b[i])));
+        }
+
+        v3DiffMany(out, a, b, N);
+
+        for (i = 0; i < N; i++) {
+            make_sure_that(same_vector(out[i], v3Diff(a[i], b[i])));
+        }
+
+        v3ScaleMany(out, a, 1.7, N);
+
+        for (i = 0; i < N; i++) {
+            make_sure_that(same_vector(out[i], v3Scaled(a[i], 1.7)));
+        }
+
+        v3DotMany(scalar, a, b, N);
+
+        for (i = 0; i < N; i++) {
+            make_sure_that(scalar[i] == v3Dot(a[i], b[i]));
+        }
+
+        v3LenMany(scalar, a, N);
+
+        for (i = 0; i < N; i++) {
+            make_sure_that(scalar[i] == v3Len(a[i]));
+        }
+
+        memcpy(out, a, sizeof(out));
+
+        v3NormalizeMany(out, out, N);
+
+        for (i = 0; i < N; i++) {
+            Vector3 v = a[i];
+
+            v3Normalize(&v);
+
+            make_sure_that(same_vector(out[i], v));
+        }
+    }
+}
+
 int main(void)
 {
     Vector3 v1 = v3New();
@@ -241,6 +698,8 @@ int main(void)
 // double v3Angle(Vector3 v1, Vector3 v2);
 // Vector3 v3Cross(Vector3 v1, Vector3 v2);
 
+    check_batch();
+
     return errors;
 }
 #endif
@@ -18,6 +18,8 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+
 typedef struct {
     double r[3];
 } Vector3;
@@ -107,6 +109,98 @@ double v3Angle(Vector3 v1, Vector3 v2);
  */
 Vector3 v3Cross(Vector3 v1, Vector3 v2);
 
+/*
+ * Batch functions.
+ *
+ * The functions below work on <n> vectors at a time, stored either as
+ * "structure of arrays" (Vector3Array, with a separate array for each
+ * coordinate) or as "array of structures" (plain arrays of Vector3). They
+ * use SIMD instructions where possible (see simd.h), but perform exactly the
+ * same operations as the single-vector functions, so their results are
+ * identical.
+ * Output arrays may be the same as input arrays, but may not overlap them in
+ * any other way.
+ */
+
+typedef struct {
+    double *r[3];
+} Vector3Array;
+
+/*
+ * Set out[i] to the sum of a[i] and b[i] for the <n> vectors in <a> and <b>.
+ */
+void v3aSum(Vector3Array out, Vector3Array a, Vector3Array b, size_t n);
+
+/*
+ * Set out[i] to the difference of a[i] and b[i] for the <n> vectors in <a>
+ * and <b>.
+ */
+void v3aDiff(Vector3Array out, Vector3Array a, Vector3Array b, size_t n);
+
+/*
+ * Set out[i] to a[i] scaled with factor <scale> for the <n> vectors in <a>.
+ */
+void v3aScale(Vector3Array out, Vector3Array a, double scale, size_t n);
+
+/*
+ * Set out[i] to the dot product of a[i] and b[i] for the <n> vectors in <a>
+ * and <b>.
+ */
+void v3aDot(double *out, Vector3Array a, Vector3Array b, size_t n);
+
+/*
+ * Set out[i] to the length of a[i] for the <n> vectors in <a>.
+ */
+void v3aLen(double *out, Vector3Array a, size_t n);
+
+/*
+ * Set out[i] to a[i] normalized, i.e. with its length set to 1, for the <n>
+ * vectors in <a>. Gives the same results as v3Normalize().
+ */
+void v3aNormalize(Vector3Array out, Vector3Array a, size_t n);
+
+/*
+ * Set out[i] to the cross product of a[i] and b[i] for the <n> vectors in <a>
+ * and <b>.
+ */
+void v3aCross(Vector3Array out, Vector3Array a, Vector3Array b, size_t n);
+
+/*
+ * Set out[i] to the sum of a[i] and b[i], for 0 <= i < <n>.
+ */
+void v3SumMany(Vector3 *out, const Vector3 *a, const Vector3 *b, size_t n);
+
+/*
+ * Set out[i] to the difference of a[i] and b[i], for 0 <= i < <n>.
+ */
+void v3DiffMany(Vector3 *out, const Vector3 *a, const Vector3 *b, size_t n);
+
+/*
+ * Set out[i] to a[i] scaled with factor <scale>, for 0 <= i < <n>.
+ */
+void v3ScaleMany(Vector3 *out, const Vector3 *a, double scale, size_t n);
+
+/*
+ * Set out[i] to the dot product of a[i] and b[i], for 0 <= i < <n>.
+ */
+void v3DotMany(double *out, const Vector3 *a, const Vector3 *b, size_t n);
+
+/*
+ * Set out[i] to the length of a[i], for 0 <= i < <n>.
+ */
+void v3LenMany(double *out, const Vector3 *a, size_t n);
+
+/*
+ * Set out[i] to a[i] normalized, i.e. with its length set to 1, for
+ * 0 <= i < <n>. Gives the same results as v3Normalize().
+ */
+void v3NormalizeMany(Vector3 *out, const Vector3 *a, size_t n);
+
+/*
+ * Set out[i] to the cross product of a[i] and b[i], for 0 <= i < <n>.
+ */
+void v3CrossMany(Vector3 *out, const Vector3 *a, const Vector3 *b, size_t n);
+
 #ifdef __cplusplus
 }
 #endif